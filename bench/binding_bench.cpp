@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file binding_bench.cpp
+/// @brief Benchmark of C++ binding callbacks against plain C callbacks
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Runs the same callback, summing the samples of a packet, written once against the C API and once
+//  as a lambda registered through waveform.hpp.  The dispatch test calls each through a function
+//  pointer with its argument, exactly as the library does, on a packet laid out the way the library
+//  queues it, so any difference is the cost of the binding itself.  The end to end test then runs
+//  both through the library over the in-process transport.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sched.h>
+#include <time.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include <waveform.hpp>
+#include <waveform_format.h>
+#include <waveform_transport.h>
+
+// ****************************************
+// Macros
+// ****************************************
+#define PAYLOAD_WORDS 360
+#define HEADER_WORDS 7
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+//  What each callback accumulates, so the work can't be optimized away
+struct bench_state {
+   float sum = 0;
+   std::atomic<uint64_t> count{0};
+};
+
+//  A packet preceded by its decoded header, as the library passes it to the data callbacks
+struct queued_packet {
+   struct waveform_packet_info info;
+   uint32_t words[HEADER_WORDS + PAYLOAD_WORDS];
+};
+
+static_assert(offsetof(queued_packet, words) == sizeof(struct waveform_packet_info),
+              "The packet info must directly precede the packet");
+
+// ****************************************
+// Static Functions
+// ****************************************
+static uint64_t now_ns()
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/// @brief The callback as a C waveform would write it
+static void c_data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   auto* state = static_cast<bench_state*>(arg);
+   const struct waveform_packet_info* info = get_packet_info(packet);
+   const float* samples = waveform_packet_samples(info);
+   float sum = 0;
+
+   for (uint32_t i = 0; i < info->num_samples; ++i)
+   {
+      sum += samples[i];
+   }
+
+   state->sum += sum;
+   state->count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// @brief Makes the same callback as c_data_cb() for the C++ binding
+static auto make_lambda(bench_state& state)
+{
+   return [&state](flex::waveform_ref, const flex::packet& packet) {
+      float sum = 0;
+
+      for (float sample : packet.samples())
+      {
+         sum += sample;
+      }
+
+      state.sum += sum;
+      state.count.fetch_add(1, std::memory_order_relaxed);
+   };
+}
+
+/// @brief Calls a data callback the way the library does
+/// @returns The average time per call in nanoseconds
+static double time_dispatch(waveform_data_cb_t cb, void* arg, queued_packet& packet, uint64_t calls)
+{
+   //  The library can't see which function it is calling, so don't let the compiler see it here either.
+   waveform_data_cb_t volatile target = cb;
+   auto* raw = reinterpret_cast<struct waveform_vita_packet*>(packet.words);
+
+   uint64_t start = now_ns();
+   for (uint64_t i = 0; i < calls; ++i)
+   {
+      target(nullptr, raw, sizeof(packet.words), arg);
+   }
+   return (double) (now_ns() - start) / calls;
+}
+
+/// @brief Builds a VITA-49 packet in network byte order that the library treats as unknown data
+/// @details The packet class says mono 32-bit floats, so the callbacks can read the samples without the packet
+///          being mistaken for a receive stream.
+static void build_packet(uint32_t* words, uint8_t sequence)
+{
+   words[0] = htonl(WF_VITA_WORD0(WF_VITA_TYPE_IF_DATA, WF_VITA_TSI_UTC, WF_VITA_TSF_REAL_TIME) |
+                    WF_VITA_WORD0_SEQUENCE(sequence) | (HEADER_WORDS + PAYLOAD_WORDS));
+   words[1] = htonl(0x04000000U);
+   words[2] = htonl(WF_VITA_OUI);
+   words[3] = htonl(WF_VITA_CLASS_WORD(WF_VITA_PACKET_CLASS(0, 1, 32, 1, 0)));
+   words[4] = 0;
+   words[5] = 0;
+   words[6] = 0;
+   for (size_t i = 0; i < PAYLOAD_WORDS; ++i)
+   {
+      words[HEADER_WORDS + i] = htonl((uint32_t) i);
+   }
+}
+
+/// @brief Sends packets through the library until the callbacks have seen them all
+/// @returns The average time per packet in nanoseconds
+static double time_end_to_end(struct waveform_memory_transport* transport, bench_state& state, uint64_t packets)
+{
+   uint32_t packet[HEADER_WORDS + PAYLOAD_WORDS];
+   uint64_t target = state.count.load() + packets;
+
+   uint64_t start = now_ns();
+   for (uint64_t i = 0; i < packets; ++i)
+   {
+      build_packet(packet, (uint8_t) i);
+      while (waveform_memory_transport_inject_vita(transport, packet, sizeof(packet)) == -1)
+      {
+         sched_yield();
+      }
+   }
+
+   while (state.count.load() < target)
+   {
+      sched_yield();
+   }
+   return (double) (now_ns() - start) / packets;
+}
+
+static void usage(const char* progname)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", progname);
+   fprintf(stderr, "Options:\n");
+   fprintf(stderr, "  -n <count>    Number of packets for the end to end test [default: 100000]\n");
+   fprintf(stderr, "  -d <count>    Number of calls for the dispatch test [default: 10000000]\n");
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int main(int argc, char** argv)
+{
+   uint64_t packets = 100000;
+   uint64_t calls = 10000000;
+   int option;
+
+   while ((option = getopt(argc, argv, "n:d:")) != -1)
+   {
+      switch (option)
+      {
+         case 'n':
+            packets = strtoull(optarg, NULL, 10);
+            break;
+         case 'd':
+            calls = strtoull(optarg, NULL, 10);
+            break;
+         default:
+            usage(basename(argv[0]));
+            exit(1);
+      }
+   }
+
+   if (packets == 0 || calls == 0)
+   {
+      usage(basename(argv[0]));
+      exit(1);
+   }
+
+   bench_state c_state;
+   bench_state cpp_state;
+   auto lambda = make_lambda(cpp_state);
+
+   queued_packet queued = {};
+   for (size_t i = 0; i < PAYLOAD_WORDS; ++i)
+   {
+      reinterpret_cast<float*>(&queued.words[HEADER_WORDS])[i] = (float) i;
+   }
+   queued.info.payload = &queued.words[HEADER_WORDS];
+   queued.info.payload_words = PAYLOAD_WORDS;
+   queued.info.num_samples = PAYLOAD_WORDS;
+   queued.info.channels = 2;
+   queued.info.bits_per_sample = 32;
+   queued.info.flags = WF_PACKET_IS_FLOAT;
+
+   //  Warm both up once so neither pays for the first touch of the packet.
+   time_dispatch(c_data_cb, &c_state, queued, calls / 10);
+   time_dispatch(flex::waveform::data_trampoline<decltype(lambda)>, &lambda, queued, calls / 10);
+
+   double c_dispatch = time_dispatch(c_data_cb, &c_state, queued, calls);
+   double cpp_dispatch = time_dispatch(flex::waveform::data_trampoline<decltype(lambda)>, &lambda, queued, calls);
+
+   struct waveform_memory_transport* transport = waveform_memory_transport_create(4096);
+   if (!transport)
+   {
+      fprintf(stderr, "Couldn't create transport\n");
+      exit(1);
+   }
+
+   struct sockaddr_in addr = {};
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   flex::radio radio(addr);
+   waveform_radio_set_memory_transport(radio.get(), transport);
+   flex::waveform wf(radio, "Bench", "BNCH", "DIGU", "1.0.0");
+
+   waveform_register_unknown_data_cb(wf.get(), c_data_cb, &c_state);
+   radio.start();
+
+   //  Wait for the connection to come up, then select our mode to make the waveform active.
+   while (waveform_memory_transport_send_line(transport, "S0|slice 0 mode=BNCH") == -1)
+   {
+      sched_yield();
+   }
+
+   time_end_to_end(transport, c_state, packets / 10);
+   double c_end_to_end = time_end_to_end(transport, c_state, packets);
+   waveform_unregister_unknown_data_cb(wf.get(), c_data_cb, &c_state);
+
+   wf.on_unknown_data(make_lambda(cpp_state));
+   double cpp_end_to_end = time_end_to_end(transport, cpp_state, packets);
+
+   printf("dispatch_calls=%llu c_ns_per_call=%.2f cpp_ns_per_call=%.2f overhead_ns=%.2f\n",
+          (unsigned long long) calls, c_dispatch, cpp_dispatch, cpp_dispatch - c_dispatch);
+   printf("end_to_end_packets=%llu c_ns_per_packet=%.1f cpp_ns_per_packet=%.1f overhead_ns=%.1f\n",
+          (unsigned long long) packets, c_end_to_end, cpp_end_to_end, cpp_end_to_end - c_end_to_end);
+   printf("checksum=%.0f\n", (double) (c_state.sum + cpp_state.sum));
+
+   //  The radio is still running and can't be torn down under its threads, so skip the destructors and
+   //  leave the cleanup to process exit, the same as vita-bench.
+   std::exit(0);
+}
@@ -0,0 +1,462 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file schedule_bench.c
+/// @brief Benchmark of timed command scheduling against a simulated radio clock
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Plays the part of the radio over an in-process transport: it streams timestamped receive IQ at
+//  the real rate, acknowledges timed commands when they arrive and executes each one when its
+//  clock reaches the target.  The waveform schedules commands a fixed number of samples ahead of
+//  the data it has seen, and the bench compares when the simulated radio really ran them with the
+//  latency the library reported.  A simulated network delay can be added in both directions to
+//  show how it biases the library's estimate of the radio's clock.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <arpa/inet.h>
+#include <endian.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include <waveform_api.h>
+#include <waveform_format.h>
+#include <waveform_transport.h>
+
+// ****************************************
+// Macros
+// ****************************************
+#define PAYLOAD_WORDS 360
+#define HEADER_WORDS 7
+#define FRAMES (PAYLOAD_WORDS / 2)
+#define MAX_PENDING 256
+#define MAX_COMMANDS 100000
+#define STREAM_ID 0x04000000U
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+//  A timed command the simulated radio has received
+struct pending {
+   bool used;
+   bool queued;
+   uint32_t sequence;
+   uint64_t received_ns;
+   uint64_t target_ns;
+   uint64_t executed_ns;
+};
+
+//  What the simulated radio and the library each saw of one command
+struct result {
+   uint64_t target_ns;
+   int64_t true_late_ns;
+   bool reported;
+   struct waveform_schedule_report report;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pending pending[MAX_PENDING];
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct result results[MAX_COMMANDS];
+static size_t result_count = 0;
+static _Atomic uint64_t reports = 0;
+static _Atomic uint64_t next_index = 0;
+static _Atomic bool done = false;
+static int64_t radio_epoch_ns = 0;
+static uint64_t delay_ns = 0;
+static uint32_t sample_rate = 24000;
+
+// ****************************************
+// Static Functions
+// ****************************************
+static uint64_t now_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/// @brief The simulated radio's clock, CLOCK_MONOTONIC moved to the wall clock's epoch
+static uint64_t radio_now_ns(void)
+{
+   return now_ns() + (uint64_t) radio_epoch_ns;
+}
+
+static void sleep_until_radio_ns(uint64_t radio_ns)
+{
+   uint64_t due = radio_ns - (uint64_t) radio_epoch_ns;
+   struct timespec until = {.tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL};
+
+   clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+}
+
+/// @brief Converts a sample rate to its VITA-49 packet class code
+/// @returns The code or -1 if the rate can't be expressed
+static int sample_rate_code(uint32_t hz)
+{
+   for (unsigned int code = 0; code < 32; ++code)
+   {
+      if ((code < 0x10 ? 3000U << code : 4000U << (code - 0x10)) == hz)
+      {
+         return (int) code;
+      }
+   }
+   return -1;
+}
+
+/// @brief Builds a receive IQ packet in network byte order, stamped with the radio time of its first frame
+static void build_packet(uint32_t* words, uint8_t sequence, uint64_t radio_ns)
+{
+   uint64_t frac = htobe64((radio_ns % 1000000000ULL) * 1000);
+
+   words[0] = htonl(WF_FORMAT_HEADER_WORD0(WF_FORMAT_FLOAT_STEREO, sequence, HEADER_WORDS + PAYLOAD_WORDS));
+   words[1] = htonl(STREAM_ID);
+   words[2] = htonl(WF_VITA_OUI);
+   words[3] = htonl(WF_VITA_CLASS_WORD(WF_VITA_PACKET_CLASS(0, 1, 32, 2, sample_rate_code(sample_rate))));
+   words[4] = htonl((uint32_t) (radio_ns / 1000000000ULL));
+   memcpy(&words[5], &frac, sizeof(frac));
+   memset(&words[HEADER_WORDS], 0, PAYLOAD_WORDS * sizeof(uint32_t));
+}
+
+/// @brief Receives the lines the library sends and keeps the timed commands among them
+static void line_cb(const char* line, void* arg)
+{
+   unsigned int sequence;
+   long sec;
+   long frac;
+
+   if (sscanf(line, "C%u|@%ld.%ld|", &sequence, &sec, &frac) != 3)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&pending_lock);
+   for (size_t i = 0; i < MAX_PENDING; ++i)
+   {
+      if (!pending[i].used)
+      {
+         pending[i] = (struct pending){
+               .used = true,
+               .sequence = sequence,
+               .received_ns = radio_now_ns(),
+               .target_ns = (uint64_t) sec * 1000000000ULL + (uint64_t) frac / 1000,
+         };
+         break;
+      }
+   }
+   pthread_mutex_unlock(&pending_lock);
+}
+
+/// @brief Records when the simulated radio really executed a command
+static void record_truth(uint64_t target_ns, uint64_t executed_ns)
+{
+   pthread_mutex_lock(&results_lock);
+   if (result_count < MAX_COMMANDS)
+   {
+      results[result_count].target_ns = target_ns;
+      results[result_count].true_late_ns = (int64_t) (executed_ns - target_ns);
+      ++result_count;
+   }
+   pthread_mutex_unlock(&results_lock);
+}
+
+/// @brief The simulated radio: streams data and acknowledges and executes timed commands on its clock
+static void* radio_thread(void* arg)
+{
+   struct waveform_memory_transport* transport = arg;
+   uint32_t packet[HEADER_WORDS + PAYLOAD_WORDS];
+   uint64_t start = radio_now_ns();
+   char lines[MAX_PENDING * 2][32];
+
+   for (uint64_t k = 0; !atomic_load(&done);)
+   {
+      uint64_t packet_ns = start + k * FRAMES * 1000000000ULL / sample_rate;
+      uint64_t packet_end_ns = start + (k + 1) * FRAMES * 1000000000ULL / sample_rate;
+      uint64_t now = radio_now_ns();
+      size_t line_count = 0;
+
+      //  A packet can't leave the radio before its last frame is sampled
+      if (packet_end_ns + delay_ns <= now)
+      {
+         build_packet(packet, (uint8_t) k, packet_ns);
+         while (waveform_memory_transport_inject_vita(transport, packet, sizeof(packet)) == -1)
+         {
+            sched_yield();
+         }
+         ++k;
+         continue;
+      }
+
+      uint64_t wake = packet_end_ns + delay_ns;
+
+      pthread_mutex_lock(&pending_lock);
+      for (size_t i = 0; i < MAX_PENDING; ++i)
+      {
+         struct pending* cmd = &pending[i];
+
+         if (!cmd->used)
+         {
+            continue;
+         }
+
+         if (!cmd->queued && cmd->received_ns + delay_ns <= now)
+         {
+            snprintf(lines[line_count++], sizeof(lines[0]), "Q%u|0|", cmd->sequence);
+            cmd->queued = true;
+         }
+         if (cmd->executed_ns == 0 && cmd->target_ns <= now)
+         {
+            cmd->executed_ns = now;
+            record_truth(cmd->target_ns, now);
+         }
+         if (cmd->executed_ns != 0 && cmd->queued && cmd->executed_ns + delay_ns <= now)
+         {
+            snprintf(lines[line_count++], sizeof(lines[0]), "R%u|0|", cmd->sequence);
+            cmd->used = false;
+            continue;
+         }
+
+         uint64_t due = !cmd->queued          ? cmd->received_ns + delay_ns
+                        : cmd->executed_ns == 0 ? cmd->target_ns
+                                                : cmd->executed_ns + delay_ns;
+         if (due < wake)
+         {
+            wake = due;
+         }
+      }
+      pthread_mutex_unlock(&pending_lock);
+
+      for (size_t i = 0; i < line_count; ++i)
+      {
+         waveform_memory_transport_send_line(transport, lines[i]);
+      }
+
+      //  Come back at least every millisecond to pick up newly arrived commands
+      if (line_count == 0)
+      {
+         sleep_until_radio_ns(wake < now + 1000000 ? wake : now + 1000000);
+      }
+   }
+
+   return NULL;
+}
+
+static void data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   const struct waveform_packet_info* info = get_packet_info(packet);
+
+   if (info->flags & WF_PACKET_HAS_SAMPLE_INDEX)
+   {
+      atomic_store(&next_index, waveform_packet_sample_index(info) + waveform_packet_num_frames(info));
+   }
+}
+
+static void report_cb(struct waveform_t* waveform, const struct waveform_schedule_report* report, void* arg)
+{
+   uint64_t target_ns = (uint64_t) report->target.tv_sec * 1000000000ULL + (uint64_t) report->target.tv_nsec;
+
+   pthread_mutex_lock(&results_lock);
+   for (size_t i = 0; i < result_count; ++i)
+   {
+      if (results[i].target_ns == target_ns && !results[i].reported)
+      {
+         results[i].report = *report;
+         results[i].report.message = NULL;
+         results[i].reported = true;
+         break;
+      }
+   }
+   pthread_mutex_unlock(&results_lock);
+
+   atomic_fetch_add(&reports, 1);
+}
+
+static void usage(const char* progname)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", progname);
+   fprintf(stderr, "Options:\n");
+   fprintf(stderr, "  -n <count>    Number of commands to schedule [default: 200]\n");
+   fprintf(stderr, "  -R <hz>       Sample rate of the simulated receive stream [default: 24000]\n");
+   fprintf(stderr, "  -l <frames>   How many frames past the latest received data to schedule each command [default: 2400]\n");
+   fprintf(stderr, "  -i <us>       Time between scheduling commands in microseconds [default: 5000]\n");
+   fprintf(stderr, "  -d <us>       Simulated one-way network delay in microseconds [default: 0]\n");
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int main(int argc, char** argv)
+{
+   uint64_t commands = 200;
+   uint64_t lead_frames = 2400;
+   uint64_t interval_us = 5000;
+   pthread_t radio_sim;
+   int option;
+
+   while ((option = getopt(argc, argv, "n:R:l:i:d:")) != -1)
+   {
+      switch (option)
+      {
+         case 'n':
+            commands = strtoull(optarg, NULL, 10);
+            break;
+         case 'R':
+            sample_rate = strtoul(optarg, NULL, 10);
+            break;
+         case 'l':
+            lead_frames = strtoull(optarg, NULL, 10);
+            break;
+         case 'i':
+            interval_us = strtoull(optarg, NULL, 10);
+            break;
+         case 'd':
+            delay_ns = strtoull(optarg, NULL, 10) * 1000;
+            break;
+         default:
+            usage(basename(argv[0]));
+            exit(1);
+      }
+   }
+
+   if (commands == 0 || commands > MAX_COMMANDS || sample_rate_code(sample_rate) == -1)
+   {
+      usage(basename(argv[0]));
+      exit(1);
+   }
+
+   struct timespec wall;
+   clock_gettime(CLOCK_REALTIME, &wall);
+   radio_epoch_ns = (int64_t) ((uint64_t) wall.tv_sec * 1000000000ULL + (uint64_t) wall.tv_nsec) - (int64_t) now_ns();
+
+   struct waveform_memory_transport* transport = waveform_memory_transport_create(4096);
+   if (!transport)
+   {
+      fprintf(stderr, "Couldn't create transport\n");
+      exit(1);
+   }
+   waveform_memory_transport_set_line_cb(transport, line_cb, NULL);
+
+   struct sockaddr_in addr = {
+         .sin_family = AF_INET,
+         .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+   };
+   struct radio_t* radio = waveform_radio_create(&addr);
+   waveform_radio_set_memory_transport(radio, transport);
+
+   struct waveform_t* wf = waveform_create(radio, "Bench", "BNCH", "DIGU", "1.0.0");
+   waveform_register_rx_data_cb(wf, data_cb, NULL);
+   waveform_set_sample_rate(wf, sample_rate);
+
+   waveform_radio_start(radio);
+
+   //  Wait for the connection to come up, then select our mode to make the waveform active.
+   while (waveform_memory_transport_send_line(transport, "S0|slice 0 mode=BNCH") == -1)
+   {
+      sched_yield();
+   }
+
+   pthread_create(&radio_sim, NULL, radio_thread, transport);
+
+   struct timespec ignored;
+   while (atomic_load(&next_index) == 0 || waveform_get_radio_time(wf, &ignored) == -1)
+   {
+      sched_yield();
+   }
+
+   uint64_t failed = 0;
+   for (uint64_t i = 0; i < commands; ++i)
+   {
+      if (waveform_schedule_command_at_sample(wf, STREAM_ID, atomic_load(&next_index) + lead_frames, report_cb, NULL,
+                                              "bench %" PRIu64, i) == -1)
+      {
+         ++failed;
+      }
+
+      struct timespec pause = {.tv_sec = interval_us / 1000000, .tv_nsec = (interval_us % 1000000) * 1000};
+      nanosleep(&pause, NULL);
+   }
+
+   //  Every command is due within the lead time, give them that and a second more to report
+   uint64_t deadline = now_ns() + lead_frames * 1000000000ULL / sample_rate + 1000000000ULL;
+   while (atomic_load(&reports) < commands - failed && now_ns() < deadline)
+   {
+      sched_yield();
+   }
+   atomic_store(&done, true);
+   pthread_join(radio_sim, NULL);
+
+   uint64_t reported = 0;
+   uint64_t late = 0;
+   double send_lead = 0, queued_lead = 0, true_late = 0, reported_late = 0, error = 0;
+   int64_t min_send_lead = INT64_MAX, max_true_late = INT64_MIN, max_error = 0;
+
+   pthread_mutex_lock(&results_lock);
+   for (size_t i = 0; i < result_count; ++i)
+   {
+      struct result* r = &results[i];
+
+      if (!r->reported || !(r->report.flags & WF_SCHEDULE_HAS_CLOCK))
+      {
+         continue;
+      }
+
+      int64_t err = r->report.executed_late_ns - r->true_late_ns;
+
+      ++reported;
+      late += r->report.send_lead_ns < 0;
+      send_lead += r->report.send_lead_ns;
+      queued_lead += r->report.queued_lead_ns;
+      true_late += r->true_late_ns;
+      reported_late += r->report.executed_late_ns;
+      error += err;
+      min_send_lead = r->report.send_lead_ns < min_send_lead ? r->report.send_lead_ns : min_send_lead;
+      max_true_late = r->true_late_ns > max_true_late ? r->true_late_ns : max_true_late;
+      max_error = llabs(err) > max_error ? llabs(err) : max_error;
+   }
+   pthread_mutex_unlock(&results_lock);
+
+   printf("commands=%" PRIu64 " reported=%" PRIu64 " failed=%" PRIu64 " sent_late=%" PRIu64 " sample_rate=%u "
+          "lead_frames=%" PRIu64 " delay_us=%" PRIu64 "\n",
+          commands, reported, failed, late, sample_rate, lead_frames, delay_ns / 1000);
+   if (reported)
+   {
+      printf("send_lead_avg_us=%.1f send_lead_min_us=%.1f queued_lead_avg_us=%.1f\n", send_lead / reported / 1e3,
+             min_send_lead / 1e3, queued_lead / reported / 1e3);
+      printf("true_late_avg_us=%.1f true_late_max_us=%.1f reported_late_avg_us=%.1f\n", true_late / reported / 1e3,
+             max_true_late / 1e3, reported_late / reported / 1e3);
+      printf("estimate_error_avg_us=%.1f estimate_error_max_us=%.1f\n", error / reported / 1e3, max_error / 1e3);
+   }
+
+   return 0;
+}
@@ -0,0 +1,445 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file vita_bench.c
+/// @brief Benchmark of the data path from packet arrival to data callback
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Plays the part of the radio over an in-process transport, so the numbers are the cost of the
+//  library alone.  Packets are spread over a number of streams and every callback can be made to
+//  burn a fixed amount of CPU to stand in for a waveform's signal processing.  Sender threads can
+//  transmit at the same time to load the shared parts of the library the way a real waveform does,
+//  and the hardware cache counters for the whole process can be reported to compare data layouts.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include <waveform_api.h>
+#include <waveform_format.h>
+#include <waveform_transport.h>
+
+// ****************************************
+// Macros
+// ****************************************
+#define PAYLOAD_WORDS 360
+#define HEADER_WORDS 7
+#define TX_SAMPLES 128
+#define MAX_SENDERS 16
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct counter {
+   const char* name;
+   uint32_t type;
+   uint64_t config;
+   int fd;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static _Atomic uint64_t callbacks_run = 0;
+static _Atomic uint64_t packets_sent = 0;
+static _Atomic bool done = false;
+static uint64_t work_ns = 0;
+static uint32_t sample_rate = 0;
+
+static struct counter counters[] = {
+      {"cache_references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, -1},
+      {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+      {"l1d_read_misses", PERF_TYPE_HW_CACHE,
+       PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1},
+      {"dtlb_read_misses", PERF_TYPE_HW_CACHE,
+       PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1},
+};
+
+static const char* backing_names[] = {
+      [WF_MEMORY_NONE] = "none",
+      [WF_MEMORY_PAGES] = "pages",
+      [WF_MEMORY_TRANSPARENT_HUGE_PAGES] = "thp",
+      [WF_MEMORY_HUGETLB] = "hugetlb",
+};
+
+// ****************************************
+// Static Functions
+// ****************************************
+static uint64_t now_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+static void data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   if (work_ns)
+   {
+      uint64_t until = now_ns() + work_ns;
+      while (now_ns() < until)
+         ;
+   }
+
+   atomic_fetch_add_explicit(&callbacks_run, 1, memory_order_relaxed);
+}
+
+/// @brief Opens the hardware counters for this thread and every thread it creates afterwards
+/// @details Must be called before the radio is started so the library's threads inherit the counters.
+static void counters_open(void)
+{
+   for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i)
+   {
+      struct perf_event_attr attr = {
+            .type = counters[i].type,
+            .size = sizeof(attr),
+            .config = counters[i].config,
+            .disabled = 1,
+            .inherit = 1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+      };
+
+      counters[i].fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      if (counters[i].fd == -1)
+      {
+         fprintf(stderr, "Couldn't open the %s counter: %m\n", counters[i].name);
+      }
+   }
+}
+
+static void counters_enable(bool enable)
+{
+   for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i)
+   {
+      if (counters[i].fd != -1)
+      {
+         ioctl(counters[i].fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+      }
+   }
+}
+
+static void counters_print(uint64_t packets)
+{
+   for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i)
+   {
+      uint64_t value;
+
+      if (counters[i].fd == -1 || read(counters[i].fd, &value, sizeof(value)) != sizeof(value))
+      {
+         continue;
+      }
+      printf("%s=%llu %s_per_packet=%.2f\n", counters[i].name, (unsigned long long) value, counters[i].name,
+             (double) value / packets);
+   }
+}
+
+/// @brief Transmits speaker data as fast as it can until the run is over
+static void* sender_thread(void* arg)
+{
+   struct waveform_t* wf = arg;
+   float samples[TX_SAMPLES] = {0};
+
+   while (!atomic_load(&done))
+   {
+      if (waveform_send_data_packet(wf, samples, TX_SAMPLES, SPEAKER_DATA) == 0)
+      {
+         atomic_fetch_add_explicit(&packets_sent, 1, memory_order_relaxed);
+      }
+   }
+
+   return NULL;
+}
+
+/// @brief Plays the radio receiving the packets the senders transmit
+static void* drain_thread(void* arg)
+{
+   struct waveform_memory_transport* transport = arg;
+   uint32_t packet[HEADER_WORDS + PAYLOAD_WORDS];
+
+   while (!atomic_load(&done))
+   {
+      if (waveform_memory_transport_take_vita(transport, packet, sizeof(packet)) == -1)
+      {
+         sched_yield();
+      }
+   }
+
+   return NULL;
+}
+
+/// @brief Converts a sample rate to its VITA-49 packet class code
+/// @returns The code or -1 if the rate can't be expressed
+static int sample_rate_code(uint32_t hz)
+{
+   for (unsigned int code = 0; code < 32; ++code)
+   {
+      if ((code < 0x10 ? 3000U << code : 4000U << (code - 0x10)) == hz)
+      {
+         return (int) code;
+      }
+   }
+   return -1;
+}
+
+/// @brief Builds a VITA-49 data packet in network byte order
+/// @details Without a sample rate the packet class is one the library treats as unknown data, so no stream ID
+///          filtering applies.  With one it is a receive IQ stream of two channel 32-bit floats at that rate.
+static void build_packet(uint32_t* words, uint32_t stream_id, uint8_t sequence)
+{
+   uint32_t packet_class = 0;
+
+   if (sample_rate)
+   {
+      packet_class = WF_VITA_PACKET_CLASS(0, 1, 32, 2, sample_rate_code(sample_rate));
+   }
+
+   words[0] = htonl(WF_FORMAT_HEADER_WORD0(WF_FORMAT_FLOAT_STEREO, sequence, HEADER_WORDS + PAYLOAD_WORDS));
+   words[1] = htonl(stream_id);
+   words[2] = htonl(WF_VITA_OUI);
+   words[3] = htonl(WF_VITA_CLASS_WORD(packet_class));
+   words[4] = 0;
+   words[5] = 0;
+   words[6] = 0;
+   for (size_t i = 0; i < PAYLOAD_WORDS; ++i)
+   {
+      words[HEADER_WORDS + i] = htonl((uint32_t) i);
+   }
+}
+
+static void usage(const char* progname)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", progname);
+   fprintf(stderr, "Options:\n");
+   fprintf(stderr, "  -n <count>    Number of packets to send [default: 100000]\n");
+   fprintf(stderr, "  -s <streams>  Number of streams to spread the packets over [default: 1]\n");
+   fprintf(stderr, "  -w <workers>  Number of data callback workers [default: 1]\n");
+   fprintf(stderr, "  -c <ns>       CPU time each callback burns in nanoseconds [default: 0]\n");
+   fprintf(stderr, "  -t <threads>  Number of threads transmitting while packets are received [default: 0]\n");
+   fprintf(stderr, "  -p            Report hardware cache and TLB counters for the run\n");
+   fprintf(stderr, "  -r <entries>  Run in real-time mode with a callback pool of this many entries [default: off]\n");
+   fprintf(stderr, "  -R <hz>       Send a receive IQ stream at this sample rate instead of unknown data [default: off]\n");
+   fprintf(stderr, "  -P            Pace the packets at the real rate of the -R stream rather than sending flat out\n");
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int main(int argc, char** argv)
+{
+   uint64_t packets = 100000;
+   unsigned int streams = 1;
+   unsigned int workers = 1;
+   unsigned int senders = 0;
+   size_t pool_size = 0;
+   bool perf = false;
+   bool paced = false;
+   pthread_t sender_threads[MAX_SENDERS];
+   pthread_t drainer;
+   int option;
+
+   while ((option = getopt(argc, argv, "n:s:w:c:t:pr:R:P")) != -1)
+   {
+      switch (option)
+      {
+         case 'n':
+            packets = strtoull(optarg, NULL, 10);
+            break;
+         case 's':
+            streams = strtoul(optarg, NULL, 10);
+            break;
+         case 'w':
+            workers = strtoul(optarg, NULL, 10);
+            break;
+         case 'c':
+            work_ns = strtoull(optarg, NULL, 10);
+            break;
+         case 't':
+            senders = strtoul(optarg, NULL, 10);
+            break;
+         case 'p':
+            perf = true;
+            break;
+         case 'r':
+            pool_size = strtoull(optarg, NULL, 10);
+            break;
+         case 'R':
+            sample_rate = strtoul(optarg, NULL, 10);
+            break;
+         case 'P':
+            paced = true;
+            break;
+         default:
+            usage(basename(argv[0]));
+            exit(1);
+      }
+   }
+
+   //  The library only accepts one receive stream per waveform, so IQ runs are per stream.
+   if (streams == 0 || senders > MAX_SENDERS || (sample_rate && (streams != 1 || sample_rate_code(sample_rate) == -1)) ||
+       (paced && !sample_rate))
+   {
+      usage(basename(argv[0]));
+      exit(1);
+   }
+
+   struct waveform_memory_transport* transport = waveform_memory_transport_create(4096);
+   if (!transport)
+   {
+      fprintf(stderr, "Couldn't create transport\n");
+      exit(1);
+   }
+
+   struct sockaddr_in addr = {
+         .sin_family = AF_INET,
+         .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+   };
+   struct radio_t* radio = waveform_radio_create(&addr);
+   waveform_radio_set_memory_transport(radio, transport);
+
+   struct waveform_t* wf = waveform_create(radio, "Bench", "BNCH", "DIGU", "1.0.0");
+   if (waveform_set_data_workers(wf, workers) == -1)
+   {
+      fprintf(stderr, "Invalid number of workers: %u\n", workers);
+      exit(1);
+   }
+   if (sample_rate)
+   {
+      waveform_register_rx_data_cb(wf, data_cb, NULL);
+      waveform_set_sample_rate(wf, sample_rate);
+   }
+   else
+   {
+      waveform_register_unknown_data_cb(wf, data_cb, NULL);
+   }
+   waveform_set_realtime(wf, pool_size);
+
+   if (perf)
+   {
+      counters_open();
+   }
+
+   waveform_radio_start(radio);
+
+   //  Wait for the connection to come up, then select our mode to make the waveform active.
+   while (waveform_memory_transport_send_line(transport, "S0|slice 0 mode=BNCH") == -1)
+   {
+      sched_yield();
+   }
+
+   if (senders)
+   {
+      pthread_create(&drainer, NULL, drain_thread, transport);
+      for (unsigned int i = 0; i < senders; ++i)
+      {
+         pthread_create(&sender_threads[i], NULL, sender_thread, wf);
+      }
+   }
+
+   uint32_t packet[HEADER_WORDS + PAYLOAD_WORDS];
+   //  Each packet holds PAYLOAD_WORDS / 2 frames of IQ
+   uint64_t period_ns = sample_rate ? (PAYLOAD_WORDS / 2) * 1000000000ULL / sample_rate : 0;
+   counters_enable(true);
+   uint64_t start = now_ns();
+
+   for (uint64_t i = 0; i < packets; ++i)
+   {
+      if (paced)
+      {
+         uint64_t due = start + i * period_ns;
+         struct timespec until = {.tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL};
+         clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+      }
+
+      build_packet(packet, 0x04000000U + (uint32_t) (i % streams), (uint8_t) i);
+      while (waveform_memory_transport_inject_vita(transport, packet, sizeof(packet)) == -1)
+      {
+         sched_yield();
+      }
+   }
+
+   while (atomic_load(&callbacks_run) < packets)
+   {
+      sched_yield();
+   }
+
+   uint64_t elapsed = now_ns() - start;
+   counters_enable(false);
+
+   atomic_store(&done, true);
+   if (senders)
+   {
+      for (unsigned int i = 0; i < senders; ++i)
+      {
+         pthread_join(sender_threads[i], NULL);
+      }
+      pthread_join(drainer, NULL);
+   }
+
+   struct waveform_lane_stats stats;
+   waveform_get_data_lane_stats(wf, sample_rate ? WF_DATA_LANE_RX : WF_DATA_LANE_UNKNOWN, &stats);
+
+   printf("packets=%llu streams=%u workers=%u work_ns=%llu senders=%u\n", (unsigned long long) packets, streams,
+          workers, (unsigned long long) work_ns, senders);
+   printf("elapsed_ms=%.3f packets_per_sec=%.0f ns_per_packet=%.1f\n", elapsed / 1e6,
+          packets * 1e9 / elapsed, (double) elapsed / packets);
+   printf("queue_latency_avg_ns=%.0f queue_latency_max_ns=%llu max_depth=%u\n",
+          stats.dispatched ? (double) stats.total_latency_ns / stats.dispatched : 0.0,
+          (unsigned long long) stats.max_latency_ns, stats.max_depth);
+   if (sample_rate)
+   {
+      //  How many streams at this rate the measured packet rate could sustain
+      printf("sample_rate=%u required_packets_per_sec=%.0f", sample_rate, 1e9 / period_ns);
+      if (!paced)
+      {
+         printf(" headroom=%.1fx", packets * (double) period_ns / elapsed);
+      }
+      printf("\n");
+   }
+   if (senders)
+   {
+      printf("tx_packets=%llu tx_packets_per_sec=%.0f\n", (unsigned long long) atomic_load(&packets_sent),
+             atomic_load(&packets_sent) * 1e9 / elapsed);
+   }
+   printf("callback_pool=%s tx_queue=%s\n", backing_names[waveform_get_memory_backing(wf, WF_MEMORY_CALLBACK_POOL)],
+          backing_names[waveform_get_memory_backing(wf, WF_MEMORY_TX_QUEUE)]);
+   if (perf)
+   {
+      counters_print(packets);
+   }
+
+   return 0;
+}
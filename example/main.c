@@ -125,11 +125,14 @@ static void packet_rx(struct waveform_t* waveform,
       return;
    }
 
-   float null_samples[get_packet_len(packet)];
+   const struct waveform_packet_info* info = get_packet_info(packet);
+   uint32_t num_samples = waveform_packet_num_samples(info);
+
+   float null_samples[num_samples];
    memset(null_samples, 0, sizeof(null_samples));
 
    pthread_mutex_lock(&ctx->rx_phase_lock);
-   for (int i = 0; i < get_packet_len(packet); i += 2)
+   for (uint32_t i = 0; i < num_samples; i += 2)
    {
       null_samples[i] = null_samples[i + 1] =
             sin_table[ctx->rx_phase] * 0.5F;
@@ -138,7 +141,7 @@ static void packet_rx(struct waveform_t* waveform,
    pthread_mutex_unlock(&ctx->rx_phase_lock);
 
    waveform_send_data_packet(waveform, null_samples,
-                             get_packet_len(packet), SPEAKER_DATA);
+                             num_samples, SPEAKER_DATA);
 
    waveform_meter_set_float_value(waveform, "junk-snr", (float) ctx->snr);
    waveform_meters_send(waveform);
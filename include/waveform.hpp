@@ -0,0 +1,484 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform.hpp
+/// @brief Header-only C++ binding for the waveform API
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_HPP
+#define WAVEFORM_SDK_WAVEFORM_HPP
+
+//  A thin layer over waveform_api.h for waveforms written in C++17 or later.  The radio and waveform are
+//  owned by RAII classes, packets are viewed through spans rather than raw pointers, and callbacks are any
+//  lambda or function object.  Each callback type gets its own trampoline instantiated from a template, so
+//  the callable is inlined into the function the library calls: a packet costs the same single indirect
+//  call as a plain C callback, with no std::function or virtual dispatch in between.
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#include "waveform_api.h"
+
+namespace flex
+{
+
+#if defined(__cpp_lib_span)
+/// @brief A view over contiguous elements, std::span where the standard library has it
+template<typename T>
+using span = std::span<T>;
+#else
+/// @brief A view over contiguous elements, standing in for std::span before C++20
+template<typename T>
+class span
+{
+public:
+   constexpr span() noexcept = default;
+   constexpr span(T* data, std::size_t size) noexcept : data_(data), size_(size)
+   {
+   }
+
+   constexpr T* data() const noexcept
+   {
+      return data_;
+   }
+
+   constexpr std::size_t size() const noexcept
+   {
+      return size_;
+   }
+
+   constexpr bool empty() const noexcept
+   {
+      return size_ == 0;
+   }
+
+   constexpr T* begin() const noexcept
+   {
+      return data_;
+   }
+
+   constexpr T* end() const noexcept
+   {
+      return data_ + size_;
+   }
+
+   constexpr T& operator[](std::size_t i) const noexcept
+   {
+      return data_[i];
+   }
+
+private:
+   T* data_ = nullptr;
+   std::size_t size_ = 0;
+};
+#endif
+
+/// @brief A view of a packet passed to a data callback
+/// @details Only valid for the duration of the callback, like the packet pointer in the C API.
+class packet
+{
+public:
+   packet(struct waveform_vita_packet* raw, std::size_t size) noexcept
+       : raw_(raw), size_(size), info_(get_packet_info(raw))
+   {
+   }
+
+   /// @brief Gets the decoded header of the packet, see get_packet_info()
+   const struct waveform_packet_info& info() const noexcept
+   {
+      return *info_;
+   }
+
+   /// @brief Gets the samples of a packet of 32-bit floats in host byte order, interleaved by channel
+   /// @returns The samples, or an empty span if they aren't 32-bit floats, see waveform_packet_samples()
+   span<const float> samples() const noexcept
+   {
+      const float* samples = waveform_packet_samples(info_);
+      return {samples, samples ? info_->num_samples : 0};
+   }
+
+   /// @brief Gets the samples of a packet of 16-bit integers, see waveform_packet_samples_i16()
+   /// @returns The samples, or an empty span if they aren't 16-bit integers
+   span<const std::int16_t> samples_i16() const noexcept
+   {
+      const std::int16_t* samples = waveform_packet_samples_i16(info_);
+      return {samples, samples ? info_->num_samples : 0};
+   }
+
+   /// @brief Gets the samples of a packet of 32-bit integers, see waveform_packet_samples_i32()
+   /// @returns The samples, or an empty span if they aren't 32-bit integers
+   span<const std::int32_t> samples_i32() const noexcept
+   {
+      const std::int32_t* samples = waveform_packet_samples_i32(info_);
+      return {samples, samples ? info_->num_samples : 0};
+   }
+
+   /// @brief Gets the payload as 32-bit words in host byte order
+   span<const std::uint32_t> words() const noexcept
+   {
+      return {static_cast<const std::uint32_t*>(info_->payload), info_->payload_words};
+   }
+
+   /// @brief Gets the data of a byte data packet, see get_packet_byte_data()
+   span<const std::uint8_t> bytes() const noexcept
+   {
+      return {get_packet_byte_data(raw_), get_packet_byte_data_length(raw_)};
+   }
+
+   std::uint32_t stream_id() const noexcept
+   {
+      return info_->stream_id;
+   }
+
+   std::uint32_t sample_rate() const noexcept
+   {
+      return info_->sample_rate;
+   }
+
+   std::uint32_t num_frames() const noexcept
+   {
+      return waveform_packet_num_frames(info_);
+   }
+
+   std::uint8_t sequence() const noexcept
+   {
+      return info_->sequence;
+   }
+
+   /// @brief Gets the index of the first frame on the timeline of the stream, see waveform_packet_sample_index()
+   std::uint64_t sample_index() const noexcept
+   {
+      return waveform_packet_sample_index(info_);
+   }
+
+   /// @brief Gets the timestamp of the packet, see waveform_packet_ts()
+   struct timespec timestamp() const noexcept
+   {
+      struct timespec ts;
+      waveform_packet_ts(info_, &ts);
+      return ts;
+   }
+
+   /// @brief Gets the packet for use with the C API
+   struct waveform_vita_packet* raw() const noexcept
+   {
+      return raw_;
+   }
+
+   /// @brief Gets the size of the packet in bytes
+   std::size_t size() const noexcept
+   {
+      return size_;
+   }
+
+private:
+   struct waveform_vita_packet* raw_;
+   std::size_t size_;
+   const struct waveform_packet_info* info_;
+};
+
+/// @brief A non-owning handle to a waveform, passed to callbacks
+class waveform_ref
+{
+public:
+   explicit waveform_ref(struct waveform_t* wf) noexcept : wf_(wf)
+   {
+   }
+
+   /// @brief Gets the waveform for use with the C API
+   struct waveform_t* get() const noexcept
+   {
+      return wf_;
+   }
+
+   /// @brief Sends samples to the radio, see waveform_send_data_packet()
+   ssize_t send_data(span<const float> samples, enum waveform_packet_type type) const noexcept
+   {
+      return waveform_send_data_packet(wf_, const_cast<float*>(samples.data()), samples.size(), type);
+   }
+
+   /// @brief Sends bytes to the radio, see waveform_send_byte_data_packet()
+   ssize_t send_bytes(span<const std::uint8_t> data) const noexcept
+   {
+      return waveform_send_byte_data_packet(wf_, const_cast<std::uint8_t*>(data.data()), data.size());
+   }
+
+   /// @brief Sends a command to the radio without waiting for the response, see waveform_send_api_command()
+   template<typename... Args>
+   std::int32_t send_api_command(const char* format, Args... args) const noexcept
+   {
+      return waveform_send_api_command_cb(wf_, nullptr, nullptr, const_cast<char*>(format), args...);
+   }
+
+   /// @brief Converts a frame index of a stream to radio time, see waveform_sample_to_time()
+   /// @returns true on success
+   bool sample_to_time(std::uint32_t stream_id, std::uint64_t sample_index, struct timespec& ts) const noexcept
+   {
+      return waveform_sample_to_time(wf_, stream_id, sample_index, &ts) == 0;
+   }
+
+   /// @brief Converts a radio time to a frame index of a stream, see waveform_time_to_sample()
+   /// @returns true on success
+   bool time_to_sample(std::uint32_t stream_id, const struct timespec& ts, std::uint64_t& sample_index) const noexcept
+   {
+      return waveform_time_to_sample(wf_, stream_id, &ts, &sample_index) == 0;
+   }
+
+   /// @brief Gets the latest context of a stream, see waveform_get_stream_context()
+   /// @returns true if the stream has sent a context packet
+   bool stream_context(std::uint32_t stream_id, struct waveform_stream_context& context) const noexcept
+   {
+      return waveform_get_stream_context(wf_, stream_id, &context) == 0;
+   }
+
+protected:
+   struct waveform_t* wf_;
+};
+
+/// @brief Owns a radio created with waveform_radio_create()
+/// @details Must outlive every waveform created on it, so declare it before them.
+class radio
+{
+public:
+   /// @brief Creates a radio, see waveform_radio_create()
+   /// @throws std::runtime_error if the radio couldn't be created
+   explicit radio(const struct sockaddr_in& addr) : radio_(waveform_radio_create(const_cast<struct sockaddr_in*>(&addr)))
+   {
+      if (!radio_)
+      {
+         throw std::runtime_error("Couldn't create radio");
+      }
+   }
+
+   radio(const radio&) = delete;
+   radio& operator=(const radio&) = delete;
+   radio(radio&& other) noexcept : radio_(std::exchange(other.radio_, nullptr))
+   {
+   }
+
+   radio& operator=(radio&& other) noexcept
+   {
+      std::swap(radio_, other.radio_);
+      return *this;
+   }
+
+   ~radio()
+   {
+      if (radio_)
+      {
+         waveform_radio_destroy(radio_);
+      }
+   }
+
+   /// @brief Connects to the radio, see waveform_radio_start()
+   int start() noexcept
+   {
+      return waveform_radio_start(radio_);
+   }
+
+   /// @brief Waits for the radio to finish, see waveform_radio_wait()
+   int wait() noexcept
+   {
+      return waveform_radio_wait(radio_);
+   }
+
+   /// @brief Gets the radio for use with the C API
+   struct radio_t* get() const noexcept
+   {
+      return radio_;
+   }
+
+private:
+   struct radio_t* radio_;
+};
+
+/// @brief Owns a waveform created with waveform_create() and the callables registered on it
+/// @details Callbacks take a waveform_ref in place of the C API's waveform pointer and have no void* argument,
+///          since a lambda can capture whatever it needs.  Registered callables are kept until the waveform is
+///          destroyed.  The signatures are:
+///          - data: void(flex::waveform_ref, const flex::packet&)
+///          - state: void(flex::waveform_ref, enum waveform_state)
+///          - command and status: int(flex::waveform_ref, flex::span<char*> argv)
+class waveform : public waveform_ref
+{
+public:
+   /// @brief Creates a waveform, see waveform_create()
+   /// @throws std::runtime_error if the waveform couldn't be created
+   waveform(radio& owner, const char* name, const char* short_name, const char* underlying_mode, const char* version)
+       : waveform_ref(waveform_create(owner.get(), name, short_name, underlying_mode, version))
+   {
+      if (!wf_)
+      {
+         throw std::runtime_error("Couldn't create waveform");
+      }
+   }
+
+   waveform(const waveform&) = delete;
+   waveform& operator=(const waveform&) = delete;
+   waveform(waveform&& other) noexcept
+       : waveform_ref(std::exchange(other.wf_, nullptr)), callables_(std::move(other.callables_))
+   {
+   }
+
+   waveform& operator=(waveform&& other) noexcept
+   {
+      std::swap(wf_, other.wf_);
+      std::swap(callables_, other.callables_);
+      return *this;
+   }
+
+   //  The C side goes first so nothing can call into a callable once it is freed.
+   ~waveform()
+   {
+      if (wf_)
+      {
+         waveform_destroy(wf_);
+      }
+   }
+
+   /// @brief Registers a receive data callable, see waveform_register_rx_data_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_rx_data(F&& f)
+   {
+      return add_data_cb(waveform_register_rx_data_cb, std::forward<F>(f));
+   }
+
+   /// @brief Registers a transmit data callable, see waveform_register_tx_data_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_tx_data(F&& f)
+   {
+      return add_data_cb(waveform_register_tx_data_cb, std::forward<F>(f));
+   }
+
+   /// @brief Registers a byte data callable, see waveform_register_byte_data_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_byte_data(F&& f)
+   {
+      return add_data_cb(waveform_register_byte_data_cb, std::forward<F>(f));
+   }
+
+   /// @brief Registers a callable for unknown packets, see waveform_register_unknown_data_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_unknown_data(F&& f)
+   {
+      return add_data_cb(waveform_register_unknown_data_cb, std::forward<F>(f));
+   }
+
+   /// @brief Registers a callable for packets that missed their deadline, see waveform_register_expired_data_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_expired_data(F&& f)
+   {
+      return add_data_cb(waveform_register_expired_data_cb, std::forward<F>(f));
+   }
+
+   /// @brief Registers a state callable, see waveform_register_state_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_state(F&& f)
+   {
+      auto* fn = store(std::forward<F>(f));
+      return waveform_register_state_cb(wf_, state_trampoline<std::decay_t<F>>, fn);
+   }
+
+   /// @brief Registers a command callable, see waveform_register_command_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_command(const char* command_name, F&& f)
+   {
+      auto* fn = store(std::forward<F>(f));
+      return waveform_register_command_cb(wf_, command_name, cmd_trampoline<std::decay_t<F>>, fn);
+   }
+
+   /// @brief Registers a status callable, see waveform_register_status_cb()
+   /// @returns 0 on success or -1 on failure
+   template<typename F>
+   int on_status(const char* status_name, F&& f)
+   {
+      auto* fn = store(std::forward<F>(f));
+      return waveform_register_status_cb(wf_, status_name, cmd_trampoline<std::decay_t<F>>, fn);
+   }
+
+   /// @brief The function the library calls for a data callable of type F, with the callable as its argument
+   /// @details Public so benchmarks can call it the way the library does.
+   template<typename F>
+   static void data_trampoline(struct waveform_t* wf, struct waveform_vita_packet* raw, std::size_t size, void* arg)
+   {
+      (*static_cast<F*>(arg))(waveform_ref(wf), packet(raw, size));
+   }
+
+private:
+   struct callable_base {
+      virtual ~callable_base() = default;
+   };
+
+   template<typename F>
+   struct callable : callable_base {
+      explicit callable(F&& f) : fn(std::forward<F>(f))
+      {
+      }
+
+      std::decay_t<F> fn;
+   };
+
+   template<typename F>
+   static void state_trampoline(struct waveform_t* wf, enum waveform_state state, void* arg)
+   {
+      (*static_cast<F*>(arg))(waveform_ref(wf), state);
+   }
+
+   template<typename F>
+   static int cmd_trampoline(struct waveform_t* wf, unsigned int argc, char* argv[], void* arg)
+   {
+      return (*static_cast<F*>(arg))(waveform_ref(wf), span<char*>(argv, argc));
+   }
+
+   template<typename F>
+   std::decay_t<F>* store(F&& f)
+   {
+      auto holder = std::make_unique<callable<F>>(std::forward<F>(f));
+      auto* fn = &holder->fn;
+      callables_.push_back(std::move(holder));
+      return fn;
+   }
+
+   template<typename F>
+   int add_data_cb(int (*reg)(struct waveform_t*, waveform_data_cb_t, void*), F&& f)
+   {
+      auto* fn = store(std::forward<F>(f));
+      return reg(wf_, data_trampoline<std::decay_t<F>>, fn);
+   }
+
+   std::vector<std::unique_ptr<callable_base>> callables_;
+};
+
+}// namespace flex
+
+#endif//WAVEFORM_SDK_WAVEFORM_HPP
@@ -22,8 +22,16 @@
 #define WAVEFORM_SDK_WAVEFORM_API_H
 
 #include <netinet/in.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /// @struct waveform_t
 /// @brief Opaque structure to keep track of the waveform.
@@ -38,6 +46,15 @@ struct radio_t;
 struct waveform_args_t;
 struct waveform_vita_packet;
 
+/// @brief The largest number of data callback worker threads that can be set with waveform_set_data_workers()
+#define WF_MAX_DATA_WORKERS 16
+
+/// @brief The default and smallest maximum VITA-49 payload, in bytes.  Fits a standard 1500 byte Ethernet frame.
+#define WF_STANDARD_PAYLOAD 1440
+/// @brief The largest maximum VITA-49 payload that can be set with waveform_set_max_payload(), in bytes.  Fits a
+///        9000 byte jumbo frame after the IP, UDP and VITA-49 headers.
+#define WF_JUMBO_PAYLOAD 8944
+
 /// @brief Enumeration for waveform meter units
 enum waveform_units
 {
@@ -83,6 +100,187 @@ enum waveform_log_levels
    WF_LOG_FATAL = 700
 };
 
+/// @brief The classes of data packets, each of which is queued to the data callbacks in its own lane.
+enum waveform_data_lane
+{
+   WF_DATA_LANE_TX,     ///< Microphone/transmit data destined for waveform_register_tx_data_cb() callbacks
+   WF_DATA_LANE_RX,     ///< Receiver data destined for waveform_register_rx_data_cb() callbacks
+   WF_DATA_LANE_BYTE,   ///< Byte stream data destined for waveform_register_byte_data_cb() callbacks
+   WF_DATA_LANE_UNKNOWN,///< Any other packets destined for waveform_register_unknown_data_cb() callbacks
+   WF_DATA_LANE_MAX
+};
+
+/// @brief How the data callback thread chooses the next lane to service
+enum waveform_lane_policy
+{
+   WF_LANE_STRICT_PRIORITY,///< Always service the highest priority non-empty lane.  TX is highest, unknown lowest.
+   WF_LANE_WEIGHTED,       ///< Service lanes round robin in priority order, each up to its weight in a row.
+   WF_LANE_EARLIEST_DEADLINE///< Service the lane whose oldest item has the earliest deadline and skip expired items.
+};
+
+/// @brief What to do with an outgoing packet when the transmit queue is full
+enum waveform_tx_drop_policy
+{
+   WF_TX_DROP_OLDEST,///< Discard the packet that has waited longest to make room, keeping latency bounded
+   WF_TX_DROP_NEWEST ///< Discard the packet being sent and return -EAGAIN to the caller
+};
+
+/// @brief Flags describing a received packet in struct waveform_packet_info
+enum waveform_packet_flags
+{
+   WF_PACKET_HAS_TIMESTAMP = 1 << 0,   ///< The timestamp fields are valid
+   WF_PACKET_IS_AUDIO = 1 << 1,        ///< The payload is audio rather than IQ
+   WF_PACKET_IS_FLOAT = 1 << 2,        ///< The samples are IEEE-754 floats rather than integers
+   WF_PACKET_HAS_TRAILER = 1 << 3,     ///< The packet ends in a VITA-49 trailer word
+   WF_PACKET_HAS_SAMPLE_INDEX = 1 << 4,///< The sample_index field is valid
+   WF_PACKET_DISCONTINUITY = 1 << 5    ///< Samples were lost or the radio's clock jumped just before this packet
+};
+
+/// @brief The header of a received packet, decoded once by the library
+/// @details Every packet handed to a data callback is preceded by one of these, retrieved with get_packet_info().
+///          The fields are plain, naturally aligned values in host byte order, so reading them costs no more than
+///          reading a local variable, unlike unpacking the VITA-49 header bitfields on every call.
+struct waveform_packet_info {
+   alignas(64) void* payload;///< The payload of the packet in host byte order
+   uint32_t payload_words;   ///< The length of the payload in 32-bit words, the same as get_packet_len()
+   uint32_t num_samples;     ///< The number of samples in the payload, counting each channel separately
+   uint64_t sample_index;    ///< The index of the first frame of the packet in its stream, if WF_PACKET_HAS_SAMPLE_INDEX is set
+   uint64_t class_id;        ///< The VITA-49 class ID: the OUI, information class and packet class
+   uint64_t timestamp_frac;  ///< The fractional part of the timestamp, if WF_PACKET_HAS_TIMESTAMP is set
+   uint32_t timestamp_int;   ///< The integer part of the timestamp, if WF_PACKET_HAS_TIMESTAMP is set
+   uint32_t stream_id;       ///< The stream ID of the packet
+   uint32_t sample_rate;     ///< The sample rate in Hz
+   uint8_t bits_per_sample;  ///< The size of each sample: 8, 16, 24 or 32
+   uint8_t channels;         ///< The number of samples per frame: 2 for stereo audio or IQ
+   uint8_t sequence;         ///< The 4-bit packet count
+   uint8_t flags;            ///< A combination of enum waveform_packet_flags
+};
+
+/// @brief The kind of pages backing a block of the library's memory
+enum waveform_memory_backing
+{
+   WF_MEMORY_NONE,                  ///< The block isn't allocated, usually because the waveform isn't active
+   WF_MEMORY_PAGES,                 ///< Normal pages
+   WF_MEMORY_TRANSPARENT_HUGE_PAGES,///< Transparent huge pages were requested with madvise(2)
+   WF_MEMORY_HUGETLB                ///< Explicit huge pages from the kernel's reserved pool
+};
+
+/// @brief The large blocks of memory the library allocates for an active waveform
+enum waveform_memory_region
+{
+   WF_MEMORY_CALLBACK_POOL,///< Data callback queue entries, allocated in real-time mode
+   WF_MEMORY_TX_QUEUE      ///< Outgoing packets waiting for the socket
+};
+
+/// @brief Statistics for outgoing VITA-49 packets
+struct waveform_tx_stats {
+   uint64_t sent;     ///< Number of packets written to the radio
+   uint64_t queued;   ///< Number of packets that had to wait in the transmit queue for the socket to become writable
+   uint64_t dropped;  ///< Number of packets discarded because the transmit queue was full
+   uint64_t errors;   ///< Number of packets discarded because of a send error other than backpressure
+   uint32_t depth;    ///< Number of packets currently waiting in the transmit queue
+   uint32_t max_depth;///< The largest depth the transmit queue has reached
+};
+
+/// @brief Statistics for a data callback lane
+struct waveform_lane_stats {
+   uint64_t enqueued;        ///< Number of callback invocations queued to the lane
+   uint64_t dispatched;      ///< Number of callback invocations taken from the lane and run
+   uint32_t depth;           ///< Number of callback invocations currently waiting in the lane
+   uint32_t max_depth;       ///< The largest depth the lane has reached
+   uint64_t total_latency_ns;///< Sum of the time items waited in the lane before their callback started
+   uint64_t max_latency_ns;  ///< The longest time an item waited in the lane before its callback started
+   uint64_t expired;         ///< Number of items that missed their deadline under WF_LANE_EARLIEST_DEADLINE
+   uint64_t dropped;         ///< Number of items dropped because no queue entry was available
+};
+
+/// @brief The parts of the library whose memory is accounted separately, see waveform_get_alloc_stats()
+enum waveform_alloc_tag
+{
+   WF_ALLOC_RX_QUEUE, ///< Received data: the receive buffer and the data callback queue entries and pools
+   WF_ALLOC_TX_QUEUE, ///< Transmitted data: the transmit queue and the packet held back for it
+   WF_ALLOC_COMMAND,  ///< Commands to and from the radio and the bookkeeping for their responses
+   WF_ALLOC_STATUS,   ///< Status lines from the radio, state and status callback work items and subscriptions
+   WF_ALLOC_METERS,   ///< Meter definitions
+   WF_ALLOC_DISCOVERY,///< Radio discovery
+   WF_ALLOC_OTHER,    ///< Everything else, such as radios, waveforms, callback lists, modules and plugins
+   WF_ALLOC_TAG_MAX
+};
+
+/// @brief Memory use of a part of the library
+struct waveform_alloc_stats {
+   uint64_t live_bytes;       ///< Bytes currently allocated, as sized by the allocator
+   uint64_t peak_bytes;       ///< The most bytes that were allocated at once
+   uint64_t allocations;      ///< Number of allocations since the process started
+   uint64_t frees;            ///< Number of allocations freed since the process started
+   double allocations_per_sec;///< Allocations per second since the previous call for the same part, 0 on the first call
+};
+
+/// @brief The fields of a struct waveform_stream_context, numbered as the bits of the VITA-49 context indicator
+enum waveform_context_field
+{
+   WF_CONTEXT_REFERENCE_POINT = 1 << 30,    ///< reference_point
+   WF_CONTEXT_BANDWIDTH = 1 << 29,          ///< bandwidth
+   WF_CONTEXT_IF_FREQUENCY = 1 << 28,       ///< if_frequency
+   WF_CONTEXT_RF_FREQUENCY = 1 << 27,       ///< rf_frequency
+   WF_CONTEXT_RF_FREQUENCY_OFFSET = 1 << 26,///< rf_frequency_offset
+   WF_CONTEXT_IF_BAND_OFFSET = 1 << 25,     ///< if_band_offset
+   WF_CONTEXT_REFERENCE_LEVEL = 1 << 24,    ///< reference_level
+   WF_CONTEXT_GAIN = 1 << 23,               ///< gain_stage1 and gain_stage2
+   WF_CONTEXT_OVER_RANGE_COUNT = 1 << 22,   ///< over_range_count
+   WF_CONTEXT_SAMPLE_RATE = 1 << 21,        ///< sample_rate
+   WF_CONTEXT_TEMPERATURE = 1 << 18,        ///< temperature
+   WF_CONTEXT_STATE_EVENT = 1 << 16,        ///< state_event
+};
+
+/// @brief The latest metadata a stream has sent in VITA-49 context packets
+/// @details Context packets only carry the fields that changed, so each one is merged into what the stream sent
+///          before.  Fields the stream has never sent are zero and their bit is clear in fields.
+struct waveform_stream_context {
+   uint32_t stream_id;          ///< The stream the context describes
+   uint32_t fields;             ///< The fields the stream has sent, a combination of enum waveform_context_field
+   uint64_t updates;            ///< Number of context packets received for the stream
+   uint32_t timestamp_int;      ///< The integer timestamp of the latest context packet
+   uint64_t timestamp_frac;     ///< The fractional timestamp of the latest context packet
+   uint32_t reference_point;    ///< The stream ID of the reference point of the context
+   double bandwidth;            ///< Bandwidth of the signal in Hz
+   double if_frequency;         ///< IF reference frequency in Hz
+   double rf_frequency;         ///< RF reference frequency in Hz
+   double rf_frequency_offset;  ///< RF reference frequency offset in Hz
+   double if_band_offset;       ///< IF band offset in Hz
+   double sample_rate;          ///< Sample rate in Hz
+   float reference_level;       ///< Reference level in dBm
+   float gain_stage1;           ///< Front end gain in dB
+   float gain_stage2;           ///< Back end gain in dB
+   float temperature;           ///< Device temperature in degrees Celsius
+   uint32_t over_range_count;   ///< Number of over range samples in the latest data packet
+   uint32_t state_event;        ///< The raw state and event indicator word
+};
+
+/// @brief Flags describing a struct waveform_schedule_report
+enum waveform_schedule_flags
+{
+   WF_SCHEDULE_HAS_CLOCK = 1 << 0,///< The radio's clock was known, so the lead and latency fields are valid
+   WF_SCHEDULE_AT_SAMPLE = 1 << 1,///< The target was given as a sample index, in stream_id and sample_index
+   WF_SCHEDULE_QUEUED = 1 << 2,   ///< The radio acknowledged queueing the command
+   WF_SCHEDULE_EXECUTED = 1 << 3  ///< The radio reported executing the command
+};
+
+/// @brief How a command scheduled with waveform_schedule_command() landed against its target
+/// @details The times are the radio's clock as estimated from the timestamps of received data, see
+///          waveform_get_radio_time().  A positive lead means that step happened before the target.
+struct waveform_schedule_report {
+   struct timespec target;  ///< The radio time the command was scheduled for
+   uint32_t stream_id;      ///< The stream the target was given on, with WF_SCHEDULE_AT_SAMPLE
+   uint64_t sample_index;   ///< The frame index the target was given as, with WF_SCHEDULE_AT_SAMPLE
+   int64_t send_lead_ns;    ///< How long before the target the command was sent
+   int64_t queued_lead_ns;  ///< How long before the target the radio acknowledged queueing it, with WF_SCHEDULE_QUEUED
+   int64_t executed_late_ns;///< How long after the target the radio reported executing it, with WF_SCHEDULE_EXECUTED
+   unsigned int code;       ///< The response code: 0 on success, otherwise the error queueing or executing the command
+   char* message;           ///< The response message, freed when the callback returns
+   uint8_t flags;           ///< A combination of enum waveform_schedule_flags
+};
+
 /// @brief A structure to hold a description of a meter
 struct waveform_meter_entry {
    char* name;              ///< The name of the meter
@@ -112,8 +310,10 @@ typedef int (*waveform_cmd_cb_t)(struct waveform_t* waveform, unsigned int argc,
 /// @details When new data arrives for the waveform, this callback is called.  It is recommended that you create a
 ///          buffer system to get the data off of this thread as quickly as possible and do your processing in a
 ///          separate thread.  Be efficient about this function as it will be called thousands of times a second when
-///          the waveform is active.  Samples are returned as 32-bit floats in host byte order.  They are in pairs,
-///          either Left first and Right second or I first and Q second depending on the underlying mode.
+///          the waveform is active.  Samples are returned as 32-bit floats in host byte order unless integer streams
+///          were asked for with waveform_set_integer_samples(), in which case the flags and bits_per_sample from
+///          get_packet_info() tell which accessor to read them with.  They are in pairs, either Left first and Right
+///          second or I first and Q second depending on the underlying mode.
 /// @param waveform The waveform receiving data
 /// @param packet A pointer to the received data
 /// @param packet_size the size of the received packet in bytes
@@ -134,6 +334,17 @@ typedef void (*waveform_response_cb_t)(struct waveform_t* waveform,
                                        unsigned int code, char* message,
                                        void* arg);
 
+/// @brief Called once a command scheduled with waveform_schedule_command() has run or been refused
+/// @param waveform The waveform the command was sent for
+/// @param report How the command landed against its target.  Only valid for the duration of the callback.
+/// @param arg The user-defined argument passed to waveform_schedule_command()
+typedef void (*waveform_schedule_cb_t)(struct waveform_t* waveform, const struct waveform_schedule_report* report,
+                                       void* arg);
+
+/// @brief Called on the radio's event loop by waveform_radio_post()
+/// @param arg The user-defined argument passed to waveform_radio_post()
+typedef void (*waveform_post_cb_t)(void* arg);
+
 /// @brief Create a waveform.
 /// @details Creates a waveform for processing.  This will register the waveform with the SDK and set it up to be
 /// handled in the event loop when executed.  This function can be called more than once if you would like to
@@ -212,12 +423,29 @@ int waveform_register_unknown_data_cb(struct waveform_t* waveform, waveform_data
 /// @return 0 upon success, -1 on failure
 int waveform_register_byte_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg);
 
+/// @brief Register a callback for data packets that missed their deadline.
+/// @details With the WF_LANE_EARLIEST_DEADLINE policy, a queued data callback whose deadline has passed by the time
+///          a worker gets to it is not run.  Instead the packet is passed to the callbacks registered here, so the
+///          waveform can fall back to a cheaper degraded path such as filling silence.  A packet is passed on
+///          exactly once if any of the data callbacks registered for it misses its deadline, however many do: by
+///          whichever of them expires first, so a slow callback ahead of the others can't make it disappear.  If no
+///          callback is registered here the packet is dropped.  These callbacks run on the data callback worker of
+///          the stream and should return quickly.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function
+/// @param arg A user-defined argument to be passed to the callback on execution.  Can be NULL.
+/// @return 0 upon success, -1 on failure
+int waveform_register_expired_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg);
+
 /// @brief Register a status callback.
 /// @details Registers a callback is called when the radio status changes.  This function also handles creating the
-///          event subscription in the API.
+///          event subscription in the API: the library subscribes only to the status its own callbacks and those
+///          registered here need, and updates the subscriptions as callbacks are registered and unregistered.
 /// @param waveform Pointer to the waveform structure returned by waveform_create()
 /// @param status_name The name of the subsystem for which you would like to receive status.  For example, if you
-///                    would like to receive slice status updates, set this parameter to "slice".
+///                    would like to receive slice status updates, set this parameter to "slice".  Only status
+///                    messages whose first word matches are passed to the callback.  NULL receives every status
+///                    message and subscribes to slice, radio and client status.
 /// @param cb The callback function
 /// @param arg A user-defined argument to be passed to the callback on execution.  Can be NULL.
 /// @return 0 upon success, -1 on failure
@@ -237,6 +465,91 @@ int waveform_register_command_cb(struct waveform_t* waveform,
                                  const char* command_name, waveform_cmd_cb_t cb,
                                  void* arg);
 
+/// @brief Unregister a state callback
+/// @details Removes a callback previously registered with waveform_register_state_cb().  This may be called while
+///          the radio is running.  Callbacks that have already been queued for execution may still run after this
+///          function returns.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_state_cb(struct waveform_t* waveform,
+                                 waveform_state_cb_t cb, void* arg);
+
+/// @brief Unregister a transmitter data callback
+/// @details Removes a callback previously registered with waveform_register_tx_data_cb().  This may be called while
+///          the radio is running.  Packets that have already been queued for the callback may still be delivered
+///          after this function returns.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_tx_data_cb(struct waveform_t* waveform,
+                                   waveform_data_cb_t cb, void* arg);
+
+/// @brief Unregister a receive data callback
+/// @details Removes a callback previously registered with waveform_register_rx_data_cb().  This may be called while
+///          the radio is running.  Packets that have already been queued for the callback may still be delivered
+///          after this function returns.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_rx_data_cb(struct waveform_t* waveform,
+                                   waveform_data_cb_t cb, void* arg);
+
+/// @brief Unregister an unknown data packet callback
+/// @details Removes a callback previously registered with waveform_register_unknown_data_cb().  This may be called
+///          while the radio is running.  Packets that have already been queued for the callback may still be
+///          delivered after this function returns.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_unknown_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg);
+
+/// @brief Unregister a raw byte data packet callback
+/// @details Removes a callback previously registered with waveform_register_byte_data_cb().  This may be called
+///          while the radio is running.  Packets that have already been queued for the callback may still be
+///          delivered after this function returns.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_byte_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg);
+
+/// @brief Unregister an expired data packet callback
+/// @details Removes a callback previously registered with waveform_register_expired_data_cb().  This may be called
+///          while the radio is running.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_expired_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg);
+
+/// @brief Unregister a status callback
+/// @details Removes a callback previously registered with waveform_register_status_cb().  This may be called while
+///          the radio is running.  The subscription for the status is dropped once nothing else needs it.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param status_name The name of the subsystem the callback was registered for
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_status_cb(struct waveform_t* waveform, const char* status_name,
+                                  waveform_cmd_cb_t cb, void* arg);
+
+/// @brief Unregister a command callback
+/// @details Removes a callback previously registered with waveform_register_command_cb().  This may be called while
+///          the radio is running.
+/// @param waveform Pointer to the waveform structure returned by waveform_create()
+/// @param command_name The name of the command the callback was registered for
+/// @param cb The callback function that was registered
+/// @param arg The argument that was registered with the callback
+/// @return 0 upon success, -1 if the callback was not registered
+int waveform_unregister_command_cb(struct waveform_t* waveform,
+                                   const char* command_name, waveform_cmd_cb_t cb,
+                                   void* arg);
+
 /// @brief Sends a command to the radio
 /// @details Does not wait for a response from the radio.  This is a shortcut for passing NULL to the cb parameter of
 ///          send_api_command_cb()
@@ -289,6 +602,44 @@ int32_t waveform_send_api_command_cb(struct waveform_t* waveform,
 int32_t waveform_send_timed_api_command_cb(struct waveform_t* waveform, struct timespec* at, waveform_response_cb_t complete_cb,
                                            waveform_response_cb_t queued_cb, void* arg, char* command, ...);
 
+/// @brief Gets the current time on the radio's clock
+/// @details Estimated from the timestamps of received sample packets against CLOCK_MONOTONIC.  The radio's clock
+///          runs ahead of the estimate by about the shortest time a packet has taken to arrive recently.
+/// @param waveform The waveform receiving data
+/// @param now A user-provided structure in which to store the radio time
+/// @returns 0 on success or -1 if no timestamped data has been received since the waveform became active
+int waveform_get_radio_time(struct waveform_t* waveform, struct timespec* now);
+
+/// @brief Sends a command for the radio to execute at a radio time and reports how it landed
+/// @details Like waveform_send_timed_api_command_cb(), but the callback receives a single report once the command has
+///          executed or the radio refused to queue it.  The report compares the target to the radio's clock when
+///          the command was sent, queued and executed, so a waveform can learn how much lead its commands need.
+///          The queued and executed times are taken as the responses arrive from the radio.  The callback may run on
+///          any thread.
+/// @param waveform The waveform sending the command
+/// @param at The radio time at which to execute the command
+/// @param cb The function to receive the report.  Can be NULL.
+/// @param arg A user-defined argument to be passed to the callback
+/// @param command A format string in printf(3) format
+/// @param ... Arguments for format specification
+/// @returns The sequence number on success or -1 on failure
+int32_t waveform_schedule_command(struct waveform_t* waveform, const struct timespec* at, waveform_schedule_cb_t cb,
+                                  void* arg, char* command, ...);
+
+/// @brief Sends a command for the radio to execute at a sample of a stream and reports how it landed
+/// @details The sample index is converted to radio time with waveform_sample_to_time(), otherwise this is the same
+///          as waveform_schedule_command().
+/// @param waveform The waveform sending the command
+/// @param stream_id The stream the sample index is on
+/// @param sample_index The frame index at which to execute the command
+/// @param cb The function to receive the report.  Can be NULL.
+/// @param arg A user-defined argument to be passed to the callback
+/// @param command A format string in printf(3) format
+/// @param ... Arguments for format specification
+/// @returns The sequence number on success, or -1 on failure or if the stream's timeline isn't anchored yet
+int32_t waveform_schedule_command_at_sample(struct waveform_t* waveform, uint32_t stream_id, uint64_t sample_index,
+                                            waveform_schedule_cb_t cb, void* arg, char* command, ...);
+
 /// @brief Adds a new meter to a meter list
 /// @details Adds a new meter to a meter list and registers it with the radio.
 /// @param waveform The waveform containing the meter
@@ -351,10 +702,22 @@ void waveform_radio_destroy(struct radio_t* radio);
 /// @returns 0 on success or -1 for failure.
 int waveform_radio_wait(struct radio_t* radio);
 
+/// @brief Runs a function on the radio's event loop thread
+/// @details The function runs in order with commands sent with waveform_send_api_command_cb() and its relatives from
+///          the same thread, on the thread that talks to the radio.  It must not block, as nothing else is sent or
+///          received while it runs.  If the radio hasn't been started yet the function runs once it is.  Functions
+///          still waiting when the radio is destroyed are discarded without being run.  May be called from any
+///          thread, including from within a posted function.
+/// @param radio The radio on whose event loop to run the function
+/// @param fn The function to run
+/// @param arg A user-defined argument to pass to the function
+/// @returns 0 on success or -1 if memory couldn't be allocated
+int waveform_radio_post(struct radio_t* radio, waveform_post_cb_t fn, void* arg);
+
 /// @brief Start the radio
 /// @details Connects to the radio and starts the event loop to begin processing commands.  All callbacks should be
-///          set up and registered by the time you call this function.  Registering a callback while the radio is
-///          running will have undefined behavior.  This command will immediately return and you must use
+///          set up and registered by the time you call this function.  Callbacks may also be registered and
+///          unregistered while the radio is running.  This command will immediately return and you must use
 ///          waveform_radio_wait() to wait for its completion.
 /// @param radio The radio on which to wait.
 /// @returns 0 on success or -1 for failure.
@@ -373,7 +736,7 @@ int waveform_radio_start(struct radio_t* radio);
 ///             or TRANSMITTER_DATA for sending to the RF transmitter.
 /// @returns 0 on success or a negative value on an error.  Return values are negative values of errno.h.  Will return
 ///          -E2BIG on a short write to the network and -EFBIG if you attempt to send too many samples in a single
-///          packet.
+///          packet.  A packet holds waveform_get_max_send_payload() / sizeof(float) samples.
 ssize_t waveform_send_data_packet(struct waveform_t* waveform, float* samples,
                                   size_t num_samples,
                                   enum waveform_packet_type type);
@@ -384,9 +747,294 @@ ssize_t waveform_send_data_packet(struct waveform_t* waveform, float* samples,
 /// @param data A reference to an array of bytes to send
 /// @param data_size The number of bytes in the samples array
 /// @returns 0 on success or a negative value on an error.  Return values are negative values of errno.h and will return
-///          -E2BIG on a short write to the network.
+///          -E2BIG on a short write to the network and -EFBIG if data_size plus the four byte length word exceeds
+///          waveform_get_max_send_payload().
 ssize_t waveform_send_byte_data_packet(struct waveform_t* waveform, uint8_t* data, size_t data_size);
 
+/// @brief Sets how the data callback thread chooses between lanes
+/// @details Data callbacks are queued in separate lanes for transmit, receive, byte and unknown data so that time
+///          critical transmit data does not wait behind receive work.  The default policy is
+///          WF_LANE_STRICT_PRIORITY.  This may be called while the waveform is running.
+/// @param waveform The waveform to configure
+/// @param policy The scheduling policy
+/// @returns 0 on success or -1 for an invalid policy
+int waveform_set_data_lane_policy(struct waveform_t* waveform, enum waveform_lane_policy policy);
+
+/// @brief Sets the weight of a data callback lane
+/// @details Only used by the WF_LANE_WEIGHTED policy.  A lane with weight N will have up to N items serviced
+///          before the next lane gets a turn.  The defaults are 8 for transmit, 4 for receive, 2 for byte and 1 for
+///          unknown data.
+/// @param waveform The waveform to configure
+/// @param lane The lane to configure
+/// @param weight The weight of the lane.  Must be at least 1.
+/// @returns 0 on success or -1 for an invalid lane or weight
+int waveform_set_data_lane_weight(struct waveform_t* waveform, enum waveform_data_lane lane, unsigned int weight);
+
+/// @brief Sets how long queued data callbacks stay current
+/// @details Under the WF_LANE_EARLIEST_DEADLINE policy every queued packet gets a deadline of its arrival time plus
+///          this many packet periods, where the period is the time covered by the samples in the packet.  Byte data
+///          and unknown packets have no period and get a fixed 20 ms instead.  Workers
+///          run the item with the earliest deadline first and hand items that are already past their deadline to
+///          the expired data callbacks instead.  The default is 4 periods.  This may be called while the waveform
+///          is running and applies to packets received afterwards.
+/// @param waveform The waveform to configure
+/// @param periods The number of packet periods a packet may wait.  Must be at least 1.
+/// @returns 0 on success or -1 if periods is 0
+int waveform_set_data_deadline(struct waveform_t* waveform, unsigned int periods);
+
+/// @brief Sets the number of threads running data callbacks
+/// @details Data callbacks are spread across a pool of worker threads by stream ID.  All callbacks for a given
+///          stream run on the same worker in the order the packets arrived, while callbacks for different streams
+///          may run at the same time on different workers.  Callbacks that share state between streams must
+///          synchronize their access to it when more than one worker is used.  The default is a single worker.
+///          This must be called before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param workers The number of worker threads, between 1 and WF_MAX_DATA_WORKERS
+/// @returns 0 on success or -1 if the number is out of range or the waveform is active
+int waveform_set_data_workers(struct waveform_t* waveform, unsigned int workers);
+
+/// @brief Enables real-time safe operation of the data path
+/// @details In real-time mode the process memory is locked with mlockall(2) when the waveform becomes active, the
+///          stacks of the data threads are faulted in before they start handling packets, and every queue entry for
+///          the data callbacks is allocated up front.  Receiving a packet and running its callbacks then never calls
+///          the allocator.  Entries come in a few sizes so small packets don't occupy a full sized buffer, and
+///          pool_size entries of each size are allocated; a packet uses a larger entry if its own size has run out.
+///          The number of full sized entries is scaled up for sample rates above 24 ksps set with
+///          waveform_set_sample_rate().
+///          If every entry is in use when a packet arrives, the callbacks for that packet are dropped and counted
+///          in the lane statistics instead.  Locking memory usually needs CAP_IPC_LOCK or a
+///          raised RLIMIT_MEMLOCK; if it fails an error is logged and the waveform runs without it.  Memory stays
+///          locked for the life of the process.  This must be called before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param pool_size The number of entries of each size to allocate, or 0 to disable real-time mode
+/// @returns 0 on success or -1 if the waveform is active
+int waveform_set_realtime(struct waveform_t* waveform, size_t pool_size);
+
+/// @brief Publishes the waveform's incoming streams into shared memory
+/// @details Every stream the waveform receives is written into its own POSIX shared memory ring named with
+///          WAVEFORM_SHM_NAME_FORMAT from waveform_shm.h, so other processes such as recorders or monitors can
+///          consume the same samples using waveform_shm_open() without their own radio stream.  Rings are created
+///          for the streams the radio assigned to the waveform when it becomes active, so the data path never sets
+///          up shared memory itself, and removed when the waveform becomes inactive.  Readers
+///          never slow the waveform down; a reader that falls behind loses packets.  This must be called before
+///          the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param prefix The prefix for the ring names, or NULL to stop publishing
+/// @param slots The number of packets each ring holds
+/// @returns 0 on success or -1 if the waveform is active, slots is 0, or memory couldn't be allocated
+int waveform_set_shm_publish(struct waveform_t* waveform, const char* prefix, uint32_t slots);
+
+/// @brief Sets the sample rate of the waveform's data streams
+/// @details Received streams are recognised at any rate the radio sends, and the rate of each packet is available
+///          from get_packet_info().  This sets the rate advertised in packets sent with waveform_send_data_packet()
+///          and sizes the real-time callback pool for the packet rate it implies: at 192 ksps an IQ stream
+///          delivers a full sized packet roughly every millisecond, eight times as often as at 24 ksps.  The rate
+///          must be one a VITA-49 packet class can express, such as 24000, 48000, 96000 or 192000.  The default is
+///          24000.  This must be called before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param sample_rate The sample rate in Hz
+/// @returns 0 on success or -1 if the waveform is active or the rate isn't supported
+int waveform_set_sample_rate(struct waveform_t* waveform, uint32_t sample_rate);
+
+/// @brief Passes streams of integer samples to the receive and transmit callbacks
+/// @details By default only two channel streams of 32-bit floats go to the receive and transmit callbacks, and
+///          streams of 16 or 32-bit integers go to the unknown data callbacks untouched.  Once enabled, integer
+///          streams go to the receive and transmit callbacks too, byte swapped to host order, so those callbacks
+///          must check WF_PACKET_IS_FLOAT and bits_per_sample from get_packet_info() and read the samples with
+///          waveform_packet_samples_i16() or waveform_packet_samples_i32().  waveform_packet_samples() and
+///          get_packet_data() return NULL for them.  This must be called before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param enable Whether to pass integer streams to the receive and transmit callbacks
+/// @returns 0 on success or -1 if the waveform is active
+int waveform_set_integer_samples(struct waveform_t* waveform, bool enable);
+
+/// @brief Sets the largest VITA-49 payload the waveform handles
+/// @details Packet buffers throughout the data path are sized from this rather than for a standard Ethernet frame.
+///          Received packets up to this size are delivered whole; anything larger is dropped and logged rather than
+///          truncated.  Sending with waveform_send_data_packet() and waveform_send_byte_data_packet() accepts payloads
+///          up to this size as well, unless the MTU of the route to the radio is smaller, in which case the limit is
+///          what fits in one frame on that route, but never less than WF_STANDARD_PAYLOAD.  Only raise this when the
+///          network to the radio carries jumbo frames.  The default is WF_STANDARD_PAYLOAD.  This must be called
+///          before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param bytes The largest payload in bytes, between WF_STANDARD_PAYLOAD and WF_JUMBO_PAYLOAD
+/// @returns 0 on success or -1 if the waveform is active or the size is out of range
+int waveform_set_max_payload(struct waveform_t* waveform, size_t bytes);
+
+/// @brief Gets the largest VITA-49 payload the waveform can currently send
+/// @details This is the size set with waveform_set_max_payload() limited by the MTU of the route to the radio, which
+///          is only known while the waveform is active.
+/// @param waveform The waveform to query
+/// @returns The largest payload in bytes
+size_t waveform_get_max_send_payload(struct waveform_t* waveform);
+
+/// @brief Configures the queue for outgoing packets
+/// @details When the VITA socket's send buffer is full, outgoing data and meter packets wait in a queue and are
+///          written as soon as the socket becomes writable instead of being dropped.  Packets sent while others
+///          are waiting go to the back of the queue so the stream stays in order.  When the queue itself is full
+///          the drop policy decides which packet is discarded.  The default is a depth of 32 packets with
+///          WF_TX_DROP_OLDEST.  This must be called before the waveform becomes active.
+/// @param waveform The waveform to configure
+/// @param depth The number of packets the queue holds.  Rounded up to a power of two.
+/// @param policy Which packet to discard when the queue is full
+/// @returns 0 on success or -1 if the waveform is active or the arguments are invalid
+int waveform_set_tx_queue(struct waveform_t* waveform, unsigned int depth, enum waveform_tx_drop_policy policy);
+
+/// @brief Gets statistics for outgoing packets
+/// @details The statistics are cumulative for the lifetime of the waveform.
+/// @param waveform The waveform to query
+/// @param stats A user-provided structure in which to store the statistics
+void waveform_get_tx_stats(struct waveform_t* waveform, struct waveform_tx_stats* stats);
+
+/// @brief Reports the kind of pages backing one of the library's large blocks of memory
+/// @details Large blocks are mapped with explicit huge pages if any have been reserved (see vm.nr_hugepages),
+///          otherwise with transparent huge pages if the kernel supports them, and otherwise with normal pages.
+///          Huge pages reduce TLB misses on the data path.  The backing is also logged at WF_LOG_INFO.
+/// @param waveform The waveform to query
+/// @param region The block of memory to query
+/// @returns The backing of the block, or WF_MEMORY_NONE if it isn't allocated
+enum waveform_memory_backing waveform_get_memory_backing(struct waveform_t* waveform, enum waveform_memory_region region);
+
+/// @brief Gets statistics for a data callback lane
+/// @details The statistics are cumulative for the lifetime of the waveform and are summed across all of the data
+///          callback workers.  The maximum depth is the largest depth seen by any single worker.
+/// @param waveform The waveform to query
+/// @param lane The lane to query
+/// @param stats A user-provided structure in which to store the statistics
+/// @returns 0 on success or -1 for an invalid lane
+int waveform_get_data_lane_stats(struct waveform_t* waveform, enum waveform_data_lane lane, struct waveform_lane_stats* stats);
+
+/// @brief Gets the memory use of a part of the library
+/// @details The library charges every block it allocates to the part it is for, including the mapped blocks of the
+///          data queues, the strings the library builds and buffers handed over by libevent, so a change in the
+///          memory or allocation rate of a path is seen here straight away.  The counters are for the whole process,
+///          across all radios and waveforms.
+/// @param tag The part of the library to query
+/// @param stats A user-provided structure in which to store the statistics
+/// @returns 0 on success or -1 for an invalid tag
+int waveform_get_alloc_stats(enum waveform_alloc_tag tag, struct waveform_alloc_stats* stats);
+
+/// @brief Gets the latest metadata a stream has sent in context packets
+/// @details Context packets are decoded by the VITA loop as they arrive, so a change to the stream is seen here in
+///          step with its data rather than when the radio gets around to a status message.  The copy is consistent:
+///          it never mixes fields from two context packets.  It takes no lock and is safe to call from any thread,
+///          including from data callbacks.  Up to 8 streams are tracked from when the waveform becomes active.
+/// @param waveform The waveform to query
+/// @param stream_id The stream to get the context of
+/// @param context A user-provided structure in which to store the context
+/// @returns 0 on success or -1 if no context packet has been received for the stream
+int waveform_get_stream_context(struct waveform_t* waveform, uint32_t stream_id, struct waveform_stream_context* context);
+
+/// @brief Converts an index on the sample timeline of a stream to radio time
+/// @details The library counts the frames of every sample stream from the first packet it receives after the
+///          waveform becomes active, handing the count to data callbacks in struct waveform_packet_info.  Lost
+///          packets are detected from the timestamps and sequence numbers and skipped over, so an index always
+///          refers to the same instant however many packets were dropped before it.  The conversion is anchored
+///          to the most recent packet timestamp the timeline agrees with.  It takes no lock and is safe to call
+///          from any thread.  Up to 8 streams are tracked.
+/// @param waveform The waveform the stream belongs to
+/// @param stream_id The stream
+/// @param sample_index The frame index, as in waveform_packet_sample_index()
+/// @param ts A user-provided structure in which to store the radio time of the frame
+/// @returns 0 on success or -1 if no timestamped packet has been received for the stream
+int waveform_sample_to_time(struct waveform_t* waveform, uint32_t stream_id, uint64_t sample_index, struct timespec* ts);
+
+/// @brief Converts a radio time to an index on the sample timeline of a stream
+/// @details The inverse of waveform_sample_to_time(), rounded to the nearest frame.  Useful for finding the
+///          samples a timed command will affect.
+/// @param waveform The waveform the stream belongs to
+/// @param stream_id The stream
+/// @param ts The radio time, as from waveform_packet_ts()
+/// @param sample_index Where to store the frame index
+/// @returns 0 on success, or -1 if no timestamped packet has been received for the stream or the time is before
+///          its first frame
+int waveform_time_to_sample(struct waveform_t* waveform, uint32_t stream_id, const struct timespec* ts, uint64_t* sample_index);
+
+/// @brief Gets the decoded header of a packet passed to a data callback
+/// @details Only valid for the packet pointer the library passes to a waveform_data_cb_t, not for copies of the
+///          packet made elsewhere.  The information lives as long as the packet does.
+/// @param packet A packet returned from the radio in the waveform_data_cb_t callback.
+/// @returns The decoded header
+static inline const struct waveform_packet_info* get_packet_info(const struct waveform_vita_packet* packet)
+{
+   return (const struct waveform_packet_info*) ((const char*) packet - sizeof(struct waveform_packet_info));
+}
+
+/// @brief Gets the samples of a decoded packet of 32-bit floats
+/// @param info The decoded header from get_packet_info()
+/// @returns The payload as an array of floating point samples, interleaved by channel, or NULL if the samples
+///          aren't 32-bit floats
+static inline float* waveform_packet_samples(const struct waveform_packet_info* info)
+{
+   return (info->flags & WF_PACKET_IS_FLOAT) && info->bits_per_sample == 32 ? (float*) info->payload : NULL;
+}
+
+/// @brief Gets the samples of a decoded packet of 16-bit integers
+/// @details Only receive and transmit callbacks of a waveform that called waveform_set_integer_samples() are
+///          passed these.
+/// @param info The decoded header from get_packet_info()
+/// @returns The payload as an array of integer samples, interleaved by channel, or NULL if the samples aren't
+///          16-bit integers
+static inline int16_t* waveform_packet_samples_i16(const struct waveform_packet_info* info)
+{
+   return !(info->flags & WF_PACKET_IS_FLOAT) && info->bits_per_sample == 16 ? (int16_t*) info->payload : NULL;
+}
+
+/// @brief Gets the samples of a decoded packet of 32-bit integers
+/// @details Only receive and transmit callbacks of a waveform that called waveform_set_integer_samples() are
+///          passed these.
+/// @param info The decoded header from get_packet_info()
+/// @returns The payload as an array of integer samples, interleaved by channel, or NULL if the samples aren't
+///          32-bit integers
+static inline int32_t* waveform_packet_samples_i32(const struct waveform_packet_info* info)
+{
+   return !(info->flags & WF_PACKET_IS_FLOAT) && info->bits_per_sample == 32 ? (int32_t*) info->payload : NULL;
+}
+
+/// @brief Gets the number of samples in a decoded packet
+/// @param info The decoded header from get_packet_info()
+/// @returns The number of samples, counting each channel separately
+static inline uint32_t waveform_packet_num_samples(const struct waveform_packet_info* info)
+{
+   return info->num_samples;
+}
+
+/// @brief Gets the number of frames in a decoded packet
+/// @param info The decoded header from get_packet_info()
+/// @returns The number of frames, each holding one sample per channel
+static inline uint32_t waveform_packet_num_frames(const struct waveform_packet_info* info)
+{
+   return info->num_samples / info->channels;
+}
+
+/// @brief Gets the position of a decoded packet on the sample timeline of its stream
+/// @details Only meaningful if WF_PACKET_HAS_SAMPLE_INDEX is set in the flags, which it is for receive and transmit
+///          data.  See waveform_sample_to_time().
+/// @param info The decoded header from get_packet_info()
+/// @returns The index of the first frame of the packet, counted from the first packet of the stream
+static inline uint64_t waveform_packet_sample_index(const struct waveform_packet_info* info)
+{
+   return info->sample_index;
+}
+
+/// @brief Gets the stream ID of a decoded packet
+/// @param info The decoded header from get_packet_info()
+/// @returns The stream ID
+static inline uint32_t waveform_packet_stream_id(const struct waveform_packet_info* info)
+{
+   return info->stream_id;
+}
+
+/// @brief Gets the timestamp of a decoded packet
+/// @details The fractional part is treated as picoseconds, as with get_packet_ts().
+/// @param info The decoded header from get_packet_info()
+/// @param ts A user-provided structure in which to store the timestamp
+static inline void waveform_packet_ts(const struct waveform_packet_info* info, struct timespec* ts)
+{
+   ts->tv_sec = info->timestamp_int;
+   ts->tv_nsec = (long) (info->timestamp_frac / 1000);
+}
+
 /// @brief Gets the length of a received packet
 /// @details Returns the length of the data in a packet received from the radio.
 /// @param packet A packet returned from the radio in the waveform_data_cb_t callback.
@@ -396,10 +1044,12 @@ uint16_t get_packet_len(struct waveform_vita_packet* packet);
 /// @brief Get the packet data
 /// @details Returns an array of floating point values representing either L/R or I/Q pairs depending on the underlying
 ///          mode.  The length of the array returned can be ascertained by calling get_packet_len().  The data in the
-///          returned array will be freed when the callback returns to the library.
+///          returned array will be freed when the callback returns to the library.  Packets of integer samples, see
+///          waveform_set_integer_samples(), are read with waveform_packet_samples_i16() or
+///          waveform_packet_samples_i32() instead.
 /// @param packet A packet returned from the radio in the waveform_data_cb_t callback.
 /// @returns 32-bit floating point values from the radio represening data from the microphone or receiver in host byte
-///          order.
+///          order, or NULL if the packet doesn't hold 32-bit floats.
 float* get_packet_data(struct waveform_vita_packet* packet);
 
 /// @brief Gets the integer timestamp from a received packet.
@@ -495,4 +1145,8 @@ uint8_t* get_packet_byte_data(struct waveform_vita_packet* packet);
 /// @returns An unsigned integer representing the number of bytes in the array returned by get_packet_byte_data()
 uint32_t get_packet_byte_data_length(struct waveform_vita_packet* packet);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif//WAVEFORM_SDK_WAVEFORM_H
\ No newline at end of file
@@ -0,0 +1,573 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_coro.hpp
+/// @brief C++20 coroutine interface for the waveform API
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_CORO_HPP
+#define WAVEFORM_SDK_WAVEFORM_CORO_HPP
+
+//  Coroutines on top of waveform.hpp, so a sequence of commands reads top to bottom instead of being
+//  chained through response callbacks and context structs.  A flex::task is started with flex::spawn()
+//  and runs on the radio's event loop, posted there with waveform_radio_post(), and every await resumes
+//  it there again, so a task never races itself or the library's command handling.  Frames come from a
+//  per-thread pool of recycled blocks, and the awaitables live inside the frame, so awaiting never
+//  allocates.
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "waveform.hpp"
+
+namespace flex
+{
+
+namespace detail
+{
+
+/// @brief Recycles coroutine frames through per-thread free lists, one per 64 byte size class
+/// @details A frame freed on another thread than the one that allocated it simply joins that thread's
+///          list, which is the usual case as tasks are started by the application and end on the event loop.
+class frame_pool
+{
+public:
+   static void* allocate(std::size_t size)
+   {
+      std::size_t size_class = class_of(size);
+      if (size_class >= classes)
+      {
+         return ::operator new(size);
+      }
+
+      free_list& list = lists()[size_class];
+      if (list.head)
+      {
+         node* block = list.head;
+         list.head = block->next;
+         --list.count;
+         return block;
+      }
+      return ::operator new((size_class + 1) * granularity);
+   }
+
+   static void deallocate(void* ptr, std::size_t size) noexcept
+   {
+      std::size_t size_class = class_of(size);
+      if (size_class >= classes)
+      {
+         ::operator delete(ptr);
+         return;
+      }
+
+      free_list& list = lists()[size_class];
+      if (list.count >= max_cached)
+      {
+         ::operator delete(ptr);
+         return;
+      }
+
+      node* block = static_cast<node*>(ptr);
+      block->next = list.head;
+      list.head = block;
+      ++list.count;
+   }
+
+private:
+   struct node {
+      node* next;
+   };
+
+   struct free_list {
+      node* head = nullptr;
+      std::size_t count = 0;
+
+      ~free_list()
+      {
+         while (head)
+         {
+            node* block = head;
+            head = block->next;
+            ::operator delete(block);
+         }
+      }
+   };
+
+   static constexpr std::size_t granularity = 64;
+   static constexpr std::size_t classes = 32;
+   static constexpr std::size_t max_cached = 64;
+
+   static std::size_t class_of(std::size_t size) noexcept
+   {
+      return size == 0 ? 0 : (size - 1) / granularity;
+   }
+
+   static free_list* lists() noexcept
+   {
+      thread_local free_list pool[classes];
+      return pool;
+   }
+};
+
+inline void resume_cb(void* address)
+{
+   std::coroutine_handle<>::from_address(address).resume();
+}
+
+/// @brief Resumes a coroutine on the radio's event loop
+/// @details If the resumption can't be queued the coroutine is resumed right here, which is late in
+///          the wrong place rather than never.
+inline void post_resume(struct radio_t* radio, std::coroutine_handle<> handle) noexcept
+{
+   if (waveform_radio_post(radio, resume_cb, handle.address()) == -1)
+   {
+      handle.resume();
+   }
+}
+
+}// namespace detail
+
+/// @brief A coroutine that runs on a radio's event loop, started with flex::spawn()
+/// @details Tasks are detached: once spawned nothing waits for them and the frame is freed when the body
+///          returns.  The body must not block, since the radio can't send or receive while it runs, and
+///          an exception escaping it terminates the program.
+class task
+{
+public:
+   struct promise_type {
+      struct radio_t* radio = nullptr;
+
+      task get_return_object() noexcept
+      {
+         return task(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      std::suspend_always initial_suspend() noexcept
+      {
+         return {};
+      }
+
+      std::suspend_never final_suspend() noexcept
+      {
+         return {};
+      }
+
+      void return_void() noexcept
+      {
+      }
+
+      void unhandled_exception() noexcept
+      {
+         std::terminate();
+      }
+
+      static void* operator new(std::size_t size)
+      {
+         return detail::frame_pool::allocate(size);
+      }
+
+      static void operator delete(void* ptr, std::size_t size) noexcept
+      {
+         detail::frame_pool::deallocate(ptr, size);
+      }
+   };
+
+   using handle = std::coroutine_handle<promise_type>;
+
+   task(const task&) = delete;
+   task& operator=(const task&) = delete;
+   task(task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr))
+   {
+   }
+
+   task& operator=(task&& other) noexcept
+   {
+      std::swap(handle_, other.handle_);
+      return *this;
+   }
+
+   //  Only a task that was never spawned still owns its frame.
+   ~task()
+   {
+      if (handle_)
+      {
+         handle_.destroy();
+      }
+   }
+
+private:
+   friend int spawn(radio& owner, task t);
+
+   explicit task(handle h) noexcept : handle_(h)
+   {
+   }
+
+   handle handle_;
+};
+
+/// @brief Starts a task on the radio's event loop
+/// @details The task runs once the event loop gets to it, or once the radio is started if it hasn't been.
+/// @returns 0 on success or -1 if the task couldn't be queued, in which case it is destroyed without running
+inline int spawn(radio& owner, task t)
+{
+   task::handle h = std::exchange(t.handle_, nullptr);
+
+   h.promise().radio = owner.get();
+   if (waveform_radio_post(owner.get(), detail::resume_cb, h.address()) == -1)
+   {
+      h.destroy();
+      return -1;
+   }
+   return 0;
+}
+
+/// @brief The radio's response to a command
+struct response {
+   bool sent = false;     ///< False if the command couldn't be queued, in which case nothing else is set
+   unsigned int code = 0; ///< The radio's result code, 0 on success
+   std::string message;   ///< The message accompanying the result code
+};
+
+/// @brief Awaitable returned by flex::send_command()
+template<typename... Args>
+class command_awaiter
+{
+public:
+   command_awaiter(waveform_ref wf, const char* format, Args... args) : wf_(wf), format_(format), args_(args...)
+   {
+   }
+
+   bool await_ready() const noexcept
+   {
+      return false;
+   }
+
+   //  The response arrives on a library thread, but the resumption it posts can't run until this has returned
+   //  to the event loop we are running on, so there is no window where it could resume the task early.
+   bool await_suspend(task::handle h) noexcept
+   {
+      handle_ = h;
+      radio_ = h.promise().radio;
+
+      std::int32_t sequence = std::apply(
+              [this](Args... args) {
+                 return waveform_send_api_command_cb(wf_.get(), response_cb, this, const_cast<char*>(format_), args...);
+              },
+              args_);
+      return sequence != -1;
+   }
+
+   response await_resume() noexcept
+   {
+      return std::move(result_);
+   }
+
+private:
+   static void response_cb(struct waveform_t*, unsigned int code, char* message, void* arg)
+   {
+      auto* self = static_cast<command_awaiter*>(arg);
+
+      self->result_.sent = true;
+      self->result_.code = code;
+      self->result_.message = message ? message : "";
+      detail::post_resume(self->radio_, self->handle_);
+   }
+
+   waveform_ref wf_;
+   const char* format_;
+   std::tuple<Args...> args_;
+   std::coroutine_handle<> handle_;
+   struct radio_t* radio_ = nullptr;
+   response result_;
+};
+
+/// @brief Sends a command to the radio and suspends the task until it responds
+/// @details The arguments are as for waveform_send_api_command_cb().  If the radio disconnects before
+///          responding the task stays suspended.
+/// @returns An awaitable producing a flex::response
+template<typename... Args>
+command_awaiter<Args...> send_command(waveform_ref wf, const char* format, Args... args)
+{
+   return command_awaiter<Args...>(wf, format, args...);
+}
+
+namespace detail
+{
+
+/// @brief Hands values from library callbacks to one awaiting task at a time
+/// @details Values nobody is waiting for are queued up to a limit, past which the oldest are dropped.
+template<typename T>
+class channel
+{
+public:
+   explicit channel(std::size_t limit) : limit_(limit)
+   {
+   }
+
+   void push(T value)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      if (waiter_)
+      {
+         *slot_ = std::move(value);
+         std::coroutine_handle<> h = std::exchange(waiter_, nullptr);
+         struct radio_t* radio = radio_;
+         lock.unlock();
+         post_resume(radio, h);
+         return;
+      }
+
+      if (queue_.size() >= limit_)
+      {
+         queue_.pop_front();
+         ++dropped_;
+      }
+      queue_.push_back(std::move(value));
+   }
+
+   std::uint64_t dropped()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return dropped_;
+   }
+
+   class awaiter
+   {
+   public:
+      explicit awaiter(channel& ch) noexcept : channel_(ch)
+      {
+      }
+
+      bool await_ready() const noexcept
+      {
+         return false;
+      }
+
+      bool await_suspend(task::handle h)
+      {
+         std::lock_guard<std::mutex> lock(channel_.mutex_);
+
+         if (!channel_.queue_.empty())
+         {
+            value_ = std::move(channel_.queue_.front());
+            channel_.queue_.pop_front();
+            return false;
+         }
+
+         channel_.waiter_ = h;
+         channel_.radio_ = h.promise().radio;
+         channel_.slot_ = &value_;
+         return true;
+      }
+
+      T await_resume()
+      {
+         return std::move(*value_);
+      }
+
+   private:
+      channel& channel_;
+      std::optional<T> value_;
+   };
+
+private:
+   std::mutex mutex_;
+   std::deque<T> queue_;
+   std::size_t limit_;
+   std::uint64_t dropped_ = 0;
+   std::coroutine_handle<> waiter_;
+   struct radio_t* radio_ = nullptr;
+   std::optional<T>* slot_ = nullptr;
+};
+
+}// namespace detail
+
+/// @brief Lets a task await the waveform's state transitions
+/// @details Registers a state callable on the waveform, which is kept for the life of the waveform.  Only one
+///          task may await next() at a time.
+class state_events
+{
+public:
+   explicit state_events(waveform& wf, std::size_t limit = 16)
+       : channel_(std::make_shared<detail::channel<enum waveform_state>>(limit))
+   {
+      if (wf.on_state([ch = channel_](waveform_ref, enum waveform_state state) { ch->push(state); }) == -1)
+      {
+         throw std::runtime_error("Couldn't register state callback");
+      }
+   }
+
+   /// @returns An awaitable producing the next state the waveform enters
+   detail::channel<enum waveform_state>::awaiter next() noexcept
+   {
+      return detail::channel<enum waveform_state>::awaiter(*channel_);
+   }
+
+private:
+   std::shared_ptr<detail::channel<enum waveform_state>> channel_;
+};
+
+/// @brief Samples of consecutive packets of a stream, copied out of the library's buffers
+/// @details Integer samples are converted to floats with a full scale of 1.0, like the radio's float streams.
+struct packet_batch {
+   std::vector<float> samples;///< The samples of each packet one after the other, interleaved by channel
+   std::size_t packets = 0;   ///< The number of packets in the batch
+   std::uint32_t stream_id = 0;
+   std::uint32_t sample_rate = 0;
+   struct timespec timestamp = {};///< The timestamp of the first packet in the batch
+   std::uint64_t sample_index = 0;///< The index of the first frame of the batch on the timeline of the stream
+};
+
+/// @brief Lets a task await data packets a batch at a time
+/// @details Registers a data callable for the lane on the waveform, which copies the samples of each packet
+///          into the batch being filled and hands it over once it holds the requested number of packets.  If
+///          the task falls more than @p limit batches behind the oldest are dropped.  Only one task may await
+///          next() at a time, and a stream is assumed to be delivered on one data thread, which is the case
+///          unless the waveform spreads its callbacks over several with waveform_set_data_workers().
+class packet_batches
+{
+public:
+   /// @throws std::invalid_argument if the lane doesn't carry samples
+   /// @throws std::runtime_error if the callable couldn't be registered
+   packet_batches(waveform& wf, enum waveform_data_lane lane, std::size_t packets_per_batch, std::size_t limit = 4)
+       : state_(std::make_shared<state>(packets_per_batch, limit))
+   {
+      auto collect = [s = state_](waveform_ref, const packet& pkt) { s->add(pkt); };
+      int ret;
+
+      switch (lane)
+      {
+         case WF_DATA_LANE_RX:
+            ret = wf.on_rx_data(std::move(collect));
+            break;
+         case WF_DATA_LANE_TX:
+            ret = wf.on_tx_data(std::move(collect));
+            break;
+         default:
+            throw std::invalid_argument("Only the receive and transmit lanes carry samples");
+      }
+
+      if (ret == -1)
+      {
+         throw std::runtime_error("Couldn't register data callback");
+      }
+   }
+
+   /// @returns An awaitable producing the next full flex::packet_batch
+   detail::channel<packet_batch>::awaiter next() noexcept
+   {
+      return detail::channel<packet_batch>::awaiter(state_->ready);
+   }
+
+   /// @brief Returns a batch's storage to be filled again, so steady state batches don't allocate
+   void recycle(packet_batch&& batch)
+   {
+      std::lock_guard<std::mutex> lock(state_->spares_lock);
+      if (state_->spares.size() < state_->limit)
+      {
+         state_->spares.push_back(std::move(batch.samples));
+      }
+   }
+
+   /// @returns The number of batches dropped because the task fell behind
+   std::uint64_t dropped()
+   {
+      return state_->ready.dropped();
+   }
+
+private:
+   struct state {
+      state(std::size_t packets_per_batch, std::size_t limit)
+          : ready(limit), packets_per_batch(packets_per_batch ? packets_per_batch : 1), limit(limit)
+      {
+      }
+
+      void add(const packet& pkt)
+      {
+         if (filling.packets == 0)
+         {
+            take_spare();
+            filling.stream_id = pkt.stream_id();
+            filling.sample_rate = pkt.sample_rate();
+            filling.timestamp = pkt.timestamp();
+            filling.sample_index = pkt.sample_index();
+         }
+
+         //  Integer samples, see waveform_set_integer_samples(), are scaled to the same full scale of 1.0
+         //  as the float streams.
+         if (pkt.info().flags & WF_PACKET_IS_FLOAT)
+         {
+            span<const float> samples = pkt.samples();
+            filling.samples.insert(filling.samples.end(), samples.begin(), samples.end());
+         }
+         else if (pkt.info().bits_per_sample == 16)
+         {
+            for (std::int16_t sample : pkt.samples_i16())
+            {
+               filling.samples.push_back(static_cast<float>(sample) * (1.0f / 32768.0f));
+            }
+         }
+         else
+         {
+            for (std::int32_t sample : pkt.samples_i32())
+            {
+               filling.samples.push_back(static_cast<float>(sample) * (1.0f / 2147483648.0f));
+            }
+         }
+
+         if (++filling.packets == packets_per_batch)
+         {
+            ready.push(std::exchange(filling, packet_batch()));
+         }
+      }
+
+      void take_spare()
+      {
+         std::lock_guard<std::mutex> lock(spares_lock);
+         if (!spares.empty())
+         {
+            filling.samples = std::move(spares.back());
+            filling.samples.clear();
+            spares.pop_back();
+         }
+      }
+
+      detail::channel<packet_batch> ready;
+      std::size_t packets_per_batch;
+      std::size_t limit;
+      packet_batch filling;
+      std::mutex spares_lock;
+      std::vector<std::vector<float>> spares;
+   };
+
+   std::shared_ptr<state> state_;
+};
+
+}// namespace flex
+
+#endif//WAVEFORM_SDK_WAVEFORM_CORO_HPP
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_format.h
+/// @brief Compile time descriptors of the VITA-49 packet formats exchanged with the radio
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_FORMAT_H
+#define WAVEFORM_SDK_WAVEFORM_FORMAT_H
+
+//  Every packet format the radio and a waveform exchange is fixed when the code is written, so its
+//  header words are spelled out here as constant expressions in host byte order.  Writing a header is
+//  then a few stores of constants, and recognising a packet is one mask and compare of its format key,
+//  the first and fourth header words side by side.
+//
+//  A format NAME is described by four macros:
+//  - NAME_WORD0: the first header word without the sequence number and packet size
+//  - NAME_CLASS: the 16-bit packet class, with a sample rate code of 0 where the rate varies
+//  - NAME_CLASS_MASK: the bits of the packet class that identify the format
+//  - NAME_HEADER_WORDS: the size of the header in 32-bit words
+//  and used through the WF_FORMAT_* macros taking NAME.  waveform_format.hpp makes types of them for C++.
+
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief The FlexRadio OUI carried in the class ID of every packet
+#define WF_VITA_OUI 0x00001c2dU
+/// @brief The information class of every packet exchanged with the radio
+#define WF_VITA_INFORMATION_CLASS 0x534cU
+
+/// @brief IF data packet with a stream ID, carrying samples
+#define WF_VITA_TYPE_IF_DATA 0x1U
+/// @brief Extension data packet with a stream ID, carrying anything else
+#define WF_VITA_TYPE_EXT_DATA 0x3U
+/// @brief No integer timestamp
+#define WF_VITA_TSI_NONE 0x0U
+/// @brief Integer timestamp in seconds since the UTC epoch
+#define WF_VITA_TSI_UTC 0x1U
+/// @brief No fractional timestamp
+#define WF_VITA_TSF_NONE 0x0U
+/// @brief Fractional timestamp in picoseconds
+#define WF_VITA_TSF_REAL_TIME 0x2U
+
+/// @brief Builds the first header word, for a packet with a class ID, without the sequence number and packet size
+#define WF_VITA_WORD0(type, tsi, tsf) \
+   (((uint32_t) (type) << 28) | (1U << 27) | ((uint32_t) (tsi) << 22) | ((uint32_t) (tsf) << 20))
+/// @brief The bits of the first header word that identify a format: the packet type and class ID present flag
+#define WF_VITA_WORD0_FORMAT_MASK 0xf8000000U
+/// @brief Places a packet sequence number in the first header word
+#define WF_VITA_WORD0_SEQUENCE(sequence) (((uint32_t) (sequence) & 0xfU) << 16)
+
+/// @brief Builds a 16-bit packet class
+/// @param is_audio 1 for audio, 0 for IQ
+/// @param is_float 1 for IEEE-754 floats, 0 for integers
+/// @param bits The bits per sample: 8, 16, 24 or 32
+/// @param channels The samples per frame: 1 or 2
+/// @param rate_code The sample rate code
+#define WF_VITA_PACKET_CLASS(is_audio, is_float, bits, channels, rate_code)                            \
+   (((uint32_t) (is_float) << 9) | ((uint32_t) (is_audio) << 8) | (((uint32_t) (channels) - 1) << 7) | \
+    (((uint32_t) (bits) / 8 - 1) << 5) | (uint32_t) (rate_code))
+/// @brief The sample rate code in a packet class
+#define WF_VITA_CLASS_RATE_MASK 0x001fU
+/// @brief Builds the fourth header word, the information class followed by the packet class
+#define WF_VITA_CLASS_WORD(packet_class) ((WF_VITA_INFORMATION_CLASS << 16) | (uint32_t) (packet_class))
+
+/// @brief Two channel 32-bit float samples, audio as sent to the radio.  Received IQ matches as well.
+#define WF_FORMAT_FLOAT_STEREO_WORD0 WF_VITA_WORD0(WF_VITA_TYPE_IF_DATA, WF_VITA_TSI_UTC, WF_VITA_TSF_REAL_TIME)
+#define WF_FORMAT_FLOAT_STEREO_CLASS WF_VITA_PACKET_CLASS(1, 1, 32, 2, 0)
+#define WF_FORMAT_FLOAT_STEREO_CLASS_MASK 0x02e0U
+#define WF_FORMAT_FLOAT_STEREO_HEADER_WORDS 7
+
+/// @brief Two channel 16 or 32-bit integer samples, audio or IQ
+#define WF_FORMAT_INT_STEREO_WORD0 WF_VITA_WORD0(WF_VITA_TYPE_IF_DATA, WF_VITA_TSI_UTC, WF_VITA_TSF_REAL_TIME)
+#define WF_FORMAT_INT_STEREO_CLASS WF_VITA_PACKET_CLASS(0, 0, 16, 2, 0)
+#define WF_FORMAT_INT_STEREO_CLASS_MASK 0x02a0U
+#define WF_FORMAT_INT_STEREO_HEADER_WORDS 7
+
+/// @brief Opaque bytes, preceded in the payload by a word holding their length
+#define WF_FORMAT_BYTE_DATA_WORD0 WF_VITA_WORD0(WF_VITA_TYPE_EXT_DATA, WF_VITA_TSI_UTC, WF_VITA_TSF_REAL_TIME)
+#define WF_FORMAT_BYTE_DATA_CLASS WF_VITA_PACKET_CLASS(1, 0, 8, 1, 0)
+#define WF_FORMAT_BYTE_DATA_CLASS_MASK 0x03ffU
+#define WF_FORMAT_BYTE_DATA_HEADER_WORDS 7
+
+/// @brief Meter values, pairs of 16-bit meter IDs and values, without a timestamp
+#define WF_FORMAT_METER_WORD0 WF_VITA_WORD0(WF_VITA_TYPE_EXT_DATA, WF_VITA_TSI_NONE, WF_VITA_TSF_NONE)
+#define WF_FORMAT_METER_CLASS 0x8002U
+#define WF_FORMAT_METER_CLASS_MASK 0xffffU
+#define WF_FORMAT_METER_HEADER_WORDS 4
+
+/// @brief Puts the first and fourth header words of a packet, in host byte order, side by side
+#define WF_FORMAT_KEY(word0, class_word) (((uint64_t) (word0) << 32) | (uint32_t) (class_word))
+/// @brief The bits of a format key that identify a format
+#define WF_FORMAT_KEY_MASK(format) WF_FORMAT_KEY(WF_VITA_WORD0_FORMAT_MASK, 0xffff0000U | format##_CLASS_MASK)
+/// @brief The identifying bits of the format key of every packet of a format
+#define WF_FORMAT_KEY_VALUE(format) \
+   (WF_FORMAT_KEY(format##_WORD0, WF_VITA_CLASS_WORD(format##_CLASS)) & WF_FORMAT_KEY_MASK(format))
+/// @brief Tests whether a format key from waveform_format_key() is of a format
+#define WF_FORMAT_MATCHES(format, key) (((key) & WF_FORMAT_KEY_MASK(format)) == WF_FORMAT_KEY_VALUE(format))
+
+/// @brief The first header word of a packet of a format, in host byte order
+/// @param format The format
+/// @param sequence The packet sequence number
+/// @param packet_words The size of the whole packet in 32-bit words
+#define WF_FORMAT_HEADER_WORD0(format, sequence, packet_words) \
+   (format##_WORD0 | WF_VITA_WORD0_SEQUENCE(sequence) | ((uint32_t) (packet_words) & 0xffffU))
+/// @brief The fourth header word of a packet of a format, in host byte order
+/// @param format The format
+/// @param rate_code The sample rate code, for formats whose rate varies
+#define WF_FORMAT_CLASS_WORD(format, rate_code) \
+   WF_VITA_CLASS_WORD(format##_CLASS | ((uint32_t) (rate_code) & WF_VITA_CLASS_RATE_MASK))
+
+/// @brief Gets the format key of a packet as it arrived from the network
+/// @param packet The packet in network byte order, at least four words long
+/// @returns The first and fourth header words for WF_FORMAT_MATCHES()
+static inline uint64_t waveform_format_key(const void* packet)
+{
+   const uint32_t* words = (const uint32_t*) packet;
+
+   return WF_FORMAT_KEY(ntohl(words[0]), ntohl(words[3]));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//WAVEFORM_SDK_WAVEFORM_FORMAT_H
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_format.hpp
+/// @brief Compile time VITA-49 packet format types for C++
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_FORMAT_HPP
+#define WAVEFORM_SDK_WAVEFORM_FORMAT_HPP
+
+//  The descriptors of waveform_format.h as types.  Each format is a specialization of flex::vita_format
+//  whose header words, masks and byte swapped constants are all computed by the compiler, so its
+//  encode() and decode() come down to the stores and the single compare the format needs.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include "waveform.hpp"
+#include "waveform_format.h"
+
+namespace flex
+{
+
+namespace detail
+{
+
+constexpr std::uint32_t to_be32(std::uint32_t value) noexcept
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   return __builtin_bswap32(value);
+#else
+   return value;
+#endif
+}
+
+constexpr std::uint64_t to_be64(std::uint64_t value) noexcept
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   return __builtin_bswap64(value);
+#else
+   return value;
+#endif
+}
+
+}// namespace detail
+
+/// @brief A VITA-49 packet format fixed at compile time
+/// @details Instantiated from the macros of a format in waveform_format.h with WF_FORMAT_TYPE(), or use one of the
+///          aliases below.  Packets are arrays of 32-bit words in network byte order, as they go over the network.
+template<std::uint32_t Word0, std::uint16_t Class, std::uint16_t ClassMask, std::size_t HeaderWords>
+struct vita_format {
+   /// @brief The size of the header in 32-bit words
+   static constexpr std::size_t header_words = HeaderWords;
+   /// @brief Whether packets of the format carry a timestamp
+   static constexpr bool has_timestamp = HeaderWords > WF_FORMAT_METER_HEADER_WORDS;
+   /// @brief The bits of a format key that identify the format
+   static constexpr std::uint64_t key_mask = WF_FORMAT_KEY(WF_VITA_WORD0_FORMAT_MASK, 0xffff0000U | ClassMask);
+   /// @brief The identifying bits of the format key of every packet of the format
+   static constexpr std::uint64_t key = WF_FORMAT_KEY(Word0, WF_VITA_CLASS_WORD(Class)) & key_mask;
+
+   /// @brief Tests a format key from waveform_format_key()
+   static constexpr bool matches(std::uint64_t format_key) noexcept
+   {
+      return (format_key & key_mask) == key;
+   }
+
+   /// @brief Tests a packet passed to a data callback
+   /// @details The library has already taken the header apart, so only the class ID is compared.
+   static bool matches(const packet& pkt) noexcept
+   {
+      constexpr std::uint64_t class_mask = (std::uint64_t{0xffffffffU} << 32) | (key_mask & 0xffffffffU);
+      constexpr std::uint64_t class_key = (std::uint64_t{WF_VITA_OUI} << 32) | (key & 0xffffffffU);
+
+      return (pkt.info().class_id & class_mask) == class_key;
+   }
+
+   /// @brief Writes the header of a packet
+   /// @param words The packet, with room for header_words + payload_words words
+   /// @param stream_id The stream ID
+   /// @param sequence The packet sequence number
+   /// @param payload_words The size of the payload in 32-bit words
+   /// @param rate_code The sample rate code, for formats whose rate varies
+   /// @param ts The time to stamp the packet with, ignored for formats without a timestamp
+   /// @returns The size of the whole packet in 32-bit words
+   static std::size_t encode(std::uint32_t* words, std::uint32_t stream_id, std::uint8_t sequence,
+                             std::size_t payload_words, unsigned int rate_code = 0,
+                             const struct timespec& ts = {}) noexcept
+   {
+      std::size_t packet_words = header_words + payload_words;
+
+      words[0] = detail::to_be32(Word0 | WF_VITA_WORD0_SEQUENCE(sequence) | (std::uint32_t(packet_words) & 0xffffU));
+      words[1] = detail::to_be32(stream_id);
+      words[2] = detail::to_be32(WF_VITA_OUI);
+      words[3] = detail::to_be32(WF_VITA_CLASS_WORD(Class | (rate_code & WF_VITA_CLASS_RATE_MASK)));
+      if constexpr (has_timestamp)
+      {
+         std::uint64_t frac = detail::to_be64(std::uint64_t(ts.tv_nsec) * 1000);
+
+         words[4] = detail::to_be32(std::uint32_t(ts.tv_sec));
+         std::memcpy(&words[5], &frac, sizeof(frac));
+      }
+      return packet_words;
+   }
+
+   /// @brief Checks that a packet is of the format and finds its payload
+   /// @param words The packet
+   /// @param size The size of the packet in bytes, as received
+   /// @returns The payload, still in network byte order, or an empty span if the packet isn't of the format or its
+   ///          size doesn't agree with its header
+   static span<const std::uint32_t> decode(const std::uint32_t* words, std::size_t size) noexcept
+   {
+      if (size < header_words * sizeof(std::uint32_t) || size % sizeof(std::uint32_t) != 0 ||
+          !matches(WF_FORMAT_KEY(detail::to_be32(words[0]), detail::to_be32(words[3]))) ||
+          (detail::to_be32(words[0]) & 0xffffU) != size / sizeof(std::uint32_t))
+      {
+         return {};
+      }
+      return {words + header_words, size / sizeof(std::uint32_t) - header_words};
+   }
+};
+
+/// @brief Makes the flex::vita_format type of a format from waveform_format.h
+#define WF_FORMAT_TYPE(format) \
+   ::flex::vita_format<format##_WORD0, format##_CLASS, format##_CLASS_MASK, format##_HEADER_WORDS>
+
+/// @brief Two channel 32-bit float samples, see WF_FORMAT_FLOAT_STEREO_WORD0
+using float_stereo_format = WF_FORMAT_TYPE(WF_FORMAT_FLOAT_STEREO);
+/// @brief Two channel 16 or 32-bit integer samples, see WF_FORMAT_INT_STEREO_WORD0
+using int_stereo_format = WF_FORMAT_TYPE(WF_FORMAT_INT_STEREO);
+/// @brief Opaque bytes, see WF_FORMAT_BYTE_DATA_WORD0
+using byte_data_format = WF_FORMAT_TYPE(WF_FORMAT_BYTE_DATA);
+/// @brief Meter values, see WF_FORMAT_METER_WORD0
+using meter_format = WF_FORMAT_TYPE(WF_FORMAT_METER);
+
+}// namespace flex
+
+#endif//WAVEFORM_SDK_WAVEFORM_FORMAT_HPP
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_module.h
+/// @brief Running signal processing in child processes connected by shared memory
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_MODULE_H
+#define WAVEFORM_SDK_WAVEFORM_MODULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "waveform_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief The environment variable through which a module finds its connection to the waveform
+#define WF_MODULE_FD_ENV "WAVEFORM_MODULE_FD"
+/// @brief The longest command or response text passed between a module and the waveform, in bytes
+#define WF_MODULE_MAX_MESSAGE 512
+
+/// @struct waveform_module
+/// @brief Opaque structure for a module as seen by the waveform that started it
+/// @details A module is a separate executable that does the signal processing of a waveform in its own process.
+///          The waveform's process keeps the connection to the radio and hands the module every receive and
+///          transmit packet through shared memory rings.  Packets that don't fit because the module has fallen
+///          behind are dropped rather than waited for, so a slow module never delays the waveform's other data
+///          callbacks or the radio connection.  A module that exits, crashes or stops taking packets is restarted
+///          with the same rings while the waveform stays active.
+struct waveform_module;
+
+/// @struct waveform_module_client
+/// @brief Opaque structure for the connection of a module to the waveform that started it
+struct waveform_module_client;
+
+/// @brief A packet passed between a module and the waveform
+/// @details The header fields are those of struct waveform_packet_info.  The payload follows directly and holds
+///          the samples in host byte order, as given to the data callbacks.
+struct waveform_module_packet {
+   uint64_t sample_index;   ///< The index of the first frame of the packet in its stream, if WF_PACKET_HAS_SAMPLE_INDEX is set
+   uint64_t timestamp_frac; ///< The fractional part of the timestamp, if WF_PACKET_HAS_TIMESTAMP is set
+   uint32_t timestamp_int;  ///< The integer part of the timestamp, if WF_PACKET_HAS_TIMESTAMP is set
+   uint32_t stream_id;      ///< The stream ID of the packet
+   uint32_t sample_rate;    ///< The sample rate in Hz
+   uint32_t num_samples;    ///< The number of samples in the payload, counting each channel separately
+   uint32_t length;         ///< The length of the payload in bytes
+   uint8_t lane;            ///< WF_DATA_LANE_RX or WF_DATA_LANE_TX, or the enum waveform_packet_type of a sent packet
+   uint8_t channels;        ///< The number of samples per frame
+   uint8_t bits_per_sample; ///< The size of each sample
+   uint8_t flags;           ///< A combination of enum waveform_packet_flags
+   uint32_t payload[];      ///< The payload
+};
+
+/// @brief The kinds of event a module receives from the waveform
+enum waveform_module_event_type
+{
+   WF_MODULE_RESPONSE,///< The radio answered a command sent with waveform_module_command()
+   WF_MODULE_STATE    ///< The state of the waveform changed, or the module was started while it was active
+};
+
+/// @brief An event received with waveform_module_event()
+struct waveform_module_event {
+   enum waveform_module_event_type type;   ///< What happened
+   uint32_t id;                            ///< The id passed to waveform_module_command(), for a response
+   uint32_t code;                          ///< The result code of the command, for a response, or 0xffffffff if it never reached the radio
+   enum waveform_state state;              ///< The new state of the waveform, for a state change
+   char message[WF_MODULE_MAX_MESSAGE + 1];///< The message of the response, always terminated
+};
+
+/// @brief Counters of a module, from waveform_module_get_stats()
+struct waveform_module_stats {
+   uint64_t delivered;///< Packets handed to the module
+   uint64_t dropped;  ///< Packets dropped because the module's ring was full
+   uint64_t sent;     ///< Packets the module sent to the radio
+   uint64_t restarts; ///< Times the module was restarted after exiting
+   uint64_t stalls;   ///< Times the module was killed for not taking packets within the stall timeout
+   pid_t pid;         ///< The process ID of the running module, or 0 if none is running
+};
+
+/// @brief Starts a module for a waveform
+/// @details The executable is started in a child process with the connection to the waveform already open and
+///          WF_MODULE_FD_ENV set in its environment.  From then on every packet that would go to the waveform's
+///          receive and transmit data callbacks is also copied into the module's rings, and the module is told of
+///          state changes.  Whenever the module exits it is started again, after 100 milliseconds if it ran for
+///          less than a second.  This may be called at any time and more than one module may be started.
+/// @param waveform The waveform whose data the module processes
+/// @param path The path of the executable
+/// @param argv The arguments, terminated by NULL, or NULL to pass only the path.  Copied.
+/// @returns The module or NULL if it couldn't be started, with errno set if the executable couldn't be run
+struct waveform_module* waveform_module_start(struct waveform_t* waveform, const char* path, char* const argv[]);
+
+/// @brief Stops a module
+/// @details The module is sent SIGTERM and then SIGKILL if it hasn't exited within a second.  Its resources are
+///          freed when the waveform is destroyed, so responses to commands that are still outstanding are safely
+///          discarded.
+/// @param module The module to stop
+void waveform_module_stop(struct waveform_module* module);
+
+/// @brief Sets how long a module may leave packets waiting before it is restarted
+/// @details A module counts as alive while it keeps calling waveform_module_wait() or waveform_module_next().  A
+///          module that has packets waiting and hasn't done either within the timeout is killed and restarted.
+///          The default is 1000 milliseconds.
+/// @param module The module to configure
+/// @param timeout_ms The timeout in milliseconds or 0 never to kill the module
+void waveform_module_set_stall_timeout(struct waveform_module* module, unsigned int timeout_ms);
+
+/// @brief Gets the counters of a module
+/// @param module The module to query
+/// @param stats A user-provided structure in which to store the counters
+void waveform_module_get_stats(struct waveform_module* module, struct waveform_module_stats* stats);
+
+/// @brief Connects a module to the waveform that started it
+/// @details Called once by the module at startup.  Packets that were waiting from an earlier run of the module
+///          are skipped.
+/// @returns The connection or NULL if the process wasn't started with waveform_module_start()
+struct waveform_module_client* waveform_module_attach(void);
+
+/// @brief Closes the connection of a module
+/// @param client The connection to close
+void waveform_module_detach(struct waveform_module_client* client);
+
+/// @brief Waits for a packet or an event
+/// @param client The connection to wait on
+/// @param timeout_ms The longest time to wait in milliseconds, or -1 to wait indefinitely
+/// @returns 1 if a packet or event may be waiting, 0 on a timeout or -1 if the waveform has gone away, in which
+///          case the module should exit
+int waveform_module_wait(struct waveform_module_client* client, int timeout_ms);
+
+/// @brief Takes the next packet without copying it
+/// @details Transmit packets are taken before receive packets.  The packet points into the ring and stays valid
+///          until the next call of this or waveform_module_wait().  Never blocks.
+/// @param client The connection to take from
+/// @param packet Set to the packet
+/// @returns 1 if a packet was returned or 0 if none is waiting
+int waveform_module_next(struct waveform_module_client* client, const struct waveform_module_packet** packet);
+
+/// @brief Sends samples to the radio through the waveform
+/// @details The waveform sends them with waveform_send_data_packet().  Never blocks.
+/// @param client The connection to send on
+/// @param type Where the radio should send the samples
+/// @param samples The samples
+/// @param num_samples The number of samples, counting each channel separately
+/// @returns 0 on success, -EAGAIN if the ring is full or -EFBIG if the samples don't fit in a packet
+int waveform_module_send(struct waveform_module_client* client, enum waveform_packet_type type, const float* samples,
+                         size_t num_samples);
+
+/// @brief Sends a command to the radio through the waveform
+/// @details The response arrives as a WF_MODULE_RESPONSE event.  A module restarted before the response arrives
+///          never receives it.
+/// @param client The connection to send on
+/// @param id An identifier returned with the response
+/// @param command The command, at most WF_MODULE_MAX_MESSAGE bytes
+/// @returns 0 on success or -1 if the command couldn't be sent
+int waveform_module_command(struct waveform_module_client* client, uint32_t id, const char* command);
+
+/// @brief Takes the next event
+/// @details Never blocks.
+/// @param client The connection to take from
+/// @param event A user-provided structure in which to store the event
+/// @returns 1 if an event was returned, 0 if none is waiting or -1 if the waveform has gone away
+int waveform_module_event(struct waveform_module_client* client, struct waveform_module_event* event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//WAVEFORM_SDK_WAVEFORM_MODULE_H
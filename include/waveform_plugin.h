@@ -0,0 +1,130 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_plugin.h
+/// @brief Signal processing in shared libraries that can be replaced while the waveform runs
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_PLUGIN_H
+#define WAVEFORM_SDK_WAVEFORM_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "waveform_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief The version of struct waveform_plugin_ops this library expects
+#define WF_PLUGIN_ABI_VERSION 1U
+/// @brief The name of the function every plugin exports, see WF_PLUGIN_EXPORT()
+#define WF_PLUGIN_ENTRY "waveform_plugin_entry"
+
+#ifdef __cplusplus
+#define WF_PLUGIN_LINKAGE extern "C"
+#else
+#define WF_PLUGIN_LINKAGE
+#endif
+
+/// @brief Exports the hooks of a plugin
+/// @details Used once at file scope in the plugin's shared library.
+/// @param ops A struct waveform_plugin_ops with static storage duration
+#define WF_PLUGIN_EXPORT(ops)                                                                           WF_PLUGIN_LINKAGE __attribute__((visibility("default"))) const struct waveform_plugin_ops*    waveform_plugin_entry(void) { return &(ops); }
+
+/// @struct waveform_plugin
+/// @brief Opaque structure for a plugin slot of a waveform
+/// @details A plugin is a shared library holding the signal processing of a waveform.  The waveform's receive and
+///          transmit packets are passed to the loaded build, and waveform_plugin_reload() replaces it with another
+///          build between two packets while the radio connection, streams and buffers stay as they are.
+struct waveform_plugin;
+
+/// @brief The hooks of a plugin
+/// @details Every hook gets the context created by init.  process is called on the data callback threads and
+///          the others on the thread loading or unloading the plugin, but never at the same time as process for
+///          the same build.
+struct waveform_plugin_ops {
+   /// @brief WF_PLUGIN_ABI_VERSION as the plugin was built
+   uint32_t abi_version;
+   /// @brief The name of the plugin, for log messages
+   const char* name;
+   /// @brief Sets up a build before it takes over
+   /// @details Runs while the build it replaces is still processing packets, so it may take its time.
+   /// @returns 0 on success or -1 to refuse to load
+   int (*init)(struct waveform_t* waveform, void* arg, void** ctx);
+   /// @brief Processes a receive or transmit packet, as a data callback would
+   void (*process)(void* ctx, struct waveform_t* waveform, enum waveform_data_lane lane,
+                   struct waveform_vita_packet* packet, size_t packet_size);
+   /// @brief Hands the state of a build being replaced to its successor.  Optional.
+   /// @details Stores a copy allocated with malloc(3) that the library frees.  Must not change the running state,
+   ///          as the build carries on if its successor refuses the state.
+   /// @returns 0 on success or -1 on failure
+   int (*save_state)(void* ctx, void** state, size_t* state_size);
+   /// @brief Takes over the state saved by the build being replaced.  Optional.
+   /// @details Called between two packets, so this is the time processing is held up for and should be quick.
+   /// @returns 0 on success or -1 to abandon the swap and keep the build being replaced
+   int (*restore_state)(void* ctx, const void* state, size_t state_size);
+   /// @brief Frees everything init set up, once the build is no longer processing packets
+   void (*teardown)(void* ctx);
+};
+
+/// @brief The type of the function exported as WF_PLUGIN_ENTRY
+typedef const struct waveform_plugin_ops* (*waveform_plugin_entry_t)(void);
+
+/// @brief Counters of a plugin slot, from waveform_plugin_get_stats()
+struct waveform_plugin_stats {
+   uint64_t packets;          ///< Packets processed by any build
+   uint64_t swaps;            ///< Times a build was replaced
+   uint64_t last_gap_samples; ///< Frames that arrived during the last swap and were not processed by either build
+   uint64_t total_gap_samples;///< Frames not processed during all swaps
+   uint64_t last_gap_ns;      ///< How long processing was held up by the last swap, in nanoseconds
+};
+
+/// @brief Loads a plugin and starts passing it the waveform's packets
+/// @details The library is copied before it is opened, so a later build written over the same file can be loaded
+///          with waveform_plugin_reload() while this one is still running.  This may be called at any time.
+/// @param waveform The waveform whose packets the plugin processes
+/// @param path The path of the shared library
+/// @param arg A user-defined argument passed to init of this and every later build
+/// @returns The plugin slot or NULL if the library couldn't be loaded or its init failed
+struct waveform_plugin* waveform_plugin_load(struct waveform_t* waveform, const char* path, void* arg);
+
+/// @brief Replaces the running build of a plugin
+/// @details The new build is initialized alongside the running one.  Then, between two packets, the running build's
+///          state is handed over and the new build takes its place.  Packets arriving during the handover are not
+///          processed and are counted as the swap gap.  The replaced build is torn down and closed afterwards.
+///          The running build is kept if the new one can't be loaded or refuses the state.
+/// @param plugin The plugin slot
+/// @param path The path of the new build, or NULL to load the file the slot was loaded from again
+/// @returns 0 on success or -1 on failure
+int waveform_plugin_reload(struct waveform_plugin* plugin, const char* path);
+
+/// @brief Unloads a plugin
+/// @details The slot itself is freed when the waveform is destroyed.
+/// @param plugin The plugin slot
+void waveform_plugin_unload(struct waveform_plugin* plugin);
+
+/// @brief Gets the counters of a plugin slot
+/// @param plugin The plugin slot to query
+/// @param stats A user-provided structure in which to store the counters
+void waveform_plugin_get_stats(struct waveform_plugin* plugin, struct waveform_plugin_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//WAVEFORM_SDK_WAVEFORM_PLUGIN_H
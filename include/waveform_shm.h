@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_shm.h
+/// @brief Shared memory rings carrying VITA-49 streams to other processes
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_SHM_H
+#define WAVEFORM_SDK_WAVEFORM_SHM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Magic number at the start of every shared memory ring
+#define WAVEFORM_SHM_MAGIC 0x57465348u
+/// @brief Version of the shared memory ring layout
+#define WAVEFORM_SHM_VERSION 2u
+/// @brief The smallest payload a slot can hold, in bytes.  Rings for waveforms with a larger maximum payload
+///        have larger slots, see waveform_shm_header.slot_size.
+#define WAVEFORM_SHM_PAYLOAD_SIZE 1440u
+/// @brief printf(3) format for the name of the ring for a stream.  Takes the prefix passed to
+///        waveform_set_shm_publish() and the stream ID.
+#define WAVEFORM_SHM_NAME_FORMAT "/%s.%08x"
+
+/// @struct waveform_shm_reader
+/// @brief Opaque structure holding a reader's mapping of and position in a ring
+struct waveform_shm_reader;
+
+/// @brief The header at the start of a shared memory ring
+/// @details Followed directly by slot_count slots of slot_size bytes each.  head is only ever written by the
+///          publishing waveform and must be read atomically.
+struct waveform_shm_header {
+   uint32_t magic;      ///< WAVEFORM_SHM_MAGIC
+   uint32_t version;    ///< WAVEFORM_SHM_VERSION
+   uint32_t stream_id;  ///< The stream ID of the packets in this ring
+   uint32_t slot_count; ///< The number of slots in the ring
+   uint64_t head;       ///< The sequence number of the next packet to be published
+   uint32_t slot_size;  ///< The size of each slot in bytes, at least sizeof(struct waveform_shm_slot)
+   uint8_t reserved[36];///< Pads the header to a cache line
+};
+
+/// @brief A slot holding one packet in a shared memory ring
+/// @details Packet n of the stream is stored in slot n % slot_count.  sequence is a sequence lock: it holds
+///          2n + 1 while packet n is being written and 2n + 2 once it is complete.  A reader has a consistent
+///          copy of the packet if sequence reads 2n + 2 both before and after it looks at the slot.  The
+///          payload has already been converted to host byte order, the same as the packets given to the
+///          data callbacks.  payload continues to the end of the slot, so it can hold payload_length bytes even
+///          when that is more than WAVEFORM_SHM_PAYLOAD_SIZE.
+struct waveform_shm_slot {
+   uint64_t sequence;                          ///< Sequence lock, see above
+   uint32_t stream_id;                         ///< Stream ID of the packet
+   uint16_t packet_class;                      ///< The VITA-49 packet class code of the packet
+   uint16_t payload_length;                    ///< Number of valid bytes in payload
+   uint32_t timestamp_int;                     ///< Integer timestamp of the packet
+   uint32_t reserved;                          ///< Reserved, always zero
+   uint64_t timestamp_frac;                    ///< Fractional timestamp of the packet
+   uint8_t payload[WAVEFORM_SHM_PAYLOAD_SIZE]; ///< The packet payload, extending to the end of the slot
+};
+
+/// @brief Opens a shared memory ring for reading
+/// @details The reader starts at the newest packet in the ring.  Each reader keeps its own position, so
+///          any number of readers may consume the same ring.  Readers never slow down the publishing waveform:
+///          a reader that falls more than a ring behind silently skips ahead and the skipped packets are counted
+///          by waveform_shm_lost().
+/// @param name The name of the ring, built with WAVEFORM_SHM_NAME_FORMAT
+/// @returns A reader to pass to the other functions or NULL on failure with errno set
+struct waveform_shm_reader* waveform_shm_open(const char* name);
+
+/// @brief Closes a reader opened with waveform_shm_open()
+/// @param reader The reader to close
+void waveform_shm_close(struct waveform_shm_reader* reader);
+
+/// @brief Gets the next packet from a ring without copying it
+/// @details Never blocks.  The returned slot points directly into the shared memory and can be overwritten by
+///          the writer at any time, so once done with it call waveform_shm_valid() and discard anything read
+///          from the slot if that returns false.
+/// @param reader The reader to read from
+/// @param slot Set to the slot holding the next packet
+/// @returns 1 if a packet was returned or 0 if there are no new packets
+int waveform_shm_next(struct waveform_shm_reader* reader, const struct waveform_shm_slot** slot);
+
+/// @brief Checks that a slot returned by waveform_shm_next() has not been overwritten
+/// @param reader The reader the slot was returned from
+/// @param slot The slot to check
+/// @returns true if everything read from the slot since waveform_shm_next() returned it is consistent
+bool waveform_shm_valid(struct waveform_shm_reader* reader, const struct waveform_shm_slot* slot);
+
+/// @brief Gets the number of packets a reader has missed
+/// @details Counts packets that were overwritten before the reader got to them, including packets found to be
+///          invalid by waveform_shm_valid().
+/// @param reader The reader to query
+/// @returns The number of packets missed since the reader was opened
+uint64_t waveform_shm_lost(struct waveform_shm_reader* reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//WAVEFORM_SDK_WAVEFORM_SHM_H
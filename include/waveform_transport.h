@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file waveform_transport.h
+/// @brief In-process transport standing in for a radio in tests and benchmarks
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_WAVEFORM_TRANSPORT_H
+#define WAVEFORM_SDK_WAVEFORM_TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "waveform_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @struct waveform_memory_transport
+/// @brief Opaque structure for an in-process transport
+/// @details An in-process transport replaces the TCP API connection and the UDP VITA socket of a radio with
+///          memory queues, so that the caller plays the part of the radio.  Nothing goes through the kernel's
+///          network stack, which makes it suitable for benchmarks of the library itself and for tests that need
+///          exact control over what the library receives and when.  Only one waveform of the radio may be
+///          active at a time.
+struct waveform_memory_transport;
+
+/// @brief Callback for lines the library sends to the in-process radio
+/// @param line The line without its terminating newline
+/// @param arg The argument passed to waveform_memory_transport_set_line_cb()
+typedef void (*waveform_memory_line_cb_t)(const char* line, void* arg);
+
+/// @brief Creates an in-process transport
+/// @param vita_depth The number of VITA packets that can be queued in each direction
+/// @returns The transport or NULL on failure
+struct waveform_memory_transport* waveform_memory_transport_create(size_t vita_depth);
+
+/// @brief Destroys an in-process transport
+/// @details The radio using the transport must have stopped.
+/// @param transport The transport to destroy
+void waveform_memory_transport_destroy(struct waveform_memory_transport* transport);
+
+/// @brief Makes a radio use an in-process transport instead of the network
+/// @details Must be called before waveform_radio_start().  The address passed to waveform_radio_create() is then
+///          only used in log messages.
+/// @param radio The radio to configure
+/// @param transport The transport to use
+/// @returns 0 on success or -1 if the radio is already started
+int waveform_radio_set_memory_transport(struct radio_t* radio, struct waveform_memory_transport* transport);
+
+/// @brief Sets the callback for lines the library sends to the radio
+/// @details Called on the radio thread for every command line the library sends.  Must be set before
+///          waveform_radio_start().
+/// @param transport The transport to configure
+/// @param cb The callback or NULL to discard the lines
+/// @param arg A user-defined argument passed to the callback
+void waveform_memory_transport_set_line_cb(struct waveform_memory_transport* transport, waveform_memory_line_cb_t cb, void* arg);
+
+/// @brief Sends a line to the library as if the radio had sent it
+/// @details For example "S0|slice 0 mode=FDV" to activate the waveform with the short name FDV.  May be called
+///          from any thread once the radio has started.
+/// @param transport The transport to send on
+/// @param line The line to send, without a terminating newline
+/// @returns 0 on success or -1 if the radio isn't connected
+int waveform_memory_transport_send_line(struct waveform_memory_transport* transport, const char* line);
+
+/// @brief Injects a VITA-49 packet as if the radio had sent it
+/// @details The packet must be in network byte order, exactly as it would arrive on the UDP socket.  May be called
+///          from any thread.
+/// @param transport The transport to inject into
+/// @param packet The packet
+/// @param length The length of the packet in bytes, at most the header plus WF_JUMBO_PAYLOAD
+/// @returns 0 on success or -1 if the queue is full or the packet is too large
+int waveform_memory_transport_inject_vita(struct waveform_memory_transport* transport, const void* packet, size_t length);
+
+/// @brief Takes a VITA-49 packet the library sent to the radio
+/// @details Never blocks.  May be called from any thread.
+/// @param transport The transport to take from
+/// @param packet A buffer for the packet
+/// @param length The size of the buffer.  A longer packet is truncated to fit.
+/// @returns The full length of the packet, which is more than length if it was truncated, or -1 if none is waiting
+ssize_t waveform_memory_transport_take_vita(struct waveform_memory_transport* transport, void* packet, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif//WAVEFORM_SDK_WAVEFORM_TRANSPORT_H
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file alloc.c
+/// @brief Heap allocation accounted by subsystem
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Every allocation the library makes goes through here with the subsystem it is for, so memory use
+//  and allocation rates can be told apart by path.  Sizes are taken from malloc_usable_size(3) rather
+//  than a header in front of each block, which keeps aligned allocations aligned and lets blocks
+//  allocated by other libraries be adopted.  Each subsystem's counters have a cache line of their own
+//  so busy paths don't slow each other down.
+
+#define _GNU_SOURCE
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct alloc_counters {
+   CACHE_ALIGNED _Atomic int64_t live;
+   _Atomic int64_t               peak;
+   _Atomic uint64_t              allocations;
+   _Atomic uint64_t              frees;
+};
+
+struct alloc_rate_mark {
+   uint64_t allocations;
+   uint64_t ns;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static struct alloc_counters alloc_counters[WF_ALLOC_TAG_MAX];
+
+static pthread_mutex_t alloc_rate_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct alloc_rate_mark alloc_rate_marks[WF_ALLOC_TAG_MAX];
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Adds to the live bytes of a subsystem and raises its peak to match
+/// @param counters The counters of the subsystem
+/// @param bytes The number of bytes, negative when freed
+static void alloc_add_live(struct alloc_counters* counters, int64_t bytes)
+{
+   int64_t live = atomic_fetch_add_explicit(&counters->live, bytes, memory_order_relaxed) + bytes;
+   int64_t peak = atomic_load_explicit(&counters->peak, memory_order_relaxed);
+
+   while (live > peak &&
+          !atomic_compare_exchange_weak_explicit(&counters->peak, &peak, live, memory_order_relaxed, memory_order_relaxed))
+   {
+   }
+}
+
+/// @brief Counts a new block
+/// @param tag The subsystem the block is charged to
+/// @param ptr The block, or NULL if the allocation failed
+/// @returns ptr
+static void* alloc_note(enum waveform_alloc_tag tag, void* ptr)
+{
+   if (ptr)
+   {
+      alloc_add_live(&alloc_counters[tag], (int64_t) malloc_usable_size(ptr));
+      atomic_fetch_add_explicit(&alloc_counters[tag].allocations, 1, memory_order_relaxed);
+   }
+   return ptr;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+void* alloc_malloc(enum waveform_alloc_tag tag, size_t size)
+{
+   return alloc_note(tag, malloc(size));
+}
+
+void* alloc_calloc(enum waveform_alloc_tag tag, size_t nmemb, size_t size)
+{
+   return alloc_note(tag, calloc(nmemb, size));
+}
+
+void* alloc_realloc(enum waveform_alloc_tag tag, void* ptr, size_t size)
+{
+   size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+   void* new_ptr = realloc(ptr, size);
+
+   if (!new_ptr)
+   {
+      return NULL;
+   }
+
+   if (!ptr)
+   {
+      return alloc_note(tag, new_ptr);
+   }
+
+   alloc_add_live(&alloc_counters[tag], (int64_t) malloc_usable_size(new_ptr) - (int64_t) old_size);
+   return new_ptr;
+}
+
+void* alloc_aligned(enum waveform_alloc_tag tag, size_t alignment, size_t size)
+{
+   return alloc_note(tag, aligned_alloc(alignment, size));
+}
+
+char* alloc_strdup(enum waveform_alloc_tag tag, const char* s)
+{
+   return alloc_note(tag, strdup(s));
+}
+
+void* alloc_adopt(enum waveform_alloc_tag tag, void* ptr)
+{
+   return alloc_note(tag, ptr);
+}
+
+void alloc_free(enum waveform_alloc_tag tag, void* ptr)
+{
+   if (!ptr)
+   {
+      return;
+   }
+
+   alloc_add_live(&alloc_counters[tag], -(int64_t) malloc_usable_size(ptr));
+   atomic_fetch_add_explicit(&alloc_counters[tag].frees, 1, memory_order_relaxed);
+   free(ptr);
+}
+
+sds alloc_sds_adopt(enum waveform_alloc_tag tag, sds s)
+{
+   if (s)
+   {
+      alloc_add_live(&alloc_counters[tag], (int64_t) sdsAllocSize(s));
+      atomic_fetch_add_explicit(&alloc_counters[tag].allocations, 1, memory_order_relaxed);
+   }
+   return s;
+}
+
+sds* alloc_sds_adopt_split(enum waveform_alloc_tag tag, sds* tokens, int count)
+{
+   if (!tokens)
+   {
+      return NULL;
+   }
+
+   for (int i = 0; i < count; ++i)
+   {
+      alloc_sds_adopt(tag, tokens[i]);
+   }
+   return alloc_note(tag, tokens);
+}
+
+void alloc_sds_free(enum waveform_alloc_tag tag, sds s)
+{
+   if (!s)
+   {
+      return;
+   }
+
+   alloc_add_live(&alloc_counters[tag], -(int64_t) sdsAllocSize(s));
+   atomic_fetch_add_explicit(&alloc_counters[tag].frees, 1, memory_order_relaxed);
+   sdsfree(s);
+}
+
+void alloc_sds_free_split(enum waveform_alloc_tag tag, sds* tokens, int count)
+{
+   if (!tokens)
+   {
+      return;
+   }
+
+   for (int i = 0; i < count; ++i)
+   {
+      alloc_sds_free(tag, tokens[i]);
+   }
+   alloc_free(tag, tokens);
+}
+
+void alloc_free_other(void* ptr)
+{
+   alloc_free(WF_ALLOC_OTHER, ptr);
+}
+
+void alloc_account(enum waveform_alloc_tag tag, int64_t bytes)
+{
+   alloc_add_live(&alloc_counters[tag], bytes);
+   atomic_fetch_add_explicit(bytes >= 0 ? &alloc_counters[tag].allocations : &alloc_counters[tag].frees, 1,
+                             memory_order_relaxed);
+}
+
+// ****************************************
+// Public API Functions
+// ****************************************
+int waveform_get_alloc_stats(enum waveform_alloc_tag tag, struct waveform_alloc_stats* stats)
+{
+   struct alloc_rate_mark* mark;
+   uint64_t now_ns;
+
+   if ((unsigned int) tag >= WF_ALLOC_TAG_MAX)
+   {
+      return -1;
+   }
+
+   stats->live_bytes = (uint64_t) atomic_load_explicit(&alloc_counters[tag].live, memory_order_relaxed);
+   stats->peak_bytes = (uint64_t) atomic_load_explicit(&alloc_counters[tag].peak, memory_order_relaxed);
+   stats->allocations = atomic_load_explicit(&alloc_counters[tag].allocations, memory_order_relaxed);
+   stats->frees = atomic_load_explicit(&alloc_counters[tag].frees, memory_order_relaxed);
+
+   now_ns = monotonic_now_ns();
+
+   pthread_mutex_lock(&alloc_rate_lock);
+   mark = &alloc_rate_marks[tag];
+   stats->allocations_per_sec =
+         mark->ns && now_ns > mark->ns ? (double) (stats->allocations - mark->allocations) * 1e9 / (double) (now_ns - mark->ns) : 0.0;
+   mark->allocations = stats->allocations;
+   mark->ns = now_ns;
+   pthread_mutex_unlock(&alloc_rate_lock);
+
+   return 0;
+}
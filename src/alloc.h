@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file alloc.h
+/// @brief Heap allocation accounted by subsystem
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_ALLOC_H
+#define WAVEFORM_SDK_ALLOC_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stddef.h>
+#include <stdint.h>
+
+// ****************************************
+// Third Party Library Includes
+// ****************************************
+#include <sds.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_api.h"
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Allocates memory for a subsystem, as malloc(3)
+/// @param tag The subsystem the memory is charged to
+/// @param size The number of bytes
+/// @returns The memory or NULL on failure
+void* alloc_malloc(enum waveform_alloc_tag tag, size_t size);
+
+/// @brief Allocates zeroed memory for a subsystem, as calloc(3)
+/// @param tag The subsystem the memory is charged to
+/// @param nmemb The number of elements
+/// @param size The size of each element
+/// @returns The memory or NULL on failure
+void* alloc_calloc(enum waveform_alloc_tag tag, size_t nmemb, size_t size);
+
+/// @brief Resizes memory of a subsystem, as realloc(3)
+/// @param tag The subsystem the memory is charged to, the same it was allocated for
+/// @param ptr The memory to resize or NULL to allocate
+/// @param size The new size in bytes
+/// @returns The memory or NULL on failure, in which case ptr is untouched
+void* alloc_realloc(enum waveform_alloc_tag tag, void* ptr, size_t size);
+
+/// @brief Allocates aligned memory for a subsystem, as aligned_alloc(3)
+/// @param tag The subsystem the memory is charged to
+/// @param alignment The alignment, a power of two
+/// @param size The number of bytes, a multiple of alignment
+/// @returns The memory or NULL on failure
+void* alloc_aligned(enum waveform_alloc_tag tag, size_t alignment, size_t size);
+
+/// @brief Copies a string for a subsystem, as strdup(3)
+/// @param tag The subsystem the memory is charged to
+/// @param s The string to copy
+/// @returns The copy or NULL on failure
+char* alloc_strdup(enum waveform_alloc_tag tag, const char* s);
+
+/// @brief Charges memory allocated with malloc(3) by something else to a subsystem
+/// @details For buffers handed over by libraries, such as lines read with evbuffer_readln(), which are then freed
+///          with alloc_free().
+/// @param tag The subsystem the memory is charged to
+/// @param ptr The memory, or NULL
+/// @returns ptr
+void* alloc_adopt(enum waveform_alloc_tag tag, void* ptr);
+
+/// @brief Charges an sds string to a subsystem
+/// @details sds allocates through its own sdsalloc.h, so strings are created as usual and handed over here.  The
+///          string is sized with sdsAllocSize(), so it mustn't be grown again before it's freed with alloc_sds_free().
+/// @param tag The subsystem the memory is charged to
+/// @param s The string, or NULL
+/// @returns s
+sds alloc_sds_adopt(enum waveform_alloc_tag tag, sds s);
+
+/// @brief Charges the result of sdssplitlen() or sdssplitargs() to a subsystem
+/// @param tag The subsystem the memory is charged to
+/// @param tokens The array of strings, or NULL
+/// @param count The number of strings in the array
+/// @returns tokens
+sds* alloc_sds_adopt_split(enum waveform_alloc_tag tag, sds* tokens, int count);
+
+/// @brief Frees an sds string of a subsystem
+/// @param tag The subsystem the string was charged to
+/// @param s The string, or NULL
+void alloc_sds_free(enum waveform_alloc_tag tag, sds s);
+
+/// @brief Frees the result of sdssplitlen() or sdssplitargs() for a subsystem
+/// @details Strings taken out of the array and replaced with NULL are skipped, as sdsfreesplitres() does.
+/// @param tag The subsystem the array was charged to
+/// @param tokens The array of strings, or NULL
+/// @param count The number of strings in the array
+void alloc_sds_free_split(enum waveform_alloc_tag tag, sds* tokens, int count);
+
+/// @brief Frees memory of a subsystem
+/// @param tag The subsystem the memory was charged to
+/// @param ptr The memory, or NULL
+void alloc_free(enum waveform_alloc_tag tag, void* ptr);
+
+/// @brief Frees memory charged to WF_ALLOC_OTHER
+/// @details For passing to functions that take a destructor, such as rcu_retire().
+/// @param ptr The memory, or NULL
+void alloc_free_other(void* ptr);
+
+/// @brief Charges memory that isn't on the heap, such as mapped blocks, to a subsystem
+/// @param tag The subsystem the memory is charged to
+/// @param bytes The number of bytes mapped, or negative when unmapped
+void alloc_account(enum waveform_alloc_tag tag, int64_t bytes);
+
+#endif//WAVEFORM_SDK_ALLOC_H
@@ -38,6 +38,7 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
 #include "utils.h"
 #include "vita.h"
 
@@ -69,8 +70,8 @@ static void discovery_cb(evutil_socket_t sock, short what, void* ctx)
    struct sockaddr_in** addrptr = (struct sockaddr_in**) ctx;
    ssize_t bytes_received;
    struct waveform_vita_packet packet;
-   sds ip;
-   sds port_string;
+   sds ip = NULL;
+   sds port_string = NULL;
 
    if (!(what & EV_READ))
    {
@@ -98,26 +99,28 @@ static void discovery_cb(evutil_socket_t sock, short what, void* ctx)
       return;
    }
 
-   if (packet.header.information_class != __constant_cpu_to_be16(SMOOTHLAKE_INFORMATION_CLASS) || packet.header.packet_class_byte != 0xffff)
+   if (packet.header.information_class != __constant_cpu_to_be16(WF_VITA_INFORMATION_CLASS) || packet.header.packet_class_byte != 0xffff)
    {
       waveform_log(WF_LOG_INFO, "Received packet with invalid ID: 0x%04x/0x%04x\n", packet.header.information_class, packet.header.packet_class_byte);
       return;
    }
 
-   sds discovery_string = sdsnewlen(packet.raw_payload, bytes_received - VITA_PACKET_HEADER_SIZE(&packet));
+   sds discovery_string = alloc_sds_adopt(WF_ALLOC_DISCOVERY,
+                                          sdsnewlen(packet.raw_payload, bytes_received - VITA_PACKET_HEADER_SIZE(&packet)));
    waveform_log(WF_LOG_DEBUG, "Discovery: %s\n", discovery_string);
    int argc;
    sds* argv = sdssplitargs(discovery_string, &argc);
-   struct sockaddr_in* addr = *addrptr = calloc(1, sizeof(struct sockaddr_in));
+   alloc_sds_adopt_split(WF_ALLOC_DISCOVERY, argv, argc);
+   struct sockaddr_in* addr = *addrptr = alloc_calloc(WF_ALLOC_DISCOVERY, 1, sizeof(struct sockaddr_in));
    unsigned long port = 0;
 
-   if ((ip = find_kwarg(argc, argv, "ip")) == NULL)
+   if ((ip = find_kwarg(WF_ALLOC_DISCOVERY, argc, argv, "ip")) == NULL)
    {
       waveform_log(WF_LOG_ERROR, "Cannot find IP in discovery packet\n");
       goto fail;
    }
 
-   if ((port_string = find_kwarg(argc, argv, "port")) == NULL)
+   if ((port_string = find_kwarg(WF_ALLOC_DISCOVERY, argc, argv, "port")) == NULL)
    {
       waveform_log(WF_LOG_ERROR, "No port number in discovery packet\n");
       goto fail;
@@ -148,17 +151,21 @@ static void discovery_cb(evutil_socket_t sock, short what, void* ctx)
    addr->sin_port = htons(port);
    addr->sin_family = AF_INET;
 
-   sdsfreesplitres(argv, argc);
-   sdsfree(discovery_string);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, ip);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, port_string);
+   alloc_sds_free_split(WF_ALLOC_DISCOVERY, argv, argc);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, discovery_string);
    event_base_loopbreak(base);
    return;
 
 fail_addr:
-   free(addr);
+   alloc_free(WF_ALLOC_DISCOVERY, addr);
    *addrptr = NULL;
 fail:
-   sdsfreesplitres(argv, argc);
-   sdsfree(discovery_string);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, ip);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, port_string);
+   alloc_sds_free_split(WF_ALLOC_DISCOVERY, argv, argc);
+   alloc_sds_free(WF_ALLOC_DISCOVERY, discovery_string);
 }
 
 static void timeout_cb(evutil_socket_t sock, short what, void* ctx)
@@ -250,6 +257,6 @@ fail_base:
 fail_socket:
    close(sock);
 fail:
-   free(addr);
+   alloc_free(WF_ALLOC_DISCOVERY, addr);
    return NULL;
 }
@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file hugemem.c
+/// @brief Large allocations backed by huge pages where the system allows
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "hugemem.h"
+#include "utils.h"
+
+// ****************************************
+// Macros
+// ****************************************
+//  The x86-64 and aarch64 default huge page size
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Describes a memory backing for the log
+/// @param backing The backing to describe
+/// @returns A string describing the backing
+static const char* hugemem_backing_to_string(enum waveform_memory_backing backing)
+{
+   switch (backing)
+   {
+      case WF_MEMORY_HUGETLB:
+         return "explicit huge pages";
+      case WF_MEMORY_TRANSPARENT_HUGE_PAGES:
+         return "transparent huge pages";
+      case WF_MEMORY_PAGES:
+         return "normal pages";
+      default:
+         return "nothing";
+   }
+}
+
+/// @brief Maps memory aligned to a huge page and asks for transparent huge pages on it
+/// @details The kernel only uses a transparent huge page for a naturally aligned range, so this maps an extra
+///          huge page and trims the ends off to get one.
+/// @param mem The block to fill in
+/// @param length The number of bytes to map, a multiple of HUGE_PAGE_SIZE
+/// @returns 0 on success or -1 if the memory couldn't be mapped
+static int hugemem_alloc_transparent(struct hugemem* mem, size_t length)
+{
+   char* raw = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (raw == MAP_FAILED)
+   {
+      return -1;
+   }
+
+   char* aligned = (char*) (((uintptr_t) raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+   if (aligned != raw)
+   {
+      munmap(raw, aligned - raw);
+   }
+   munmap(aligned + length, raw + HUGE_PAGE_SIZE - aligned);
+
+   mem->base = aligned;
+   mem->length = length;
+
+   //  Without THP in the kernel this fails, but the mapping is still perfectly good memory.
+   mem->backing = madvise(aligned, length, MADV_HUGEPAGE) == 0 ? WF_MEMORY_TRANSPARENT_HUGE_PAGES : WF_MEMORY_PAGES;
+
+   return 0;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int hugemem_alloc(struct hugemem* mem, size_t size, enum waveform_alloc_tag tag, const char* what)
+{
+   mem->tag = tag;
+
+   //  Below half a huge page the rounding would waste more than the TLB saves.
+   if (size >= HUGE_PAGE_SIZE / 2)
+   {
+      size_t length = DIV_ROUND_UP(size, HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+
+      mem->base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (mem->base != MAP_FAILED)
+      {
+         mem->length = length;
+         mem->backing = WF_MEMORY_HUGETLB;
+         goto out;
+      }
+
+      if (hugemem_alloc_transparent(mem, length) == 0)
+      {
+         goto out;
+      }
+   }
+
+   mem->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (mem->base == MAP_FAILED)
+   {
+      mem->base = NULL;
+      mem->length = 0;
+      mem->backing = WF_MEMORY_NONE;
+      return -1;
+   }
+   mem->length = size;
+   mem->backing = WF_MEMORY_PAGES;
+
+out:
+   alloc_account(mem->tag, (int64_t) mem->length);
+   waveform_log(WF_LOG_INFO, "Mapped %zu bytes for %s using %s\n", mem->length, what,
+                hugemem_backing_to_string(mem->backing));
+   return 0;
+}
+
+void hugemem_free(struct hugemem* mem)
+{
+   if (mem->base == NULL)
+   {
+      return;
+   }
+
+   munmap(mem->base, mem->length);
+   alloc_account(mem->tag, -(int64_t) mem->length);
+   mem->base = NULL;
+   mem->length = 0;
+   mem->backing = WF_MEMORY_NONE;
+}
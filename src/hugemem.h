@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file hugemem.h
+/// @brief Large allocations backed by huge pages where the system allows
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_HUGEMEM_H
+#define WAVEFORM_SDK_HUGEMEM_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stddef.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_api.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief A block of memory mapped directly from the kernel
+struct hugemem {
+   void*                        base;
+   size_t                       length;
+   enum waveform_memory_backing backing;
+   enum waveform_alloc_tag      tag;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Maps a zeroed block of memory, preferring huge pages
+/// @details Blocks big enough to be worth it first try explicit huge pages with MAP_HUGETLB, which only works
+///          if the administrator has reserved some, then transparent huge pages with madvise(2), and finally
+///          fall back to normal pages.  The backing actually used is recorded in the block and logged.
+/// @param mem The block to fill in
+/// @param size The number of bytes needed
+/// @param tag The subsystem the memory is charged to
+/// @param what A description of the memory for the log
+/// @returns 0 on success or -1 if no memory could be mapped
+int hugemem_alloc(struct hugemem* mem, size_t size, enum waveform_alloc_tag tag, const char* what);
+
+/// @brief Unmaps a block of memory
+/// @param mem The block to unmap.  Does nothing if it was never mapped.
+void hugemem_free(struct hugemem* mem);
+
+#endif//WAVEFORM_SDK_HUGEMEM_H
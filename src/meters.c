@@ -35,6 +35,7 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
 #include "meters.h"
 #include "utils.h"
 #include "waveform.h"
@@ -116,7 +117,8 @@ static void register_meter_cb(struct waveform_t* waveform, unsigned int code, sd
 
 register_failed:
    LL_DELETE(waveform->meter_head, entry);
-   free(entry);
+   alloc_sds_free(WF_ALLOC_METERS, entry->name);
+   alloc_free(WF_ALLOC_METERS, entry);
 }
 
 /// @brief Finds a meter structure given its name
@@ -169,8 +171,8 @@ void waveform_register_meter(struct waveform_t* wf, const char* name, float min,
       return;
    }
 
-   struct waveform_meter* new_entry = calloc(1, sizeof(*new_entry));
-   new_entry->name = sdsnew(name);
+   struct waveform_meter* new_entry = alloc_calloc(WF_ALLOC_METERS, 1, sizeof(*new_entry));
+   new_entry->name = alloc_sds_adopt(WF_ALLOC_METERS, sdsnew(name));
    new_entry->min = min;
    new_entry->max = max;
    new_entry->unit = unit;
@@ -228,18 +230,6 @@ ssize_t waveform_meters_send(struct waveform_t* wf)
    int i = 0;
 
    struct waveform_vita_packet_sans_ts packet = {
-         .header = {
-               .packet_type = VITA_PACKET_TYPE_EXT_DATA_WITH_STREAM_ID,
-               .class_present = true,
-               .trailer_present = false,
-               .integer_timestamp_type = INTEGER_TIMESTAMP_NOT_PRESENT,
-               .fractional_timestamp_type = FRACTIONAL_TIMESTAMP_NOT_PRESENT,
-               .sequence = wf->vita.meter_sequence++,
-               .stream_id = __constant_cpu_to_be32(METER_STREAM_ID),
-               .oui = __constant_cpu_to_be32(FLEX_OUI),
-               .information_class = __constant_cpu_to_be16(SMOOTHLAKE_INFORMATION_CLASS),
-               .packet_class_byte = __constant_cpu_to_be16(METER_PACKET_CLASS),
-         },
          .raw_payload = {0},
    };
 
@@ -260,7 +250,10 @@ ssize_t waveform_meters_send(struct waveform_t* wf)
       }
    }
 
-   packet.header.length = i;
+   size_t packet_words = WF_FORMAT_METER_HEADER_WORDS + i;
+   vita_write_header((struct waveform_vita_packet*) &packet,
+                     WF_FORMAT_HEADER_WORD0(WF_FORMAT_METER, wf->vita.meter_sequence++, packet_words),
+                     WF_FORMAT_CLASS_WORD(WF_FORMAT_METER, 0), METER_STREAM_ID, NULL);
 
-   return vita_send_packet(&wf->vita, (struct waveform_vita_packet*) &packet);
+   return vita_send_packet(&wf->vita, (struct waveform_vita_packet*) &packet, packet_words * sizeof(uint32_t));
 }
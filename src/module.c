@@ -0,0 +1,1297 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file module.c
+/// @brief Signal processing modules running in child processes
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  The waveform's process keeps the radio connection and the data path; each module is a separate
+//  executable started with fork() and exec.  A memfd holds three single-producer single-consumer
+//  rings: transmit and receive packets towards the module and outgoing samples back from it, each
+//  with an eventfd doorbell that is only rung when the consumer may be asleep.  Commands, responses
+//  and state changes are small and rare, so they travel over a SOCK_SEQPACKET socket pair instead.
+//
+//  A supervisor thread per module drains the outgoing ring, forwards commands and restarts the
+//  module whenever it exits.  The rings and doorbells outlive each run of the module, so a restart
+//  only needs a new process and socket pair and the waveform never notices beyond the packets
+//  dropped in the meantime.  The module bumps a heartbeat in the shared memory whenever it looks
+//  for packets, which lets the supervisor tell a module that is stuck from one that is idle.
+
+#define _GNU_SOURCE
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "module.h"
+#include "spsc.h"
+#include "utils.h"
+#include "waveform.h"
+
+// ****************************************
+// Macros
+// ****************************************
+#define MODULE_MAGIC 0x57464d44U
+#define MODULE_VERSION 1U
+#define MODULE_RING_SLOTS 64
+//  The shared memory, control socket, packet doorbell and send doorbell, in that order
+#define MODULE_FIRST_FD 3
+#define MODULE_FD_COUNT 4
+#define MODULE_POLL_MS 10
+#define MODULE_DEFAULT_STALL_MS 1000
+#define MODULE_MIN_LIFETIME_MS 1000
+#define MODULE_BACKOFF_MS 100
+#define MODULE_KILL_WAIT_MS 1000
+//  Reported as the code of a command that never reached the radio
+#define MODULE_SEND_FAILED 0xffffffffU
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+enum module_ring
+{
+   MODULE_RING_TX,
+   MODULE_RING_RX,
+   MODULE_RING_SEND,
+   MODULE_RINGS
+};
+
+enum module_message_type
+{
+   MODULE_MESSAGE_COMMAND,
+   MODULE_MESSAGE_RESPONSE,
+   MODULE_MESSAGE_STATE
+};
+
+//  The start of the shared memory.  The rings follow at the given offsets.
+struct module_shared {
+   uint32_t               magic;
+   uint32_t               version;
+   uint64_t               ring_offset[MODULE_RINGS];
+   //  Bumped by the module whenever it looks for packets
+   CACHE_ALIGNED uint64_t heartbeat;
+};
+
+//  Sent over the control socket with only as much of text as is used
+struct module_message {
+   uint32_t type;
+   uint32_t id;
+   uint32_t value;
+   char     text[WF_MODULE_MAX_MESSAGE + 1];
+};
+
+struct module_request {
+   struct waveform_module* module;
+   uint32_t                generation;
+   uint32_t                id;
+};
+
+struct waveform_module {
+   struct waveform_t*      wf;
+   char*                   path;
+   char**                  argv;
+   char                    env_entry[32];
+
+   size_t                  shm_size;
+   int                     shm_fd;
+   struct module_shared*   shared;
+   struct spsc_ring        rings[MODULE_RINGS];
+   //  Data callbacks for different streams may run at the same time on different workers
+   pthread_mutex_t         ring_locks[MODULE_RING_SEND];
+   int                     data_fd;
+   int                     send_fd;
+
+   //  Used by the radio thread to answer the running module
+   pthread_mutex_t         lock;
+   _Atomic bool            running;
+   int                     ctrl_fd;
+   uint32_t                generation;
+   bool                    active;
+   bool                    transmitting;
+
+   //  Only touched by the supervisor thread once it has started
+   pthread_t               thread;
+   pid_t                   pid;
+   int                     pidfd;
+   bool                    ctrl_open;
+   bool                    attached;
+   uint64_t                started_ms;
+   uint64_t                respawn_ms;
+   uint64_t                last_heartbeat;
+   uint64_t                heartbeat_ms;
+
+   _Atomic unsigned int    stall_ms;
+   _Atomic uint64_t        delivered;
+   _Atomic uint64_t        dropped;
+   _Atomic uint64_t        sent;
+   _Atomic uint64_t        restarts;
+   _Atomic uint64_t        stalls;
+   _Atomic pid_t           current_pid;
+   //  Held by the waveform and by each command waiting for its response
+   _Atomic unsigned int    refs;
+
+   struct waveform_module* next;
+};
+
+struct waveform_module_client {
+   size_t                shm_size;
+   struct module_shared* shared;
+   struct spsc_ring      rings[MODULE_RINGS];
+   //  The ring holding the packet last returned by waveform_module_next()
+   struct spsc_ring*     held;
+   int                   ctrl_fd;
+   int                   data_fd;
+   int                   send_fd;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static pthread_mutex_t module_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Gets the monotonic time
+/// @returns The time in milliseconds
+static uint64_t module_now_ms(void)
+{
+   return monotonic_now_ns() / 1000000;
+}
+
+/// @brief Gets the size of a slot in the rings
+/// @returns The size in bytes, enough for the largest payload
+static size_t module_slot_size(void)
+{
+   return sizeof(struct waveform_module_packet) + WF_JUMBO_PAYLOAD;
+}
+
+/// @brief Sends a message over a control socket
+/// @details Never blocks, so a module that doesn't read its events can't hold up the radio thread.
+/// @param fd The control socket
+/// @param type The type of the message
+/// @param id The command identifier
+/// @param value The result code or state
+/// @param text The text, truncated to WF_MODULE_MAX_MESSAGE bytes
+/// @returns 0 on success or -1 on failure
+static int module_send_message(int fd, enum module_message_type type, uint32_t id, uint32_t value, const char* text)
+{
+   struct module_message msg = {.type = type, .id = id, .value = value};
+   size_t length = 0;
+
+   if (text)
+   {
+      length = strnlen(text, WF_MODULE_MAX_MESSAGE);
+      memcpy(msg.text, text, length);
+   }
+   msg.text[length] = '\0';
+
+   if (send(fd, &msg, offsetof(struct module_message, text) + length + 1, MSG_NOSIGNAL | MSG_DONTWAIT) == -1)
+   {
+      return -1;
+   }
+
+   return 0;
+}
+
+/// @brief Receives a message from a control socket
+/// @param fd The control socket
+/// @param msg A buffer for the message, whose text is always terminated
+/// @returns 1 if a message was received, 0 if none is waiting or -1 if the other end has closed the socket
+static int module_recv_message(int fd, struct module_message* msg)
+{
+   for (;;)
+   {
+      ssize_t length = recv(fd, msg, sizeof(*msg), MSG_DONTWAIT);
+
+      if (length == 0)
+      {
+         return -1;
+      }
+
+      if (length == -1)
+      {
+         return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+      }
+
+      if ((size_t) length <= offsetof(struct module_message, text))
+      {
+         continue;
+      }
+
+      length -= offsetof(struct module_message, text);
+      msg->text[length < WF_MODULE_MAX_MESSAGE ? length : WF_MODULE_MAX_MESSAGE] = '\0';
+      return 1;
+   }
+}
+
+/// @brief Copies a packet into one of the rings towards the module
+/// @param module The module
+/// @param which MODULE_RING_TX or MODULE_RING_RX
+/// @param packet The packet as passed to a data callback
+static void module_deliver(struct waveform_module* module, enum module_ring which, struct waveform_vita_packet* packet)
+{
+   const struct waveform_packet_info* info = get_packet_info(packet);
+   size_t length = (size_t) info->payload_words * sizeof(uint32_t);
+   struct waveform_module_packet* slot;
+   bool wake;
+
+   pthread_mutex_lock(&module->ring_locks[which]);
+
+   slot = spsc_ring_reserve(&module->rings[which]);
+   if (!slot || length > WF_JUMBO_PAYLOAD)
+   {
+      pthread_mutex_unlock(&module->ring_locks[which]);
+      atomic_fetch_add_explicit(&module->dropped, 1, memory_order_relaxed);
+      return;
+   }
+
+   slot->sample_index = info->sample_index;
+   slot->timestamp_frac = info->timestamp_frac;
+   slot->timestamp_int = info->timestamp_int;
+   slot->stream_id = info->stream_id;
+   slot->sample_rate = info->sample_rate;
+   slot->num_samples = info->num_samples;
+   slot->length = (uint32_t) length;
+   slot->lane = which == MODULE_RING_TX ? WF_DATA_LANE_TX : WF_DATA_LANE_RX;
+   slot->channels = info->channels;
+   slot->bits_per_sample = info->bits_per_sample;
+   slot->flags = info->flags;
+   memcpy(slot->payload, info->payload, length);
+   wake = spsc_ring_commit(&module->rings[which]);
+
+   pthread_mutex_unlock(&module->ring_locks[which]);
+
+   atomic_fetch_add_explicit(&module->delivered, 1, memory_order_relaxed);
+   if (wake)
+   {
+      eventfd_write(module->data_fd, 1);
+   }
+}
+
+static void module_tx_data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size,
+                              void* arg)
+{
+   module_deliver((struct waveform_module*) arg, MODULE_RING_TX, packet);
+}
+
+static void module_rx_data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size,
+                              void* arg)
+{
+   module_deliver((struct waveform_module*) arg, MODULE_RING_RX, packet);
+}
+
+static void module_state_cb(struct waveform_t* waveform, enum waveform_state state, void* arg)
+{
+   struct waveform_module* module = (struct waveform_module*) arg;
+
+   pthread_mutex_lock(&module->lock);
+
+   switch (state)
+   {
+      case ACTIVE:
+         module->active = true;
+         break;
+      case INACTIVE:
+         module->active = false;
+         module->transmitting = false;
+         break;
+      case PTT_REQUESTED:
+         module->transmitting = true;
+         break;
+      case UNKEY_REQUESTED:
+         module->transmitting = false;
+         break;
+   }
+
+   if (module->ctrl_fd != -1)
+   {
+      module_send_message(module->ctrl_fd, MODULE_MESSAGE_STATE, 0, state, NULL);
+   }
+
+   pthread_mutex_unlock(&module->lock);
+}
+
+/// @brief Frees a module that has been halted
+/// @param module The module
+static void module_free(struct waveform_module* module)
+{
+   close(module->data_fd);
+   close(module->send_fd);
+   munmap(module->shared, module->shm_size);
+   close(module->shm_fd);
+
+   pthread_mutex_destroy(&module->lock);
+   for (int i = 0; i < MODULE_RING_SEND; ++i)
+   {
+      pthread_mutex_destroy(&module->ring_locks[i]);
+   }
+
+   for (char** arg = module->argv; arg && *arg; ++arg)
+   {
+      alloc_free(WF_ALLOC_OTHER, *arg);
+   }
+   alloc_free(WF_ALLOC_OTHER, module->argv);
+   alloc_free(WF_ALLOC_OTHER, module->path);
+   alloc_free(WF_ALLOC_OTHER, module);
+}
+
+/// @brief Drops a reference to a module, freeing it with the last one
+/// @details The waveform holds one reference and every command waiting for its response another, so a response
+///          that arrives after the waveform is destroyed never finds the module freed.
+/// @param module The module
+static void module_put(struct waveform_module* module)
+{
+   if (atomic_fetch_sub(&module->refs, 1) == 1)
+   {
+      module_free(module);
+   }
+}
+
+static void module_response_cb(struct waveform_t* waveform, unsigned int code, char* message, void* arg)
+{
+   struct module_request* req = (struct module_request*) arg;
+   struct waveform_module* module = req->module;
+
+   //  A module that was restarted since sending the command doesn't know about it.
+   pthread_mutex_lock(&module->lock);
+   if (module->ctrl_fd != -1 && module->generation == req->generation)
+   {
+      module_send_message(module->ctrl_fd, MODULE_MESSAGE_RESPONSE, req->id, code, message);
+   }
+   pthread_mutex_unlock(&module->lock);
+
+   module_put(module);
+   alloc_free(WF_ALLOC_COMMAND, req);
+}
+
+/// @brief Turns the child of fork() into the module
+/// @details The parent has other threads, so only async-signal-safe functions may be called until the exec.  If
+///          the exec fails its errno is written to err_fd.
+/// @param module The module
+/// @param ctrl_fd The module's end of the control socket
+/// @param err_fd The write end of a pipe closed by a successful exec
+/// @param envp The environment of the module
+static void module_exec(struct waveform_module* module, int ctrl_fd, int err_fd, char** envp)
+{
+   int fds[MODULE_FD_COUNT] = {module->shm_fd, ctrl_fd, module->data_fd, module->send_fd};
+   int moved[MODULE_FD_COUNT];
+   sigset_t mask;
+   int err;
+
+   //  Move everything clear of the descriptors the module expects first so no dup2() replaces a
+   //  descriptor that is still to be moved.
+   err_fd = fcntl(err_fd, F_DUPFD_CLOEXEC, MODULE_FIRST_FD + MODULE_FD_COUNT);
+   if (err_fd == -1)
+   {
+      _exit(127);
+   }
+
+   for (int i = 0; i < MODULE_FD_COUNT; ++i)
+   {
+      moved[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, MODULE_FIRST_FD + MODULE_FD_COUNT);
+      if (moved[i] == -1)
+      {
+         goto fail;
+      }
+   }
+
+   for (int i = 0; i < MODULE_FD_COUNT; ++i)
+   {
+      if (dup2(moved[i], MODULE_FIRST_FD + i) == -1)
+      {
+         goto fail;
+      }
+   }
+
+   //  The signal mask survives the exec, and the thread that forked may have signals blocked.
+   sigemptyset(&mask);
+   sigprocmask(SIG_SETMASK, &mask, NULL);
+
+   execve(module->path, module->argv, envp);
+
+fail:
+   err = errno;
+   while (write(err_fd, &err, sizeof(err)) == -1 && errno == EINTR)
+      ;
+   _exit(127);
+}
+
+/// @brief Builds the environment of a module
+/// @details The current environment with WF_MODULE_FD_ENV replaced.  Must be built before fork() since
+///          allocating memory isn't safe in the child.
+/// @param module The module
+/// @returns The environment, whose strings belong to the environment of the process, or NULL on failure
+static char** module_build_env(struct waveform_module* module)
+{
+   size_t prefix = strlen(WF_MODULE_FD_ENV "=");
+   size_t count = 0;
+   char** envp;
+
+   while (environ[count])
+   {
+      ++count;
+   }
+
+   envp = alloc_malloc(WF_ALLOC_OTHER, (count + 2) * sizeof(envp[0]));
+   if (!envp)
+   {
+      return NULL;
+   }
+
+   count = 0;
+   for (char** entry = environ; *entry; ++entry)
+   {
+      if (strncmp(*entry, WF_MODULE_FD_ENV "=", prefix) != 0)
+      {
+         envp[count++] = *entry;
+      }
+   }
+   envp[count++] = module->env_entry;
+   envp[count] = NULL;
+
+   return envp;
+}
+
+/// @brief Starts a run of a module
+/// @param module The module, which must not have a process running
+/// @returns 0 on success or -1 on failure with errno set
+static int module_spawn(struct waveform_module* module)
+{
+   int sv[2];
+   int err_pipe[2];
+   int child_errno;
+   ssize_t ret;
+   char** envp;
+   pid_t pid;
+
+   if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+   {
+      return -1;
+   }
+
+   if (pipe2(err_pipe, O_CLOEXEC) == -1)
+   {
+      goto fail_socket;
+   }
+
+   envp = module_build_env(module);
+   if (!envp)
+   {
+      goto fail_pipe;
+   }
+
+   pid = fork();
+   if (pid == 0)
+   {
+      module_exec(module, sv[1], err_pipe[1], envp);
+   }
+
+   alloc_free(WF_ALLOC_OTHER, envp);
+   close(sv[1]);
+   close(err_pipe[1]);
+   if (pid == -1)
+   {
+      close(err_pipe[0]);
+      close(sv[0]);
+      return -1;
+   }
+
+   //  The pipe is closed without anything written to it once the exec succeeds.
+   do
+   {
+      ret = read(err_pipe[0], &child_errno, sizeof(child_errno));
+   } while (ret == -1 && errno == EINTR);
+   close(err_pipe[0]);
+
+   if (ret == sizeof(child_errno))
+   {
+      waitpid(pid, NULL, 0);
+      close(sv[0]);
+      errno = child_errno;
+      return -1;
+   }
+
+#ifdef SYS_pidfd_open
+   module->pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+   module->pidfd = -1;
+#endif
+
+   module->pid = pid;
+   module->ctrl_open = true;
+   module->attached = false;
+   module->started_ms = module_now_ms();
+   module->last_heartbeat = __atomic_load_n(&module->shared->heartbeat, __ATOMIC_RELAXED);
+   module->heartbeat_ms = module->started_ms;
+   atomic_store(&module->current_pid, pid);
+
+   pthread_mutex_lock(&module->lock);
+   module->ctrl_fd = sv[0];
+   ++module->generation;
+   if (module->active)
+   {
+      module_send_message(module->ctrl_fd, MODULE_MESSAGE_STATE, 0, ACTIVE, NULL);
+   }
+   if (module->transmitting)
+   {
+      module_send_message(module->ctrl_fd, MODULE_MESSAGE_STATE, 0, PTT_REQUESTED, NULL);
+   }
+   pthread_mutex_unlock(&module->lock);
+
+   waveform_log(WF_LOG_INFO, "Started module %s as process %d\n", module->path, (int) pid);
+   return 0;
+
+fail_pipe:
+   close(err_pipe[0]);
+   close(err_pipe[1]);
+fail_socket:
+   close(sv[0]);
+   close(sv[1]);
+   return -1;
+}
+
+/// @brief Forgets the process of a module once it has been reaped
+/// @param module The module
+static void module_forget(struct waveform_module* module)
+{
+   if (module->pidfd != -1)
+   {
+      close(module->pidfd);
+      module->pidfd = -1;
+   }
+
+   pthread_mutex_lock(&module->lock);
+   close(module->ctrl_fd);
+   module->ctrl_fd = -1;
+   pthread_mutex_unlock(&module->lock);
+
+   module->pid = 0;
+   atomic_store(&module->current_pid, 0);
+}
+
+/// @brief Checks whether the process of a module has exited and schedules a restart if so
+/// @param module The module
+static void module_reap(struct waveform_module* module)
+{
+   int status;
+   pid_t ret = waitpid(module->pid, &status, WNOHANG);
+   uint64_t now;
+
+   if (ret == 0 || (ret == -1 && errno != ECHILD))
+   {
+      return;
+   }
+
+   if (ret == -1)
+   {
+      waveform_log(WF_LOG_WARNING, "Module %s was reaped elsewhere\n", module->path);
+   }
+   else if (WIFSIGNALED(status))
+   {
+      waveform_log(WF_LOG_WARNING, "Module %s was killed by signal %d\n", module->path, WTERMSIG(status));
+   }
+   else
+   {
+      waveform_log(WF_LOG_WARNING, "Module %s exited with status %d\n", module->path, WEXITSTATUS(status));
+   }
+
+   module_forget(module);
+   atomic_fetch_add_explicit(&module->restarts, 1, memory_order_relaxed);
+
+   //  Don't spin on a module that dies as soon as it starts.
+   now = module_now_ms();
+   module->respawn_ms = now - module->started_ms < MODULE_MIN_LIFETIME_MS ? now + MODULE_BACKOFF_MS : now;
+}
+
+/// @brief Kills a module that has packets waiting but has stopped looking for them
+/// @details Time before the module first looks for packets isn't counted, so a slow start isn't mistaken for a
+///          stall.
+/// @param module The module
+/// @param now The monotonic time in milliseconds
+static void module_check_stall(struct waveform_module* module, uint64_t now)
+{
+   uint64_t heartbeat = __atomic_load_n(&module->shared->heartbeat, __ATOMIC_RELAXED);
+   unsigned int stall_ms = atomic_load(&module->stall_ms);
+
+   if (heartbeat != module->last_heartbeat)
+   {
+      module->attached = true;
+   }
+
+   if (heartbeat != module->last_heartbeat ||
+       (spsc_ring_empty(&module->rings[MODULE_RING_TX]) && spsc_ring_empty(&module->rings[MODULE_RING_RX])))
+   {
+      module->last_heartbeat = heartbeat;
+      module->heartbeat_ms = now;
+      return;
+   }
+
+   if (module->pid == 0 || !module->attached || stall_ms == 0 || now - module->heartbeat_ms < stall_ms)
+   {
+      return;
+   }
+
+   waveform_log(WF_LOG_WARNING, "Module %s has not taken packets for %u ms, restarting it\n", module->path, stall_ms);
+   kill(module->pid, SIGKILL);
+   atomic_fetch_add_explicit(&module->stalls, 1, memory_order_relaxed);
+   module->heartbeat_ms = now;
+}
+
+/// @brief Sends the samples a module has queued to the radio
+/// @param module The module
+static void module_drain_sends(struct waveform_module* module)
+{
+   struct spsc_ring* ring = &module->rings[MODULE_RING_SEND];
+   struct waveform_module_packet* packet;
+
+   //  At most a ring's worth at a time, so a module that keeps moving head can't keep the supervisor here.
+   for (uint32_t n = 0; n < MODULE_RING_SLOTS && (packet = spsc_ring_peek(ring)); ++n)
+   {
+      //  The module can write anything into the ring, so check what it wrote.
+      uint32_t num_samples = packet->num_samples;
+      uint8_t type = packet->lane;
+
+      if (num_samples <= WF_JUMBO_PAYLOAD / sizeof(float) && (type == SPEAKER_DATA || type == TRANSMITTER_DATA))
+      {
+         waveform_send_data_packet(module->wf, (float*) packet->payload, num_samples, (enum waveform_packet_type) type);
+         atomic_fetch_add_explicit(&module->sent, 1, memory_order_relaxed);
+      }
+      spsc_ring_release(ring);
+   }
+}
+
+/// @brief Sends the commands a module has sent on to the radio
+/// @param module The module
+static void module_forward_commands(struct waveform_module* module)
+{
+   struct module_message msg;
+   struct module_request* req;
+   int ret;
+
+   while ((ret = module_recv_message(module->ctrl_fd, &msg)) == 1)
+   {
+      if (msg.type != MODULE_MESSAGE_COMMAND)
+      {
+         continue;
+      }
+
+      req = alloc_malloc(WF_ALLOC_COMMAND, sizeof(*req));
+      if (!req)
+      {
+         module_send_message(module->ctrl_fd, MODULE_MESSAGE_RESPONSE, msg.id, MODULE_SEND_FAILED, "Out of memory");
+         continue;
+      }
+
+      req->module = module;
+      req->generation = module->generation;
+      req->id = msg.id;
+      atomic_fetch_add(&module->refs, 1);
+      if (waveform_send_api_command_cb(module->wf, module_response_cb, req, "%s", msg.text) < 0)
+      {
+         module_send_message(module->ctrl_fd, MODULE_MESSAGE_RESPONSE, msg.id, MODULE_SEND_FAILED, "Not connected");
+         atomic_fetch_sub(&module->refs, 1);
+         alloc_free(WF_ALLOC_COMMAND, req);
+      }
+   }
+
+   if (ret == -1)
+   {
+      module->ctrl_open = false;
+   }
+}
+
+/// @brief Stops the process of a module, politely at first
+/// @param module The module
+static void module_terminate(struct waveform_module* module)
+{
+   if (module->pid == 0)
+   {
+      return;
+   }
+
+   kill(module->pid, SIGTERM);
+   for (unsigned int waited = 0; waitpid(module->pid, NULL, WNOHANG) == 0; waited += MODULE_POLL_MS)
+   {
+      if (waited >= MODULE_KILL_WAIT_MS)
+      {
+         kill(module->pid, SIGKILL);
+         waitpid(module->pid, NULL, 0);
+         break;
+      }
+      poll(NULL, 0, MODULE_POLL_MS);
+   }
+
+   module_forget(module);
+}
+
+static void* module_supervise(void* arg)
+{
+   struct waveform_module* module = (struct waveform_module*) arg;
+   struct pollfd fds[3];
+   eventfd_t count;
+
+   while (atomic_load(&module->running))
+   {
+      nfds_t nfds = 1;
+      int ctrl_index = -1;
+
+      if (module->pid == 0 && module_now_ms() >= module->respawn_ms)
+      {
+         if (module_spawn(module) == -1)
+         {
+            waveform_log(WF_LOG_ERROR, "Couldn't restart module %s: %s\n", module->path, strerror(errno));
+            module->respawn_ms = module_now_ms() + MODULE_BACKOFF_MS;
+         }
+      }
+
+      fds[0] = (struct pollfd){.fd = module->send_fd, .events = POLLIN};
+      if (module->pid != 0 && module->ctrl_open)
+      {
+         ctrl_index = (int) nfds;
+         fds[nfds++] = (struct pollfd){.fd = module->ctrl_fd, .events = POLLIN};
+      }
+      if (module->pidfd != -1)
+      {
+         fds[nfds++] = (struct pollfd){.fd = module->pidfd, .events = POLLIN};
+      }
+
+      if (poll(fds, nfds, MODULE_POLL_MS) == -1 && errno != EINTR)
+      {
+         waveform_log(WF_LOG_ERROR, "Polling module %s: %s\n", module->path, strerror(errno));
+         break;
+      }
+
+      if (fds[0].revents & POLLIN)
+      {
+         eventfd_read(module->send_fd, &count);
+      }
+      module_drain_sends(module);
+
+      if (ctrl_index != -1 && fds[ctrl_index].revents)
+      {
+         module_forward_commands(module);
+      }
+
+      if (module->pid != 0)
+      {
+         module_check_stall(module, module_now_ms());
+         module_reap(module);
+      }
+   }
+
+   module_terminate(module);
+   return NULL;
+}
+
+/// @brief Stops the supervisor and process of a module without touching the waveform's callbacks
+/// @param module The module
+static void module_halt(struct waveform_module* module)
+{
+   pthread_mutex_lock(&module->lock);
+   bool running = atomic_exchange(&module->running, false);
+   pthread_mutex_unlock(&module->lock);
+
+   if (running)
+   {
+      pthread_join(module->thread, NULL);
+   }
+}
+
+/// @brief Creates the shared memory and doorbells of a module
+/// @param module The module
+/// @returns 0 on success or -1 on failure
+static int module_create_shared(struct waveform_module* module)
+{
+   size_t ring_size = spsc_ring_size(MODULE_RING_SLOTS, module_slot_size());
+
+   module->shm_size = sizeof(struct module_shared) + MODULE_RINGS * ring_size;
+   module->shm_fd = memfd_create("waveform-module", MFD_CLOEXEC);
+   if (module->shm_fd == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create module memory: %s\n", strerror(errno));
+      return -1;
+   }
+
+   if (ftruncate(module->shm_fd, (off_t) module->shm_size) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't size module memory: %s\n", strerror(errno));
+      goto fail_fd;
+   }
+
+   module->shared = mmap(NULL, module->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, module->shm_fd, 0);
+   if (module->shared == MAP_FAILED)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't map module memory: %s\n", strerror(errno));
+      goto fail_fd;
+   }
+
+   module->shared->version = MODULE_VERSION;
+   for (int i = 0; i < MODULE_RINGS; ++i)
+   {
+      //  The module can write over anything in the memory, so the offsets and geometry used here are the ones
+      //  worked out above, never read back from it.
+      size_t offset = sizeof(struct module_shared) + i * ring_size;
+
+      module->shared->ring_offset[i] = offset;
+      spsc_ring_init(&module->rings[i], (uint8_t*) module->shared + offset, MODULE_RING_SLOTS, module_slot_size());
+   }
+   __atomic_store_n(&module->shared->magic, MODULE_MAGIC, __ATOMIC_RELEASE);
+
+   module->data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   module->send_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (module->data_fd == -1 || module->send_fd == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create module doorbells: %s\n", strerror(errno));
+      goto fail_eventfd;
+   }
+
+   return 0;
+
+fail_eventfd:
+   if (module->data_fd != -1)
+   {
+      close(module->data_fd);
+   }
+   if (module->send_fd != -1)
+   {
+      close(module->send_fd);
+   }
+   munmap(module->shared, module->shm_size);
+fail_fd:
+   close(module->shm_fd);
+   return -1;
+}
+
+/// @brief Bumps the heartbeat the supervisor watches for stalls
+/// @param client The connection of the module
+static inline void module_client_beat(struct waveform_module_client* client)
+{
+   __atomic_fetch_add(&client->shared->heartbeat, 1, __ATOMIC_RELAXED);
+}
+
+/// @brief Hands the packet last returned by waveform_module_next() back to the waveform
+/// @param client The connection of the module
+static inline void module_client_release(struct waveform_module_client* client)
+{
+   if (client->held)
+   {
+      spsc_ring_release(client->held);
+      client->held = NULL;
+   }
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+void module_halt_all(struct waveform_t* wf)
+{
+   pthread_mutex_lock(&module_list_lock);
+   for (struct waveform_module* module = wf->modules; module; module = module->next)
+   {
+      module_halt(module);
+   }
+   pthread_mutex_unlock(&module_list_lock);
+}
+
+void module_destroy_all(struct waveform_t* wf)
+{
+   pthread_mutex_lock(&module_list_lock);
+   struct waveform_module* module = wf->modules;
+   wf->modules = NULL;
+   pthread_mutex_unlock(&module_list_lock);
+
+   while (module)
+   {
+      struct waveform_module* next = module->next;
+
+      module_halt(module);
+      module_put(module);
+      module = next;
+   }
+}
+
+// ****************************************
+// Public API Functions
+// ****************************************
+struct waveform_module* waveform_module_start(struct waveform_t* waveform, const char* path, char* const argv[])
+{
+   size_t argc = 0;
+   int err;
+   int ret;
+
+   struct waveform_module* module = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*module));
+   if (!module)
+   {
+      return NULL;
+   }
+
+   module->wf = waveform;
+   module->ctrl_fd = -1;
+   module->pidfd = -1;
+   atomic_init(&module->stall_ms, MODULE_DEFAULT_STALL_MS);
+   atomic_init(&module->refs, 1);
+   snprintf(module->env_entry, sizeof(module->env_entry), WF_MODULE_FD_ENV "=%d", MODULE_FIRST_FD);
+
+   while (argv && argv[argc])
+   {
+      ++argc;
+   }
+   if (argc == 0)
+   {
+      argv = (char* const[]){(char*) path, NULL};
+      argc = 1;
+   }
+
+   module->path = alloc_strdup(WF_ALLOC_OTHER, path);
+   module->argv = alloc_calloc(WF_ALLOC_OTHER, argc + 1, sizeof(module->path));
+   if (!module->path || !module->argv)
+   {
+      goto fail_module;
+   }
+
+   for (size_t i = 0; i < argc; ++i)
+   {
+      module->argv[i] = alloc_strdup(WF_ALLOC_OTHER, argv[i]);
+      if (!module->argv[i])
+      {
+         goto fail_module;
+      }
+   }
+
+   if (module_create_shared(module) == -1)
+   {
+      goto fail_module;
+   }
+
+   pthread_mutex_init(&module->lock, NULL);
+   for (int i = 0; i < MODULE_RING_SEND; ++i)
+   {
+      pthread_mutex_init(&module->ring_locks[i], NULL);
+   }
+
+   //  Learn the current state before the first run so it can be told.
+   if (waveform_register_state_cb(waveform, module_state_cb, module) == -1)
+   {
+      goto fail_shared;
+   }
+   module->active = __atomic_load_n(&waveform->active_slice, __ATOMIC_RELAXED) != -1;
+
+   if (module_spawn(module) == -1)
+   {
+      err = errno;
+      waveform_log(WF_LOG_ERROR, "Couldn't start module %s: %s\n", path, strerror(err));
+      goto fail_state;
+   }
+
+   atomic_init(&module->running, true);
+   ret = pthread_create(&module->thread, NULL, module_supervise, module);
+   if (ret)
+   {
+      waveform_log(WF_LOG_ERROR, "Creating thread: %s\n", strerror(ret));
+      atomic_store(&module->running, false);
+      module_terminate(module);
+      err = ret;
+      goto fail_state;
+   }
+
+   if (waveform_register_tx_data_cb(waveform, module_tx_data_cb, module) == -1 ||
+       waveform_register_rx_data_cb(waveform, module_rx_data_cb, module) == -1)
+   {
+      waveform_unregister_tx_data_cb(waveform, module_tx_data_cb, module);
+      module_halt(module);
+      err = ENOMEM;
+      goto fail_state;
+   }
+
+   pthread_mutex_lock(&module_list_lock);
+   module->next = waveform->modules;
+   waveform->modules = module;
+   pthread_mutex_unlock(&module_list_lock);
+
+   return module;
+
+fail_state:
+   waveform_unregister_state_cb(waveform, module_state_cb, module);
+   //  Freed with the waveform in case the state callback is still running.
+   pthread_mutex_lock(&module_list_lock);
+   module->next = waveform->modules;
+   waveform->modules = module;
+   pthread_mutex_unlock(&module_list_lock);
+   errno = err;
+   return NULL;
+
+fail_shared:
+   pthread_mutex_destroy(&module->lock);
+   for (int i = 0; i < MODULE_RING_SEND; ++i)
+   {
+      pthread_mutex_destroy(&module->ring_locks[i]);
+   }
+   close(module->data_fd);
+   close(module->send_fd);
+   munmap(module->shared, module->shm_size);
+   close(module->shm_fd);
+fail_module:
+   for (char** arg = module->argv; arg && *arg; ++arg)
+   {
+      alloc_free(WF_ALLOC_OTHER, *arg);
+   }
+   alloc_free(WF_ALLOC_OTHER, module->argv);
+   alloc_free(WF_ALLOC_OTHER, module->path);
+   alloc_free(WF_ALLOC_OTHER, module);
+   return NULL;
+}
+
+void waveform_module_stop(struct waveform_module* module)
+{
+   if (!atomic_load(&module->running))
+   {
+      return;
+   }
+
+   waveform_unregister_tx_data_cb(module->wf, module_tx_data_cb, module);
+   waveform_unregister_rx_data_cb(module->wf, module_rx_data_cb, module);
+   waveform_unregister_state_cb(module->wf, module_state_cb, module);
+   module_halt(module);
+}
+
+void waveform_module_set_stall_timeout(struct waveform_module* module, unsigned int timeout_ms)
+{
+   atomic_store(&module->stall_ms, timeout_ms);
+}
+
+void waveform_module_get_stats(struct waveform_module* module, struct waveform_module_stats* stats)
+{
+   stats->delivered = atomic_load_explicit(&module->delivered, memory_order_relaxed);
+   stats->dropped = atomic_load_explicit(&module->dropped, memory_order_relaxed);
+   stats->sent = atomic_load_explicit(&module->sent, memory_order_relaxed);
+   stats->restarts = atomic_load_explicit(&module->restarts, memory_order_relaxed);
+   stats->stalls = atomic_load_explicit(&module->stalls, memory_order_relaxed);
+   stats->pid = atomic_load(&module->current_pid);
+}
+
+struct waveform_module_client* waveform_module_attach(void)
+{
+   const char* env = getenv(WF_MODULE_FD_ENV);
+   struct stat st;
+   int base;
+
+   if (!env)
+   {
+      errno = ENOENT;
+      return NULL;
+   }
+   base = atoi(env);
+
+   struct waveform_module_client* client = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*client));
+   if (!client)
+   {
+      return NULL;
+   }
+
+   if (fstat(base, &st) == -1)
+   {
+      goto fail_client;
+   }
+
+   client->shm_size = (size_t) st.st_size;
+   client->shared = mmap(NULL, client->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, base, 0);
+   if (client->shared == MAP_FAILED)
+   {
+      goto fail_client;
+   }
+
+   if (client->shm_size < sizeof(struct module_shared) + MODULE_RINGS * spsc_ring_size(MODULE_RING_SLOTS, module_slot_size()) ||
+       __atomic_load_n(&client->shared->magic, __ATOMIC_ACQUIRE) != MODULE_MAGIC ||
+       client->shared->version != MODULE_VERSION)
+   {
+      errno = EINVAL;
+      goto fail_map;
+   }
+
+   for (int i = 0; i < MODULE_RINGS; ++i)
+   {
+      spsc_ring_attach(&client->rings[i], (uint8_t*) client->shared + client->shared->ring_offset[i], MODULE_RING_SLOTS,
+                       module_slot_size());
+   }
+
+   //  Whatever an earlier run left behind is stale by now.
+   spsc_ring_skip(&client->rings[MODULE_RING_TX]);
+   spsc_ring_skip(&client->rings[MODULE_RING_RX]);
+
+   //  The module's own children have no business with the connection.
+   close(base);
+   client->ctrl_fd = base + 1;
+   client->data_fd = base + 2;
+   client->send_fd = base + 3;
+   fcntl(client->ctrl_fd, F_SETFD, FD_CLOEXEC);
+   fcntl(client->data_fd, F_SETFD, FD_CLOEXEC);
+   fcntl(client->send_fd, F_SETFD, FD_CLOEXEC);
+
+   module_client_beat(client);
+   return client;
+
+fail_map:
+   munmap(client->shared, client->shm_size);
+fail_client:
+   alloc_free(WF_ALLOC_OTHER, client);
+   return NULL;
+}
+
+void waveform_module_detach(struct waveform_module_client* client)
+{
+   module_client_release(client);
+   munmap(client->shared, client->shm_size);
+   close(client->ctrl_fd);
+   close(client->data_fd);
+   close(client->send_fd);
+   alloc_free(WF_ALLOC_OTHER, client);
+}
+
+int waveform_module_wait(struct waveform_module_client* client, int timeout_ms)
+{
+   struct pollfd fds[2] = {{.fd = client->data_fd, .events = POLLIN}, {.fd = client->ctrl_fd, .events = POLLIN}};
+   eventfd_t count;
+   int ret;
+
+   module_client_release(client);
+   module_client_beat(client);
+
+   if (!spsc_ring_empty(&client->rings[MODULE_RING_TX]) || !spsc_ring_empty(&client->rings[MODULE_RING_RX]))
+   {
+      return 1;
+   }
+
+   ret = poll(fds, ARRAY_SIZE(fds), timeout_ms);
+   if (ret == -1)
+   {
+      return errno == EINTR ? 0 : -1;
+   }
+
+   if (fds[1].revents & (POLLHUP | POLLERR))
+   {
+      return -1;
+   }
+
+   if (fds[0].revents & POLLIN)
+   {
+      eventfd_read(client->data_fd, &count);
+   }
+
+   return ret > 0;
+}
+
+int waveform_module_next(struct waveform_module_client* client, const struct waveform_module_packet** packet)
+{
+   module_client_release(client);
+   module_client_beat(client);
+
+   for (int i = MODULE_RING_TX; i <= MODULE_RING_RX; ++i)
+   {
+      struct waveform_module_packet* cur = spsc_ring_peek(&client->rings[i]);
+
+      if (cur)
+      {
+         client->held = &client->rings[i];
+         *packet = cur;
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+int waveform_module_send(struct waveform_module_client* client, enum waveform_packet_type type, const float* samples,
+                         size_t num_samples)
+{
+   struct spsc_ring* ring = &client->rings[MODULE_RING_SEND];
+   struct waveform_module_packet* slot;
+
+   if (num_samples > WF_JUMBO_PAYLOAD / sizeof(float))
+   {
+      return -EFBIG;
+   }
+
+   slot = spsc_ring_reserve(ring);
+   if (!slot)
+   {
+      return -EAGAIN;
+   }
+
+   memset(slot, 0, sizeof(*slot));
+   slot->num_samples = (uint32_t) num_samples;
+   slot->length = (uint32_t) (num_samples * sizeof(float));
+   slot->lane = (uint8_t) type;
+   memcpy(slot->payload, samples, slot->length);
+
+   if (spsc_ring_commit(ring))
+   {
+      eventfd_write(client->send_fd, 1);
+   }
+
+   return 0;
+}
+
+int waveform_module_command(struct waveform_module_client* client, uint32_t id, const char* command)
+{
+   if (strlen(command) > WF_MODULE_MAX_MESSAGE)
+   {
+      errno = E2BIG;
+      return -1;
+   }
+
+   return module_send_message(client->ctrl_fd, MODULE_MESSAGE_COMMAND, id, 0, command);
+}
+
+int waveform_module_event(struct waveform_module_client* client, struct waveform_module_event* event)
+{
+   struct module_message msg;
+   int ret = module_recv_message(client->ctrl_fd, &msg);
+
+   if (ret != 1)
+   {
+      return ret;
+   }
+
+   event->type = msg.type == MODULE_MESSAGE_STATE ? WF_MODULE_STATE : WF_MODULE_RESPONSE;
+   event->id = msg.id;
+   event->code = msg.value;
+   event->state = (enum waveform_state) msg.value;
+   strcpy(event->message, msg.text);
+
+   return 1;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file module.h
+/// @brief Signal processing modules running in child processes
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_MODULE_H
+#define WAVEFORM_SDK_MODULE_H
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_module.h"
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Stops the supervisors and processes of every module of a waveform
+/// @details Afterwards no module sends anything to the radio, but the modules stay allocated for any data
+///          callbacks still running.
+/// @param wf The waveform being destroyed
+void module_halt_all(struct waveform_t* wf);
+
+/// @brief Frees every module of a waveform
+/// @details Must only be called once no data callbacks can run any more.  A module with commands still waiting for
+///          their responses is freed when the last of them arrives.
+/// @param wf The waveform being destroyed
+void module_destroy_all(struct waveform_t* wf);
+
+#endif//WAVEFORM_SDK_MODULE_H
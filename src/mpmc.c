@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file mpmc.c
+/// @brief Bounded lock-free multi-producer multi-consumer queue
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  This is Dmitry Vyukov's bounded MPMC queue.  Every cell carries a sequence number that
+//  says whose turn it is: a cell at position pos is free for a producer when its sequence is
+//  pos, and holds data for a consumer when its sequence is pos + 1.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "mpmc.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct mpmc_cell {
+   _Atomic size_t sequence;
+   size_t length;
+   unsigned char data[];
+};
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Gets a cell of a queue
+/// @param queue The queue holding the cell
+/// @param pos The position of the cell.  Wraps around the queue.
+/// @returns The cell
+static inline struct mpmc_cell* mpmc_cell(struct mpmc_queue* queue, size_t pos)
+{
+   return (struct mpmc_cell*) (queue->cells + (pos & queue->mask) * queue->cell_size);
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int mpmc_init(struct mpmc_queue* queue, size_t capacity, size_t data_size, enum waveform_alloc_tag tag, const char* what)
+{
+   size_t count = 2;
+
+   while (count < capacity)
+   {
+      count <<= 1;
+   }
+
+   queue->data_size = data_size;
+   //  Whole cache lines per cell, so a producer filling one cell doesn't disturb a consumer reading the next.
+   queue->cell_size = DIV_ROUND_UP(sizeof(struct mpmc_cell) + data_size, CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
+   queue->mask = count - 1;
+
+   //  Mapped memory is zeroed and page aligned, which covers the cache line alignment.
+   if (hugemem_alloc(&queue->mem, count * queue->cell_size, tag, what) == -1)
+   {
+      return -1;
+   }
+   queue->cells = queue->mem.base;
+
+   for (size_t i = 0; i < count; ++i)
+   {
+      atomic_init(&mpmc_cell(queue, i)->sequence, i);
+   }
+
+   atomic_init(&queue->enqueue_pos, 0);
+   atomic_init(&queue->dequeue_pos, 0);
+
+   return 0;
+}
+
+void mpmc_destroy(struct mpmc_queue* queue)
+{
+   hugemem_free(&queue->mem);
+   queue->cells = NULL;
+}
+
+bool mpmc_push(struct mpmc_queue* queue, const void* data, size_t length)
+{
+   struct mpmc_cell* cell;
+   size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+   if (length > queue->data_size)
+   {
+      return false;
+   }
+
+   for (;;)
+   {
+      cell = mpmc_cell(queue, pos);
+      size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+      if (diff == 0)
+      {
+         if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                   memory_order_relaxed, memory_order_relaxed))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         //  The consumer hasn't freed this cell from the last lap yet.
+         return false;
+      }
+      else
+      {
+         pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+      }
+   }
+
+   memcpy(cell->data, data, length);
+   cell->length = length;
+   atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+   return true;
+}
+
+ssize_t mpmc_pop(struct mpmc_queue* queue, void* data, size_t length)
+{
+   struct mpmc_cell* cell;
+   size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+   for (;;)
+   {
+      cell = mpmc_cell(queue, pos);
+      size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+      intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+      if (diff == 0)
+      {
+         if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                                                   memory_order_relaxed, memory_order_relaxed))
+         {
+            break;
+         }
+      }
+      else if (diff < 0)
+      {
+         return -1;
+      }
+      else
+      {
+         pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+      }
+   }
+
+   size_t record_length = cell->length;
+   memcpy(data, cell->data, record_length < length ? record_length : length);
+   atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+
+   return (ssize_t) record_length;
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file mpmc.h
+/// @brief Bounded lock-free multi-producer multi-consumer queue
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_MPMC_H
+#define WAVEFORM_SDK_MPMC_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "hugemem.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief A bounded queue of variable length records
+/// @details Each record is copied into a fixed size cell.  Any number of threads may push and pop at the
+///          same time without taking a lock.
+struct mpmc_queue {
+   struct hugemem                mem;
+   char*                         cells;
+   size_t                        cell_size;
+   size_t                        data_size;
+   size_t                        mask;
+   //  Producers and consumers each get a line of their own
+   CACHE_ALIGNED _Atomic size_t  enqueue_pos;
+   CACHE_ALIGNED _Atomic size_t  dequeue_pos;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Allocates a queue
+/// @param queue The queue to initialize
+/// @param capacity The number of records the queue can hold.  Rounded up to a power of two.
+/// @param data_size The largest record the queue can hold in bytes
+/// @param tag The subsystem the memory is charged to
+/// @param what A description of the queue for the log
+/// @returns 0 on success or -1 if the memory couldn't be allocated
+int mpmc_init(struct mpmc_queue* queue, size_t capacity, size_t data_size, enum waveform_alloc_tag tag, const char* what);
+
+/// @brief Frees a queue
+/// @details No other thread may be using the queue.
+/// @param queue The queue to free
+void mpmc_destroy(struct mpmc_queue* queue);
+
+/// @brief Adds a record to the tail of a queue
+/// @param queue The queue to add to
+/// @param data The record to add
+/// @param length The length of the record in bytes
+/// @returns true on success or false if the queue is full or the record is too large
+bool mpmc_push(struct mpmc_queue* queue, const void* data, size_t length);
+
+/// @brief Takes a record from the head of a queue
+/// @param queue The queue to take from
+/// @param data A buffer for the record
+/// @param length The size of the buffer.  Longer records are truncated.
+/// @returns The length of the record, which is more than length if it was truncated, or -1 if the queue is empty
+ssize_t mpmc_pop(struct mpmc_queue* queue, void* data, size_t length);
+
+#endif//WAVEFORM_SDK_MPMC_H
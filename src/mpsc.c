@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file mpsc.c
+/// @brief Unbounded wait-free multi-producer single-consumer queue
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  This is Dmitry Vyukov's intrusive MPSC queue.  Producers swing the tail to their node and
+//  then link the old tail to it.  The stub node keeps the list from ever being empty so the
+//  consumer never has to touch the tail except to re-insert the stub.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stddef.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "mpsc.h"
+
+// ****************************************
+// Global Functions
+// ****************************************
+void mpsc_init(struct mpsc_queue* queue)
+{
+   atomic_init(&queue->stub.next, NULL);
+   atomic_init(&queue->tail, &queue->stub);
+   queue->head = &queue->stub;
+}
+
+void mpsc_push(struct mpsc_queue* queue, struct mpsc_node* node)
+{
+   atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+   struct mpsc_node* prev = atomic_exchange_explicit(&queue->tail, node, memory_order_acq_rel);
+   atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+struct mpsc_node* mpsc_pop(struct mpsc_queue* queue)
+{
+   struct mpsc_node* head = queue->head;
+   struct mpsc_node* next = atomic_load_explicit(&head->next, memory_order_acquire);
+
+   if (head == &queue->stub)
+   {
+      if (next == NULL)
+      {
+         return NULL;
+      }
+      queue->head = next;
+      head = next;
+      next = atomic_load_explicit(&next->next, memory_order_acquire);
+   }
+
+   if (next)
+   {
+      queue->head = next;
+      return head;
+   }
+
+   //  head is the last node we can see.  If a producer has already swung the tail past it we
+   //  have to wait for it to finish linking, so report empty and let its wakeup bring us back.
+   if (head != atomic_load_explicit(&queue->tail, memory_order_acquire))
+   {
+      return NULL;
+   }
+
+   //  Put the stub back behind head so head can be handed out without leaving the list empty.
+   mpsc_push(queue, &queue->stub);
+
+   next = atomic_load_explicit(&head->next, memory_order_acquire);
+   if (next)
+   {
+      queue->head = next;
+      return head;
+   }
+
+   return NULL;
+}
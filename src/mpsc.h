@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file mpsc.h
+/// @brief Unbounded wait-free multi-producer single-consumer queue
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_MPSC_H
+#define WAVEFORM_SDK_MPSC_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdatomic.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief A link in an MPSC queue
+/// @details Embed this in the structure being queued and use container_of to get back to it.
+struct mpsc_node {
+   _Atomic(struct mpsc_node*) next;
+};
+
+/// @brief An intrusive queue that any number of threads may push to and one thread pops from
+/// @details Pushing is a single atomic exchange, so it never waits on another thread.
+struct mpsc_queue {
+   //  Producers only touch the tail and the consumer mostly touches the head
+   CACHE_ALIGNED _Atomic(struct mpsc_node*) tail;
+   CACHE_ALIGNED struct mpsc_node*          head;
+   struct mpsc_node                         stub;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Initializes an empty queue
+/// @param queue The queue to initialize
+void mpsc_init(struct mpsc_queue* queue);
+
+/// @brief Adds a node to the tail of a queue
+/// @details Safe to call from any thread.
+/// @param queue The queue to add to
+/// @param node The node to add.  It belongs to the queue until it is popped.
+void mpsc_push(struct mpsc_queue* queue, struct mpsc_node* node);
+
+/// @brief Takes a node from the head of a queue
+/// @details Only one thread may pop from a queue.  A push that is still in progress is not visible
+///          yet, so an empty result may be followed by more nodes once that producer finishes.
+/// @param queue The queue to take from
+/// @returns The node or NULL if none are available
+struct mpsc_node* mpsc_pop(struct mpsc_queue* queue);
+
+#endif//WAVEFORM_SDK_MPSC_H
@@ -0,0 +1,495 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file plugin.c
+/// @brief Signal processing in shared libraries that can be replaced while the waveform runs
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Each plugin slot holds one loaded build, a shared library opened with dlopen(3), and passes it
+//  the waveform's receive and transmit packets from data callbacks registered for the slot.
+//  Replacing the build must not race with those callbacks, which may run on several workers at
+//  once, but neither may the data path take a lock for every packet.  So every callback counts
+//  itself in and out of the slot, and a swap raises a flag that turns new callbacks away, waits
+//  for the count to drain, hands the state over and lowers the flag again.  Packets turned away in
+//  the meantime are counted as the swap gap.
+//
+//  The library is copied into a memfd before it is opened.  dlopen(3) returns the already loaded
+//  handle for a file it has seen before, so opening a copy is what lets a new build written over
+//  the same path be loaded next to the running one.  It recognises files by name as well, so the
+//  memfd stays open as long as its build is loaded and two builds never share a /proc/self/fd path.
+
+#define _GNU_SOURCE
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "plugin.h"
+#include "utils.h"
+#include "waveform.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct plugin_build {
+   void*                             handle;
+   int                               fd;
+   const struct waveform_plugin_ops* ops;
+   void*                             ctx;
+};
+
+struct waveform_plugin {
+   struct waveform_t*            wf;
+   char*                         path;
+   void*                         arg;
+
+   //  Serializes loading and unloading builds
+   pthread_mutex_t               lock;
+   uint64_t                      gap_mark;
+
+   //  Read by the data callbacks for every packet
+   CACHE_ALIGNED _Atomic(struct plugin_build*) current;
+   _Atomic bool                  swapping;
+   _Atomic unsigned int          in_flight;
+
+   CACHE_ALIGNED _Atomic uint64_t packets;
+   _Atomic uint64_t              gap_total;
+   _Atomic uint64_t              swaps;
+   _Atomic uint64_t              last_gap_ns;
+
+   struct waveform_plugin*       next;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static pthread_mutex_t plugin_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Passes a packet to the running build of a plugin
+/// @param plugin The plugin slot
+/// @param lane The lane the packet arrived on
+/// @param packet The packet
+/// @param packet_size The size of the packet in bytes
+static void plugin_process(struct waveform_plugin* plugin, enum waveform_data_lane lane,
+                           struct waveform_vita_packet* packet, size_t packet_size)
+{
+   struct plugin_build* build;
+
+   //  Paired with plugin_pause(): either the swap sees this callback counted in, or this callback
+   //  sees the swap under way.
+   atomic_fetch_add(&plugin->in_flight, 1);
+
+   if (atomic_load(&plugin->swapping))
+   {
+      const struct waveform_packet_info* info = get_packet_info(packet);
+
+      atomic_fetch_add_explicit(&plugin->gap_total, info->channels ? waveform_packet_num_frames(info) : info->num_samples,
+                                memory_order_relaxed);
+   }
+   else if ((build = atomic_load_explicit(&plugin->current, memory_order_acquire)))
+   {
+      build->ops->process(build->ctx, plugin->wf, lane, packet, packet_size);
+      atomic_fetch_add_explicit(&plugin->packets, 1, memory_order_relaxed);
+   }
+
+   atomic_fetch_sub_explicit(&plugin->in_flight, 1, memory_order_release);
+}
+
+static void plugin_tx_data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size,
+                              void* arg)
+{
+   plugin_process((struct waveform_plugin*) arg, WF_DATA_LANE_TX, packet, packet_size);
+}
+
+static void plugin_rx_data_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size,
+                              void* arg)
+{
+   plugin_process((struct waveform_plugin*) arg, WF_DATA_LANE_RX, packet, packet_size);
+}
+
+/// @brief Stops passing packets to a plugin and waits for the ones being processed
+/// @param plugin The plugin slot
+static void plugin_pause(struct waveform_plugin* plugin)
+{
+   atomic_store(&plugin->swapping, true);
+   while (atomic_load(&plugin->in_flight) != 0)
+   {
+      sched_yield();
+   }
+}
+
+/// @brief Starts passing packets to a plugin again
+/// @param plugin The plugin slot
+static void plugin_resume(struct waveform_plugin* plugin)
+{
+   atomic_store_explicit(&plugin->swapping, false, memory_order_release);
+}
+
+/// @brief Opens a build of a plugin and initializes it
+/// @param plugin The plugin slot
+/// @param path The path of the shared library
+/// @returns The build or NULL on failure
+static struct plugin_build* plugin_open(struct waveform_plugin* plugin, const char* path)
+{
+   char fd_path[32];
+   struct stat st;
+   waveform_plugin_entry_t entry;
+   int in_fd;
+
+   struct plugin_build* build = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*build));
+   if (!build)
+   {
+      return NULL;
+   }
+
+   in_fd = open(path, O_RDONLY | O_CLOEXEC);
+   if (in_fd == -1 || fstat(in_fd, &st) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't open plugin %s: %s\n", path, strerror(errno));
+      goto fail_in;
+   }
+
+   build->fd = memfd_create("waveform-plugin", MFD_CLOEXEC);
+   if (build->fd == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't copy plugin %s: %s\n", path, strerror(errno));
+      goto fail_in;
+   }
+
+   for (off_t copied = 0; copied < st.st_size;)
+   {
+      ssize_t ret = sendfile(build->fd, in_fd, &copied, (size_t) (st.st_size - copied));
+      if (ret <= 0)
+      {
+         waveform_log(WF_LOG_ERROR, "Couldn't copy plugin %s: %s\n", path, ret == 0 ? "File shrank" : strerror(errno));
+         goto fail_copy;
+      }
+   }
+
+   snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", build->fd);
+   build->handle = dlopen(fd_path, RTLD_NOW | RTLD_LOCAL);
+   if (!build->handle)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't load plugin %s: %s\n", path, dlerror());
+      goto fail_copy;
+   }
+
+   close(in_fd);
+
+   entry = (waveform_plugin_entry_t) dlsym(build->handle, WF_PLUGIN_ENTRY);
+   build->ops = entry ? entry() : NULL;
+   if (!build->ops || build->ops->abi_version != WF_PLUGIN_ABI_VERSION || !build->ops->process)
+   {
+      waveform_log(WF_LOG_ERROR, "%s is not a plugin for this library\n", path);
+      goto fail_handle;
+   }
+
+   if (build->ops->init && build->ops->init(plugin->wf, plugin->arg, &build->ctx) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Plugin %s failed to initialize\n", path);
+      goto fail_handle;
+   }
+
+   return build;
+
+fail_handle:
+   dlclose(build->handle);
+   close(build->fd);
+   alloc_free(WF_ALLOC_OTHER, build);
+   return NULL;
+
+fail_copy:
+   close(build->fd);
+fail_in:
+   if (in_fd != -1)
+   {
+      close(in_fd);
+   }
+   alloc_free(WF_ALLOC_OTHER, build);
+   return NULL;
+}
+
+/// @brief Tears down and closes a build that no longer processes packets
+/// @param build The build
+static void plugin_close(struct plugin_build* build)
+{
+   if (!build)
+   {
+      return;
+   }
+
+   if (build->ops->teardown)
+   {
+      build->ops->teardown(build->ctx);
+   }
+   dlclose(build->handle);
+   close(build->fd);
+   alloc_free(WF_ALLOC_OTHER, build);
+}
+
+/// @brief Hands the state of the running build of a plugin to its successor and swaps them
+/// @details Must be called with the plugin paused.
+/// @param plugin The plugin slot
+/// @param build The successor
+/// @returns 0 on success or -1 if the state couldn't be handed over
+static int plugin_handoff(struct waveform_plugin* plugin, struct plugin_build* build)
+{
+   struct plugin_build* cur = atomic_load_explicit(&plugin->current, memory_order_relaxed);
+   void* state = NULL;
+   size_t state_size = 0;
+   int ret = 0;
+
+   if (cur->ops->save_state && build->ops->restore_state)
+   {
+      if (cur->ops->save_state(cur->ctx, &state, &state_size) == -1)
+      {
+         waveform_log(WF_LOG_ERROR, "Plugin %s couldn't save its state\n", cur->ops->name);
+         return -1;
+      }
+
+      ret = build->ops->restore_state(build->ctx, state, state_size);
+      free(state);
+      if (ret == -1)
+      {
+         waveform_log(WF_LOG_ERROR, "Plugin %s refused the state of the running build\n", build->ops->name);
+         return -1;
+      }
+   }
+
+   atomic_store_explicit(&plugin->current, build, memory_order_release);
+   return 0;
+}
+
+/// @brief Closes the running build of a plugin without touching the waveform's callbacks
+/// @param plugin The plugin slot
+static void plugin_detach(struct waveform_plugin* plugin)
+{
+   struct plugin_build* build;
+
+   pthread_mutex_lock(&plugin->lock);
+   plugin_pause(plugin);
+   build = atomic_exchange(&plugin->current, NULL);
+   plugin_resume(plugin);
+   pthread_mutex_unlock(&plugin->lock);
+
+   plugin_close(build);
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+void plugin_halt_all(struct waveform_t* wf)
+{
+   pthread_mutex_lock(&plugin_list_lock);
+   for (struct waveform_plugin* plugin = wf->plugins; plugin; plugin = plugin->next)
+   {
+      plugin_detach(plugin);
+   }
+   pthread_mutex_unlock(&plugin_list_lock);
+}
+
+void plugin_destroy_all(struct waveform_t* wf)
+{
+   pthread_mutex_lock(&plugin_list_lock);
+   struct waveform_plugin* plugin = wf->plugins;
+   wf->plugins = NULL;
+   pthread_mutex_unlock(&plugin_list_lock);
+
+   while (plugin)
+   {
+      struct waveform_plugin* next = plugin->next;
+
+      plugin_detach(plugin);
+      pthread_mutex_destroy(&plugin->lock);
+      alloc_free(WF_ALLOC_OTHER, plugin->path);
+      alloc_free(WF_ALLOC_OTHER, plugin);
+      plugin = next;
+   }
+}
+
+// ****************************************
+// Public API Functions
+// ****************************************
+struct waveform_plugin* waveform_plugin_load(struct waveform_t* waveform, const char* path, void* arg)
+{
+   struct plugin_build* build;
+
+   struct waveform_plugin* plugin = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*plugin));
+   if (!plugin)
+   {
+      return NULL;
+   }
+
+   plugin->wf = waveform;
+   plugin->arg = arg;
+   plugin->path = alloc_strdup(WF_ALLOC_OTHER, path);
+   if (!plugin->path)
+   {
+      goto fail_plugin;
+   }
+
+   build = plugin_open(plugin, path);
+   if (!build)
+   {
+      goto fail_path;
+   }
+
+   pthread_mutex_init(&plugin->lock, NULL);
+   atomic_init(&plugin->current, build);
+
+   if (waveform_register_tx_data_cb(waveform, plugin_tx_data_cb, plugin) == -1 ||
+       waveform_register_rx_data_cb(waveform, plugin_rx_data_cb, plugin) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't register the callbacks of plugin %s\n", path);
+      waveform_unregister_tx_data_cb(waveform, plugin_tx_data_cb, plugin);
+      plugin_detach(plugin);
+      //  Freed with the waveform in case a callback is still running.
+      pthread_mutex_lock(&plugin_list_lock);
+      plugin->next = waveform->plugins;
+      waveform->plugins = plugin;
+      pthread_mutex_unlock(&plugin_list_lock);
+      return NULL;
+   }
+
+   pthread_mutex_lock(&plugin_list_lock);
+   plugin->next = waveform->plugins;
+   waveform->plugins = plugin;
+   pthread_mutex_unlock(&plugin_list_lock);
+
+   waveform_log(WF_LOG_INFO, "Loaded plugin %s from %s\n", build->ops->name, path);
+   return plugin;
+
+fail_path:
+   alloc_free(WF_ALLOC_OTHER, plugin->path);
+fail_plugin:
+   alloc_free(WF_ALLOC_OTHER, plugin);
+   return NULL;
+}
+
+int waveform_plugin_reload(struct waveform_plugin* plugin, const char* path)
+{
+   struct plugin_build* build;
+   struct plugin_build* old;
+   char* new_path = NULL;
+   uint64_t gap_mark;
+   uint64_t start;
+   uint64_t gap_ns;
+   int ret;
+
+   pthread_mutex_lock(&plugin->lock);
+
+   old = atomic_load(&plugin->current);
+   if (!old)
+   {
+      pthread_mutex_unlock(&plugin->lock);
+      return -1;
+   }
+
+   if (path)
+   {
+      new_path = alloc_strdup(WF_ALLOC_OTHER, path);
+      if (!new_path)
+      {
+         pthread_mutex_unlock(&plugin->lock);
+         return -1;
+      }
+   }
+
+   build = plugin_open(plugin, path ? path : plugin->path);
+   if (!build)
+   {
+      pthread_mutex_unlock(&plugin->lock);
+      alloc_free(WF_ALLOC_OTHER, new_path);
+      return -1;
+   }
+
+   gap_mark = atomic_load(&plugin->gap_total);
+   start = monotonic_now_ns();
+   plugin_pause(plugin);
+   ret = plugin_handoff(plugin, build);
+   plugin_resume(plugin);
+   gap_ns = monotonic_now_ns() - start;
+
+   if (ret == -1)
+   {
+      pthread_mutex_unlock(&plugin->lock);
+      plugin_close(build);
+      alloc_free(WF_ALLOC_OTHER, new_path);
+      return -1;
+   }
+
+   if (new_path)
+   {
+      alloc_free(WF_ALLOC_OTHER, plugin->path);
+      plugin->path = new_path;
+   }
+   plugin->gap_mark = gap_mark;
+   atomic_store(&plugin->last_gap_ns, gap_ns);
+   atomic_fetch_add(&plugin->swaps, 1);
+
+   waveform_log(WF_LOG_INFO, "Swapped in plugin %s from %s, processing held up for %llu ns and %llu samples\n",
+                build->ops->name, plugin->path, (unsigned long long) gap_ns,
+                (unsigned long long) (atomic_load(&plugin->gap_total) - plugin->gap_mark));
+
+   pthread_mutex_unlock(&plugin->lock);
+
+   plugin_close(old);
+   return 0;
+}
+
+void waveform_plugin_unload(struct waveform_plugin* plugin)
+{
+   if (!atomic_load(&plugin->current))
+   {
+      return;
+   }
+
+   waveform_unregister_tx_data_cb(plugin->wf, plugin_tx_data_cb, plugin);
+   waveform_unregister_rx_data_cb(plugin->wf, plugin_rx_data_cb, plugin);
+   plugin_detach(plugin);
+}
+
+void waveform_plugin_get_stats(struct waveform_plugin* plugin, struct waveform_plugin_stats* stats)
+{
+   pthread_mutex_lock(&plugin->lock);
+   stats->packets = atomic_load_explicit(&plugin->packets, memory_order_relaxed);
+   stats->swaps = atomic_load(&plugin->swaps);
+   stats->total_gap_samples = atomic_load_explicit(&plugin->gap_total, memory_order_relaxed);
+   stats->last_gap_samples = stats->swaps ? stats->total_gap_samples - plugin->gap_mark : 0;
+   stats->last_gap_ns = atomic_load(&plugin->last_gap_ns);
+   pthread_mutex_unlock(&plugin->lock);
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file plugin.h
+/// @brief Signal processing in shared libraries that can be replaced while the waveform runs
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_PLUGIN_H
+#define WAVEFORM_SDK_PLUGIN_H
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_plugin.h"
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Unloads the running build of every plugin slot of a waveform
+/// @details Data callbacks that still run afterwards skip the plugins.
+/// @param wf The waveform being destroyed
+void plugin_halt_all(struct waveform_t* wf);
+
+/// @brief Unloads and frees every plugin slot of a waveform
+/// @details Must only be called once no data callbacks can run any more.
+/// @param wf The waveform being destroyed
+void plugin_destroy_all(struct waveform_t* wf);
+
+#endif//WAVEFORM_SDK_PLUGIN_H
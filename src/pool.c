@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file pool.c
+/// @brief Preallocated fixed size object pools
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "pool.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+//  Free objects are kept in a list threaded through the objects themselves.
+struct pool_entry {
+   struct pool_entry* next;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+int pool_init(struct pool* pool, size_t obj_size, size_t count, enum waveform_alloc_tag tag)
+{
+   //  Objects are handed to different threads, so keep each one on its own cache lines.
+   size_t align = CACHE_LINE_SIZE;
+
+   if (obj_size < sizeof(struct pool_entry))
+   {
+      obj_size = sizeof(struct pool_entry);
+   }
+   pool->obj_size = DIV_ROUND_UP(obj_size, align) * align;
+   pool->count = count;
+   pool->free_list = NULL;
+
+   //  Mapped memory is page aligned, which covers the cache line alignment.
+   if (hugemem_alloc(&pool->mem, pool->obj_size * count, tag, "data callback pool") == -1)
+   {
+      return -1;
+   }
+   pool->base = pool->mem.base;
+
+   //  Touch every page now so the first packets don't take the page faults.
+   memset(pool->base, 0, pool->obj_size * count);
+
+   for (size_t i = count; i > 0; --i)
+   {
+      struct pool_entry* entry = (struct pool_entry*) (pool->base + (i - 1) * pool->obj_size);
+      entry->next = pool->free_list;
+      pool->free_list = entry;
+   }
+
+   pthread_mutex_init(&pool->lock, NULL);
+
+   return 0;
+}
+
+void pool_destroy(struct pool* pool)
+{
+   pthread_mutex_destroy(&pool->lock);
+   hugemem_free(&pool->mem);
+   pool->base = NULL;
+   pool->free_list = NULL;
+}
+
+void* pool_get(struct pool* pool)
+{
+   pthread_mutex_lock(&pool->lock);
+   struct pool_entry* entry = pool->free_list;
+   if (entry)
+   {
+      pool->free_list = entry->next;
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return entry;
+}
+
+void pool_put(struct pool* pool, void* obj)
+{
+   struct pool_entry* entry = obj;
+
+   pthread_mutex_lock(&pool->lock);
+   entry->next = pool->free_list;
+   pool->free_list = entry;
+   pthread_mutex_unlock(&pool->lock);
+}
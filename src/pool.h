@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file pool.h
+/// @brief Preallocated fixed size object pools
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_POOL_H
+#define WAVEFORM_SDK_POOL_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "hugemem.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct pool_entry;
+
+/// @brief A pool of equally sized objects allocated up front
+/// @details Getting and putting objects never calls into the allocator, so a pool can be used on
+///          threads that must not allocate.
+struct pool {
+   struct hugemem     mem;
+   char*              base;
+   size_t             obj_size;
+   size_t             count;
+   pthread_mutex_t    lock;
+   struct pool_entry* free_list;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Allocates the memory for a pool
+/// @details All of the memory is written to before this returns so that it is faulted in.
+/// @param pool The pool to initialize
+/// @param obj_size The size of each object in the pool
+/// @param count The number of objects in the pool
+/// @param tag The subsystem the memory is charged to
+/// @returns 0 on success or -1 if the memory couldn't be allocated
+int pool_init(struct pool* pool, size_t obj_size, size_t count, enum waveform_alloc_tag tag);
+
+/// @brief Frees the memory for a pool
+/// @details Every object in the pool is freed whether or not it has been returned.
+/// @param pool The pool to free
+void pool_destroy(struct pool* pool);
+
+/// @brief Takes an object from a pool
+/// @param pool The pool to take the object from
+/// @returns An uninitialized object or NULL if every object is in use
+void* pool_get(struct pool* pool);
+
+/// @brief Returns an object to a pool
+/// @param pool The pool the object was taken from
+/// @param obj The object to return
+void pool_put(struct pool* pool, void* obj);
+
+#endif//WAVEFORM_SDK_POOL_H
@@ -30,9 +30,12 @@
 #include <limits.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stdalign.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 // ****************************************
 // Third Party Library Includes
@@ -50,8 +53,11 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
 #include "meters.h"
 #include "radio.h"
+#include "rcu.h"
+#include "transport.h"
 #include "utils.h"
 #include "waveform.h"
 
@@ -72,32 +78,63 @@ enum cmd_cb_type
    CMD_CB_COMPLETE
 };
 
+//  A formatted command waiting for the event loop to write it to the radio, or
+//  without a line, a function posted to run on the event loop
+struct radio_cmd {
+   struct mpsc_node node;
+   sds line;
+   waveform_post_cb_t fn;
+   void* arg;
+};
+
 struct resp_cb_wq_desc {
    unsigned int code;
    sds message;
-   enum cmd_cb_type type;
-   struct response_queue_entry* rq_entry;
+   struct waveform_t* wf;
+   waveform_response_cb_t cb;
+   void* ctx;
 };
 
 struct status_cb_wq_desc {
    struct waveform_t* wf;
    sds message;
-   struct waveform_cb_list* cb;
+   struct waveform_cb cb;
 };
 
 struct cmd_cb_wq_desc {
    int sequence;
    sds message;
    struct waveform_t* wf;
-   struct waveform_cb_list* cb;
+   struct waveform_cb cb;
 };
 
 struct state_cb_wq_desc {
    struct waveform_t* wf;
    enum waveform_state state;
-   struct waveform_cb_list* cb;
+   struct waveform_cb cb;
+};
+
+//  A status object that arrives through a subscription of another name
+struct status_topic {
+   const char* status;
+   const char* topic;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+//  What the library itself needs: slice status for mode changes, and radio status, which carries
+//  the interlock state for PTT.
+static const char* const internal_topics[] = {"slice", "radio"};
+
+static const struct status_topic status_topics[] = {
+      {"interlock", "radio"},
+      {"transmit", "tx"},
 };
 
+//  Subscribed to for a status callback registered without a name, as the library always used to.
+static const char* const all_topics[] = {"slice", "radio", "client"};
+
 // ****************************************
 // Static Functions
 // ****************************************
@@ -109,21 +146,25 @@ struct state_cb_wq_desc {
 ///          the callback and the sequence number to a linked list of response
 ///          queue entries to be looked up when we recieve a command response.
 /// @param waveform A reference to the waveform
+/// @param sequence The sequence number the command was sent with
 /// @param cb A pointer to the function that we will call when the response to this
 ///           command arrives.
 /// @param ctx A pointer to a user-defined context structure that will be provided to the
 ///            callback function when the command response arrives.
-static void add_sequence_to_response_queue(struct waveform_t* waveform,
-                                           waveform_response_cb_t cb, waveform_response_cb_t queued_cb, void* ctx)
+/// @param on_loop Whether to run the callbacks on the radio's event loop rather than the work queue
+static void add_sequence_to_response_queue(struct waveform_t* waveform, uint32_t sequence,
+                                           waveform_response_cb_t cb, waveform_response_cb_t queued_cb, void* ctx,
+                                           bool on_loop)
 {
    struct response_queue_entry* new_entry;
 
-   new_entry = (struct response_queue_entry*) malloc(sizeof(*new_entry));
+   new_entry = (struct response_queue_entry*) alloc_malloc(WF_ALLOC_COMMAND, sizeof(*new_entry));
    new_entry->cb = cb;
    new_entry->queued_cb = queued_cb;
-   new_entry->sequence = waveform->radio->sequence;
+   new_entry->sequence = sequence;
    new_entry->ctx = ctx;
    new_entry->wf = waveform;
+   new_entry->on_loop = on_loop;
 
    pthread_mutex_lock(&(waveform->radio->rq_lock));
    LL_APPEND(waveform->radio->rq_head, new_entry);
@@ -139,37 +180,11 @@ static void add_sequence_to_response_queue(struct waveform_t* waveform,
 static void rq_call_cb(void* arg)
 {
    struct resp_cb_wq_desc* desc = (struct resp_cb_wq_desc*) arg;
-   waveform_response_cb_t cb;
 
-   if (desc->type == CMD_CB_COMPLETE)
-   {
-      cb = desc->rq_entry->cb;
-   }
-   else if (desc->type == CMD_CB_QUEUED)
-   {
-      cb = desc->rq_entry->queued_cb;
-   }
-   else
-   {
-      //  We shouldn't get here.  This isn't a valid command callback type.
-      return;
-   }
+   desc->cb(desc->wf, desc->code, desc->message, desc->ctx);
 
-   if (cb)
-   {
-      cb(desc->rq_entry->wf, desc->code, desc->message, desc->rq_entry->ctx);
-   }
-
-   //  Only free the response queue entry if we're complete, or if we have failed
-   //  to queue the command.  Otherwise we need it in there to call the response
-   //  callback when the command actually executes.
-   if (desc->type == CMD_CB_COMPLETE || (desc->type == CMD_CB_QUEUED && desc->code != 0))
-   {
-      free(desc->rq_entry);
-   }
-
-   sdsfree(desc->message);
-   free(desc);
+   alloc_sds_free(WF_ALLOC_COMMAND, desc->message);
+   alloc_free(WF_ALLOC_COMMAND, desc);
 }
 
 /// @brief Runs any callbacks for a command and removes entries from the command queue
@@ -193,32 +208,59 @@ static void complete_response_entry(struct radio_t* radio,
    struct response_queue_entry* current_entry;
    pthread_workitem_handle_t handle;
    unsigned int gencountp;
-   struct resp_cb_wq_desc* desc = calloc(1, sizeof(*desc));
+
+   //  Only remove the entry from the queue if we're complete, or if we have failed
+   //  to queue the command.  Otherwise we need it in there to call the response
+   //  callback when the command actually executes.
+   bool done = type == CMD_CB_COMPLETE || (type == CMD_CB_QUEUED && code != 0);
 
    pthread_mutex_lock(&(radio->rq_lock));
    LL_SEARCH_SCALAR(radio->rq_head, current_entry, sequence, sequence);
+   if (current_entry && done)
+   {
+      LL_DELETE(radio->rq_head, current_entry);
+   }
    pthread_mutex_unlock(&(radio->rq_lock));
    if (!current_entry)
    {
-      free(desc);
       return;
    }
 
-   desc->code = code;
-   desc->rq_entry = current_entry;
-   desc->message = sdsdup(message);
-   desc->type = type;
+   //  The entry is only read here, on the radio's thread, so the work items for the queued and completion
+   //  responses of a command never race to use or free it.
+   waveform_response_cb_t cb = type == CMD_CB_COMPLETE ? current_entry->cb : current_entry->queued_cb;
+   struct waveform_t* wf = current_entry->wf;
+   void* ctx = current_entry->ctx;
+   bool on_loop = current_entry->on_loop;
+   if (done)
+   {
+      alloc_free(WF_ALLOC_COMMAND, current_entry);
+   }
 
-   //  Only remove the entry from the queue if we're complete, or if we have failed
-   //  to queue the command.  Otherwise we need it in there to call the response
-   //  callback when the command actually executes.
-   if (type == CMD_CB_COMPLETE || (type == CMD_CB_QUEUED && code != 0))
+   if (!cb)
    {
-      pthread_mutex_lock(&(radio->rq_lock));
-      LL_DELETE(radio->rq_head, current_entry);
-      pthread_mutex_unlock(&(radio->rq_lock));
+      return;
+   }
+
+   if (on_loop)
+   {
+      cb(wf, code, message, ctx);
+      return;
+   }
+
+   struct resp_cb_wq_desc* desc = alloc_calloc(WF_ALLOC_COMMAND, 1, sizeof(*desc));
+   if (!desc)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't queue the response to command %u\n", sequence);
+      return;
    }
 
+   desc->code = code;
+   desc->message = alloc_sds_adopt(WF_ALLOC_COMMAND, sdsdup(message));
+   desc->wf = wf;
+   desc->cb = cb;
+   desc->ctx = ctx;
+
    pthread_workqueue_additem_np(radio->cb_wq, rq_call_cb, desc, &handle,
                                 &gencountp);
 }
@@ -233,7 +275,7 @@ static void destroy_response_queue(struct waveform_t* waveform)
    LL_FOREACH_SAFE(waveform->radio->rq_head, current_entry, tmp_entry)
    {
       LL_DELETE(waveform->radio->rq_head, current_entry);
-      free(current_entry);
+      alloc_free(WF_ALLOC_COMMAND, current_entry);
    }
    pthread_mutex_unlock(&(waveform->radio->rq_lock));
 }
@@ -247,9 +289,9 @@ static void radio_call_state_cb(void* arg)
 {
    struct state_cb_wq_desc* desc = (struct state_cb_wq_desc*) arg;
 
-   desc->cb->state_cb(desc->wf, desc->state, desc->cb->arg);
+   desc->cb.state_cb(desc->wf, desc->state, desc->cb.arg);
 
-   free(desc);
+   alloc_free(WF_ALLOC_STATUS, desc);
 }
 
 /// @brief Process changes in the interlock state
@@ -280,13 +322,13 @@ static void interlock_state_change(struct radio_t* radio, sds state)
    {
       waveform_cb_for_each (cur_wf, state_cbs, cur_cb)
       {
-         struct state_cb_wq_desc* desc = calloc(1, sizeof(*desc));
+         struct state_cb_wq_desc* desc = alloc_calloc(WF_ALLOC_STATUS, 1, sizeof(*desc));
          pthread_workitem_handle_t handle;
          unsigned int gencountp;
 
          desc->wf = cur_wf;
          desc->state = cb_state;
-         desc->cb = cur_cb;
+         desc->cb = *cur_cb;
 
          pthread_workqueue_additem_np(radio->cb_wq, radio_call_state_cb, desc, &handle, &gencountp);
       }
@@ -313,13 +355,13 @@ static void mode_change(struct radio_t* radio, sds mode, char slice)
       {
          waveform_cb_for_each (cur_wf, state_cbs, cur_cb)
          {
-            struct state_cb_wq_desc* desc = calloc(1, sizeof(*desc));
+            struct state_cb_wq_desc* desc = alloc_calloc(WF_ALLOC_STATUS, 1, sizeof(*desc));
             pthread_workitem_handle_t handle;
             unsigned int gencountp;
 
             desc->wf = cur_wf;
             desc->state = INACTIVE;
-            desc->cb = cur_cb;
+            desc->cb = *cur_cb;
 
             pthread_workqueue_additem_np(radio->cb_wq, radio_call_state_cb, desc, &handle, &gencountp);
          }
@@ -333,13 +375,13 @@ static void mode_change(struct radio_t* radio, sds mode, char slice)
       {
          waveform_cb_for_each (cur_wf, state_cbs, cur_cb)
          {
-            struct state_cb_wq_desc* desc = calloc(1, sizeof(*desc));
+            struct state_cb_wq_desc* desc = alloc_calloc(WF_ALLOC_STATUS, 1, sizeof(*desc));
             pthread_workitem_handle_t handle;
             unsigned int gencountp;
 
             desc->wf = cur_wf;
             desc->state = ACTIVE;
-            desc->cb = cur_cb;
+            desc->cb = *cur_cb;
 
             pthread_workqueue_additem_np(radio->cb_wq, radio_call_state_cb, desc, &handle, &gencountp);
          }
@@ -360,19 +402,20 @@ static void radio_call_status_cb(void* arg)
    struct status_cb_wq_desc* desc = (struct status_cb_wq_desc*) arg;
 
    sds* argv = sdssplitargs(desc->message, &argc);
+   alloc_sds_adopt_split(WF_ALLOC_STATUS, argv, argc);
    if (argc < 1)
    {
-      sdsfree(desc->message);
-      sdsfreesplitres(argv, argc);
-      free(desc);
+      alloc_sds_free(WF_ALLOC_STATUS, desc->message);
+      alloc_sds_free_split(WF_ALLOC_STATUS, argv, argc);
+      alloc_free(WF_ALLOC_STATUS, desc);
       return;
    }
 
-   (desc->cb->cmd_cb)(desc->wf, argc, argv, desc->cb->arg);
+   (desc->cb.cmd_cb)(desc->wf, argc, argv, desc->cb.arg);
 
-   sdsfreesplitres(argv, argc);
-   sdsfree(desc->message);
-   free(desc);
+   alloc_sds_free_split(WF_ALLOC_STATUS, argv, argc);
+   alloc_sds_free(WF_ALLOC_STATUS, desc->message);
+   alloc_free(WF_ALLOC_STATUS, desc);
 }
 
 /// @brief Handle a status message received from the radio
@@ -387,15 +430,16 @@ static void process_status_message(struct radio_t* radio, sds message)
    int argc;
 
    sds* argv = sdssplitargs(message, &argc);
+   alloc_sds_adopt_split(WF_ALLOC_STATUS, argv, argc);
    if (argc < 1)
    {
-      sdsfreesplitres(argv, argc);
+      alloc_sds_free_split(WF_ALLOC_STATUS, argv, argc);
       return;
    }
 
    if (strcmp(argv[0], "slice") == 0)
    {
-      sds mode = find_kwarg(argc, argv, "mode");
+      sds mode = find_kwarg(WF_ALLOC_STATUS, argc, argv, "mode");
       if (mode)
       {
          errno = 0;
@@ -412,16 +456,16 @@ static void process_status_message(struct radio_t* radio, sds message)
          {
             mode_change(radio, mode, (char) slice);
          }
-         sdsfree(mode);
+         alloc_sds_free(WF_ALLOC_STATUS, mode);
       }
    }
    else if (strcmp(argv[0], "interlock") == 0)
    {
-      sds state = find_kwarg(argc, argv, "state");
+      sds state = find_kwarg(WF_ALLOC_STATUS, argc, argv, "state");
       if (state)
       {
          interlock_state_change(radio, state);
-         sdsfree(state);
+         alloc_sds_free(WF_ALLOC_STATUS, state);
       }
    }
 
@@ -429,14 +473,19 @@ static void process_status_message(struct radio_t* radio, sds message)
    {
       waveform_cb_for_each (cur_wf, status_cbs, cur_cb)
       {
+         if (cur_cb->name != NULL && strcmp(cur_cb->name, argv[0]) != 0)
+         {
+            continue;
+         }
+
          struct status_cb_wq_desc* desc =
-               calloc(1, sizeof(*desc));
+               alloc_calloc(WF_ALLOC_STATUS, 1, sizeof(*desc));
          pthread_workitem_handle_t handle;
          unsigned int gencountp;
 
          desc->wf = cur_wf;
-         desc->message = sdsdup(message);
-         desc->cb = cur_cb;
+         desc->message = alloc_sds_adopt(WF_ALLOC_STATUS, sdsdup(message));
+         desc->cb = *cur_cb;
 
          pthread_workqueue_additem_np(radio->cb_wq,
                                       radio_call_status_cb, desc,
@@ -444,7 +493,7 @@ static void process_status_message(struct radio_t* radio, sds message)
       }
    }
 
-   sdsfreesplitres(argv, argc);
+   alloc_sds_free_split(WF_ALLOC_STATUS, argv, argc);
 }
 
 /// @brief Work queue function to execute callback for a waveform command message
@@ -459,16 +508,17 @@ static void radio_call_command_cb(void* arg)
    struct cmd_cb_wq_desc* desc = (struct cmd_cb_wq_desc*) arg;
 
    sds* argv = sdssplitargs(desc->message, &argc);
+   alloc_sds_adopt_split(WF_ALLOC_COMMAND, argv, argc);
    if (argc < 1)
    {
-      sdsfree(desc->message);
-      sdsfreesplitres(argv, argc);
-      free(desc);
+      alloc_sds_free(WF_ALLOC_COMMAND, desc->message);
+      alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
+      alloc_free(WF_ALLOC_COMMAND, desc);
       return;
    }
 
    int ret =
-         (desc->cb->cmd_cb)(desc->wf, argc - 2, argv + 2, desc->cb->arg);
+         (desc->cb.cmd_cb)(desc->wf, argc - 2, argv + 2, desc->cb.arg);
    if (ret)
    {
       waveform_send_api_command_cb(desc->wf, NULL, NULL,
@@ -482,9 +532,9 @@ static void radio_call_command_cb(void* arg)
                                    desc->sequence);
    }
 
-   sdsfreesplitres(argv, argc);
-   sdsfree(desc->message);
-   free(desc);
+   alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
+   alloc_sds_free(WF_ALLOC_COMMAND, desc->message);
+   alloc_free(WF_ALLOC_COMMAND, desc);
 }
 
 /// @brief Handle a waveform command received from the radio
@@ -500,9 +550,10 @@ static void process_waveform_command(struct radio_t* radio, int sequence,
    int argc;
 
    sds* argv = sdssplitargs(message, &argc);
+   alloc_sds_adopt_split(WF_ALLOC_COMMAND, argv, argc);
    if (argc < 3 || strcmp(argv[0], "slice") != 0)
    {
-      sdsfreesplitres(argv, argc);
+      alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
       return;
    }
 
@@ -514,7 +565,7 @@ static void process_waveform_command(struct radio_t* radio, int sequence,
    {
       waveform_log(WF_LOG_ERROR, "Error finding slice: %s\n", strerror(errno));
 
-      sdsfreesplitres(argv, argc);
+      alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
       return;
    }
 
@@ -532,13 +583,13 @@ static void process_waveform_command(struct radio_t* radio, int sequence,
             continue;
          }
 
-         struct cmd_cb_wq_desc* desc = calloc(1, sizeof(*desc));
+         struct cmd_cb_wq_desc* desc = alloc_calloc(WF_ALLOC_COMMAND, 1, sizeof(*desc));
          pthread_workitem_handle_t handle;
          unsigned int gencountp;
 
          desc->wf = cur_wf;
-         desc->message = sdsdup(message);
-         desc->cb = cur_cb;
+         desc->message = alloc_sds_adopt(WF_ALLOC_COMMAND, sdsdup(message));
+         desc->cb = *cur_cb;
          desc->sequence = sequence;
 
          pthread_workqueue_additem_np(radio->cb_wq,
@@ -547,7 +598,7 @@ static void process_waveform_command(struct radio_t* radio, int sequence,
       }
    }
 
-   sdsfreesplitres(argv, argc);
+   alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
 }
 
 /// @brief Process a line from the radio api
@@ -573,6 +624,7 @@ static void radio_process_line(struct radio_t* radio, sds line)
    char command = *line;
    sdsrange(line, 1, -1);
    sds* tokens = sdssplitlen(line, sdslen(line), "|", 1, &count);
+   alloc_sds_adopt_split(WF_ALLOC_STATUS, tokens, count);
 
    switch (command)
    {
@@ -719,7 +771,7 @@ static void radio_process_line(struct radio_t* radio, sds line)
          break;
    }
 
-   sdsfreesplitres(tokens, count);
+   alloc_sds_free_split(WF_ALLOC_STATUS, tokens, count);
 }
 
 static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int code, char* message, void* arg)
@@ -737,8 +789,9 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
    }
 
    sds* argv = sdssplitargs(message, &argc);
+   alloc_sds_adopt_split(WF_ALLOC_COMMAND, argv, argc);
 
-   if (false == find_kwarg_as_int(argc, argv, "tx_stream_in_id", &waveform->vita.tx_stream_in_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "tx_stream_in_id", &waveform->vita.tx_stream_in_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Incoming TX stream ID\n");
    }
@@ -747,7 +800,7 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
       waveform_log(WF_LOG_DEBUG, "Found Incoming TX stream ID: 0x%08x\n", waveform->vita.tx_stream_in_id);
    }
 
-   if (false == find_kwarg_as_int(argc, argv, "rx_stream_in_id", &waveform->vita.rx_stream_in_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "rx_stream_in_id", &waveform->vita.rx_stream_in_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Incoming RX stream ID\n");
    }
@@ -758,7 +811,7 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
 
    //  TODO: These two streams come to us via the waveform command, but we can't send to them
    //        successfully: tx_stream_out_id, rx_stream_out_id.
-   if (false == find_kwarg_as_int(argc, argv, "tx_stream_out_id", &waveform->vita.tx_stream_out_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "tx_stream_out_id", &waveform->vita.tx_stream_out_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Outgoing TX stream ID\n");
    }
@@ -767,7 +820,7 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
       waveform_log(WF_LOG_DEBUG, "Found Outgoing TX stream ID: 0x%08x\n", waveform->vita.tx_stream_out_id);
    }
 
-   if (false == find_kwarg_as_int(argc, argv, "rx_stream_out_id", &waveform->vita.rx_stream_out_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "rx_stream_out_id", &waveform->vita.rx_stream_out_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Outgoing RX stream ID\n");
    }
@@ -776,7 +829,7 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
       waveform_log(WF_LOG_DEBUG, "Found Outgoing RX stream ID: 0x%08x\n", waveform->vita.rx_stream_out_id);
    }
 
-   if (false == find_kwarg_as_int(argc, argv, "byte_stream_in_id", &waveform->vita.byte_stream_in_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "byte_stream_in_id", &waveform->vita.byte_stream_in_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Incoming Byte stream ID\n");
    }
@@ -785,7 +838,7 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
       waveform_log(WF_LOG_DEBUG, "Found Incoming Byte stream ID: 0x%08x\n", waveform->vita.byte_stream_in_id);
    }
 
-   if (false == find_kwarg_as_int(argc, argv, "byte_stream_out_id", &waveform->vita.byte_stream_out_id))
+   if (false == find_kwarg_as_int(WF_ALLOC_COMMAND, argc, argv, "byte_stream_out_id", &waveform->vita.byte_stream_out_id))
    {
       waveform_log(WF_LOG_ERROR, "Cannot find Outgoing Byte stream ID\n");
    }
@@ -794,7 +847,172 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
       waveform_log(WF_LOG_DEBUG, "Found Outgoing Byte stream ID: 0x%08x\n", waveform->vita.byte_stream_out_id);
    }
 
-   sdsfreesplitres(argv, argc);
+   alloc_sds_free_split(WF_ALLOC_COMMAND, argv, argc);
+}
+
+/// @brief Finds the subscription that delivers a status object
+/// @param status The name of the status object, the first word of the status message
+/// @returns The name to subscribe to, which for most status objects is the same
+static const char* status_topic(const char* status)
+{
+   for (size_t i = 0; i < ARRAY_SIZE(status_topics); ++i)
+   {
+      if (strcmp(status_topics[i].status, status) == 0)
+      {
+         return status_topics[i].topic;
+      }
+   }
+
+   return status;
+}
+
+/// @brief Tests whether a set of subscriptions has a subscription
+/// @param topics The set of subscriptions
+/// @param count The number of subscriptions in the set
+/// @param topic The subscription to look for
+/// @returns true if the subscription is in the set
+static bool has_topic(sds* topics, size_t count, const char* topic)
+{
+   for (size_t i = 0; i < count; ++i)
+   {
+      if (strcmp(topics[i], topic) == 0)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+/// @brief Adds a subscription to a set if it isn't already there
+/// @param topics The set of subscriptions, which may be moved as it grows
+/// @param count The number of subscriptions in the set, updated if one is added
+/// @param topic The subscription to add
+/// @returns true on success or false if the set couldn't be grown, in which case it is unchanged
+static bool add_topic(sds** topics, size_t* count, const char* topic)
+{
+   if (has_topic(*topics, *count, topic))
+   {
+      return true;
+   }
+
+   sds name = alloc_sds_adopt(WF_ALLOC_STATUS, sdsnew(topic));
+   if (!name)
+   {
+      return false;
+   }
+
+   sds* grown = alloc_realloc(WF_ALLOC_STATUS, *topics, (*count + 1) * sizeof(**topics));
+   if (!grown)
+   {
+      alloc_sds_free(WF_ALLOC_STATUS, name);
+      return false;
+   }
+
+   grown[(*count)++] = name;
+   *topics = grown;
+   return true;
+}
+
+/// @brief Frees a set of subscriptions
+/// @param topics The set of subscriptions
+/// @param count The number of subscriptions in the set
+static void free_topics(sds* topics, size_t count)
+{
+   for (size_t i = 0; i < count; ++i)
+   {
+      alloc_sds_free(WF_ALLOC_STATUS, topics[i]);
+   }
+   alloc_free(WF_ALLOC_STATUS, topics);
+}
+
+/// @brief Brings the radio's status subscriptions in line with what is needed
+/// @details Subscribes to what the library needs itself and to the status each registered status callback is for, and
+///          drops subscriptions nothing needs any more.  Only ever run on the radio's event loop while connected, so the
+///          set of current subscriptions needs no locking.
+/// @param radio The radio whose subscriptions to update
+static void radio_update_subscriptions(struct radio_t* radio)
+{
+   struct waveform_t* sender = NULL;
+   sds* wanted = NULL;
+   size_t wanted_count = 0;
+   bool ok = true;
+
+   for (size_t i = 0; i < ARRAY_SIZE(internal_topics); ++i)
+   {
+      ok = ok && add_topic(&wanted, &wanted_count, internal_topics[i]);
+   }
+
+   rcu_read_lock();
+   radio_waveforms_for_each (radio, cur_wf)
+   {
+      if (!sender)
+      {
+         sender = cur_wf;
+      }
+
+      waveform_cb_for_each (cur_wf, status_cbs, cur_cb)
+      {
+         if (cur_cb->name)
+         {
+            ok = ok && add_topic(&wanted, &wanted_count, status_topic(cur_cb->name));
+            continue;
+         }
+
+         for (size_t i = 0; i < ARRAY_SIZE(all_topics); ++i)
+         {
+            ok = ok && add_topic(&wanted, &wanted_count, all_topics[i]);
+         }
+      }
+   }
+   rcu_read_unlock();
+
+   if (!ok)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't allocate status subscriptions\n");
+      free_topics(wanted, wanted_count);
+      return;
+   }
+
+   //  Commands are sent on behalf of a waveform, and with none there's nobody to want status anyway.
+   if (!sender)
+   {
+      free_topics(wanted, wanted_count);
+      return;
+   }
+
+   for (size_t i = 0; i < wanted_count; ++i)
+   {
+      if (!has_topic(radio->subscriptions, radio->subscription_count, wanted[i]))
+      {
+         waveform_send_api_command_cb(sender, NULL, NULL, "sub %s all", wanted[i]);
+      }
+   }
+
+   for (size_t i = 0; i < radio->subscription_count; ++i)
+   {
+      if (!has_topic(wanted, wanted_count, radio->subscriptions[i]))
+      {
+         waveform_send_api_command_cb(sender, NULL, NULL, "unsub %s all", radio->subscriptions[i]);
+      }
+   }
+
+   free_topics(radio->subscriptions, radio->subscription_count);
+   radio->subscriptions = wanted;
+   radio->subscription_count = wanted_count;
+}
+
+/// @brief Runs radio_update_subscriptions() for a change posted from another thread
+/// @details Changes made before the radio connects are picked up when it does.
+/// @param arg The radio
+static void radio_subscriptions_changed_cb(void* arg)
+{
+   struct radio_t* radio = (struct radio_t*) arg;
+
+   if (radio->connected)
+   {
+      radio_update_subscriptions(radio);
+   }
 }
 
 /// @brief Initialize radio after connection established
@@ -803,21 +1021,15 @@ static void radio_set_waveform_streams(struct waveform_t* waveform, unsigned int
 /// @param radio A reference to the radio that has connected
 static void radio_init(struct radio_t* radio)
 {
-   int sub = 0;
+   //  A new connection starts out with no subscriptions.
+   free_topics(radio->subscriptions, radio->subscription_count);
+   radio->subscriptions = NULL;
+   radio->subscription_count = 0;
+   radio->connected = true;
+   radio_update_subscriptions(radio);
 
    radio_waveforms_for_each (radio, cur_wf)
    {
-      if (sub == 0)
-      {
-         waveform_send_api_command_cb(cur_wf, NULL, NULL,
-                                      "sub slice all");
-         waveform_send_api_command_cb(cur_wf, NULL, NULL,
-                                      "sub radio all");
-         waveform_send_api_command_cb(cur_wf, NULL, NULL,
-                                      "sub client all");
-         sub = 1;
-      }
-
       waveform_send_api_command_cb(
             cur_wf, radio_set_waveform_streams, NULL,
             "waveform create name=%s mode=%s underlying_mode=%s version=%s",
@@ -898,13 +1110,45 @@ static void radio_read_cb(struct bufferevent* bev, void* ctx)
 
    struct evbuffer* input_buffer = bufferevent_get_input(bev);
 
-   while ((line = evbuffer_readln(input_buffer, &chars_read,
-                                  EVBUFFER_EOL_ANY)))
+   while ((line = alloc_adopt(WF_ALLOC_STATUS, evbuffer_readln(input_buffer, &chars_read, EVBUFFER_EOL_ANY))))
    {
-      sds newline = sdsnewlen(line, chars_read);
-      free(line);
+      sds newline = alloc_sds_adopt(WF_ALLOC_STATUS, sdsnewlen(line, chars_read));
+      alloc_free(WF_ALLOC_STATUS, line);
+      rcu_read_lock();
       radio_process_line(radio, newline);
-      sdsfree(newline);
+      rcu_read_unlock();
+      alloc_sds_free(WF_ALLOC_STATUS, newline);
+   }
+}
+
+/// @brief Writes queued commands to the radio
+/// @details Commands are formatted on the caller's thread and handed to the event loop through the command
+///          queue, so the bufferevent is only ever touched from this thread.  The eventfd counts submissions
+///          and reading it resets the count, so one wakeup may drain many commands.
+/// @param fd The command eventfd
+/// @param what The libevent event flags
+/// @param arg The radio
+static void radio_cmd_cb(evutil_socket_t fd, short what, void* arg)
+{
+   struct radio_t* radio = (struct radio_t*) arg;
+   struct mpsc_node* node;
+   eventfd_t count;
+
+   eventfd_read(fd, &count);
+
+   while ((node = mpsc_pop(&radio->cmd_queue)))
+   {
+      struct radio_cmd* cmd = container_of(node, struct radio_cmd, node);
+      if (cmd->line)
+      {
+         bufferevent_write(radio->bev, cmd->line, sdslen(cmd->line));
+         alloc_sds_free(WF_ALLOC_COMMAND, cmd->line);
+      }
+      else
+      {
+         cmd->fn(cmd->arg);
+      }
+      alloc_free(WF_ALLOC_COMMAND, cmd);
    }
 }
 
@@ -919,11 +1163,11 @@ static void* radio_evt_loop(void* arg)
    struct radio_t* radio = (struct radio_t*) arg;
 
    evthread_use_pthreads();
+   rcu_register_thread();
 
    radio->base = event_base_new();
 
-   radio->bev = bufferevent_socket_new(
-         radio->base, -1, BEV_OPT_CLOSE_ON_FREE | BEV_OPT_THREADSAFE);
+   radio->bev = radio->transport->radio_open(radio, radio->base);
    if (!radio->bev)
    {
       waveform_log(WF_LOG_FATAL, "Could not create buffer event socket\n");
@@ -932,6 +1176,13 @@ static void* radio_evt_loop(void* arg)
 
    bufferevent_setcb(radio->bev, radio_read_cb, NULL, radio_event_cb,
                      radio);
+
+   radio->cmd_event = event_new(radio->base, radio->cmd_fd, EV_READ | EV_PERSIST, radio_cmd_cb, radio);
+   if (!radio->cmd_event || event_add(radio->cmd_event, NULL))
+   {
+      waveform_log(WF_LOG_FATAL, "Could not create command queue event\n");
+      goto bev_abort;
+   }
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "hicpp-signed-bitwise"
    if (bufferevent_enable(
@@ -943,9 +1194,7 @@ static void* radio_evt_loop(void* arg)
       goto bev_abort;
    }
 
-   if (bufferevent_socket_connect(radio->bev,
-                                  (struct sockaddr*) &radio->addr,
-                                  sizeof(struct sockaddr_in)))
+   if (radio->transport->radio_connect(radio, radio->bev))
    {
       waveform_log(WF_LOG_FATAL, "Could not connect to radio\n");
       goto bev_abort;
@@ -964,35 +1213,50 @@ static void* radio_evt_loop(void* arg)
    }
 
 bev_abort:
+   if (radio->cmd_event)
+   {
+      event_free(radio->cmd_event);
+      radio->cmd_event = NULL;
+   }
    bufferevent_free(radio->bev);
+   radio->transport->radio_close(radio);
 
 eb_abort:
    event_base_free(radio->base);
 
+   rcu_unregister_thread();
    return NULL;
 }
 
-// ****************************************
-// Global Functions
-// ****************************************
-int32_t waveform_radio_send_api_command_cb_va(struct waveform_t* wf,
-                                              struct timespec* at,
-                                              waveform_response_cb_t cb, waveform_response_cb_t queued_cb, void* arg,
-                                              char* command, va_list ap)
+/// @brief Formats a command and queues it for the radio's event loop to write
+/// @param wf A reference to the waveform
+/// @param at When to execute the command, or NULL for immediately
+/// @param cb Callback for the command response, or NULL
+/// @param queued_cb Callback for the timed command being queued, or NULL
+/// @param arg Argument to be passed to the callbacks
+/// @param on_loop Whether to run the callbacks on the radio's event loop rather than the work queue
+/// @param command The format string for the command
+/// @param ap A va_list to complete the format string
+/// @returns The next sequence number or -1
+static int32_t radio_send_command_va(struct waveform_t* wf, struct timespec* at, waveform_response_cb_t cb,
+                                     waveform_response_cb_t queued_cb, void* arg, bool on_loop, char* command,
+                                     va_list ap)
 {
    int cmdlen;
    char* message_format;
-   va_list aq;
+   struct radio_t* radio = wf->radio;
+
+   //  The top bit of the sequence is reserved, so the counter is free to wrap through it.
+   uint32_t sequence = atomic_fetch_add(&radio->sequence, 1) & ~(1U << 31);
 
-   struct evbuffer* output = bufferevent_get_output(wf->radio->bev);
    if (at)
    {
-      cmdlen = asprintf(&message_format, "C%" PRIu32 "|@%ld.%ld|%s\n", wf->radio->sequence, at->tv_sec, at->tv_nsec * 1000,
+      cmdlen = asprintf(&message_format, "C%" PRIu32 "|@%ld.%ld|%s\n", sequence, at->tv_sec, at->tv_nsec * 1000,
                         command);
    }
    else
    {
-      cmdlen = asprintf(&message_format, "C%" PRIu32 "|%s\n", wf->radio->sequence,
+      cmdlen = asprintf(&message_format, "C%" PRIu32 "|%s\n", sequence,
                         command);
    }
 
@@ -1000,25 +1264,61 @@ int32_t waveform_radio_send_api_command_cb_va(struct waveform_t* wf,
    {
       return -1;
    }
+   alloc_adopt(WF_ALLOC_COMMAND, message_format);
 
-   va_copy(aq, ap);
-   sds debugstring = sdscatvprintf(sdsnew("Tx: "), message_format, aq);
-   va_end(aq);
-   waveform_log(WF_LOG_TRACE, "%s", debugstring);
-   sdsfree(debugstring);
+   struct radio_cmd* cmd = alloc_malloc(WF_ALLOC_COMMAND, sizeof(*cmd));
+   if (!cmd)
+   {
+      alloc_free(WF_ALLOC_COMMAND, message_format);
+      return -1;
+   }
 
-   evbuffer_add_vprintf(output, message_format, ap);
+   cmd->fn = NULL;
+   cmd->line = alloc_sds_adopt(WF_ALLOC_COMMAND, sdscatvprintf(sdsempty(), message_format, ap));
+   alloc_free(WF_ALLOC_COMMAND, message_format);
+   if (!cmd->line)
+   {
+      alloc_free(WF_ALLOC_COMMAND, cmd);
+      return -1;
+   }
 
-   free(message_format);
+   waveform_log(WF_LOG_TRACE, "Tx: %s", cmd->line);
 
+   //  The response can't arrive until the command is written, so register for it first.
    if (cb)
    {
-      add_sequence_to_response_queue(wf, cb, queued_cb, arg);
+      add_sequence_to_response_queue(wf, sequence, cb, queued_cb, arg, on_loop);
    }
 
-   wf->radio->sequence = (wf->radio->sequence + 1) & ~(1 << 31);
+   mpsc_push(&radio->cmd_queue, &cmd->node);
+   eventfd_write(radio->cmd_fd, 1);
 
-   return (uint32_t) wf->radio->sequence;
+   return (int32_t) ((sequence + 1) & ~(1U << 31));
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+int32_t waveform_radio_send_api_command_cb_va(struct waveform_t* wf,
+                                              struct timespec* at,
+                                              waveform_response_cb_t cb, waveform_response_cb_t queued_cb, void* arg,
+                                              char* command, va_list ap)
+{
+   return radio_send_command_va(wf, at, cb, queued_cb, arg, false, command, ap);
+}
+
+int32_t radio_send_api_command_on_loop_va(struct waveform_t* wf, struct timespec* at, waveform_response_cb_t cb,
+                                          waveform_response_cb_t queued_cb, void* arg, char* command, va_list ap)
+{
+   return radio_send_command_va(wf, at, cb, queued_cb, arg, true, command, ap);
+}
+
+void radio_subscriptions_changed(struct radio_t* radio)
+{
+   if (waveform_radio_post(radio, radio_subscriptions_changed_cb, radio) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't queue a status subscription update\n");
+   }
 }
 
 // ****************************************
@@ -1026,13 +1326,23 @@ int32_t waveform_radio_send_api_command_cb_va(struct waveform_t* wf,
 // ****************************************
 struct radio_t* waveform_radio_create(struct sockaddr_in* addr)
 {
-   struct radio_t* radio = calloc(1, sizeof(*radio));
+   struct radio_t* radio = alloc_aligned(WF_ALLOC_OTHER, alignof(struct radio_t), sizeof(*radio));
    if (!radio)
    {
       return NULL;
    }
+   memset(radio, 0, sizeof(*radio));
 
    memcpy(&radio->addr, addr, sizeof(struct sockaddr_in));
+   radio->transport = &socket_transport_ops;
+
+   radio->cmd_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (radio->cmd_fd == -1)
+   {
+      alloc_free(WF_ALLOC_OTHER, radio);
+      return NULL;
+   }
+   mpsc_init(&radio->cmd_queue);
 
    pthread_workqueue_init_np();
 
@@ -1043,8 +1353,39 @@ struct radio_t* waveform_radio_create(struct sockaddr_in* addr)
 
 void waveform_radio_destroy(struct radio_t* radio)
 {
+   struct mpsc_node* node;
+
+   //  Anything still queued never made it to the radio, and posted functions are dropped without running.
+   while ((node = mpsc_pop(&radio->cmd_queue)))
+   {
+      struct radio_cmd* cmd = container_of(node, struct radio_cmd, node);
+      alloc_sds_free(WF_ALLOC_COMMAND, cmd->line);
+      alloc_free(WF_ALLOC_COMMAND, cmd);
+   }
+   close(radio->cmd_fd);
+
+   free_topics(radio->subscriptions, radio->subscription_count);
+
    pthread_mutex_destroy(&(radio->rq_lock));
-   free(radio);
+   alloc_free(WF_ALLOC_OTHER, radio);
+}
+
+int waveform_radio_post(struct radio_t* radio, waveform_post_cb_t fn, void* arg)
+{
+   struct radio_cmd* cmd = alloc_malloc(WF_ALLOC_COMMAND, sizeof(*cmd));
+   if (!cmd)
+   {
+      return -1;
+   }
+
+   cmd->line = NULL;
+   cmd->fn = fn;
+   cmd->arg = arg;
+
+   mpsc_push(&radio->cmd_queue, &cmd->node);
+   eventfd_write(radio->cmd_fd, 1);
+
+   return 0;
 }
 
 int waveform_radio_start(struct radio_t* radio)
@@ -1086,7 +1427,7 @@ int waveform_radio_start(struct radio_t* radio)
    ret = pthread_create(&radio->thread, NULL, radio_evt_loop, radio);
    if (ret)
    {
-      free(radio);
+      alloc_free(WF_ALLOC_OTHER, radio);
       waveform_log(WF_LOG_SEVERE, "Creating thread: %s\n", strerror(ret));
       return -1;
    }
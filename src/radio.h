@@ -25,37 +25,58 @@
 // Third Party Library Includes
 // ****************************************
 #include <pthread_workqueue.h>
+#include <sds.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/time.h>
 
 // ****************************************
 // Project Includes
 // ****************************************
+#include "mpsc.h"
+#include "utils.h"
 #include "waveform_api.h"
 
 // ****************************************
 // Structs, Enums, typedefs
 // ****************************************
+struct transport_ops;
+
 struct response_queue_entry {
    struct waveform_t* wf;
    unsigned int sequence;
    waveform_response_cb_t cb;
    waveform_response_cb_t queued_cb;
    void* ctx;
+   //  Run the callbacks on the radio's event loop as each response arrives instead of on the work queue
+   bool on_loop;
    struct response_queue_entry* next;
 };
 
+//  Must be allocated with aligned_alloc() to honor the cache line alignment.
 struct radio_t {
    struct sockaddr_in addr;
    pthread_t thread;
    struct event_base* base;
    struct bufferevent* bev;
    unsigned long handle;
-   _Atomic uint32_t sequence;
    pthread_workqueue_t cb_wq;
+   const struct transport_ops* transport;
+   void* transport_ctx;
+   int cmd_fd;
+   struct event* cmd_event;
+   //  Bumped by every thread that sends a command
+   CACHE_ALIGNED _Atomic uint32_t sequence;
+   //  Taken by senders registering for a response and by the radio thread completing one
+   CACHE_ALIGNED pthread_mutex_t rq_lock;
    struct response_queue_entry* rq_head;
-   pthread_mutex_t rq_lock;
+   //  Commands formatted by any thread, written to bev by the event loop
+   struct mpsc_queue cmd_queue;
+   //  Only touched by the event loop
+   bool connected;
+   sds* subscriptions;
+   size_t subscription_count;
 };
 
 // ****************************************
@@ -76,4 +97,25 @@ int32_t waveform_radio_send_api_command_cb_va(struct waveform_t* wf, struct time
                                               waveform_response_cb_t cb, waveform_response_cb_t queued_cb, void* arg,
                                               char* command, va_list ap);
 
+/// @brief Send a command to the radio and handle its responses on the radio's event loop
+/// @details As waveform_radio_send_api_command_cb_va(), but the callbacks are run on the radio's event loop in the
+///          order the responses arrive, rather than on the work queue where the queued and completion callbacks of a
+///          command may overlap.  The callbacks must return quickly and the message is only valid while they run.
+/// @param wf A reference to the waveform
+/// @param at When to execute the command.  Can be NULL for immediately.
+/// @param cb Callback that we will call when the command response arrives.  Can be NULL.
+/// @param queued_cb Callback we will call when the timed command is successfully queued.  Can be NULL.
+/// @param arg Argument to be passed to the callbacks.
+/// @param command The format string for the command to send to the radio.
+/// @param ap A va_list to complete the format string specified in the command parameter.
+/// @returns The next sequence number or -1
+int32_t radio_send_api_command_on_loop_va(struct waveform_t* wf, struct timespec* at, waveform_response_cb_t cb,
+                                          waveform_response_cb_t queued_cb, void* arg, char* command, va_list ap);
+
+/// @brief Recomputes the radio's status subscriptions after the status callbacks have changed
+/// @details May be called from any thread.  The subscriptions are updated on the radio's event loop once it is
+///          connected.
+/// @param radio The radio whose waveforms' callbacks changed
+void radio_subscriptions_changed(struct radio_t* radio);
+
 #endif//WAVEFORM_SDK_RADIO_H
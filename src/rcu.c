@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file rcu.c
+/// @brief Read-copy-update support for data read on the event loop threads
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  This is a small epoch based reclamation scheme.  Writers publish a new immutable
+//  version of an object with an atomic pointer swap and retire the old one tagged with
+//  the current global epoch.  Readers record the epoch they entered at in their own
+//  reader slot.  A retired object can be freed once no reader slot holds an epoch
+//  at or before the one the object was retired in.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// ****************************************
+// Third Party Library Includes
+// ****************************************
+#include <utlist.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "rcu.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct rcu_retired {
+   void* ptr;
+   void (*free_fn)(void*);
+   uint64_t epoch;
+   struct rcu_retired* next;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static _Atomic uint64_t rcu_epoch = 1;
+static pthread_mutex_t rcu_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_reader* rcu_readers = NULL;
+static struct rcu_retired* rcu_retired_head = NULL;
+static __thread struct rcu_reader* rcu_self = NULL;
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Find the oldest epoch any reader is currently inside of
+/// @details Must be called with rcu_lock held.
+/// @returns The oldest active epoch or UINT64_MAX if no reader is in a critical section.
+static uint64_t rcu_oldest_reader_epoch(void)
+{
+   uint64_t oldest = UINT64_MAX;
+   struct rcu_reader* reader;
+
+   LL_FOREACH(rcu_readers, reader)
+   {
+      uint64_t epoch = atomic_load(&reader->epoch);
+      if (epoch != 0 && epoch < oldest)
+      {
+         oldest = epoch;
+      }
+   }
+
+   return oldest;
+}
+
+/// @brief Free retired objects that are no longer visible
+/// @details Must be called with rcu_lock held.
+static void rcu_reclaim_locked(void)
+{
+   struct rcu_retired* entry;
+   struct rcu_retired* tmp;
+   uint64_t oldest = rcu_oldest_reader_epoch();
+
+   LL_FOREACH_SAFE(rcu_retired_head, entry, tmp)
+   {
+      if (entry->epoch < oldest)
+      {
+         LL_DELETE(rcu_retired_head, entry);
+         entry->free_fn(entry->ptr);
+         alloc_free(WF_ALLOC_OTHER, entry);
+      }
+   }
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+void rcu_register_thread(void)
+{
+   if (rcu_self != NULL)
+   {
+      return;
+   }
+
+   rcu_self = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*rcu_self));
+   if (!rcu_self)
+   {
+      waveform_log(WF_LOG_FATAL, "Cannot allocate RCU reader\n");
+      abort();
+   }
+
+   pthread_mutex_lock(&rcu_lock);
+   LL_PREPEND(rcu_readers, rcu_self);
+   pthread_mutex_unlock(&rcu_lock);
+}
+
+void rcu_unregister_thread(void)
+{
+   if (rcu_self == NULL)
+   {
+      return;
+   }
+
+   pthread_mutex_lock(&rcu_lock);
+   LL_DELETE(rcu_readers, rcu_self);
+   rcu_reclaim_locked();
+   pthread_mutex_unlock(&rcu_lock);
+
+   alloc_free(WF_ALLOC_OTHER, rcu_self);
+   rcu_self = NULL;
+}
+
+void rcu_read_lock(void)
+{
+   //  The store must be visible before we load any protected pointer, otherwise a writer
+   //  could scan our slot, see us idle, and free the version we are about to read.
+   atomic_store_explicit(&rcu_self->epoch, atomic_load_explicit(&rcu_epoch, memory_order_acquire), memory_order_relaxed);
+   atomic_thread_fence(memory_order_seq_cst);
+}
+
+void rcu_read_unlock(void)
+{
+   atomic_store_explicit(&rcu_self->epoch, 0, memory_order_release);
+}
+
+void rcu_retire(void* ptr, void (*free_fn)(void*))
+{
+   if (ptr == NULL)
+   {
+      return;
+   }
+
+   struct rcu_retired* entry = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*entry));
+   if (!entry)
+   {
+      waveform_log(WF_LOG_FATAL, "Cannot allocate RCU retirement entry\n");
+      abort();
+   }
+
+   entry->ptr = ptr;
+   entry->free_fn = free_fn;
+
+   pthread_mutex_lock(&rcu_lock);
+   //  Readers that entered at or before this epoch may still see the object.
+   //  Anyone entering after the increment is guaranteed to see the new version.
+   entry->epoch = atomic_fetch_add(&rcu_epoch, 1);
+   LL_PREPEND(rcu_retired_head, entry);
+   rcu_reclaim_locked();
+   pthread_mutex_unlock(&rcu_lock);
+}
+
+void rcu_reclaim(void)
+{
+   pthread_mutex_lock(&rcu_lock);
+   rcu_reclaim_locked();
+   pthread_mutex_unlock(&rcu_lock);
+}
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file rcu.h
+/// @brief Read-copy-update support for data read on the event loop threads
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_RCU_H
+#define WAVEFORM_SDK_RCU_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdatomic.h>
+#include <stdint.h>
+
+// ****************************************
+// Macros
+// ****************************************
+/// @brief Read an RCU protected pointer
+/// @details Must be called between rcu_read_lock() and rcu_read_unlock().  The object pointed to is
+///          guaranteed not to be freed until the matching rcu_read_unlock().
+#define rcu_dereference(p) atomic_load_explicit(&(p), memory_order_acquire)
+
+/// @brief Publish a new version of an RCU protected pointer
+/// @details The object must be fully initialized before it is published.  Returns the previous
+///          value of the pointer, which should be handed to rcu_retire() once nothing else refers to it.
+#define rcu_exchange(p, v) atomic_exchange_explicit(&(p), (v), memory_order_acq_rel)
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief Per-thread reader state
+/// @details Each reading thread owns one of these.  epoch holds the global epoch observed at
+///          rcu_read_lock() time, or zero when the thread is outside of a read-side critical section.
+struct rcu_reader {
+   _Atomic uint64_t epoch;
+   struct rcu_reader* next;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Registers the calling thread as an RCU reader
+/// @details Must be called by any thread before it calls rcu_read_lock().  Typically called at the top of
+///          an event loop thread.
+void rcu_register_thread(void);
+
+/// @brief Removes the calling thread from the set of RCU readers
+/// @details Must be called before a thread registered with rcu_register_thread() exits.
+void rcu_unregister_thread(void);
+
+/// @brief Enters a read-side critical section
+/// @details Pointers obtained by rcu_dereference() inside the critical section stay valid until the
+///          matching rcu_read_unlock().  This takes no locks and does not write to any shared cache line.
+void rcu_read_lock(void);
+
+/// @brief Leaves a read-side critical section
+void rcu_read_unlock(void);
+
+/// @brief Schedules an object to be freed once no reader can still see it
+/// @details The object must already be unreachable from any RCU protected pointer.  It will be freed
+///          by free_fn after every reader that might have observed it has left its critical section.
+///          Reclamation is attempted opportunistically on this and subsequent calls.
+/// @param ptr The object to free
+/// @param free_fn The function used to free the object
+void rcu_retire(void* ptr, void (*free_fn)(void*));
+
+/// @brief Frees any retired objects that are no longer visible to readers
+void rcu_reclaim(void);
+
+#endif//WAVEFORM_SDK_RCU_H
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file rt.c
+/// @brief Support for running the data path on real-time threads
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "rt.h"
+
+// ****************************************
+// Static Variables
+// ****************************************
+#ifdef WAVEFORM_RT_DEBUG
+static __thread const char* rt_thread_name = NULL;
+static __thread bool rt_reporting = false;
+#endif
+
+// ****************************************
+// Static Functions
+// ****************************************
+#ifdef WAVEFORM_RT_DEBUG
+/// @brief Reports a heap call made on a real-time thread
+/// @details Formats by hand and writes straight to the file descriptor since stdio may allocate and
+///          would recurse back into here.
+/// @param function The name of the heap function that was called
+/// @param size The size requested, or zero for free
+static void rt_report(const char* function, size_t size)
+{
+   char buf[128];
+   char digits[24];
+   size_t len = 0;
+   size_t ndigits = 0;
+
+   if (rt_thread_name == NULL || rt_reporting)
+   {
+      return;
+   }
+   rt_reporting = true;
+
+   do
+   {
+      digits[ndigits++] = (char) ('0' + size % 10);
+      size /= 10;
+   } while (size != 0);
+
+   const char* parts[] = {"rt: ", function, "(", NULL, ") on real-time thread ", rt_thread_name, "\n"};
+   for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); ++i)
+   {
+      if (parts[i] == NULL)
+      {
+         while (ndigits > 0 && len < sizeof(buf))
+         {
+            buf[len++] = digits[--ndigits];
+         }
+         continue;
+      }
+
+      size_t part_len = strlen(parts[i]);
+      if (part_len > sizeof(buf) - len)
+      {
+         part_len = sizeof(buf) - len;
+      }
+      memcpy(buf + len, parts[i], part_len);
+      len += part_len;
+   }
+
+   (void) !write(STDERR_FILENO, buf, len);
+
+   rt_reporting = false;
+}
+#endif
+
+// ****************************************
+// Global Functions
+// ****************************************
+int rt_lock_memory(void)
+{
+   return mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+void rt_prefault_stack(void)
+{
+   volatile unsigned char stack[RT_STACK_PREFAULT_SIZE];
+
+   //  Volatile so the compiler can't drop the writes to a buffer nobody reads.
+   for (size_t i = 0; i < sizeof(stack); i += 64)
+   {
+      stack[i] = 0;
+   }
+}
+
+#ifdef WAVEFORM_RT_DEBUG
+void rt_register_thread(const char* name)
+{
+   rt_thread_name = name;
+}
+
+void rt_unregister_thread(void)
+{
+   rt_thread_name = NULL;
+}
+
+//  glibc's real implementations, which remain reachable under these names.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+void* malloc(size_t size)
+{
+   rt_report("malloc", size);
+   return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size)
+{
+   rt_report("calloc", nmemb * size);
+   return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+   rt_report("realloc", size);
+   return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+   rt_report("aligned_alloc", size);
+   return __libc_memalign(alignment, size);
+}
+
+void free(void* ptr)
+{
+   if (ptr != NULL)
+   {
+      rt_report("free", 0);
+   }
+   __libc_free(ptr);
+}
+#endif
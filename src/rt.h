@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file rt.h
+/// @brief Support for running the data path on real-time threads
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_RT_H
+#define WAVEFORM_SDK_RT_H
+
+// ****************************************
+// Macros
+// ****************************************
+//  How much of each real-time thread's stack to fault in when it starts
+#define RT_STACK_PREFAULT_SIZE (64 * 1024)
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Locks all current and future memory of the process into RAM
+/// @details This is process wide and is never undone, since other waveforms in the same process may
+///          be relying on it.
+/// @returns 0 on success or -1 on failure with errno set
+int rt_lock_memory(void);
+
+/// @brief Faults in the stack of the calling thread
+/// @details Call at the top of a real-time thread so the stack pages it will use are already
+///          present when the thread starts handling packets.
+void rt_prefault_stack(void);
+
+#ifdef WAVEFORM_RT_DEBUG
+/// @brief Marks the calling thread as real-time
+/// @details In WAVEFORM_RT_DEBUG builds the library interposes on the heap functions and reports
+///          every call made on a marked thread to stderr.  Call once the thread has finished setting up
+///          and is about to enter its steady state.
+/// @param name The name to report for the thread
+void rt_register_thread(const char* name);
+
+/// @brief Stops reporting heap use on the calling thread
+void rt_unregister_thread(void);
+#else
+static inline void rt_register_thread(const char* name)
+{
+   (void) name;
+}
+
+static inline void rt_unregister_thread(void)
+{
+}
+#endif
+
+#endif//WAVEFORM_SDK_RT_H
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file shm.c
+/// @brief Publishing VITA-49 streams into shared memory rings
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  Each ring has a single writer, the VITA thread of the waveform, and any number of readers in
+//  other processes.  Readers only ever read the mapping, so they cannot slow the writer down.
+//  Every slot carries its own sequence lock which lets a reader detect that a slot was
+//  overwritten while it was looking at it.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "shm.h"
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct waveform_shm_reader {
+   size_t                      size;
+   struct waveform_shm_header* header;
+   uint8_t*                    slots;
+   uint64_t                    cursor;
+   uint64_t                    expected;
+   uint64_t                    lost;
+};
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Gets the slot of a ring that holds a packet
+/// @param header The header of the ring
+/// @param slots The first slot of the ring
+/// @param n The sequence number of the packet
+/// @returns The slot
+static inline struct waveform_shm_slot* shm_slot(const struct waveform_shm_header* header, uint8_t* slots, uint64_t n)
+{
+   return (struct waveform_shm_slot*) (slots + (n % header->slot_count) * header->slot_size);
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+struct shm_ring* shm_ring_create(const char* prefix, uint32_t stream_id, uint32_t slot_count, size_t payload_size)
+{
+   //  Keep every slot's sequence lock aligned.
+   size_t slot_size = DIV_ROUND_UP(offsetof(struct waveform_shm_slot, payload) + payload_size, sizeof(uint64_t)) * sizeof(uint64_t);
+   if (slot_size < sizeof(struct waveform_shm_slot))
+   {
+      slot_size = sizeof(struct waveform_shm_slot);
+   }
+
+   int fd;
+
+   struct shm_ring* ring = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*ring));
+   if (!ring)
+   {
+      return NULL;
+   }
+
+   ring->name = alloc_sds_adopt(WF_ALLOC_OTHER, sdscatprintf(sdsempty(), WAVEFORM_SHM_NAME_FORMAT, prefix, stream_id));
+   if (!ring->name)
+   {
+      goto fail_ring;
+   }
+
+   ring->size = sizeof(struct waveform_shm_header) + slot_count * slot_size;
+
+   fd = shm_open(ring->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create shared memory ring %s: %s\n", ring->name, strerror(errno));
+      goto fail_name;
+   }
+
+   if (ftruncate(fd, ring->size) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't size shared memory ring %s: %s\n", ring->name, strerror(errno));
+      goto fail_fd;
+   }
+
+   ring->header = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+   if (ring->header == MAP_FAILED)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't map shared memory ring %s: %s\n", ring->name, strerror(errno));
+      goto fail_fd;
+   }
+   close(fd);
+
+   ring->slots = (uint8_t*) (ring->header + 1);
+   ring->header->version = WAVEFORM_SHM_VERSION;
+   ring->header->stream_id = stream_id;
+   ring->header->slot_count = slot_count;
+   ring->header->slot_size = (uint32_t) slot_size;
+   ring->header->head = 0;
+   //  Readers check the magic number last, so publish it after everything else is set up.
+   __atomic_store_n(&ring->header->magic, WAVEFORM_SHM_MAGIC, __ATOMIC_RELEASE);
+
+   return ring;
+
+fail_fd:
+   close(fd);
+   shm_unlink(ring->name);
+fail_name:
+   alloc_sds_free(WF_ALLOC_OTHER, ring->name);
+fail_ring:
+   alloc_free(WF_ALLOC_OTHER, ring);
+   return NULL;
+}
+
+void shm_ring_destroy(struct shm_ring* ring)
+{
+   munmap(ring->header, ring->size);
+   shm_unlink(ring->name);
+   alloc_sds_free(WF_ALLOC_OTHER, ring->name);
+   alloc_free(WF_ALLOC_OTHER, ring);
+}
+
+void shm_ring_publish(struct shm_ring* ring, uint16_t packet_class, uint32_t timestamp_int, uint64_t timestamp_frac,
+                      const void* payload, size_t length)
+{
+   uint64_t n = __atomic_load_n(&ring->header->head, __ATOMIC_RELAXED);
+   struct waveform_shm_slot* slot = shm_slot(ring->header, ring->slots, n);
+   size_t max_length = ring->header->slot_size - offsetof(struct waveform_shm_slot, payload);
+
+   if (length > max_length)
+   {
+      length = max_length;
+   }
+
+   //  Mark the slot as being written before touching any of its contents.
+   __atomic_store_n(&slot->sequence, 2 * n + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+
+   slot->stream_id = ring->header->stream_id;
+   slot->packet_class = packet_class;
+   slot->payload_length = (uint16_t) length;
+   slot->timestamp_int = timestamp_int;
+   slot->reserved = 0;
+   slot->timestamp_frac = timestamp_frac;
+   memcpy(slot->payload, payload, length);
+
+   __atomic_store_n(&slot->sequence, 2 * n + 2, __ATOMIC_RELEASE);
+   __atomic_store_n(&ring->header->head, n + 1, __ATOMIC_RELEASE);
+}
+
+// ****************************************
+// Public API Functions
+// ****************************************
+struct waveform_shm_reader* waveform_shm_open(const char* name)
+{
+   struct stat st;
+   int fd;
+
+   struct waveform_shm_reader* reader = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*reader));
+   if (!reader)
+   {
+      return NULL;
+   }
+
+   fd = shm_open(name, O_RDONLY, 0);
+   if (fd == -1)
+   {
+      goto fail_reader;
+   }
+
+   if (fstat(fd, &st) == -1)
+   {
+      goto fail_fd;
+   }
+
+   if ((size_t) st.st_size < sizeof(struct waveform_shm_header))
+   {
+      errno = EINVAL;
+      goto fail_fd;
+   }
+
+   reader->size = st.st_size;
+   reader->header = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+   if (reader->header == MAP_FAILED)
+   {
+      goto fail_fd;
+   }
+   close(fd);
+
+   if (__atomic_load_n(&reader->header->magic, __ATOMIC_ACQUIRE) != WAVEFORM_SHM_MAGIC ||
+       reader->header->version != WAVEFORM_SHM_VERSION ||
+       reader->header->slot_size < sizeof(struct waveform_shm_slot) ||
+       reader->size < sizeof(struct waveform_shm_header) + (size_t) reader->header->slot_count * reader->header->slot_size)
+   {
+      munmap(reader->header, reader->size);
+      errno = EINVAL;
+      goto fail_reader;
+   }
+
+   reader->slots = (uint8_t*) (reader->header + 1);
+   reader->cursor = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+
+   return reader;
+
+fail_fd:
+   close(fd);
+fail_reader:
+   alloc_free(WF_ALLOC_OTHER, reader);
+   return NULL;
+}
+
+void waveform_shm_close(struct waveform_shm_reader* reader)
+{
+   munmap(reader->header, reader->size);
+   alloc_free(WF_ALLOC_OTHER, reader);
+}
+
+int waveform_shm_next(struct waveform_shm_reader* reader, const struct waveform_shm_slot** slot)
+{
+   uint32_t slot_count = reader->header->slot_count;
+
+   for (;;)
+   {
+      uint64_t head = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+      if (reader->cursor == head)
+      {
+         return 0;
+      }
+
+      //  Everything older than a ring behind the writer is gone.
+      if (head - reader->cursor > slot_count)
+      {
+         reader->lost += head - slot_count - reader->cursor;
+         reader->cursor = head - slot_count;
+      }
+
+      struct waveform_shm_slot* cur = shm_slot(reader->header, reader->slots, reader->cursor);
+      uint64_t expected = 2 * reader->cursor + 2;
+      ++reader->cursor;
+
+      if (__atomic_load_n(&cur->sequence, __ATOMIC_ACQUIRE) != expected)
+      {
+         //  The writer lapped us while we were looking.
+         ++reader->lost;
+         continue;
+      }
+
+      reader->expected = expected;
+      *slot = cur;
+      return 1;
+   }
+}
+
+bool waveform_shm_valid(struct waveform_shm_reader* reader, const struct waveform_shm_slot* slot)
+{
+   //  Make sure all of the caller's reads of the slot happen before we check it again.
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != reader->expected)
+   {
+      ++reader->lost;
+      return false;
+   }
+
+   return true;
+}
+
+uint64_t waveform_shm_lost(struct waveform_shm_reader* reader)
+{
+   return reader->lost;
+}
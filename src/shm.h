@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file shm.h
+/// @brief Publishing VITA-49 streams into shared memory rings
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_SHM_H
+#define WAVEFORM_SDK_SHM_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stddef.h>
+#include <stdint.h>
+
+// ****************************************
+// Third Party Library Includes
+// ****************************************
+#include <sds.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_shm.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief The writer side of a shared memory ring
+struct shm_ring {
+   sds                         name;
+   size_t                      size;
+   struct waveform_shm_header* header;
+   uint8_t*                    slots;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Creates the shared memory ring for a stream
+/// @details Any existing ring with the same name is replaced.
+/// @param prefix The prefix of the ring name
+/// @param stream_id The stream ID the ring carries
+/// @param slot_count The number of packets the ring holds
+/// @param payload_size The largest payload a slot must hold in bytes
+/// @returns The new ring or NULL on failure
+struct shm_ring* shm_ring_create(const char* prefix, uint32_t stream_id, uint32_t slot_count, size_t payload_size);
+
+/// @brief Removes a shared memory ring
+/// @details Readers that still have the ring open keep their mapping but will see no new packets.
+/// @param ring The ring to remove
+void shm_ring_destroy(struct shm_ring* ring);
+
+/// @brief Publishes a packet into a ring
+/// @details There must only ever be one thread publishing into a ring.
+/// @param ring The ring to publish into
+/// @param packet_class The VITA-49 packet class code of the packet
+/// @param timestamp_int The integer timestamp of the packet
+/// @param timestamp_frac The fractional timestamp of the packet
+/// @param payload The payload of the packet
+/// @param length The length of the payload in bytes.  Truncated to the payload size the ring was created with.
+void shm_ring_publish(struct shm_ring* ring, uint16_t packet_class, uint32_t timestamp_int, uint64_t timestamp_frac,
+                      const void* payload, size_t length);
+
+#endif//WAVEFORM_SDK_SHM_H
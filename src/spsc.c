@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file spsc.c
+/// @brief Bounded single-producer single-consumer ring that can be shared between processes
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+//  head and tail count slots from the creation of the ring and never wrap in practice, so the
+//  ring is empty when they are equal and full when they are slot_count apart.  Each side only
+//  writes its own counter, and the builtins are used rather than _Atomic so the layout is the
+//  same plain integers in every process mapping the ring.
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <string.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "spsc.h"
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// @brief Rounds a slot size up to a whole number of cache lines
+/// @param slot_size The size of each slot in bytes
+/// @returns The rounded size in bytes
+static inline uint32_t spsc_slot_stride(size_t slot_size)
+{
+   return (uint32_t) (DIV_ROUND_UP(slot_size, CACHE_LINE_SIZE) * CACHE_LINE_SIZE);
+}
+
+/// @brief Gets a slot of a ring
+/// @param ring The ring
+/// @param n The position of the slot since the ring was created
+/// @returns The slot
+static inline void* spsc_slot(struct spsc_ring* ring, uint64_t n)
+{
+   return ring->shared->slots + (n % ring->slot_count) * ring->slot_size;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+size_t spsc_ring_size(uint32_t slot_count, size_t slot_size)
+{
+   return sizeof(struct spsc_shared) + (size_t) slot_count * spsc_slot_stride(slot_size);
+}
+
+void spsc_ring_init(struct spsc_ring* ring, void* memory, uint32_t slot_count, size_t slot_size)
+{
+   memset(memory, 0, sizeof(struct spsc_shared));
+   spsc_ring_attach(ring, memory, slot_count, slot_size);
+}
+
+void spsc_ring_attach(struct spsc_ring* ring, void* memory, uint32_t slot_count, size_t slot_size)
+{
+   ring->shared = memory;
+   ring->slot_count = slot_count;
+   ring->slot_size = spsc_slot_stride(slot_size);
+}
+
+void* spsc_ring_reserve(struct spsc_ring* ring)
+{
+   uint64_t head = ring->shared->head;
+
+   if (head - __atomic_load_n(&ring->shared->tail, __ATOMIC_ACQUIRE) >= ring->slot_count)
+   {
+      return NULL;
+   }
+
+   return spsc_slot(ring, head);
+}
+
+bool spsc_ring_commit(struct spsc_ring* ring)
+{
+   uint64_t head = ring->shared->head;
+
+   //  The store and the load must not be reordered, or the consumer could go to sleep on an empty
+   //  ring just as the producer decides it doesn't need waking.
+   __atomic_store_n(&ring->shared->head, head + 1, __ATOMIC_SEQ_CST);
+   return __atomic_load_n(&ring->shared->tail, __ATOMIC_SEQ_CST) == head;
+}
+
+void* spsc_ring_peek(struct spsc_ring* ring)
+{
+   uint64_t tail = ring->shared->tail;
+
+   if (__atomic_load_n(&ring->shared->head, __ATOMIC_ACQUIRE) == tail)
+   {
+      return NULL;
+   }
+
+   return spsc_slot(ring, tail);
+}
+
+void spsc_ring_release(struct spsc_ring* ring)
+{
+   __atomic_store_n(&ring->shared->tail, ring->shared->tail + 1, __ATOMIC_SEQ_CST);
+}
+
+void spsc_ring_skip(struct spsc_ring* ring)
+{
+   __atomic_store_n(&ring->shared->tail, __atomic_load_n(&ring->shared->head, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+}
+
+bool spsc_ring_empty(const struct spsc_ring* ring)
+{
+   //  Pairs with spsc_ring_commit() so a consumer that finds the ring empty after its last release is
+   //  guaranteed to be woken.
+   return __atomic_load_n(&ring->shared->head, __ATOMIC_SEQ_CST) ==
+          __atomic_load_n(&ring->shared->tail, __ATOMIC_SEQ_CST);
+}
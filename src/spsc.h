@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file spsc.h
+/// @brief Bounded single-producer single-consumer ring that can be shared between processes
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_SPSC_H
+#define WAVEFORM_SDK_SPSC_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "utils.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+/// @brief The part of a ring that lives in the shared memory
+/// @details Holds no pointers, so the producer and consumer may be in different processes that map it at
+///          different addresses.  The slots follow the structure directly.
+struct spsc_shared {
+   //  Written only by the producer and only by the consumer respectively
+   CACHE_ALIGNED uint64_t head;
+   CACHE_ALIGNED uint64_t tail;
+   CACHE_ALIGNED uint8_t  slots[];
+};
+
+/// @brief One side's handle on a ring
+/// @details The geometry is kept here rather than in the shared memory, so the process on the other side can't
+///          steer this side outside of the ring by writing over it.
+struct spsc_ring {
+   struct spsc_shared* shared;
+   uint32_t            slot_count;
+   uint32_t            slot_size;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Gets the memory a ring needs
+/// @param slot_count The number of slots in the ring
+/// @param slot_size The size of each slot in bytes
+/// @returns The size in bytes, a whole number of cache lines
+size_t spsc_ring_size(uint32_t slot_count, size_t slot_size);
+
+/// @brief Initializes an empty ring
+/// @param ring The handle to set up
+/// @param memory Memory of at least spsc_ring_size() bytes
+/// @param slot_count The number of slots in the ring
+/// @param slot_size The size of each slot in bytes, rounded up to a cache line
+void spsc_ring_init(struct spsc_ring* ring, void* memory, uint32_t slot_count, size_t slot_size);
+
+/// @brief Sets up a handle on a ring that another process has initialized
+/// @param ring The handle to set up
+/// @param memory The ring as passed to spsc_ring_init()
+/// @param slot_count The number of slots in the ring
+/// @param slot_size The size of each slot in bytes as passed to spsc_ring_init()
+void spsc_ring_attach(struct spsc_ring* ring, void* memory, uint32_t slot_count, size_t slot_size);
+
+/// @brief Gets the next free slot for the producer to fill
+/// @param ring The ring
+/// @returns The slot or NULL if the ring is full
+void* spsc_ring_reserve(struct spsc_ring* ring);
+
+/// @brief Hands the slot from spsc_ring_reserve() to the consumer
+/// @param ring The ring
+/// @returns true if the consumer had taken everything before, so it may be waiting to be woken
+bool spsc_ring_commit(struct spsc_ring* ring);
+
+/// @brief Gets the oldest slot for the consumer without taking it
+/// @param ring The ring
+/// @returns The slot or NULL if the ring is empty
+void* spsc_ring_peek(struct spsc_ring* ring);
+
+/// @brief Returns the slot from spsc_ring_peek() to the producer
+/// @param ring The ring
+void spsc_ring_release(struct spsc_ring* ring);
+
+/// @brief Discards everything waiting in a ring
+/// @details Only the consumer may call this.
+/// @param ring The ring
+void spsc_ring_skip(struct spsc_ring* ring);
+
+/// @brief Checks whether anything is waiting in a ring
+/// @param ring The ring
+/// @returns true if the ring is empty
+bool spsc_ring_empty(const struct spsc_ring* ring);
+
+#endif//WAVEFORM_SDK_SPSC_H
@@ -0,0 +1,414 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file transport.c
+/// @brief Transports carrying the radio API and VITA-49 traffic
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// ****************************************
+// Third Party Library Includes
+// ****************************************
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "alloc.h"
+#include "mpmc.h"
+#include "radio.h"
+#include "transport.h"
+#include "utils.h"
+#include "vita.h"
+#include "waveform.h"
+#include "waveform_transport.h"
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct waveform_memory_transport {
+   struct mpmc_queue                to_sdk;
+   struct mpmc_queue                from_sdk;
+   int                              vita_fd;
+   _Atomic(struct bufferevent*)     radio_end;
+   waveform_memory_line_cb_t        line_cb;
+   void*                            line_arg;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static const uint16_t vita_port = 4991;
+
+// ****************************************
+// Socket Transport
+// ****************************************
+static struct bufferevent* socket_radio_open(struct radio_t* radio, struct event_base* base)
+{
+   //  Commands reach the socket through the radio's command queue, so only the event loop touches it.
+   return bufferevent_socket_new(base, -1, BEV_OPT_CLOSE_ON_FREE);
+}
+
+static int socket_radio_connect(struct radio_t* radio, struct bufferevent* bev)
+{
+   return bufferevent_socket_connect(bev, (struct sockaddr*) &radio->addr, sizeof(struct sockaddr_in));
+}
+
+static void socket_radio_close(struct radio_t* radio)
+{
+}
+
+static int socket_vita_open(struct vita* vita, uint16_t* port)
+{
+   struct waveform_t* wf = container_of(vita, struct waveform_t, vita);
+   int sock;
+
+   struct sockaddr_in bind_addr = {
+         .sin_family = AF_INET,
+         .sin_addr.s_addr = htonl(INADDR_ANY),
+         .sin_port = 0,
+   };
+   socklen_t bind_addr_len = sizeof(bind_addr);
+
+   // TODO: This needs to come back in when the radio does sane stuff with ports again
+   //   struct sockaddr_in radio_addr = {
+   //         .sin_family = AF_INET,
+   //         .sin_addr.s_addr = wf->radio->addr.sin_addr.s_addr,
+   //         .sin_port = htons(vita_port)};
+   vita->radio_addr.sin_family = AF_INET;
+   vita->radio_addr.sin_addr.s_addr = wf->radio->addr.sin_addr.s_addr;
+   vita->radio_addr.sin_port = htons(vita_port);
+
+   sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+   if (sock == -1)
+   {
+      waveform_log(WF_LOG_ERROR, " Failed to initialize VITA socket: %s\n", strerror(errno));
+      return -1;
+   }
+
+   if (bind(sock, (struct sockaddr*) &bind_addr, sizeof(bind_addr)))
+   {
+      waveform_log(WF_LOG_ERROR, "error binding socket: %s\n", strerror(errno));
+      goto fail_socket;
+   }
+
+   // TODO: This needs to come back in when the radio does sane stuff with ports again
+   //   if (connect(sock, (struct sockaddr*) &radio_addr, sizeof(struct sockaddr_in)) == -1)
+   //   {
+   //      waveform_log(WF_LOG_ERROR, "Couldn't connect socket: %s\n", strerror(errno));
+   //      goto fail_socket;
+   //   }
+
+   if (getsockname(sock, (struct sockaddr*) &bind_addr, &bind_addr_len) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't get port number of VITA socket\n");
+      goto fail_socket;
+   }
+
+   *port = ntohs(bind_addr.sin_port);
+   return sock;
+
+fail_socket:
+   close(sock);
+   return -1;
+}
+
+static ssize_t socket_vita_recv(struct vita* vita, void* buf, size_t len)
+{
+   //  MSG_TRUNC makes a datagram that doesn't fit report its real length instead of being silently cut short.
+   return recv(vita->sock, buf, len, MSG_TRUNC);
+}
+
+static ssize_t socket_vita_send(struct vita* vita, const void* buf, size_t len)
+{
+   return sendto(vita->sock, buf, len, 0, (const struct sockaddr*) &vita->radio_addr, sizeof(struct sockaddr_in));
+}
+
+static size_t socket_vita_mtu(struct vita* vita)
+{
+   int mtu = 0;
+   socklen_t mtu_len = sizeof(mtu);
+
+   //  The VITA socket isn't connected, so ask the kernel about the route with a socket that is.
+   int probe = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+   if (probe == -1)
+   {
+      return 0;
+   }
+
+   if (connect(probe, (const struct sockaddr*) &vita->radio_addr, sizeof(struct sockaddr_in)) == -1 ||
+       getsockopt(probe, IPPROTO_IP, IP_MTU, &mtu, &mtu_len) == -1)
+   {
+      waveform_log(WF_LOG_INFO, "Couldn't get the MTU of the route to the radio: %s\n", strerror(errno));
+      mtu = 0;
+   }
+
+   close(probe);
+   return mtu > 0 ? (size_t) mtu : 0;
+}
+
+static void socket_vita_close(struct vita* vita)
+{
+   close(vita->sock);
+}
+
+const struct transport_ops socket_transport_ops = {
+      .radio_open = socket_radio_open,
+      .radio_connect = socket_radio_connect,
+      .radio_close = socket_radio_close,
+      .vita_open = socket_vita_open,
+      .vita_recv = socket_vita_recv,
+      .vita_send = socket_vita_send,
+      .vita_mtu = socket_vita_mtu,
+      .vita_close = socket_vita_close,
+};
+
+// ****************************************
+// Memory Transport
+// ****************************************
+/// @brief Libevent callback for lines the library has sent to the in-process radio
+/// @param bev The radio's end of the bufferevent pair
+/// @param ctx The transport
+static void memory_radio_read_cb(struct bufferevent* bev, void* ctx)
+{
+   struct waveform_memory_transport* transport = ctx;
+   struct evbuffer* input = bufferevent_get_input(bev);
+   char* line;
+   size_t len;
+
+   while ((line = alloc_adopt(WF_ALLOC_COMMAND, evbuffer_readln(input, &len, EVBUFFER_EOL_LF))))
+   {
+      if (transport->line_cb)
+      {
+         transport->line_cb(line, transport->line_arg);
+      }
+      alloc_free(WF_ALLOC_COMMAND, line);
+   }
+}
+
+static struct bufferevent* memory_radio_open(struct radio_t* radio, struct event_base* base)
+{
+   struct waveform_memory_transport* transport = radio->transport_ctx;
+   struct bufferevent* pair[2];
+
+   //  The radio end is written from the benchmark's threads, so this pair still needs its lock.
+   if (bufferevent_pair_new(base, BEV_OPT_CLOSE_ON_FREE | BEV_OPT_THREADSAFE, pair) == -1)
+   {
+      return NULL;
+   }
+
+   bufferevent_setcb(pair[1], memory_radio_read_cb, NULL, NULL, transport);
+   bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+   transport->radio_end = pair[1];
+
+   return pair[0];
+}
+
+static int memory_radio_connect(struct radio_t* radio, struct bufferevent* bev)
+{
+   //  There's nothing to wait for, but deliver the event from the loop like a real connection would.
+   bufferevent_trigger_event(bev, BEV_EVENT_CONNECTED, BEV_TRIG_DEFER_CALLBACKS);
+   return 0;
+}
+
+static void memory_radio_close(struct radio_t* radio)
+{
+   struct waveform_memory_transport* transport = radio->transport_ctx;
+   struct bufferevent* radio_end = atomic_exchange(&transport->radio_end, NULL);
+
+   if (radio_end)
+   {
+      bufferevent_free(radio_end);
+   }
+}
+
+static int memory_vita_open(struct vita* vita, uint16_t* port)
+{
+   struct waveform_memory_transport* transport = vita->transport_ctx;
+
+   //  Nothing listens on a port, but the radio API still wants one.
+   *port = vita_port;
+   return transport->vita_fd;
+}
+
+static ssize_t memory_vita_recv(struct vita* vita, void* buf, size_t len)
+{
+   struct waveform_memory_transport* transport = vita->transport_ctx;
+   eventfd_t count;
+
+   //  The eventfd is a semaphore, so this consumes exactly one packet's worth of wakeup.
+   if (eventfd_read(transport->vita_fd, &count) == -1)
+   {
+      return -1;
+   }
+
+   ssize_t ret = mpmc_pop(&transport->to_sdk, buf, len);
+   if (ret == -1)
+   {
+      errno = EAGAIN;
+   }
+   return ret;
+}
+
+static ssize_t memory_vita_send(struct vita* vita, const void* buf, size_t len)
+{
+   struct waveform_memory_transport* transport = vita->transport_ctx;
+
+   if (!mpmc_push(&transport->from_sdk, buf, len))
+   {
+      errno = ENOBUFS;
+      return -1;
+   }
+   return (ssize_t) len;
+}
+
+static size_t memory_vita_mtu(struct vita* vita)
+{
+   //  Packets are copied whole, so any size the waveform is configured for goes through.
+   return 0;
+}
+
+static void memory_vita_close(struct vita* vita)
+{
+   //  The eventfd belongs to the transport and outlives the waveform being active.
+}
+
+const struct transport_ops memory_transport_ops = {
+      .radio_open = memory_radio_open,
+      .radio_connect = memory_radio_connect,
+      .radio_close = memory_radio_close,
+      .vita_open = memory_vita_open,
+      .vita_recv = memory_vita_recv,
+      .vita_send = memory_vita_send,
+      .vita_mtu = memory_vita_mtu,
+      .vita_close = memory_vita_close,
+};
+
+// ****************************************
+// Public API Functions
+// ****************************************
+struct waveform_memory_transport* waveform_memory_transport_create(size_t vita_depth)
+{
+   struct waveform_memory_transport* transport = alloc_calloc(WF_ALLOC_OTHER, 1, sizeof(*transport));
+   if (!transport)
+   {
+      return NULL;
+   }
+
+   if (mpmc_init(&transport->to_sdk, vita_depth, sizeof(union vita_packet_buffer), WF_ALLOC_OTHER,
+                 "memory transport receive queue") == -1)
+   {
+      goto fail_transport;
+   }
+
+   if (mpmc_init(&transport->from_sdk, vita_depth, sizeof(union vita_packet_buffer), WF_ALLOC_OTHER,
+                 "memory transport transmit queue") == -1)
+   {
+      goto fail_to_sdk;
+   }
+
+   transport->vita_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE | EFD_CLOEXEC);
+   if (transport->vita_fd == -1)
+   {
+      goto fail_from_sdk;
+   }
+
+   return transport;
+
+fail_from_sdk:
+   mpmc_destroy(&transport->from_sdk);
+fail_to_sdk:
+   mpmc_destroy(&transport->to_sdk);
+fail_transport:
+   alloc_free(WF_ALLOC_OTHER, transport);
+   return NULL;
+}
+
+void waveform_memory_transport_destroy(struct waveform_memory_transport* transport)
+{
+   close(transport->vita_fd);
+   mpmc_destroy(&transport->from_sdk);
+   mpmc_destroy(&transport->to_sdk);
+   alloc_free(WF_ALLOC_OTHER, transport);
+}
+
+int waveform_radio_set_memory_transport(struct radio_t* radio, struct waveform_memory_transport* transport)
+{
+   if (radio->base != NULL)
+   {
+      return -1;
+   }
+
+   radio->transport = &memory_transport_ops;
+   radio->transport_ctx = transport;
+
+   return 0;
+}
+
+void waveform_memory_transport_set_line_cb(struct waveform_memory_transport* transport, waveform_memory_line_cb_t cb, void* arg)
+{
+   transport->line_cb = cb;
+   transport->line_arg = arg;
+}
+
+int waveform_memory_transport_send_line(struct waveform_memory_transport* transport, const char* line)
+{
+   struct bufferevent* radio_end = atomic_load(&transport->radio_end);
+
+   if (!radio_end)
+   {
+      return -1;
+   }
+
+   bufferevent_lock(radio_end);
+   int ret = bufferevent_write(radio_end, line, strlen(line));
+   if (ret == 0)
+   {
+      ret = bufferevent_write(radio_end, "\n", 1);
+   }
+   bufferevent_unlock(radio_end);
+
+   return ret;
+}
+
+int waveform_memory_transport_inject_vita(struct waveform_memory_transport* transport, const void* packet, size_t length)
+{
+   if (!mpmc_push(&transport->to_sdk, packet, length))
+   {
+      return -1;
+   }
+
+   eventfd_write(transport->vita_fd, 1);
+   return 0;
+}
+
+ssize_t waveform_memory_transport_take_vita(struct waveform_memory_transport* transport, void* packet, size_t length)
+{
+   return mpmc_pop(&transport->from_sdk, packet, length);
+}
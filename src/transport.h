@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file transport.h
+/// @brief Transports carrying the radio API and VITA-49 traffic
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_TRANSPORT_H
+#define WAVEFORM_SDK_TRANSPORT_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdint.h>
+#include <sys/types.h>
+
+// ****************************************
+// Third Party Library Includes
+// ****************************************
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct radio_t;
+struct vita;
+
+/// @brief The operations of a transport
+/// @details The radio thread talks to the radio over a bufferevent, and the VITA thread sends and receives
+///          datagrams over a file descriptor that becomes readable when a packet is waiting.  A transport
+///          decides what is underneath both.  The radio operations run on the radio thread, vita_open() and
+///          vita_close() on the VITA thread, and vita_send() on any thread.
+struct transport_ops {
+   /// @brief Creates the bufferevent for the API connection
+   /// @returns The bufferevent or NULL on failure
+   struct bufferevent* (*radio_open)(struct radio_t* radio, struct event_base* base);
+   /// @brief Starts connecting the API connection
+   /// @details Must result in BEV_EVENT_CONNECTED or an error being delivered to the bufferevent.
+   /// @returns 0 on success or -1 on failure
+   int (*radio_connect)(struct radio_t* radio, struct bufferevent* bev);
+   /// @brief Releases anything radio_open() set up beyond the bufferevent itself
+   void (*radio_close)(struct radio_t* radio);
+   /// @brief Opens the VITA endpoint for a waveform
+   /// @param port Set to the UDP port to report to the radio
+   /// @returns A file descriptor that is readable when a packet can be received, or -1 on failure
+   int (*vita_open)(struct vita* vita, uint16_t* port);
+   /// @brief Receives one VITA packet without blocking
+   /// @returns The full length of the packet, which is more than len if it didn't fit, or -1 with errno set
+   ssize_t (*vita_recv)(struct vita* vita, void* buf, size_t len);
+   /// @brief Sends one VITA packet to the radio
+   /// @returns The number of bytes sent or -1 with errno set
+   ssize_t (*vita_send)(struct vita* vita, const void* buf, size_t len);
+   /// @brief Gets the MTU of the route to the radio
+   /// @returns The MTU in bytes, or 0 if there is no limit or it isn't known
+   size_t (*vita_mtu)(struct vita* vita);
+   /// @brief Closes the VITA endpoint opened with vita_open()
+   void (*vita_close)(struct vita* vita);
+};
+
+// ****************************************
+// Global Variables
+// ****************************************
+//  Talks to a real radio over TCP and UDP
+extern const struct transport_ops socket_transport_ops;
+//  Talks to a struct waveform_memory_transport in the same process
+extern const struct transport_ops memory_transport_ops;
+
+#endif//WAVEFORM_SDK_TRANSPORT_H
@@ -36,6 +36,7 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
 #include "utils.h"
 
 // ****************************************
@@ -63,17 +64,17 @@ static const struct waveform_log_messages {
 // ****************************************
 // Global Functions
 // ****************************************
-sds find_kwarg(int argc, sds* argv, sds key)
+sds find_kwarg(enum waveform_alloc_tag tag, int argc, sds* argv, sds key)
 {
    for (int i = 0; i < argc; ++i)
    {
       int count;
 
-      sds* kvp =
-            sdssplitlen(argv[i], sdslen(argv[i]), "=", 1, &count);
+      sds* kvp = sdssplitlen(argv[i], sdslen(argv[i]), "=", 1, &count);
+      alloc_sds_adopt_split(tag, kvp, count);
       if (count != 2)
       {
-         sdsfreesplitres(kvp, count);
+         alloc_sds_free_split(tag, kvp, count);
          continue;
       }
 
@@ -81,27 +82,28 @@ sds find_kwarg(int argc, sds* argv, sds key)
       {
          sds value = kvp[1];
          kvp[1] = NULL;
-         sdsfreesplitres(kvp, count);
+         alloc_sds_free_split(tag, kvp, count);
          return value;
       }
 
-      sdsfreesplitres(kvp, count);
+      alloc_sds_free_split(tag, kvp, count);
    }
 
    return NULL;
 }
 
-bool find_kwarg_as_int(int argc, sds* argv, sds key, uint32_t* value)
+bool find_kwarg_as_int(enum waveform_alloc_tag tag, int argc, sds* argv, sds key, uint32_t* value)
 {
    sds val_string;
 
-   if ((val_string = find_kwarg(argc, argv, key)) == NULL)
+   if ((val_string = find_kwarg(tag, argc, argv, key)) == NULL)
    {
       return false;
    }
 
    errno = 0;
    *value = strtoul(val_string, NULL, 0);
+   alloc_sds_free(tag, val_string);
    if ((errno == ERANGE && *value == ULONG_MAX) || (errno != 0 && *value == 0))
    {
       *value = 0;
@@ -26,6 +26,8 @@
 // ****************************************
 #include <sds.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 // ****************************************
 // Project Includes
@@ -39,6 +41,12 @@
 #define MEMBER_SIZE(type, member) sizeof(((type*) 0)->member)
 #define DIV_ROUND_UP(n, d) (((n) + (d) -1) / (d))
 
+//  Starts a member on its own cache line so that fields written by different threads
+//  don't keep stealing the line from each other.  Structures using this must be
+//  allocated with aligned_alloc() rather than malloc().
+#define CACHE_LINE_SIZE 64
+#define CACHE_ALIGNED _Alignas(CACHE_LINE_SIZE)
+
 #define container_of(ptr, type, member) ({                      \
         const typeof( ((type *)0)->member ) *__mptr = (ptr);    \
         (type *)( (char *)__mptr - offsetof(type,member) ); })
@@ -71,20 +79,32 @@ short float_to_fixed(double input, unsigned char fractional_bits);
 /// @brief Find a "Keyword" argument in a set of parsed arguments
 /// @details A keyword argument is in the format "keyword=value".  These are very common structures in the API, so we provide functionality to
 ///          parse them easily.  Given the key and set of arguments, we'll return the value as a string.
+/// @param tag The subsystem to charge the strings to.  The returned string must be freed with alloc_sds_free() for it.
 /// @param argc The number of arguments passed in
 /// @param argv A reference to an array of string arguments to parse
 /// @param key The key of the keyword argument you wish to extract
 /// @returns A string value of the value of the argument with the given keyword or NULL on failure to find an element with that keyword.
-sds find_kwarg(int argc, sds* argv, sds key);
+sds find_kwarg(enum waveform_alloc_tag tag, int argc, sds* argv, sds key);
 
 /// @brief Find a "Keyword" argument in a set of parsed arguments and return the value as a integer
 /// @details A keyword argument is in the format "keyword=value".  These are very common structures in the API, so we provide functionality to
 ///          parse them easily.  Given the key and set of arguments, we'll return the value as an integer.
+/// @param tag The subsystem to charge the strings used while parsing to
 /// @param argc The number of arguments passed in
 /// @param argv A reference to an array of string arguments to parse
 /// @param key The key of the keyword argument you wish to extract
 /// @param value an pointer to the integer in which to store the value
 /// @returns true on success or false on failure.  Leaves '0' as the value if there is a failure
-bool find_kwarg_as_int(int argc, sds* argv, sds key, uint32_t* value);
+bool find_kwarg_as_int(enum waveform_alloc_tag tag, int argc, sds* argv, sds key, uint32_t* value);
+
+/// @brief Gets the current time of the monotonic clock
+/// @returns The current time in nanoseconds
+static inline uint64_t monotonic_now_ns(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
 
 #endif// UTILS_H_
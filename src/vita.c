@@ -25,9 +25,11 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,7 +45,12 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
 #include "radio.h"
+#include "rcu.h"
+#include "rt.h"
+#include "shm.h"
+#include "transport.h"
 #include "utils.h"
 #include "vita.h"
 #include "waveform.h"
@@ -51,28 +58,68 @@
 // ****************************************
 // Structs, Enums, typedefs
 // ****************************************
+//  Shared by the descriptors of one packet, so that whichever of them expires first passes the
+//  packet to the expired callbacks and the rest don't.
+struct vita_expiry {
+   _Atomic unsigned int refs;
+   _Atomic bool passed_on;
+};
+
+//  The packet is stored right after the descriptor in a buffer only as large as its
+//  size class, so small packets don't drag a full sized slot through the cache.
 struct data_cb_wq_desc {
-   struct waveform_cb_list* cb;
-   struct waveform_vita_packet packet;
+   struct waveform_cb cb;
+   struct waveform_vita_packet* packet;
    size_t packet_size;
    struct waveform_t* wf;
+   uint64_t enqueued_ns;
+   uint64_t deadline_ns;
+   unsigned int buf_class;
+   //  Points at own_expiry of the first descriptor queued for the packet, which is kept until the last
+   //  descriptor of the packet is released
+   struct vita_expiry* expiry;
+   struct vita_expiry own_expiry;
+   struct data_cb_wq_desc* prev;
    struct data_cb_wq_desc* next;
+   //  Must come right before the packet for get_packet_info()
+   struct waveform_packet_info info;
+   uint64_t buffer[];
 };
 
+_Static_assert(offsetof(struct data_cb_wq_desc, buffer) ==
+                     offsetof(struct data_cb_wq_desc, info) + sizeof(struct waveform_packet_info),
+               "The packet info must directly precede the packet");
+
 // ****************************************
 // Constants
 // ****************************************
-static const uint16_t vita_port = 4991;
+
+//  Packet buffer sizes in bytes, smallest first.  The first covers meters, context and short byte
+//  stream packets and the second a 128 sample stereo audio packet.  The last class is sized at run
+//  time to hold any packet up to the waveform's maximum payload, see vita_buf_class_size().
+static const size_t vita_buf_classes[VITA_BUF_CLASSES - 1] = {
+      256,
+      1088,
+};
+
+//  The IPv4 and UDP headers in front of every VITA packet on the wire, in bytes
+static const size_t ip_udp_header_size = 20 + 8;
+
+//  The size in words of each context field, from bit 30 of the context indicator down to bit 10.  The
+//  fields below those vary in size, so decoding stops there.
+static const uint8_t vita_context_field_words[] = {1, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1, 1, 2, 1, 2, 11, 11, 13, 13, 1};
+
+//  Default weights for WF_LANE_WEIGHTED, indexed by enum waveform_data_lane
+static const unsigned int default_lane_weights[WF_DATA_LANE_MAX] = {
+      [WF_DATA_LANE_TX] = 8,
+      [WF_DATA_LANE_RX] = 4,
+      [WF_DATA_LANE_BYTE] = 2,
+      [WF_DATA_LANE_UNKNOWN] = 1,
+};
 
 // ****************************************
 // Static Variables
 // ****************************************
-static sem_t wq_sem;
-static pthread_mutex_t wq_lock;
-static struct data_cb_wq_desc* wq = NULL;
-static _Atomic bool wq_running = false;
-static pthread_t wq_thread;
-static struct sockaddr_in radio_addr;
 
 // ****************************************
 // Static Functions
@@ -325,406 +372,1427 @@ inline static void vita_swap_payload(struct waveform_vita_packet* packet)
    }
 }
 
-/// @brief Libevent callback for when a VITA packet is read from the UDP socket.
-/// @details When a packet is recieved from the network, libevent calls this callback to let us know.  In here we do all of
-///          our initial packet processing and sanity checks and endian flipping before calling the appropriate user callback
-///          function.
-/// @param socket The socket upon which the VITA packet was received
-/// @param what The event type that occurred
-/// @param ctx A reference to the VITA structure for the processing loop.
-static void vita_read_cb(evutil_socket_t socket, short what, void* ctx)
+/// @brief Byte swaps the samples of a VITA-49 packet
+/// @details 16-bit samples are swapped individually and anything else a 32-bit word at a time.
+/// @param packet The packet whose samples to swap
+static void vita_swap_samples(struct waveform_vita_packet* packet)
 {
-   struct vita* vita = (struct vita*) ctx;
-   ssize_t bytes_received;
-   struct waveform_vita_packet packet;
-
-   if (!(what & EV_READ))
+   if (packet->header.packet_class.bits_per_sample != BPS_16)
    {
-      waveform_log(WF_LOG_INFO, "Callback is not for a read?!\n");
+      vita_swap_payload(packet);
       return;
    }
 
-   if ((bytes_received = recv(socket, &packet, sizeof(packet), 0)) == -1)
+   size_t payload_len = packet->header.length - (VITA_PACKET_HEADER_SIZE(packet) / sizeof(uint32_t));
+   uint16_t* samples = (uint16_t*) packet->raw_payload;
+   for (size_t i = 0; i < payload_len * 2; ++i)
    {
-      waveform_log(WF_LOG_ERROR, "VITA read failed: %s\n", strerror(errno));
-      return;
+      samples[i] = ntohs(samples[i]);
    }
+}
 
-   //  Swap appropriate header fields.  We swap the static values for comparison for the class IDs,
-   //  so we don't need to worry about swapping that.
-   packet.header.length = ntohs(packet.header.length);
-   packet.header.stream_id = ntohl(packet.header.stream_id);
+/// @brief Test whether a packet carries a stream of audio or IQ samples
+/// @details Recognises two channel streams of 32-bit floats at any sample rate the packet class can express.  This
+///          covers the 24 ksps audio the radio sends by default as well as IQ streams at 48, 96 and 192 ksps and
+///          above.  Streams of 16 or 32-bit integers are only recognised if the waveform asked for them, since
+///          callbacks written for the radio's audio read every payload as floats.
+/// @param format_key The format key of the packet from waveform_format_key()
+/// @param int_samples Whether the waveform accepts integer samples, see waveform_set_integer_samples()
+/// @returns true if the packet should go to the RX or TX data callbacks
+static inline bool vita_is_sample_packet(uint64_t format_key, bool int_samples)
+{
+   return WF_FORMAT_MATCHES(WF_FORMAT_FLOAT_STEREO, format_key) ||
+          (int_samples && WF_FORMAT_MATCHES(WF_FORMAT_INT_STEREO, format_key));
+}
 
-   if (packet.header.integer_timestamp_type != INTEGER_TIMESTAMP_NOT_PRESENT)
-   {
-      packet.header.timestamp_int = htonl(packet.header.timestamp_int);
-      packet.header.timestamp_frac = be64toh(packet.header.timestamp_frac);
-   }
+/// @brief Converts a packet class sample rate code to Hz
+/// @param code The sample_rate field of the packet class
+/// @returns The sample rate in Hz
+static inline uint32_t vita_sample_rate_hz(unsigned int code)
+{
+   return code < SR_4K ? 3000U << code : 4000U << (code - SR_4K);
+}
 
-   if (packet.header.oui != __constant_cpu_to_be32(FLEX_OUI))
+/// @brief Converts a sample rate in Hz to a packet class sample rate code
+/// @param hz The sample rate in Hz
+/// @returns The sample rate code or -1 if the rate can't be expressed in a packet class
+static int vita_sample_rate_code(uint32_t hz)
+{
+   for (unsigned int code = SR_3K; code <= SR_131072K; ++code)
    {
-      waveform_log(WF_LOG_INFO, "Invalid OUI: 0x%08x\n", ntohl(packet.header.oui));
-      return;
+      if (vita_sample_rate_hz(code) == hz)
+      {
+         return (int) code;
+      }
    }
 
-   unsigned long payload_length = (packet.header.length * sizeof(uint32_t)) - VITA_PACKET_HEADER_SIZE(&packet);
-
-   if (payload_length != bytes_received - VITA_PACKET_HEADER_SIZE(&packet))
-   {
-      waveform_log(WF_LOG_INFO, "VITA header size doesn't match bytes read from network (%lu != %ld - %lu) -- %lu\n",
-                   payload_length, bytes_received, VITA_PACKET_HEADER_SIZE(&packet), sizeof(struct waveform_vita_packet));
-      return;
-   }
+   return -1;
+}
 
-   if (packet.header.information_class != __constant_be16_to_cpu(SMOOTHLAKE_INFORMATION_CLASS))
-   {
-      waveform_log(WF_LOG_INFO, "Invalid packet information class: 0x%04x\n", ntohs(packet.header.information_class));
-      return;
-   }
+/// @brief Calculates the time covered by the samples in a packet
+/// @details Uses the sample rate, sample size and channel count from the packet class.
+/// @param info The decoded header of the packet
+/// @returns The packet period in nanoseconds
+static uint64_t vita_packet_period_ns(const struct waveform_packet_info* info)
+{
+   return (uint64_t) (info->num_samples / info->channels) * 1000000000ULL / info->sample_rate;
+}
 
-   struct waveform_t* cur_wf = container_of(vita, struct waveform_t, vita);
-   struct waveform_cb_list* cb_list;
+/// @brief Decodes the header of a received packet for the data callbacks
+/// @details The header must already be in host byte order.  The payload pointer is left for the caller to set
+///          because it has to point into the copy of the packet each callback receives.
+/// @param packet The packet to decode
+/// @param payload_length The length of the payload in bytes
+/// @param info The structure to fill in
+static void vita_decode_info(const struct waveform_vita_packet* packet, size_t payload_length,
+                             struct waveform_packet_info* info)
+{
+   memset(info, 0, sizeof(*info));
+   info->payload_words = payload_length / sizeof(uint32_t);
+   info->bits_per_sample = (packet->header.packet_class.bits_per_sample + 1) * 8;
+   info->channels = packet->header.packet_class.frames_per_sample + 1;
+   info->num_samples = payload_length / (info->bits_per_sample / 8);
+   info->sample_rate = vita_sample_rate_hz(packet->header.packet_class.sample_rate);
+   info->stream_id = packet->header.stream_id;
+   info->class_id = ((uint64_t) ntohl(packet->header.oui) << 32) |
+                    ((uint64_t) ntohs(packet->header.information_class) << 16) |
+                    ntohs(packet->header.packet_class_byte);
+   info->sequence = packet->header.sequence;
 
-   if (packet.header.packet_type == VITA_PACKET_TYPE_IF_DATA_WITH_STREAM_ID &&
-       packet.header.packet_class.is_audio &&
-       packet.header.packet_class.bits_per_sample == BPS_32 &&
-       packet.header.packet_class.sample_rate == SR_24K &&
-       packet.header.packet_class.frames_per_sample == FPS_2 &&
-       packet.header.packet_class.is_float)
+   if (packet->header.integer_timestamp_type != INTEGER_TIMESTAMP_NOT_PRESENT)
    {
-      //  This is an audio packet from the RX or Mic
-      vita_swap_payload(&packet);
-      if (is_transmit_packet(&packet))
-      {
-         if (vita->tx_stream_in_id == 0)
-         {
-            waveform_log(WF_LOG_DEBUG, "No Incoming TX Stream ID, setting to 0x%08x\n", packet.header.stream_id);
-            vita->tx_stream_in_id = packet.header.stream_id;
-         }
-         else if (vita->tx_stream_in_id != packet.header.stream_id)
-         {
-            waveform_log(WF_LOG_INFO, "Incoming TX stream 0x%08x is not expected (0x%08x)\n", packet.header.stream_id, vita->tx_stream_in_id);
-            return;
-         }
-
-         cb_list = cur_wf->tx_data_cbs;
-      }
-      else
-      {
-         if (vita->rx_stream_in_id == 0)
-         {
-            waveform_log(WF_LOG_DEBUG, "No Incoming RX Stream ID, setting to 0x%08x\n", packet.header.stream_id);
-            vita->rx_stream_in_id = packet.header.stream_id;
-         }
-         else if (vita->rx_stream_in_id != packet.header.stream_id)
-         {
-            waveform_log(WF_LOG_INFO, "Incoming RX stream 0x%08x is not expected (0x%08x)\n", packet.header.stream_id, vita->tx_stream_in_id);
-            return;
-         }
-
-         cb_list = cur_wf->rx_data_cbs;
-      }
+      info->flags |= WF_PACKET_HAS_TIMESTAMP;
+      info->timestamp_int = packet->header.timestamp_int;
+      info->timestamp_frac = packet->header.timestamp_frac;
    }
-   else if (packet.header.packet_type == VITA_PACKET_TYPE_EXT_DATA_WITH_STREAM_ID &&
-            packet.header.packet_class.is_audio == true &&
-            packet.header.packet_class.bits_per_sample == BPS_8 &&
-            packet.header.packet_class.sample_rate == SR_3K &&
-            packet.header.packet_class.frames_per_sample == FPS_1 &&
-            packet.header.packet_class.is_float == false)
+   if (packet->header.packet_class.is_audio)
    {
-      // This is a byte data packet.
-      // We don't swap the data around here so that we are transparent
-      // to the user who is sending it.
-      packet.byte_payload.length = ntohl(packet.byte_payload.length);
-      cb_list = cur_wf->byte_data_cbs;
+      info->flags |= WF_PACKET_IS_AUDIO;
    }
-   else
+   if (packet->header.packet_class.is_float)
    {
-      // This is an unknown format packet
-      vita_swap_payload(&packet);
-      cb_list = cur_wf->unknown_data_cbs;
+      info->flags |= WF_PACKET_IS_FLOAT;
    }
-
-   struct waveform_cb_list* cur_cb;
-   LL_FOREACH(cb_list, cur_cb)
+   if (packet->header.trailer_present)
    {
-      struct data_cb_wq_desc* desc = calloc(1, sizeof(*desc));// Freed when taken out of linked list
-
-      desc->wf = cur_wf;
-      memcpy(&desc->packet, &packet, bytes_received);
-      desc->packet_size = bytes_received;
-      desc->cb = cur_cb;
-
-      pthread_mutex_lock(&wq_lock);
-      LL_APPEND(wq, desc);
-      pthread_mutex_unlock(&wq_lock);
-
-      sem_post(&wq_sem);
+      info->flags |= WF_PACKET_HAS_TRAILER;
    }
 }
 
-/// @brief VITA processing event loop
-/// @details An event loop for VITA processing that opens a socket to communicate with the radio, sets up
-///          appropriate callbacks so that we can handle events and then executes event_base_dispatch
-///          which will run in an infinite loop until there is no more connection there.  See the libevent
-///          documentation for more details.
-/// @param arg The VITA struct for which to run the event loop
-static void* vita_evt_loop(void* arg)
+/// @brief Gets the size of the packets a buffer class holds
+/// @param vita The VITA loop the buffers are for
+/// @param buf_class The buffer class
+/// @returns The size in bytes of the largest packet that fits the class
+static inline size_t vita_buf_class_size(const struct vita* vita, unsigned int buf_class)
 {
-   struct waveform_t* wf = (struct waveform_t*) arg;
-   struct vita* vita = &(wf->vita);
-   int ret;
+   return buf_class < VITA_BUF_CLASSES - 1 ? vita_buf_classes[buf_class] : VITA_PACKET_SIZE(vita->max_payload);
+}
 
-   struct sched_param thread_fifo_priority = {
-         .sched_priority = sched_get_priority_max(SCHED_FIFO)};
+/// @brief Allocates a queue entry for a data callback
+/// @details The entry has room for a packet of the given size after it.  In real-time mode the entry comes from
+///          the preallocated pool for the smallest size class that fits, or a larger one if that pool is
+///          exhausted, so the packet path never calls the allocator.
+/// @param vita The VITA loop the entry is for
+/// @param packet_size The size of the packet to be stored in the entry in bytes
+/// @returns A queue entry with its packet pointer set and everything else zeroed, or NULL if none is available
+static struct data_cb_wq_desc* vita_desc_alloc(struct vita* vita, size_t packet_size)
+{
+   struct data_cb_wq_desc* desc = NULL;
+   unsigned int buf_class = 0;
 
-   ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &thread_fifo_priority);
-   if (ret)
+   if (vita->rt_pool_size == 0)
    {
-      waveform_log(WF_LOG_DEBUG, "Setting thread to realtime: %m\n");
+      size_t align = alignof(struct data_cb_wq_desc);
+      desc = alloc_aligned(WF_ALLOC_RX_QUEUE, align, DIV_ROUND_UP(sizeof(*desc) + packet_size, align) * align);
    }
+   else
+   {
+      while (buf_class < VITA_BUF_CLASSES && vita_buf_class_size(vita, buf_class) < packet_size)
+      {
+         ++buf_class;
+      }
 
-   struct sockaddr_in bind_addr = {
-         .sin_family = AF_INET,
-         .sin_addr.s_addr = htonl(INADDR_ANY),
-         .sin_port = 0,
-   };
-   socklen_t bind_addr_len = sizeof(bind_addr);
-
-   // TODO: This needs to come back in when the radio does sane stuff with ports again
-   //   struct sockaddr_in radio_addr = {
-   //         .sin_family = AF_INET,
-   //         .sin_addr.s_addr = wf->radio->addr.sin_addr.s_addr,
-   //         .sin_port = htons(vita_port)};
-   radio_addr.sin_family = AF_INET;
-   radio_addr.sin_addr.s_addr = wf->radio->addr.sin_addr.s_addr;
-   radio_addr.sin_port = htons(vita_port);
-
-   waveform_log(WF_LOG_DEBUG, "Initializing VITA-49 engine...\n");
+      for (; desc == NULL && buf_class < VITA_BUF_CLASSES; ++buf_class)
+      {
+         desc = pool_get(&vita->desc_pools[buf_class]);
+      }
+      --buf_class;
+   }
 
-   vita->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
-   if (vita->sock == -1)
+   if (desc)
    {
-      waveform_log(WF_LOG_ERROR, " Failed to initialize VITA socket: %s\n", strerror(errno));
-      goto fail;
+      memset(desc, 0, sizeof(*desc));
+      desc->buf_class = buf_class;
+      desc->packet = (struct waveform_vita_packet*) desc->buffer;
    }
+   return desc;
+}
 
-   if (bind(vita->sock, (struct sockaddr*) &bind_addr, sizeof(bind_addr)))
+/// @brief Frees a queue entry allocated with vita_desc_alloc()
+/// @param vita The VITA loop the entry is for
+/// @param desc The entry to free
+static void vita_desc_free(struct vita* vita, struct data_cb_wq_desc* desc)
+{
+   if (vita->rt_pool_size == 0)
    {
-      waveform_log(WF_LOG_ERROR, "error binding socket: %s\n", strerror(errno));
-      goto fail_socket;
+      alloc_free(WF_ALLOC_RX_QUEUE, desc);
+      return;
    }
 
-   // TODO: This needs to come back in when the radio does sane stuff with ports again
-   //   if (connect(vita->sock, (struct sockaddr*) &radio_addr, sizeof(struct sockaddr_in)) == -1)
-   //   {
-   //      waveform_log(WF_LOG_ERROR, "Couldn't connect socket: %s\n", strerror(errno));
-   //      goto fail_socket;
-   //   }
+   pool_put(&vita->desc_pools[desc->buf_class], desc);
+}
 
-   if (getsockname(vita->sock, (struct sockaddr*) &bind_addr, &bind_addr_len) == -1)
+/// @brief Drops a reference to the expiry state shared by the descriptors of a packet
+/// @details The state lives in the first descriptor queued for the packet, which is freed once the last
+///          reference is gone.
+/// @param vita The VITA loop the descriptors are for
+/// @param expiry The shared state to drop the reference to
+static void vita_expiry_put(struct vita* vita, struct vita_expiry* expiry)
+{
+   if (atomic_fetch_sub_explicit(&expiry->refs, 1, memory_order_acq_rel) == 1)
    {
-      waveform_log(WF_LOG_ERROR, "Couldn't get port number of VITA socket\n");
-      goto fail_socket;
+      vita_desc_free(vita, container_of(expiry, struct data_cb_wq_desc, own_expiry));
    }
+}
 
-   vita->base = event_base_new();
-   if (!vita->base)
-   {
-      waveform_log(WF_LOG_ERROR, "Couldn't create VITA event base\n");
-      goto fail_socket;
-   }
+/// @brief Releases a queue entry once its callback has run, expired or been abandoned
+/// @param vita The VITA loop the entry is for
+/// @param desc The entry to release
+static void vita_desc_release(struct vita* vita, struct data_cb_wq_desc* desc)
+{
+   struct vita_expiry* expiry = desc->expiry;
 
-   vita->read_evt = event_new(vita->base, vita->sock, EV_READ | EV_PERSIST, vita_read_cb, vita);
-   if (!vita->read_evt)
-   {
-      waveform_log(WF_LOG_ERROR, "Couldn't create VITA read event\n");
-      goto fail_base;
-   }
-   if (event_add(vita->read_evt, NULL) == -1)
+   if (expiry != &desc->own_expiry)
    {
-      waveform_log(WF_LOG_ERROR, "Couldn't add VITA read event to base\n");
-      goto fail_evt;
+      vita_desc_free(vita, desc);
    }
+   vita_expiry_put(vita, expiry);
+}
 
-   vita->port = ntohs(bind_addr.sin_port);
+/// @brief Picks the worker that runs the callbacks for a stream
+/// @details The stream ID is hashed so that neighbouring IDs still spread evenly across the workers.
+/// @param vita The VITA loop whose workers to choose from
+/// @param stream_id The stream ID of the packet
+/// @returns The worker to queue the callbacks for the stream on
+static inline struct vita_worker* vita_stream_worker(struct vita* vita, uint32_t stream_id)
+{
+   uint32_t hash = stream_id * 0x9e3779b1u;
 
-   vita->data_sequence = 0;
-   vita->meter_sequence = 0;
-   vita->byte_data_sequence = 0;
+   return &vita->workers[(hash ^ (hash >> 16)) % vita->num_workers];
+}
 
-   waveform_send_api_command_cb(wf, NULL, NULL, "waveform set %s udpport=%hu", wf->name, vita->port);
-   waveform_send_api_command_cb(wf, NULL, NULL, "client udpport %hu", vita->port);
+/// @brief Queues a data callback on one of the lanes of a callback worker
+/// @param worker The worker that should run the callback
+/// @param lane The lane to queue the callback in
+/// @param desc The callback to queue.  Ownership passes to the worker.
+/// @param budget_ns How long the callback may wait before it is late
+static void vita_enqueue(struct vita_worker* worker, enum waveform_data_lane lane, struct data_cb_wq_desc* desc,
+                         uint64_t budget_ns)
+{
+   struct vita_lane* cur_lane = &worker->lanes[lane];
 
-   event_base_dispatch(vita->base);
+   desc->enqueued_ns = monotonic_now_ns();
+   desc->deadline_ns = desc->enqueued_ns + budget_ns;
 
-   waveform_log(WF_LOG_DEBUG, "VITA thread ending...\n");
+   pthread_mutex_lock(&worker->lock);
+   DL_APPEND(cur_lane->head, desc);
+   ++cur_lane->stats.enqueued;
+   if (++cur_lane->stats.depth > cur_lane->stats.max_depth)
+   {
+      cur_lane->stats.max_depth = cur_lane->stats.depth;
+   }
+   pthread_mutex_unlock(&worker->lock);
 
-fail_evt:
-   event_free(vita->read_evt);
-fail_base:
-   event_base_free(vita->base);
-fail_socket:
-   close(vita->sock);
-   vita->sock = 0;
-fail:
-   return NULL;
+   sem_post(&worker->sem);
 }
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "EndlessLoop"
-/// @brief Data callback event loop
-/// @details An event loop for running user-defined data callbacks.  This runs and
-///          takes tasks from the wq linked list and executes them in order.  This
-///          thread terminates when the main VITA loop terminates.
-static void* vita_cb_loop(void* arg __attribute__((unused)))
+/// @brief Chooses the lane a callback worker should service next
+/// @details Lanes are ordered by priority, transmit data first.  With the strict priority policy the first
+///          non-empty lane always wins.  With the weighted policy each lane gets up to its weight in items per
+///          round, and a new round starts when no lane with work has any turns left.  With the earliest
+///          deadline policy the lane whose head has the earliest deadline wins, ties going to the higher
+///          priority lane.  Items in a lane always stay in arrival order.  Must be called with the worker
+///          lock held.
+/// @param worker The worker whose lanes to examine
+/// @returns The lane to service or NULL if every lane is empty
+static struct vita_lane* vita_next_lane(struct vita_worker* worker)
 {
-   struct timespec timeout;
-   int ret;
-
-   //  Run this as a lower priority than the thread servicing the socket
-   struct sched_param thread_fifo_priority = {
-         .sched_priority = sched_get_priority_max(SCHED_FIFO) - 8,
-   };
-   ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &thread_fifo_priority);
-   if (ret)
-   {
-      waveform_log(WF_LOG_DEBUG, "Setting thread to realtime: %s\n", strerror(ret));
-   }
+   enum waveform_lane_policy policy = worker->vita->lane_policy;
 
-   wq_running = true;
-   while (wq_running)
+   if (policy == WF_LANE_EARLIEST_DEADLINE)
    {
+      struct vita_lane* earliest = NULL;
 
-      if (clock_gettime(CLOCK_REALTIME, &timeout) == -1)
+      for (size_t i = 0; i < WF_DATA_LANE_MAX; ++i)
       {
-         waveform_log(WF_LOG_ERROR, "Couldn't gert time.\n");
-         continue;
+         struct vita_lane* lane = &worker->lanes[i];
+         if (lane->head != NULL && (earliest == NULL || lane->head->deadline_ns < earliest->head->deadline_ns))
+         {
+            earliest = lane;
+         }
       }
 
-      timeout.tv_sec += 1;
-
-      while ((ret = sem_timedwait(&wq_sem, &timeout)) == -1 && errno == EINTR)
-         ;
+      return earliest;
+   }
 
-      if (ret == -1)
+   if (policy == WF_LANE_WEIGHTED)
+   {
+      for (int round = 0; round < 2; ++round)
       {
-         if (errno == ETIMEDOUT)
+         for (size_t i = 0; i < WF_DATA_LANE_MAX; ++i)
          {
-            continue;
+            struct vita_lane* lane = &worker->lanes[i];
+            if (lane->head != NULL && lane->credit > 0)
+            {
+               --lane->credit;
+               return lane;
+            }
          }
-         else
+
+         for (size_t i = 0; i < WF_DATA_LANE_MAX; ++i)
          {
-            waveform_log(WF_LOG_ERROR, "Error acquiring semaphore: %s\n", strerror(errno));
-            continue;
+            worker->lanes[i].credit = worker->vita->lane_weights[i];
          }
       }
 
-      if (wq == NULL)
+      return NULL;
+   }
+
+   for (size_t i = 0; i < WF_DATA_LANE_MAX; ++i)
+   {
+      if (worker->lanes[i].head != NULL)
       {
-         waveform_log(WF_LOG_WARNING, "Thread awakened but nothing is in the queue?\n");
-         continue;
+         return &worker->lanes[i];
       }
-
-      struct data_cb_wq_desc* current_task = wq;
-      pthread_mutex_lock(&wq_lock);
-      LL_DELETE(wq, current_task);
-      pthread_mutex_unlock(&wq_lock);
-
-      (current_task->cb->data_cb)(current_task->wf, &current_task->packet, current_task->packet_size, current_task->cb->arg);
-
-      free(current_task);
    }
 
    return NULL;
 }
-#pragma clang diagnostic pop
 
-// ****************************************
-// Global Functions
-// ****************************************
-int vita_init(struct waveform_t* wf)
+/// @brief Creates the shared memory rings for the streams the radio sends to the waveform
+/// @details Runs on the thread activating the waveform, so the VITA loop never has to open, size or map shared
+///          memory itself.  A ring that can't be created is logged once here and its stream isn't published.
+/// @param vita The VITA loop being started
+static void vita_shm_create_rings(struct vita* vita)
 {
-   int ret;
-
-   sem_init(&wq_sem, 0, 0);
+   uint32_t stream_ids[] = {vita->tx_stream_in_id, vita->rx_stream_in_id, vita->byte_stream_in_id};
 
-   ret = pthread_create(&wq_thread, NULL, vita_cb_loop, NULL);
-   if (ret)
+   vita->shm_ring_count = 0;
+   for (size_t i = 0; i < ARRAY_SIZE(stream_ids) && vita->shm_ring_count < VITA_MAX_SHM_STREAMS; ++i)
    {
-      waveform_log(WF_LOG_FATAL, "Cannot create work queue thread: %s\n", strerror(ret));
-      return -1;
+      bool seen = stream_ids[i] == 0;
+
+      for (size_t j = 0; j < vita->shm_ring_count && !seen; ++j)
+      {
+         seen = vita->shm_stream_ids[j] == stream_ids[i];
+      }
+      if (seen)
+      {
+         continue;
+      }
+
+      struct shm_ring* ring = shm_ring_create(vita->shm_prefix, stream_ids[i], vita->shm_slots, vita->max_payload);
+      if (!ring)
+      {
+         waveform_log(WF_LOG_ERROR, "Stream 0x%08x won't be published to shared memory\n", stream_ids[i]);
+         continue;
+      }
+
+      vita->shm_stream_ids[vita->shm_ring_count] = stream_ids[i];
+      vita->shm_rings[vita->shm_ring_count++] = ring;
    }
+}
 
-   ret = pthread_create(&wf->vita.thread, NULL, vita_evt_loop, wf);
-   if (ret)
+/// @brief Removes the shared memory rings of the waveform
+/// @param vita The VITA loop, which must no longer be running
+static void vita_shm_destroy_rings(struct vita* vita)
+{
+   for (size_t i = 0; i < vita->shm_ring_count; ++i)
    {
-      waveform_log(WF_LOG_ERROR, "Creating thread: %s\n", strerror(ret));
-      return -1;
+      shm_ring_destroy(vita->shm_rings[i]);
+      vita->shm_rings[i] = NULL;
    }
-
-   return 0;
+   vita->shm_ring_count = 0;
 }
 
-void vita_destroy(struct waveform_t* wf)
+/// @brief Publishes a packet into the shared memory ring for its stream
+/// @details Streams without a ring, because they weren't assigned to the waveform or their ring couldn't be created,
+///          are not published.
+/// @param vita The VITA loop the packet was received on
+/// @param packet The packet to publish, already in host byte order
+/// @param payload_length The length of the payload of the packet in bytes
+static void vita_shm_publish(struct vita* vita, struct waveform_vita_packet* packet, size_t payload_length)
 {
-   if (wf->vita.sock == 0)
+   for (size_t i = 0; i < vita->shm_ring_count; ++i)
    {
-      waveform_log(WF_LOG_INFO, "Waveform is not running, not trying to destory again\n");
-      return;
+      if (vita->shm_stream_ids[i] == packet->header.stream_id)
+      {
+         shm_ring_publish(vita->shm_rings[i], packet->header.packet_class_byte, packet->header.timestamp_int,
+                          packet->header.timestamp_frac, packet->raw_payload, payload_length);
+         return;
+      }
    }
+}
 
-   // Stop both the threads
-   wq_running = false;
-   pthread_join(wq_thread, NULL);
-   sem_destroy(&wq_sem);
-
-   event_base_loopexit(wf->vita.base, NULL);
+/// @brief Starts updating a structure that other threads read with vita_seq_read()
+/// @details The sequence is odd until vita_seq_write_end(), so readers overlapping the update retry.  Only one
+///          thread may write a given structure.
+/// @param sequence The sequence counter of the structure
+/// @returns The sequence to pass to vita_seq_write_end()
+static inline uint32_t vita_seq_write_begin(uint32_t* sequence)
+{
+   uint32_t start = *sequence;
 
-   //  Clean up the callback work queue
-   struct data_cb_wq_desc* task;
-   struct data_cb_wq_desc* tmp;
-   LL_FOREACH_SAFE(wq, task, tmp)
-   {
-      LL_DELETE(wq, task);
-      free(task);
-   }
+   __atomic_store_n(sequence, start + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   return start;
 }
 
-ssize_t vita_send_packet(struct vita* vita, struct waveform_vita_packet* packet)
+/// @brief Finishes an update started with vita_seq_write_begin()
+/// @param sequence The sequence counter of the structure
+/// @param start The sequence returned by vita_seq_write_begin()
+static inline void vita_seq_write_end(uint32_t* sequence, uint32_t start)
 {
-   packet->header.length += VITA_PACKET_HEADER_SIZE(packet) / sizeof(uint32_t);
-   size_t len = packet->header.length * sizeof(uint32_t);
-   packet->header.length = htons(packet->header.length);
+   __atomic_store_n(sequence, start + 2, __ATOMIC_RELEASE);
+}
 
-   //   waveform_log(WF_LOG_DEBUG, "Transmitting Packet of length %ld bytes:\n", len);
+/// @brief Copies a structure written with vita_seq_write_begin() and vita_seq_write_end() without tearing
+/// @param sequence The sequence counter of the structure
+/// @param dst Where to copy the structure
+/// @param src The structure
+/// @param size The size of the structure
+static void vita_seq_read(const uint32_t* sequence, void* dst, const void* src, size_t size)
+{
+   uint32_t start = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
 
-   ssize_t bytes_sent;
-   if ((bytes_sent = sendto(vita->sock, packet, len, 0, (const struct sockaddr*) &radio_addr, sizeof(struct sockaddr_in))) == -1)
+   for (;;)
    {
-      char error_string[1024];
-      strerror_r(errno, error_string, sizeof(error_string));
-      waveform_log(WF_LOG_ERROR, "Error sending vita packet to %s: %s\n", inet_ntoa(radio_addr.sin_addr), error_string);
-      return -errno;
-   }
+      if (start & 1)
+      {
+         start = __atomic_load_n(sequence, __ATOMIC_ACQUIRE);
+         continue;
+      }
 
-   if (bytes_sent != len)
-   {
-      waveform_log(WF_LOG_ERROR, "Short write on vita send\n");
-      return -E2BIG;
-   }
+      memcpy(dst, src, size);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
 
-   return 0;
+      uint32_t end = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+      if (end == start)
+      {
+         return;
+      }
+      start = end;
+   }
 }
 
-ssize_t vita_send_data_packet(struct vita* vita, float* samples, size_t num_samples, enum waveform_packet_type type)
+/// @brief Converts a 64-bit context field with a radix point after bit 20, such as a frequency in Hz
+/// @param field The two words of the field, in network byte order
+/// @returns The value of the field
+static inline double vita_context_fixed64(const uint32_t* field)
 {
-   if (num_samples * sizeof(float) > MEMBER_SIZE(struct waveform_vita_packet, raw_payload))
-   {
-      waveform_log(WF_LOG_ERROR, "%lu samples exceeds maximum sending limit of %lu samples\n", num_samples,
-                   MEMBER_SIZE(struct waveform_vita_packet, raw_payload) / sizeof(float));
-      return -EFBIG;
-   }
+   int64_t value = (int64_t) (((uint64_t) ntohl(field[0]) << 32) | ntohl(field[1]));
+
+   return (double) value / (double) (1 << 20);
+}
+
+/// @brief Converts a signed 16-bit context field with a radix point after bit radix
+/// @param half The field in the low 16 bits, in host byte order
+/// @param radix The position of the radix point
+/// @returns The value of the field
+static inline float vita_context_fixed16(uint32_t half, unsigned int radix)
+{
+   return (float) (int16_t) (half & 0xffffU) / (float) (1 << radix);
+}
+
+/// @brief Finds the context slot of a stream, claiming a free one the first time the stream is seen
+/// @param vita The VITA loop the context packet was received on
+/// @param stream_id The stream the context packet describes
+/// @returns The slot, or NULL if every slot belongs to another stream
+static struct vita_context* vita_context_slot(struct vita* vita, uint32_t stream_id)
+{
+   for (size_t i = 0; i < VITA_MAX_CONTEXT_STREAMS; ++i)
+   {
+      struct vita_context* slot = &vita->contexts[i];
+
+      if (slot->sequence == 0)
+      {
+         //  Readers only trust the stream ID once they see a completed write, which releases it.
+         __atomic_store_n(&slot->stream_id, stream_id, __ATOMIC_RELAXED);
+         slot->context.stream_id = stream_id;
+         return slot;
+      }
+
+      if (slot->stream_id == stream_id)
+      {
+         return slot;
+      }
+   }
+
+   return NULL;
+}
+
+/// @brief Merges a context packet into the context of its stream
+/// @details The fields up to the variable sized ones are decoded; anything after them is ignored.  Readers in
+///          waveform_get_stream_context() retry if they overlap the update.
+/// @param vita The VITA loop the packet was received on
+/// @param packet The packet, with its header in host byte order and its payload still in network byte order
+/// @param payload_length The length of the payload of the packet in bytes
+static void vita_context_update(struct vita* vita, const struct waveform_vita_packet* packet, size_t payload_length)
+{
+   const uint32_t* words = (const uint32_t*) ((const uint8_t*) packet + VITA_PACKET_HEADER_SIZE(packet));
+   size_t count = payload_length / sizeof(uint32_t);
+   struct vita_context* slot;
+
+   if (count < 1)
+   {
+      return;
+   }
+
+   if (!(slot = vita_context_slot(vita, packet->header.stream_id)))
+   {
+      waveform_log(WF_LOG_DEBUG, "No room for the context of stream 0x%08x\n", packet->header.stream_id);
+      return;
+   }
+
+   uint32_t indicators = ntohl(words[0]);
+   struct waveform_stream_context* context = &slot->context;
+   uint32_t sequence = vita_seq_write_begin(&slot->sequence);
+
+   size_t pos = 1;
+   for (size_t i = 0; i < ARRAY_SIZE(vita_context_field_words); ++i)
+   {
+      uint32_t bit = 1U << (30 - i);
+      const uint32_t* field = &words[pos];
+
+      if (!(indicators & bit))
+      {
+         continue;
+      }
+
+      pos += vita_context_field_words[i];
+      if (pos > count)
+      {
+         waveform_log(WF_LOG_DEBUG, "Context packet for stream 0x%08x is truncated\n", packet->header.stream_id);
+         break;
+      }
+
+      switch (bit)
+      {
+         case WF_CONTEXT_REFERENCE_POINT:
+            context->reference_point = ntohl(field[0]);
+            break;
+         case WF_CONTEXT_BANDWIDTH:
+            context->bandwidth = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_IF_FREQUENCY:
+            context->if_frequency = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_RF_FREQUENCY:
+            context->rf_frequency = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_RF_FREQUENCY_OFFSET:
+            context->rf_frequency_offset = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_IF_BAND_OFFSET:
+            context->if_band_offset = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_REFERENCE_LEVEL:
+            context->reference_level = vita_context_fixed16(ntohl(field[0]), 7);
+            break;
+         case WF_CONTEXT_GAIN:
+            context->gain_stage1 = vita_context_fixed16(ntohl(field[0]), 7);
+            context->gain_stage2 = vita_context_fixed16(ntohl(field[0]) >> 16, 7);
+            break;
+         case WF_CONTEXT_OVER_RANGE_COUNT:
+            context->over_range_count = ntohl(field[0]);
+            break;
+         case WF_CONTEXT_SAMPLE_RATE:
+            context->sample_rate = vita_context_fixed64(field);
+            break;
+         case WF_CONTEXT_TEMPERATURE:
+            context->temperature = vita_context_fixed16(ntohl(field[0]), 6);
+            break;
+         case WF_CONTEXT_STATE_EVENT:
+            context->state_event = ntohl(field[0]);
+            break;
+         default:
+            //  Skipped over but not recorded
+            continue;
+      }
+      context->fields |= bit;
+   }
+
+   if (packet->header.integer_timestamp_type != INTEGER_TIMESTAMP_NOT_PRESENT)
+   {
+      context->timestamp_int = packet->header.timestamp_int;
+      context->timestamp_frac = packet->header.timestamp_frac;
+   }
+   ++context->updates;
+
+   vita_seq_write_end(&slot->sequence, sequence);
+}
+
+/// @brief Finds the timeline of a stream, claiming a free one the first time the stream is seen
+/// @param vita The VITA loop the packet was received on
+/// @param stream_id The stream of the packet
+/// @returns The timeline, or NULL if every timeline belongs to another stream
+static struct vita_timeline* vita_timeline_slot(struct vita* vita, uint32_t stream_id)
+{
+   for (size_t i = 0; i < VITA_MAX_TIMELINE_STREAMS; ++i)
+   {
+      struct vita_timeline* slot = &vita->timelines[i];
+
+      if (slot->sequence == 0)
+      {
+         __atomic_store_n(&slot->stream_id, stream_id, __ATOMIC_RELAXED);
+         return slot;
+      }
+
+      if (slot->stream_id == stream_id)
+      {
+         return slot;
+      }
+   }
+
+   return NULL;
+}
+
+/// @brief Refines the estimate of the radio's clock with a packet that has just arrived
+/// @param vita The VITA loop the packet was received on
+/// @param radio_ns The radio time of the end of the packet, when it can first have been sent
+static void vita_clock_update(struct vita* vita, uint64_t radio_ns)
+{
+   struct vita_clock* clock = &vita->clock;
+   uint32_t sequence = vita_seq_write_begin(&clock->sequence);
+
+   vita_clock_sample(clock, (int64_t) (monotonic_now_ns() - radio_ns));
+
+   vita_seq_write_end(&clock->sequence, sequence);
+}
+
+/// @brief Places a sample packet on the timeline of its stream, see vita_timeline_place()
+/// @param vita The VITA loop the packet was received on
+/// @param info The decoded header of the packet, updated with its index
+static void vita_timeline_advance(struct vita* vita, struct waveform_packet_info* info)
+{
+   struct vita_timeline* timeline = vita_timeline_slot(vita, info->stream_id);
+   uint64_t end_ns;
+
+   if (!timeline)
+   {
+      return;
+   }
+
+   uint32_t sequence = vita_seq_write_begin(&timeline->sequence);
+   end_ns = vita_timeline_place(timeline, sequence == 0, info);
+   vita_seq_write_end(&timeline->sequence, sequence);
+
+   if (info->flags & WF_PACKET_HAS_TIMESTAMP)
+   {
+      vita_clock_update(vita, end_ns);
+   }
+}
+
+/// @brief Whether a send failed only because the socket can't take the packet yet
+/// @param err The errno from the send
+/// @returns true if the packet should be queued and retried
+static inline bool vita_tx_backpressure(int err)
+{
+   return err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS;
+}
+
+/// @brief Adds a packet to the transmit queue, applying the drop policy if it is full
+/// @param vita The VITA loop sending the packet
+/// @param packet The packet, already in network byte order
+/// @param len The length of the packet in bytes
+/// @returns 0 if the packet was queued or -EAGAIN if it was dropped
+static int vita_tx_queue(struct vita* vita, const struct waveform_vita_packet* packet, size_t len)
+{
+   struct vita_tx* tx = &vita->tx;
+   char discard;
+
+   uint32_t depth = atomic_fetch_add(&tx->pending, 1) + 1;
+
+   while (!mpmc_push(&tx->queue, packet, len))
+   {
+      if (tx->policy == WF_TX_DROP_NEWEST)
+      {
+         atomic_fetch_sub(&tx->pending, 1);
+         atomic_fetch_add(&tx->dropped, 1);
+         return -EAGAIN;
+      }
+
+      //  The event loop may take the oldest packet before we can, in which case there's room now anyway.
+      if (mpmc_pop(&tx->queue, &discard, 0) != -1)
+      {
+         depth = atomic_fetch_sub(&tx->pending, 1) - 1;
+         atomic_fetch_add(&tx->dropped, 1);
+      }
+   }
+
+   atomic_fetch_add(&tx->queued, 1);
+
+   uint32_t max_depth = atomic_load(&tx->max_depth);
+   while (depth > max_depth && !atomic_compare_exchange_weak(&tx->max_depth, &max_depth, depth))
+      ;
+
+   event_add(tx->write_evt, NULL);
+
+   return 0;
+}
+
+/// @brief Libevent callback for when the VITA socket can take more packets
+/// @details Sends queued packets in order until the queue is empty or the socket fills up again, in which case the
+///          packet that didn't fit is held and the write event is armed again.
+/// @param socket The VITA socket
+/// @param what The event type that occurred
+/// @param ctx A reference to the VITA structure for the processing loop.
+static void vita_write_cb(evutil_socket_t socket, short what, void* ctx)
+{
+   struct vita* vita = (struct vita*) ctx;
+   struct vita_tx* tx = &vita->tx;
+
+   for (;;)
+   {
+      if (tx->held_length == 0)
+      {
+         //  Cells are the size of the held buffer, so nothing is ever truncated here.
+         ssize_t length = mpmc_pop(&tx->queue, tx->held, VITA_PACKET_SIZE(vita->max_payload));
+         if (length == -1)
+         {
+            return;
+         }
+         tx->held_length = (size_t) length;
+      }
+
+      ssize_t bytes_sent = vita->transport->vita_send(vita, tx->held, tx->held_length);
+      if (bytes_sent == -1)
+      {
+         if (vita_tx_backpressure(errno))
+         {
+            event_add(tx->write_evt, NULL);
+            return;
+         }
+
+         waveform_log(WF_LOG_ERROR, "Error sending queued vita packet: %s\n", strerror(errno));
+         atomic_fetch_add(&tx->errors, 1);
+      }
+      else
+      {
+         atomic_fetch_add(&tx->sent, 1);
+      }
+
+      tx->held_length = 0;
+      atomic_fetch_sub(&tx->pending, 1);
+   }
+}
+
+/// @brief Libevent callback for when a VITA packet is read from the UDP socket.
+/// @details When a packet is recieved from the network, libevent calls this callback to let us know.  In here we do all of
+///          our initial packet processing and sanity checks and endian flipping before calling the appropriate user callback
+///          function.
+/// @param socket The socket upon which the VITA packet was received
+/// @param what The event type that occurred
+/// @param ctx A reference to the VITA structure for the processing loop.
+static void vita_read_cb(evutil_socket_t socket, short what, void* ctx)
+{
+   struct vita* vita = (struct vita*) ctx;
+   ssize_t bytes_received;
+   //  Only this thread reads packets, so one buffer of the largest size configured does for all of them.
+   struct waveform_vita_packet* packet = vita->rx_packet;
+   size_t packet_size = VITA_PACKET_SIZE(vita->max_payload);
+
+   if (!(what & EV_READ))
+   {
+      waveform_log(WF_LOG_INFO, "Callback is not for a read?!\n");
+      return;
+   }
+
+   if ((bytes_received = vita->transport->vita_recv(vita, packet, packet_size)) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "VITA read failed: %s\n", strerror(errno));
+      return;
+   }
+
+   if ((size_t) bytes_received > packet_size)
+   {
+      waveform_log(WF_LOG_INFO, "Dropping %ld byte VITA packet larger than the maximum payload allows (%lu)\n",
+                   bytes_received, packet_size);
+      return;
+   }
+
+   //  The format is read off the header as it arrived, before any of it is swapped.
+   uint64_t format_key = waveform_format_key(packet);
+
+   //  Swap appropriate header fields.  We swap the static values for comparison for the class IDs,
+   //  so we don't need to worry about swapping that.
+   packet->header.length = ntohs(packet->header.length);
+   packet->header.stream_id = ntohl(packet->header.stream_id);
+
+   if (packet->header.integer_timestamp_type != INTEGER_TIMESTAMP_NOT_PRESENT)
+   {
+      packet->header.timestamp_int = htonl(packet->header.timestamp_int);
+      packet->header.timestamp_frac = be64toh(packet->header.timestamp_frac);
+   }
+
+   if (packet->header.oui != __constant_cpu_to_be32(WF_VITA_OUI))
+   {
+      waveform_log(WF_LOG_INFO, "Invalid OUI: 0x%08x\n", ntohl(packet->header.oui));
+      return;
+   }
+
+   unsigned long payload_length = (packet->header.length * sizeof(uint32_t)) - VITA_PACKET_HEADER_SIZE(packet);
+
+   if (payload_length != bytes_received - VITA_PACKET_HEADER_SIZE(packet))
+   {
+      waveform_log(WF_LOG_INFO, "VITA header size doesn't match bytes read from network (%lu != %ld - %lu) -- %lu\n",
+                   payload_length, bytes_received, VITA_PACKET_HEADER_SIZE(packet), packet_size);
+      return;
+   }
+
+   if (packet->header.information_class != __constant_cpu_to_be16(WF_VITA_INFORMATION_CLASS))
+   {
+      waveform_log(WF_LOG_INFO, "Invalid packet information class: 0x%04x\n", ntohs(packet->header.information_class));
+      return;
+   }
+
+   struct waveform_t* cur_wf = container_of(vita, struct waveform_t, vita);
+   _Atomic(struct waveform_cb_list*)* cb_list;
+   enum waveform_data_lane lane;
+
+   if (vita_is_sample_packet(format_key, vita->int_samples))
+   {
+      //  This is an audio or IQ packet from the RX or Mic
+      vita_swap_samples(packet);
+      if (is_transmit_packet(packet))
+      {
+         if (vita->tx_stream_in_id == 0)
+         {
+            waveform_log(WF_LOG_DEBUG, "No Incoming TX Stream ID, setting to 0x%08x\n", packet->header.stream_id);
+            vita->tx_stream_in_id = packet->header.stream_id;
+         }
+         else if (vita->tx_stream_in_id != packet->header.stream_id)
+         {
+            waveform_log(WF_LOG_INFO, "Incoming TX stream 0x%08x is not expected (0x%08x)\n", packet->header.stream_id, vita->tx_stream_in_id);
+            return;
+         }
+
+         cb_list = &cur_wf->tx_data_cbs;
+         lane = WF_DATA_LANE_TX;
+      }
+      else
+      {
+         if (vita->rx_stream_in_id == 0)
+         {
+            waveform_log(WF_LOG_DEBUG, "No Incoming RX Stream ID, setting to 0x%08x\n", packet->header.stream_id);
+            vita->rx_stream_in_id = packet->header.stream_id;
+         }
+         else if (vita->rx_stream_in_id != packet->header.stream_id)
+         {
+            waveform_log(WF_LOG_INFO, "Incoming RX stream 0x%08x is not expected (0x%08x)\n", packet->header.stream_id, vita->tx_stream_in_id);
+            return;
+         }
+
+         cb_list = &cur_wf->rx_data_cbs;
+         lane = WF_DATA_LANE_RX;
+      }
+   }
+   else if (WF_FORMAT_MATCHES(WF_FORMAT_BYTE_DATA, format_key))
+   {
+      // This is a byte data packet.
+      // We don't swap the data around here so that we are transparent
+      // to the user who is sending it.
+      packet->byte_payload.length = ntohl(packet->byte_payload.length);
+      cb_list = &cur_wf->byte_data_cbs;
+      lane = WF_DATA_LANE_BYTE;
+   }
+   else
+   {
+      //  Context packets are decoded for waveform_get_stream_context() and still passed on as before.
+      if (packet->header.packet_type == VITA_PACKET_TYPE_CTX)
+      {
+         vita_context_update(vita, packet, payload_length);
+      }
+
+      // This is an unknown format packet
+      vita_swap_payload(packet);
+      cb_list = &cur_wf->unknown_data_cbs;
+      lane = WF_DATA_LANE_UNKNOWN;
+   }
+
+   if (vita->shm_prefix != NULL)
+   {
+      vita_shm_publish(vita, packet, payload_length);
+   }
+
+   struct vita_worker* worker = vita_stream_worker(vita, packet->header.stream_id);
+   size_t header_size = VITA_PACKET_HEADER_SIZE(packet);
+   struct waveform_packet_info info;
+
+   vita_decode_info(packet, payload_length, &info);
+
+   //  Only sample packets have a period.  The class bits it would be worked out from mean nothing for the other
+   //  lanes, so those get a fixed budget.
+   uint64_t budget_ns = VITA_UNTIMED_DEADLINE_NS;
+   if (lane == WF_DATA_LANE_RX || lane == WF_DATA_LANE_TX)
+   {
+      vita_timeline_advance(vita, &info);
+      budget_ns = vita_packet_period_ns(&info) * vita->deadline_periods;
+   }
+   struct vita_expiry* expiry = NULL;
+
+   rcu_read_lock();
+   struct waveform_cb_list* cbs = rcu_dereference(*cb_list);
+   for (size_t i = 0; cbs != NULL && i < cbs->count; ++i)
+   {
+      struct data_cb_wq_desc* desc = vita_desc_alloc(vita, bytes_received);// Freed when taken out of linked list
+      if (!desc)
+      {
+         pthread_mutex_lock(&worker->lock);
+         ++worker->lanes[lane].stats.dropped;
+         pthread_mutex_unlock(&worker->lock);
+         continue;
+      }
+
+      desc->wf = cur_wf;
+      memcpy(desc->packet, packet, bytes_received);
+      desc->packet_size = bytes_received;
+      desc->info = info;
+      desc->info.payload = (char*) desc->packet + header_size;
+      desc->cb = cbs->cbs[i];
+      if (expiry == NULL)
+      {
+         //  This loop holds a reference until every descriptor is queued, so a worker finishing the first
+         //  one early can't free the state the others still need.
+         expiry = &desc->own_expiry;
+         atomic_init(&expiry->refs, 1);
+      }
+      atomic_fetch_add_explicit(&expiry->refs, 1, memory_order_relaxed);
+      desc->expiry = expiry;
+
+      vita_enqueue(worker, lane, desc, budget_ns);
+   }
+   rcu_read_unlock();
+
+   if (expiry != NULL)
+   {
+      vita_expiry_put(vita, expiry);
+   }
+}
+
+/// @brief VITA processing event loop
+/// @details An event loop for VITA processing that opens a socket to communicate with the radio, sets up
+///          appropriate callbacks so that we can handle events and then executes event_base_dispatch
+///          which will run in an infinite loop until there is no more connection there.  See the libevent
+///          documentation for more details.
+/// @param arg The VITA struct for which to run the event loop
+static void* vita_evt_loop(void* arg)
+{
+   struct waveform_t* wf = (struct waveform_t*) arg;
+   struct vita* vita = &(wf->vita);
+   int ret;
+
+   struct sched_param thread_fifo_priority = {
+         .sched_priority = sched_get_priority_max(SCHED_FIFO)};
+
+   ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &thread_fifo_priority);
+   if (ret)
+   {
+      waveform_log(WF_LOG_DEBUG, "Setting thread to realtime: %m\n");
+   }
+
+   rcu_register_thread();
+
+   waveform_log(WF_LOG_DEBUG, "Initializing VITA-49 engine...\n");
+
+   uint16_t port;
+   vita->sock = vita->transport->vita_open(vita, &port);
+   if (vita->sock == -1)
+   {
+      vita->sock = 0;
+      goto fail;
+   }
+
+   //  Large payloads are only sent whole if they fit in a frame on the route to the radio.  Standard
+   //  sized packets are always allowed, as they always have been, and are fragmented if need be.
+   size_t mtu = vita->transport->vita_mtu(vita);
+   size_t send_payload = vita->max_payload;
+   if (mtu != 0 && VITA_PACKET_SIZE(send_payload) + ip_udp_header_size > mtu)
+   {
+      send_payload = mtu > VITA_PACKET_SIZE(WF_STANDARD_PAYLOAD) + ip_udp_header_size
+                           ? (mtu - ip_udp_header_size - VITA_PACKET_SIZE(0)) / sizeof(uint32_t) * sizeof(uint32_t)
+                           : WF_STANDARD_PAYLOAD;
+      waveform_log(WF_LOG_INFO, "Route to the radio has an MTU of %zu, sending payloads of up to %zu bytes\n", mtu,
+                   send_payload);
+   }
+   vita->send_payload = send_payload;
+
+   vita->base = event_base_new();
+   if (!vita->base)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create VITA event base\n");
+      goto fail_socket;
+   }
+
+   vita->read_evt = event_new(vita->base, vita->sock, EV_READ | EV_PERSIST, vita_read_cb, vita);
+   if (!vita->read_evt)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create VITA read event\n");
+      goto fail_base;
+   }
+   if (event_add(vita->read_evt, NULL) == -1)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't add VITA read event to base\n");
+      goto fail_evt;
+   }
+
+   vita->tx.write_evt = event_new(vita->base, vita->sock, EV_WRITE, vita_write_cb, vita);
+   if (!vita->tx.write_evt)
+   {
+      waveform_log(WF_LOG_ERROR, "Couldn't create VITA write event\n");
+      goto fail_evt;
+   }
+   vita->tx.ready = true;
+
+   vita->port = port;
+
+   vita->data_sequence = 0;
+   vita->meter_sequence = 0;
+   vita->byte_data_sequence = 0;
+
+   waveform_send_api_command_cb(wf, NULL, NULL, "waveform set %s udpport=%hu", wf->name, vita->port);
+   waveform_send_api_command_cb(wf, NULL, NULL, "client udpport %hu", vita->port);
+
+   rt_prefault_stack();
+   rt_register_thread("vita_evt_loop");
+
+   event_base_dispatch(vita->base);
+
+   rt_unregister_thread();
+
+   waveform_log(WF_LOG_DEBUG, "VITA thread ending...\n");
+
+   //  Senders that saw the loop ready may still be using the write event and the socket, so wait for them to finish
+   //  before either goes away.  Both sides use sequentially consistent operations, so a sender either sees ready
+   //  cleared or is counted here.
+   vita->tx.ready = false;
+   while (atomic_load(&vita->tx.senders) != 0)
+   {
+      sched_yield();
+   }
+   event_free(vita->tx.write_evt);
+   vita->tx.write_evt = NULL;
+
+fail_evt:
+   event_free(vita->read_evt);
+fail_base:
+   event_base_free(vita->base);
+fail_socket:
+   vita->transport->vita_close(vita);
+   vita->sock = 0;
+fail:
+   rcu_unregister_thread();
+   return NULL;
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "EndlessLoop"
+/// @brief Data callback event loop
+/// @details An event loop for running user-defined data callbacks.  Each worker
+///          runs one of these, taking tasks from its own lanes and executing them,
+///          choosing the lane according to the waveform's lane policy.  Within a lane
+///          tasks run in order.  This thread terminates when the main VITA loop terminates.
+/// @param arg The worker whose lanes to service
+static void* vita_cb_loop(void* arg)
+{
+   struct vita_worker* worker = (struct vita_worker*) arg;
+   struct vita* vita = worker->vita;
+   struct timespec timeout;
+   int ret;
+
+   //  Run this as a lower priority than the thread servicing the socket
+   struct sched_param thread_fifo_priority = {
+         .sched_priority = sched_get_priority_max(SCHED_FIFO) - 8,
+   };
+   ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &thread_fifo_priority);
+   if (ret)
+   {
+      waveform_log(WF_LOG_DEBUG, "Setting thread to realtime: %s\n", strerror(ret));
+   }
+
+   rcu_register_thread();
+   rt_prefault_stack();
+   rt_register_thread("vita_cb_loop");
+
+   while (vita->wq_running)
+   {
+
+      if (clock_gettime(CLOCK_REALTIME, &timeout) == -1)
+      {
+         waveform_log(WF_LOG_ERROR, "Couldn't gert time.\n");
+         continue;
+      }
+
+      timeout.tv_sec += 1;
+
+      while ((ret = sem_timedwait(&worker->sem, &timeout)) == -1 && errno == EINTR)
+         ;
+
+      if (ret == -1)
+      {
+         if (errno == ETIMEDOUT)
+         {
+            continue;
+         }
+         else
+         {
+            waveform_log(WF_LOG_ERROR, "Error acquiring semaphore: %s\n", strerror(errno));
+            continue;
+         }
+      }
+
+      pthread_mutex_lock(&worker->lock);
+      struct vita_lane* lane = vita_next_lane(worker);
+      if (lane == NULL)
+      {
+         pthread_mutex_unlock(&worker->lock);
+         waveform_log(WF_LOG_WARNING, "Thread awakened but nothing is in the queue?\n");
+         continue;
+      }
+
+      struct data_cb_wq_desc* current_task = lane->head;
+      DL_DELETE(lane->head, current_task);
+
+      uint64_t now = monotonic_now_ns();
+      bool expired = vita->lane_policy == WF_LANE_EARLIEST_DEADLINE && now > current_task->deadline_ns;
+      uint64_t latency = now - current_task->enqueued_ns;
+      --lane->stats.depth;
+      if (expired)
+      {
+         ++lane->stats.expired;
+      }
+      else
+      {
+         ++lane->stats.dispatched;
+         lane->stats.total_latency_ns += latency;
+         if (latency > lane->stats.max_latency_ns)
+         {
+            lane->stats.max_latency_ns = latency;
+         }
+      }
+      pthread_mutex_unlock(&worker->lock);
+
+      if (expired && !atomic_exchange(&current_task->expiry->passed_on, true))
+      {
+         //  Too late to be useful, let the waveform's degraded path have it if it wants it.  Every callback of
+         //  the packet has its own descriptor, and whichever of them expires first passes it on, so the degraded
+         //  path sees it once.
+         rcu_read_lock();
+         waveform_cb_for_each (current_task->wf, expired_data_cbs, cur_cb)
+         {
+            (cur_cb->data_cb)(current_task->wf, current_task->packet, current_task->packet_size, cur_cb->arg);
+         }
+         rcu_read_unlock();
+      }
+      else if (!expired)
+      {
+         (current_task->cb.data_cb)(current_task->wf, current_task->packet, current_task->packet_size, current_task->cb.arg);
+      }
+
+      vita_desc_release(vita, current_task);
+   }
+
+   rt_unregister_thread();
+   rcu_unregister_thread();
+
+   return NULL;
+}
+#pragma clang diagnostic pop
+
+// ****************************************
+// Global Functions
+// ****************************************
+void vita_setup(struct vita* vita)
+{
+   vita->lane_policy = WF_LANE_STRICT_PRIORITY;
+   for (size_t i = 0; i < WF_DATA_LANE_MAX; ++i)
+   {
+      vita->lane_weights[i] = default_lane_weights[i];
+   }
+   vita->deadline_periods = 4;
+
+   vita->sample_rate_code = SR_24K;
+   vita->max_payload = WF_STANDARD_PAYLOAD;
+   vita->send_payload = WF_STANDARD_PAYLOAD;
+
+   vita->tx.depth = 32;
+   vita->tx.policy = WF_TX_DROP_OLDEST;
+
+   vita->num_workers = 1;
+   for (size_t i = 0; i < WF_MAX_DATA_WORKERS; ++i)
+   {
+      struct vita_worker* worker = &vita->workers[i];
+
+      worker->vita = vita;
+      pthread_mutex_init(&worker->lock, NULL);
+      for (size_t j = 0; j < WF_DATA_LANE_MAX; ++j)
+      {
+         worker->lanes[j].credit = default_lane_weights[j];
+      }
+   }
+}
+
+void vita_teardown(struct vita* vita)
+{
+   for (size_t i = 0; i < WF_MAX_DATA_WORKERS; ++i)
+   {
+      pthread_mutex_destroy(&vita->workers[i].lock);
+   }
+
+   alloc_free(WF_ALLOC_OTHER, vita->shm_prefix);
+}
+
+/// @brief Stops the data callback workers and frees any callbacks they had not run yet
+/// @param vita The VITA loop whose workers to stop
+/// @param count The number of workers that were started
+static void vita_stop_workers(struct vita* vita, unsigned int count)
+{
+   vita->wq_running = false;
+
+   for (unsigned int i = 0; i < count; ++i)
+   {
+      struct vita_worker* worker = &vita->workers[i];
+
+      pthread_join(worker->thread, NULL);
+      sem_destroy(&worker->sem);
+
+      pthread_mutex_lock(&worker->lock);
+      for (size_t j = 0; j < WF_DATA_LANE_MAX; ++j)
+      {
+         struct vita_lane* lane = &worker->lanes[j];
+         struct data_cb_wq_desc* task;
+         struct data_cb_wq_desc* tmp;
+         DL_FOREACH_SAFE(lane->head, task, tmp)
+         {
+            DL_DELETE(lane->head, task);
+            vita_desc_release(vita, task);
+         }
+         lane->stats.depth = 0;
+      }
+      pthread_mutex_unlock(&worker->lock);
+   }
+}
+
+int vita_init(struct waveform_t* wf)
+{
+   struct vita* vita = &wf->vita;
+   unsigned int started;
+   unsigned int pools = 0;
+   int ret;
+
+   vita->transport = wf->radio->transport;
+   vita->transport_ctx = wf->radio->transport_ctx;
+
+   if (vita->rt_pool_size != 0)
+   {
+      if (rt_lock_memory() == -1)
+      {
+         waveform_log(WF_LOG_ERROR, "Couldn't lock memory for real-time mode: %s\n", strerror(errno));
+      }
+
+      for (pools = 0; pools < VITA_BUF_CLASSES; ++pools)
+      {
+         size_t size = sizeof(struct data_cb_wq_desc) + vita_buf_class_size(vita, pools);
+         size_t count = vita->rt_pool_size;
+
+         //  The pool size is given for 24 ksps.  Faster streams fill full sized packets proportionally
+         //  more often, so scale that class to keep the same amount of time buffered.
+         if (pools == VITA_BUF_CLASSES - 1)
+         {
+            count *= DIV_ROUND_UP(vita_sample_rate_hz(vita->sample_rate_code), 24000);
+         }
+
+         if (pool_init(&vita->desc_pools[pools], size, count, WF_ALLOC_RX_QUEUE) == -1)
+         {
+            waveform_log(WF_LOG_FATAL, "Cannot allocate data callback pool\n");
+            goto fail_pools;
+         }
+      }
+   }
+
+   size_t packet_size = VITA_PACKET_SIZE(vita->max_payload);
+
+   vita->rx_packet = alloc_malloc(WF_ALLOC_RX_QUEUE, packet_size);
+   vita->tx.held = alloc_malloc(WF_ALLOC_TX_QUEUE, packet_size);
+   if (!vita->rx_packet || !vita->tx.held)
+   {
+      waveform_log(WF_LOG_FATAL, "Cannot allocate packet buffers\n");
+      goto fail_buffers;
+   }
+
+   if (mpmc_init(&vita->tx.queue, vita->tx.depth, packet_size, WF_ALLOC_TX_QUEUE, "transmit queue") == -1)
+   {
+      waveform_log(WF_LOG_FATAL, "Cannot allocate transmit queue\n");
+      goto fail_buffers;
+   }
+   vita->tx.pending = 0;
+   vita->tx.held_length = 0;
+   memset(vita->contexts, 0, sizeof(vita->contexts));
+   memset(vita->timelines, 0, sizeof(vita->timelines));
+   memset(&vita->clock, 0, sizeof(vita->clock));
+
+   if (vita->shm_prefix != NULL)
+   {
+      vita_shm_create_rings(vita);
+   }
+
+   vita->wq_running = true;
+   for (started = 0; started < vita->num_workers; ++started)
+   {
+      struct vita_worker* worker = &vita->workers[started];
+
+      sem_init(&worker->sem, 0, 0);
+      ret = pthread_create(&worker->thread, NULL, vita_cb_loop, worker);
+      if (ret)
+      {
+         waveform_log(WF_LOG_FATAL, "Cannot create work queue thread: %s\n", strerror(ret));
+         sem_destroy(&worker->sem);
+         goto fail_workers;
+      }
+   }
+
+   ret = pthread_create(&vita->thread, NULL, vita_evt_loop, wf);
+   if (ret)
+   {
+      waveform_log(WF_LOG_ERROR, "Creating thread: %s\n", strerror(ret));
+      goto fail_workers;
+   }
+
+   return 0;
+
+fail_workers:
+   vita_stop_workers(vita, started);
+   vita_shm_destroy_rings(vita);
+   mpmc_destroy(&vita->tx.queue);
+fail_buffers:
+   alloc_free(WF_ALLOC_TX_QUEUE, vita->tx.held);
+   vita->tx.held = NULL;
+   alloc_free(WF_ALLOC_RX_QUEUE, vita->rx_packet);
+   vita->rx_packet = NULL;
+   pools = vita->rt_pool_size != 0 ? VITA_BUF_CLASSES : 0;
+fail_pools:
+   for (unsigned int i = 0; i < pools; ++i)
+   {
+      pool_destroy(&vita->desc_pools[i]);
+   }
+   return -1;
+}
+
+void vita_destroy(struct waveform_t* wf)
+{
+   if (!wf->vita.wq_running)
+   {
+      waveform_log(WF_LOG_INFO, "Waveform is not running, not trying to destory again\n");
+      return;
+   }
+
+   // Stop the socket thread first so nothing more is queued, then the callback workers
+   if (wf->vita.sock != 0)
+   {
+      event_base_loopexit(wf->vita.base, NULL);
+   }
+   pthread_join(wf->vita.thread, NULL);
+
+   vita_stop_workers(&wf->vita, wf->vita.num_workers);
+
+   //  Anything still waiting to be sent is lost with the socket.
+   mpmc_destroy(&wf->vita.tx.queue);
+   alloc_free(WF_ALLOC_TX_QUEUE, wf->vita.tx.held);
+   wf->vita.tx.held = NULL;
+   alloc_free(WF_ALLOC_RX_QUEUE, wf->vita.rx_packet);
+   wf->vita.rx_packet = NULL;
+
+   if (wf->vita.rt_pool_size != 0)
+   {
+      for (size_t i = 0; i < VITA_BUF_CLASSES; ++i)
+      {
+         pool_destroy(&wf->vita.desc_pools[i]);
+      }
+   }
+
+   vita_shm_destroy_rings(&wf->vita);
+}
+
+/// @brief Sends a packet, or queues it behind those already waiting
+/// @details Only called between incrementing and decrementing the sender count with the loop ready, so the socket
+///          and write event stay valid throughout.
+/// @param vita The VITA loop to which to send the packet
+/// @param packet The packet, already in network byte order
+/// @param len The length of the packet in bytes
+/// @returns As vita_send_packet()
+static ssize_t vita_tx_send(struct vita* vita, struct waveform_vita_packet* packet, size_t len)
+{
+   //  Once packets are waiting, new ones go behind them so the stream stays in order.
+   if (atomic_load(&vita->tx.pending) != 0)
+   {
+      return vita_tx_queue(vita, packet, len);
+   }
+
+   ssize_t bytes_sent;
+   if ((bytes_sent = vita->transport->vita_send(vita, packet, len)) == -1)
+   {
+      if (vita_tx_backpressure(errno))
+      {
+         return vita_tx_queue(vita, packet, len);
+      }
+
+      int err = errno;
+      char error_string[1024];
+      strerror_r(err, error_string, sizeof(error_string));
+      waveform_log(WF_LOG_ERROR, "Error sending vita packet to %s: %s\n", inet_ntoa(vita->radio_addr.sin_addr), error_string);
+      atomic_fetch_add(&vita->tx.errors, 1);
+      return -err;
+   }
+
+   if (bytes_sent != len)
+   {
+      waveform_log(WF_LOG_ERROR, "Short write on vita send\n");
+      atomic_fetch_add(&vita->tx.errors, 1);
+      return -E2BIG;
+   }
+
+   atomic_fetch_add(&vita->tx.sent, 1);
+   return 0;
+}
+
+ssize_t vita_send_packet(struct vita* vita, struct waveform_vita_packet* packet, size_t len)
+{
+   ssize_t ret;
+
+   atomic_fetch_add(&vita->tx.senders, 1);
+   if (!vita->tx.ready)
+   {
+      atomic_fetch_sub(&vita->tx.senders, 1);
+      atomic_fetch_add(&vita->tx.errors, 1);
+      return -ENOTCONN;
+   }
+
+   ret = vita_tx_send(vita, packet, len);
+   atomic_fetch_sub(&vita->tx.senders, 1);
+
+   return ret;
+}
+
+ssize_t vita_send_data_packet(struct vita* vita, float* samples, size_t num_samples, enum waveform_packet_type type)
+{
+   size_t send_payload = vita->send_payload;
+
+   if (num_samples * sizeof(float) > send_payload)
+   {
+      waveform_log(WF_LOG_ERROR, "%lu samples exceeds maximum sending limit of %lu samples\n", num_samples,
+                   send_payload / sizeof(float));
+      return -EFBIG;
+   }
 
    struct timespec current_time = {0};
    if (clock_gettime(CLOCK_REALTIME, &current_time) == -1)
@@ -734,45 +1802,30 @@ ssize_t vita_send_data_packet(struct vita* vita, float* samples, size_t num_samp
       current_time.tv_nsec = 0;
    }
 
-   struct waveform_vita_packet packet = {
-         .header = {
-               .packet_type = VITA_PACKET_TYPE_IF_DATA_WITH_STREAM_ID,
-               .class_present = true,
-               .trailer_present = false,
-               .integer_timestamp_type = INTEGER_TIMESTAMP_UTC,
-               .fractional_timestamp_type = FRACTIONAL_TIMESTAMP_REAL_TIME,
-               .sequence = vita->data_sequence++,
-               .length = num_samples,
-               .timestamp_int = htonl(current_time.tv_sec),
-               .timestamp_frac = htobe64(current_time.tv_nsec * 1000),
-               .stream_id = htonl(type == TRANSMITTER_DATA ? vita->tx_stream_in_id : vita->rx_stream_in_id),
-               .oui = __constant_cpu_to_be32(FLEX_OUI),
-               .information_class = __constant_cpu_to_be16(SMOOTHLAKE_INFORMATION_CLASS),
-               .packet_class = {
-                     .is_audio = true,
-                     .is_float = true,
-                     .sample_rate = SR_24K,
-                     .bits_per_sample = BPS_32,
-                     .frames_per_sample = FPS_2,
-               },
-         },
-         .raw_payload = {0},
-   };
+   union vita_packet_buffer buffer;
+   struct waveform_vita_packet* packet = &buffer.packet;
+
+   //  Only the header is initialized, every word of the payload is written below.
+   size_t packet_words = WF_FORMAT_FLOAT_STEREO_HEADER_WORDS + num_samples;
+   vita_write_header(packet, WF_FORMAT_HEADER_WORD0(WF_FORMAT_FLOAT_STEREO, vita->data_sequence++, packet_words),
+                     WF_FORMAT_CLASS_WORD(WF_FORMAT_FLOAT_STEREO, vita->sample_rate_code),
+                     type == TRANSMITTER_DATA ? vita->tx_stream_in_id : vita->rx_stream_in_id, &current_time);
 
    for (size_t i = 0; i < num_samples; ++i)
    {
-      packet.word_payload[i] = htonl(((uint32_t*) samples)[i]);
+      packet->word_payload[i] = htonl(((uint32_t*) samples)[i]);
    }
 
-   return vita_send_packet(vita, &packet);
+   return vita_send_packet(vita, packet, packet_words * sizeof(uint32_t));
 }
 
 ssize_t vita_send_byte_data_packet(struct vita* vita, void* data, size_t data_size)
 {
-   if (data_size > MEMBER_SIZE(struct waveform_vita_packet, byte_payload.data))
+   size_t max_data_size = vita->send_payload - MEMBER_SIZE(struct waveform_vita_packet, byte_payload.length);
+
+   if (data_size > max_data_size)
    {
-      waveform_log(WF_LOG_ERROR, "%lu bytes exceeds maximum sending limit of %lu byt4es\n", data_size,
-                   MEMBER_SIZE(struct waveform_vita_packet, byte_payload.data));
+      waveform_log(WF_LOG_ERROR, "%lu bytes exceeds maximum sending limit of %lu byt4es\n", data_size, max_data_size);
       return -EFBIG;
    }
 
@@ -784,41 +1837,342 @@ ssize_t vita_send_byte_data_packet(struct vita* vita, void* data, size_t data_si
       current_time.tv_nsec = 0;
    }
 
-   struct waveform_vita_packet packet = {
-         .header = {
-               .packet_type = VITA_PACKET_TYPE_EXT_DATA_WITH_STREAM_ID,
-               .class_present = true,
-               .trailer_present = false,
-               .integer_timestamp_type = INTEGER_TIMESTAMP_UTC,
-               .fractional_timestamp_type = FRACTIONAL_TIMESTAMP_REAL_TIME,
-               .sequence = vita->byte_data_sequence++,
-               .length = DIV_ROUND_UP(data_size, sizeof(uint32_t)) + 1,
-               .timestamp_int = htonl(current_time.tv_sec),
-               .timestamp_frac = htobe64(current_time.tv_nsec * 1000),
-               .stream_id = htonl(vita->byte_stream_in_id),
-               .oui = __constant_cpu_to_be32(FLEX_OUI),
-               .information_class = __constant_cpu_to_be16(SMOOTHLAKE_INFORMATION_CLASS),
-               .packet_class = {
-                     .is_audio = true,
-                     .is_float = false,
-                     .sample_rate = SR_3K,
-                     .bits_per_sample = BPS_8,
-                     .frames_per_sample = FPS_1,
-               },
-         },
-         .byte_payload = {
-               .length = htonl(data_size),
-               .data = {0},
-         },
-   };
+   union vita_packet_buffer buffer;
+   struct waveform_vita_packet* packet = &buffer.packet;
 
-   memcpy(packet.byte_payload.data, data, data_size);
-   return vita_send_packet(vita, &packet);
+   size_t packet_words = WF_FORMAT_BYTE_DATA_HEADER_WORDS + DIV_ROUND_UP(data_size, sizeof(uint32_t)) + 1;
+   vita_write_header(packet, WF_FORMAT_HEADER_WORD0(WF_FORMAT_BYTE_DATA, vita->byte_data_sequence++, packet_words),
+                     WF_FORMAT_CLASS_WORD(WF_FORMAT_BYTE_DATA, 0), vita->byte_stream_in_id, &current_time);
+
+   //  Only the padding after the data in its last word is sent, so that is all that needs zeroing.
+   packet->word_payload[DIV_ROUND_UP(data_size, sizeof(uint32_t))] = 0;
+   packet->byte_payload.length = htonl(data_size);
+   memcpy(packet->byte_payload.data, data, data_size);
+   return vita_send_packet(vita, packet, packet_words * sizeof(uint32_t));
+}
+
+int vita_radio_time_ns(struct vita* vita, uint64_t* radio_ns)
+{
+   struct vita_clock clock;
+
+   vita_seq_read(&vita->clock.sequence, &clock, &vita->clock, sizeof(clock));
+   if (!clock.valid)
+   {
+      return -1;
+   }
+
+   *radio_ns = monotonic_now_ns() - (uint64_t) clock.offset_ns;
+   return 0;
 }
 
 // ****************************************
 // Public API Functions
 // ****************************************
+int waveform_set_data_lane_policy(struct waveform_t* waveform, enum waveform_lane_policy policy)
+{
+   if (policy != WF_LANE_STRICT_PRIORITY && policy != WF_LANE_WEIGHTED && policy != WF_LANE_EARLIEST_DEADLINE)
+   {
+      return -1;
+   }
+
+   waveform->vita.lane_policy = policy;
+
+   return 0;
+}
+
+int waveform_set_data_lane_weight(struct waveform_t* waveform, enum waveform_data_lane lane, unsigned int weight)
+{
+   if (lane >= WF_DATA_LANE_MAX || weight == 0)
+   {
+      return -1;
+   }
+
+   waveform->vita.lane_weights[lane] = weight;
+
+   return 0;
+}
+
+int waveform_set_data_deadline(struct waveform_t* waveform, unsigned int periods)
+{
+   if (periods == 0)
+   {
+      return -1;
+   }
+
+   waveform->vita.deadline_periods = periods;
+
+   return 0;
+}
+
+int waveform_set_data_workers(struct waveform_t* waveform, unsigned int workers)
+{
+   if (workers == 0 || workers > WF_MAX_DATA_WORKERS || waveform->vita.wq_running)
+   {
+      return -1;
+   }
+
+   waveform->vita.num_workers = workers;
+
+   return 0;
+}
+
+int waveform_set_realtime(struct waveform_t* waveform, size_t pool_size)
+{
+   if (waveform->vita.wq_running)
+   {
+      return -1;
+   }
+
+   waveform->vita.rt_pool_size = pool_size;
+
+   return 0;
+}
+
+int waveform_set_shm_publish(struct waveform_t* waveform, const char* prefix, uint32_t slots)
+{
+   char* new_prefix = NULL;
+
+   if (waveform->vita.wq_running || (prefix != NULL && slots == 0))
+   {
+      return -1;
+   }
+
+   if (prefix != NULL)
+   {
+      new_prefix = alloc_strdup(WF_ALLOC_OTHER, prefix);
+      if (!new_prefix)
+      {
+         return -1;
+      }
+   }
+
+   alloc_free(WF_ALLOC_OTHER, waveform->vita.shm_prefix);
+   waveform->vita.shm_prefix = new_prefix;
+   waveform->vita.shm_slots = slots;
+
+   return 0;
+}
+
+int waveform_set_sample_rate(struct waveform_t* waveform, uint32_t sample_rate)
+{
+   int code = vita_sample_rate_code(sample_rate);
+
+   if (waveform->vita.wq_running || code == -1)
+   {
+      return -1;
+   }
+
+   waveform->vita.sample_rate_code = (unsigned int) code;
+
+   return 0;
+}
+
+int waveform_set_integer_samples(struct waveform_t* waveform, bool enable)
+{
+   if (waveform->vita.wq_running)
+   {
+      return -1;
+   }
+
+   waveform->vita.int_samples = enable;
+
+   return 0;
+}
+
+int waveform_set_max_payload(struct waveform_t* waveform, size_t bytes)
+{
+   if (waveform->vita.wq_running || bytes < WF_STANDARD_PAYLOAD || bytes > WF_JUMBO_PAYLOAD)
+   {
+      return -1;
+   }
+
+   //  The header's length field counts whole words.
+   waveform->vita.max_payload = bytes / sizeof(uint32_t) * sizeof(uint32_t);
+   waveform->vita.send_payload = waveform->vita.max_payload;
+
+   return 0;
+}
+
+size_t waveform_get_max_send_payload(struct waveform_t* waveform)
+{
+   return waveform->vita.send_payload;
+}
+
+int waveform_set_tx_queue(struct waveform_t* waveform, unsigned int depth, enum waveform_tx_drop_policy policy)
+{
+   if (waveform->vita.wq_running || depth == 0 || policy > WF_TX_DROP_NEWEST)
+   {
+      return -1;
+   }
+
+   waveform->vita.tx.depth = depth;
+   waveform->vita.tx.policy = policy;
+
+   return 0;
+}
+
+void waveform_get_tx_stats(struct waveform_t* waveform, struct waveform_tx_stats* stats)
+{
+   struct vita_tx* tx = &waveform->vita.tx;
+
+   stats->sent = atomic_load(&tx->sent);
+   stats->queued = atomic_load(&tx->queued);
+   stats->dropped = atomic_load(&tx->dropped);
+   stats->errors = atomic_load(&tx->errors);
+   stats->depth = atomic_load(&tx->pending);
+   stats->max_depth = atomic_load(&tx->max_depth);
+}
+
+enum waveform_memory_backing waveform_get_memory_backing(struct waveform_t* waveform, enum waveform_memory_region region)
+{
+   switch (region)
+   {
+      case WF_MEMORY_CALLBACK_POOL:
+         //  The full sized class is by far the largest
+         return waveform->vita.desc_pools[VITA_BUF_CLASSES - 1].mem.backing;
+      case WF_MEMORY_TX_QUEUE:
+         return waveform->vita.tx.queue.mem.backing;
+      default:
+         return WF_MEMORY_NONE;
+   }
+}
+
+int waveform_get_data_lane_stats(struct waveform_t* waveform, enum waveform_data_lane lane, struct waveform_lane_stats* stats)
+{
+   if (lane >= WF_DATA_LANE_MAX)
+   {
+      return -1;
+   }
+
+   memset(stats, 0, sizeof(*stats));
+
+   for (size_t i = 0; i < WF_MAX_DATA_WORKERS; ++i)
+   {
+      struct vita_worker* worker = &waveform->vita.workers[i];
+
+      pthread_mutex_lock(&worker->lock);
+      struct waveform_lane_stats* cur = &worker->lanes[lane].stats;
+      stats->enqueued += cur->enqueued;
+      stats->dispatched += cur->dispatched;
+      stats->depth += cur->depth;
+      stats->total_latency_ns += cur->total_latency_ns;
+      stats->expired += cur->expired;
+      stats->dropped += cur->dropped;
+      if (cur->max_depth > stats->max_depth)
+      {
+         stats->max_depth = cur->max_depth;
+      }
+      if (cur->max_latency_ns > stats->max_latency_ns)
+      {
+         stats->max_latency_ns = cur->max_latency_ns;
+      }
+      pthread_mutex_unlock(&worker->lock);
+   }
+
+   return 0;
+}
+
+int waveform_get_stream_context(struct waveform_t* waveform, uint32_t stream_id, struct waveform_stream_context* context)
+{
+   for (size_t i = 0; i < VITA_MAX_CONTEXT_STREAMS; ++i)
+   {
+      struct vita_context* slot = &waveform->vita.contexts[i];
+      uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+      //  Slots are claimed in order, so the stream has no context if this one is free
+      if (sequence == 0)
+      {
+         return -1;
+      }
+
+      if (__atomic_load_n(&slot->stream_id, __ATOMIC_RELAXED) == stream_id)
+      {
+         vita_seq_read(&slot->sequence, context, &slot->context, sizeof(*context));
+         return 0;
+      }
+   }
+
+   return -1;
+}
+
+/// @brief Gets a consistent copy of the timeline of a stream
+/// @param vita The VITA loop receiving the stream
+/// @param stream_id The stream
+/// @param timeline Where to copy the timeline
+/// @returns 0 on success or -1 if the stream has no anchored timeline
+static int vita_timeline_read(struct vita* vita, uint32_t stream_id, struct vita_timeline* timeline)
+{
+   for (size_t i = 0; i < VITA_MAX_TIMELINE_STREAMS; ++i)
+   {
+      struct vita_timeline* slot = &vita->timelines[i];
+
+      if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == 0)
+      {
+         return -1;
+      }
+
+      if (__atomic_load_n(&slot->stream_id, __ATOMIC_RELAXED) == stream_id)
+      {
+         vita_seq_read(&slot->sequence, timeline, slot, sizeof(*timeline));
+         return timeline->anchored ? 0 : -1;
+      }
+   }
+
+   return -1;
+}
+
+int waveform_get_radio_time(struct waveform_t* waveform, struct timespec* now)
+{
+   uint64_t radio_ns;
+
+   if (vita_radio_time_ns(&waveform->vita, &radio_ns) == -1)
+   {
+      return -1;
+   }
+
+   now->tv_sec = (time_t) (radio_ns / 1000000000ULL);
+   now->tv_nsec = (long) (radio_ns % 1000000000ULL);
+   return 0;
+}
+
+int waveform_sample_to_time(struct waveform_t* waveform, uint32_t stream_id, uint64_t sample_index, struct timespec* ts)
+{
+   struct vita_timeline timeline;
+
+   if (vita_timeline_read(&waveform->vita, stream_id, &timeline) == -1)
+   {
+      return -1;
+   }
+
+   int64_t offset = vita_frames_to_ns((int64_t) (sample_index - timeline.anchor_index), timeline.sample_rate);
+   uint64_t time_ns = timeline.anchor_ns + (uint64_t) offset;
+
+   ts->tv_sec = (time_t) (time_ns / 1000000000ULL);
+   ts->tv_nsec = (long) (time_ns % 1000000000ULL);
+   return 0;
+}
+
+int waveform_time_to_sample(struct waveform_t* waveform, uint32_t stream_id, const struct timespec* ts, uint64_t* sample_index)
+{
+   struct vita_timeline timeline;
+
+   if (vita_timeline_read(&waveform->vita, stream_id, &timeline) == -1)
+   {
+      return -1;
+   }
+
+   uint64_t time_ns = (uint64_t) ts->tv_sec * 1000000000ULL + (uint64_t) ts->tv_nsec;
+   int64_t offset = vita_ns_to_frames((int64_t) (time_ns - timeline.anchor_ns), timeline.sample_rate);
+
+   if (offset < 0 && (uint64_t) -offset > timeline.anchor_index)
+   {
+      return -1;
+   }
+
+   *sample_index = timeline.anchor_index + (uint64_t) offset;
+   return 0;
+}
+
 inline uint16_t get_packet_len(struct waveform_vita_packet* packet)
 {
    return packet->header.length - (VITA_PACKET_HEADER_SIZE(packet) / sizeof(uint32_t));
@@ -826,7 +2180,7 @@ inline uint16_t get_packet_len(struct waveform_vita_packet* packet)
 
 inline float* get_packet_data(struct waveform_vita_packet* packet)
 {
-   return packet->if_samples;
+   return waveform_packet_samples(get_packet_info(packet));
 }
 
 inline uint8_t* get_packet_byte_data(struct waveform_vita_packet* packet)
@@ -25,7 +25,11 @@
 // System Includes
 // ****************************************
 #include <asm/byteorder.h>
+#include <endian.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdbool.h>
+#include <time.h>
 
 // ****************************************
 // Third Party Library Includes
@@ -38,15 +42,37 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "mpmc.h"
+#include "pool.h"
 #include "utils.h"
+#include "vita_timeline.h"
 #include "waveform_api.h"
+#include "waveform_format.h"
 
 // ****************************************
 // Macros
 // ****************************************
+//  The most streams a waveform will publish to shared memory
+#define VITA_MAX_SHM_STREAMS 8
+
+//  The most streams whose context packets are decoded
+#define VITA_MAX_CONTEXT_STREAMS 8
+
+//  The most streams whose sample timelines are kept
+#define VITA_MAX_TIMELINE_STREAMS 8
+
+//  How long byte data and unknown packets, which have no sample period, may wait for their callbacks
+#define VITA_UNTIMED_DEADLINE_NS 20000000ULL
+
+//  The number of buffer sizes used for packets queued to the data callbacks
+#define VITA_BUF_CLASSES 3
+
 #define VITA_PACKET_HEADER_SIZE(packet) \
    ((packet)->header.integer_timestamp_type != INTEGER_TIMESTAMP_NOT_PRESENT ? MEMBER_SIZE(struct waveform_vita_packet, header) : MEMBER_SIZE(struct waveform_vita_packet_sans_ts, header))
 
+//  The size of a buffer that holds any packet with up to payload bytes of payload
+#define VITA_PACKET_SIZE(payload) (MEMBER_SIZE(struct waveform_vita_packet, header) + (payload))
+
 // ****************************************
 // Structures, Enums, typedefs
 // ****************************************
@@ -289,21 +315,111 @@ struct waveform_vita_packet_sans_ts {
 };
 #pragma pack(pop)
 
+//  Room to build a packet with the largest payload a waveform can be configured for.  The
+//  payload of packet simply runs on into the rest of the buffer.
+union vita_packet_buffer {
+   struct waveform_vita_packet packet;
+   uint8_t                     bytes[VITA_PACKET_SIZE(WF_JUMBO_PAYLOAD)];
+};
+
+//  The latest context of one stream.  Only the VITA event loop writes it; anyone may read it by
+//  copying context between two loads of an even sequence.  A sequence of 0 marks an unused slot.
+struct vita_context {
+   uint32_t                       sequence;
+   uint32_t                       stream_id;
+   struct waveform_stream_context context;
+};
+
+struct data_cb_wq_desc;
+struct shm_ring;
+struct transport_ops;
+
+//  A queue of pending data callbacks for one class of packet.  All fields
+//  are protected by the lock of the owning struct vita_worker.
+struct vita_lane {
+   struct data_cb_wq_desc*    head;
+   unsigned int               credit;
+   struct waveform_lane_stats stats;
+};
+
+//  A thread running data callbacks.  Every stream is assigned to exactly
+//  one worker so callbacks for a stream run in order.
+struct vita_worker {
+   CACHE_ALIGNED pthread_t thread;
+   sem_t            sem;
+   pthread_mutex_t  lock;
+   struct vita*     vita;
+   struct vita_lane lanes[WF_DATA_LANE_MAX];
+};
+
+//  Outgoing packets waiting for the socket to become writable.  Any thread may
+//  queue a packet; only the VITA event loop sends them.
+struct vita_tx {
+   struct mpmc_queue                       queue;
+   struct event*                           write_evt;
+   _Atomic bool                            ready;
+   unsigned int                            depth;
+   enum waveform_tx_drop_policy            policy;
+   //  Written by every sending thread
+   CACHE_ALIGNED _Atomic uint32_t          senders;
+   _Atomic uint32_t                        pending;
+   _Atomic uint32_t                        max_depth;
+   _Atomic uint64_t                        sent;
+   _Atomic uint64_t                        queued;
+   _Atomic uint64_t                        dropped;
+   _Atomic uint64_t                        errors;
+   //  The packet at the head of the queue, held by the event loop until it is sent
+   CACHE_ALIGNED size_t                    held_length;
+   struct waveform_vita_packet*            held;
+};
+
+//  Laid out by which threads write each part.  The first block is set up before the
+//  loop starts and only read while it runs, so every thread can share those lines.
 struct vita {
-   int                sock;
-   unsigned short     port;// XXX Do we really need to keep this around?
-   pthread_t          thread;
-   struct event_base* base;
-   struct event*      read_evt;
-   _Atomic uint8_t    meter_sequence;
-   _Atomic uint8_t    data_sequence;
-   _Atomic uint8_t    byte_data_sequence;
-   uint32_t           tx_stream_in_id;
-   uint32_t           rx_stream_in_id;
-   uint32_t           tx_stream_out_id;
-   uint32_t           rx_stream_out_id;
-   uint32_t           byte_stream_in_id;
-   uint32_t           byte_stream_out_id;
+   int                                sock;
+   unsigned short                     port;// XXX Do we really need to keep this around?
+   pthread_t                          thread;
+   struct event_base*                 base;
+   struct event*                      read_evt;
+   uint32_t                           tx_stream_in_id;
+   uint32_t                           rx_stream_in_id;
+   uint32_t                           tx_stream_out_id;
+   uint32_t                           rx_stream_out_id;
+   uint32_t                           byte_stream_in_id;
+   uint32_t                           byte_stream_out_id;
+   _Atomic bool                       wq_running;
+   _Atomic(enum waveform_lane_policy) lane_policy;
+   _Atomic unsigned int               lane_weights[WF_DATA_LANE_MAX];
+   _Atomic unsigned int               deadline_periods;
+   unsigned int                       num_workers;
+   size_t                             rt_pool_size;
+   unsigned int                       sample_rate_code;
+   bool                               int_samples;
+   size_t                             max_payload;
+   _Atomic size_t                     send_payload;
+   struct waveform_vita_packet*       rx_packet;
+   char*                              shm_prefix;
+   uint32_t                           shm_slots;
+   struct sockaddr_in                 radio_addr;
+   const struct transport_ops*        transport;
+   void*                              transport_ctx;
+   //  Written by every thread that sends packets
+   CACHE_ALIGNED _Atomic uint8_t      meter_sequence;
+   _Atomic uint8_t                    data_sequence;
+   _Atomic uint8_t                    byte_data_sequence;
+   //  Written when the waveform becomes active, before the VITA event loop starts
+   CACHE_ALIGNED struct shm_ring*     shm_rings[VITA_MAX_SHM_STREAMS];
+   uint32_t                           shm_stream_ids[VITA_MAX_SHM_STREAMS];
+   size_t                             shm_ring_count;
+   //  Written by the VITA event loop as context packets arrive
+   CACHE_ALIGNED struct vita_context  contexts[VITA_MAX_CONTEXT_STREAMS];
+   //  Written by the VITA event loop as sample packets arrive
+   CACHE_ALIGNED struct vita_timeline timelines[VITA_MAX_TIMELINE_STREAMS];
+   struct vita_clock                  clock;
+   //  Written by the VITA event loop and the workers as callbacks are queued and run
+   CACHE_ALIGNED struct pool          desc_pools[VITA_BUF_CLASSES];
+   struct vita_tx                     tx;
+   struct vita_worker                 workers[WF_MAX_DATA_WORKERS];
 };
 #pragma clang diagnostic pop
 
@@ -313,14 +429,27 @@ struct vita {
 #define DISCOVERY_STREAM_ID 0x00000800u
 #define METER_STREAM_ID 0x88000000u
 
-#define FLEX_OUI 0x00001c2dU
-#define SMOOTHLAKE_INFORMATION_CLASS 0x534cU
-
-#define METER_PACKET_CLASS 0x8002
-
 // ****************************************
 // Global Functions
 // ****************************************
+/// @brief Prepare the VITA state of a newly created waveform
+/// @details Initializes the parts of the VITA state that live for the whole lifetime of the waveform rather than
+///          just while it is active, such as the data callback workers and their statistics.
+/// @param vita The VITA structure to prepare
+void vita_setup(struct vita* vita);
+
+/// @brief Release the VITA state of a waveform being destroyed
+/// @details The counterpart of vita_setup().  The VITA loop must already be stopped.
+/// @param vita The VITA structure to release
+void vita_teardown(struct vita* vita);
+
+/// @brief Estimates the radio's clock from the timestamps of received packets
+/// @details Safe to call from any thread.
+/// @param vita The VITA loop receiving the packets
+/// @param radio_ns Where to store the current radio time in nanoseconds
+/// @returns 0 on success or -1 if no timestamped sample packet has been received yet
+int vita_radio_time_ns(struct vita* vita, uint64_t* radio_ns);
+
 /// @brief Create a VITA-49 processing loop on a waveform
 /// @details When the waveform becomes active, we will want to create an event loop upon which to process the data.
 ///          Call this function to create and initialize the loop.
@@ -330,14 +459,40 @@ int vita_init(struct waveform_t* wf);
 
 /// @brief Sends a VITA packet to the radio
 /// @details This is a low level function to send data to the radio.  It is designed to be generic enough to send data packets
-///          as well as send meter packets.  The user is expected to have filled in the appropriate parts of the packet including
-///          the packet type, class id, the number of samples in the packet (only in the payload, not header), sequence number for
-///          the stream, and the stream id itself.
+///          as well as send meter packets.  The packet must be complete and in network byte order, usually with a header
+///          written by vita_write_header().
 /// @param vita The VITA loop to which to send the packet
 /// @param packet a reference to the packet contents
+/// @param len The length of the packet in bytes
 /// @returns 0 on success or a negative value on an error.  Return values are negative values of errno.h and will return
-///          -E2BIG on a short write to the network.
-ssize_t vita_send_packet(struct vita* vita, struct waveform_vita_packet* packet);
+///          -E2BIG on a short write to the network.  A packet that can't be written yet because the socket is full
+///          is queued and counts as success; -EAGAIN means the transmit queue was full and the packet was dropped.
+///          -ENOTCONN means the VITA loop isn't running.
+ssize_t vita_send_packet(struct vita* vita, struct waveform_vita_packet* packet, size_t len);
+
+/// @brief Writes the header of an outgoing packet in network byte order
+/// @details Takes the header words of a format from waveform_format.h, so with those constant this comes down to a
+///          few stores.  Formats without a timestamp have a four word header and take a NULL timestamp.
+/// @param packet The packet whose header to write
+/// @param word0 The first header word with the sequence number and packet size, from WF_FORMAT_HEADER_WORD0()
+/// @param class_word The fourth header word, from WF_FORMAT_CLASS_WORD()
+/// @param stream_id The stream ID
+/// @param ts The time to stamp the packet with, or NULL for a format without a timestamp
+static inline void vita_write_header(struct waveform_vita_packet* packet, uint32_t word0, uint32_t class_word,
+                                     uint32_t stream_id, const struct timespec* ts)
+{
+   uint32_t* words = (uint32_t*) packet;
+
+   words[0] = htonl(word0);
+   words[1] = htonl(stream_id);
+   words[2] = __constant_cpu_to_be32(WF_VITA_OUI);
+   words[3] = htonl(class_word);
+   if (ts)
+   {
+      packet->header.timestamp_int = htonl(ts->tv_sec);
+      packet->header.timestamp_frac = htobe64(ts->tv_nsec * 1000);
+   }
+}
 
 /// @brief Sends a data packet to the radio
 /// @details
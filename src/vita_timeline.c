@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file vita_timeline.c
+/// @brief Sample timelines of received streams and the estimate of the radio's clock
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "vita_timeline.h"
+
+// ****************************************
+// Global Functions
+// ****************************************
+uint64_t vita_timeline_place(struct vita_timeline* timeline, bool fresh, struct waveform_packet_info* info)
+{
+   uint32_t frames = info->num_samples / info->channels;
+   bool has_timestamp = info->flags & WF_PACKET_HAS_TIMESTAMP;
+   bool anchor = false;
+
+   uint64_t time_ns = (uint64_t) info->timestamp_int * 1000000000ULL + info->timestamp_frac / 1000;
+   uint64_t index = timeline->next_index;
+
+   if (fresh || timeline->sample_rate != info->sample_rate)
+   {
+      //  A new stream, or one whose rate changed, starts a fresh anchor
+      timeline->anchored = false;
+   }
+   else if (has_timestamp && timeline->anchored)
+   {
+      int64_t offset = vita_ns_to_frames((int64_t) (time_ns - timeline->anchor_ns), info->sample_rate);
+      int64_t drift = (int64_t) (timeline->anchor_index + (uint64_t) offset - index);
+
+      if (drift > (int64_t) frames / 2 || drift < -((int64_t) frames / 2))
+      {
+         info->flags |= WF_PACKET_DISCONTINUITY;
+         if (drift > 0)
+         {
+            index += (uint64_t) drift;
+         }
+         anchor = true;
+      }
+   }
+   else
+   {
+      uint8_t lost = (info->sequence - timeline->next_packet) & 0xfU;
+
+      if (lost != 0)
+      {
+         info->flags |= WF_PACKET_DISCONTINUITY;
+         index += (uint64_t) lost * timeline->last_frames;
+      }
+   }
+
+   if (has_timestamp && (anchor || !timeline->anchored))
+   {
+      timeline->anchor_index = index;
+      timeline->anchor_ns = time_ns;
+      timeline->anchored = true;
+   }
+   timeline->sample_rate = info->sample_rate;
+   timeline->next_packet = (info->sequence + 1) & 0xfU;
+   timeline->last_frames = frames;
+   timeline->next_index = index + frames;
+
+   info->sample_index = index;
+   info->flags |= WF_PACKET_HAS_SAMPLE_INDEX;
+
+   return time_ns + (uint64_t) vita_frames_to_ns(frames, info->sample_rate);
+}
+
+void vita_clock_sample(struct vita_clock* clock, int64_t offset_ns)
+{
+   if (clock->window_packets == 0 || offset_ns < clock->window_min_ns)
+   {
+      clock->window_min_ns = offset_ns;
+   }
+   if (!clock->valid || offset_ns < clock->offset_ns)
+   {
+      clock->offset_ns = offset_ns;
+      clock->valid = true;
+   }
+   if (++clock->window_packets == VITA_CLOCK_WINDOW)
+   {
+      clock->offset_ns = clock->window_min_ns;
+      clock->window_packets = 0;
+   }
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+/// @file vita_timeline.h
+/// @brief Sample timelines of received streams and the estimate of the radio's clock
+/// @authors Annaliese McDermond <anna@flex-radio.com>
+///
+/// @copyright Copyright (c) 2020 FlexRadio Systems
+///
+/// This program is free software: you can redistribute it and/or modify
+/// it under the terms of the GNU Lesser General Public License as published by
+/// the Free Software Foundation, version 3.
+///
+/// This program is distributed in the hope that it will be useful, but
+/// WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+/// Lesser General Public License for more details.
+///
+/// You should have received a copy of the GNU Lesser General Public License
+/// along with this program. If not, see <http://www.gnu.org/licenses/>.
+///
+
+#ifndef WAVEFORM_SDK_VITA_TIMELINE_H
+#define WAVEFORM_SDK_VITA_TIMELINE_H
+
+// ****************************************
+// System Includes
+// ****************************************
+#include <stdbool.h>
+#include <stdint.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_api.h"
+
+// ****************************************
+// Macros
+// ****************************************
+//  The number of timestamped packets over which the smallest clock offset is taken
+#define VITA_CLOCK_WINDOW 256
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+//  The sample timeline of one stream, read and written like struct vita_context.  The index of
+//  a frame at radio time t is anchor_index + (t - anchor_ns) * sample_rate.
+struct vita_timeline {
+   uint32_t sequence;
+   uint32_t stream_id;
+   uint32_t sample_rate;
+   uint8_t  next_packet;// The packet sequence number expected next
+   bool     anchored;   // Whether anchor_index and anchor_ns are valid
+   uint32_t last_frames;
+   uint64_t next_index;
+   uint64_t anchor_index;
+   uint64_t anchor_ns;  // Radio time in nanoseconds
+};
+
+//  How far CLOCK_MONOTONIC is ahead of the radio's clock, read and written like struct vita_context.
+//  Each packet gives the offset plus however long it took to arrive, so the smallest offset seen over
+//  the last window is the best estimate, and starting a new window lets it follow drift.
+struct vita_clock {
+   uint32_t sequence;
+   uint32_t window_packets;
+   bool     valid;
+   int64_t  offset_ns;
+   int64_t  window_min_ns;
+};
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// @brief Converts a time difference to a number of frames, rounded to the nearest frame
+/// @param ns The time difference in nanoseconds
+/// @param rate The sample rate in Hz
+/// @returns The number of frames
+static inline int64_t vita_ns_to_frames(int64_t ns, uint32_t rate)
+{
+   int64_t rem = ns % 1000000000LL;
+   int64_t half = rem < 0 ? -500000000LL : 500000000LL;
+
+   //  Split at whole seconds so a day's worth of nanoseconds times the rate doesn't overflow
+   return (ns / 1000000000LL) * rate + (rem * rate + half) / 1000000000LL;
+}
+
+/// @brief Converts a number of frames to a time difference
+/// @param frames The number of frames
+/// @param rate The sample rate in Hz
+/// @returns The time difference in nanoseconds
+static inline int64_t vita_frames_to_ns(int64_t frames, uint32_t rate)
+{
+   return (frames / rate) * 1000000000LL + (frames % rate) * 1000000000LL / rate;
+}
+
+/// @brief Places a sample packet on a timeline
+/// @details The index of a packet is normally where the previous one ended.  If the timestamp of the packet puts it
+///          more than half a packet away from there, or its sequence number shows packets went missing when there
+///          is no timestamp, the lost frames are skipped and the packet is flagged as a discontinuity.  A clock
+///          that jumps backwards can't be followed without reusing indices, so the timeline keeps counting and is
+///          anchored again instead.  The caller serializes access to the timeline.
+/// @param timeline The timeline of the packet's stream
+/// @param fresh true if the timeline hasn't been used for the stream before
+/// @param info The decoded header of the packet, updated with its index
+/// @returns The radio time of the end of the packet in nanoseconds, if WF_PACKET_HAS_TIMESTAMP is set
+uint64_t vita_timeline_place(struct vita_timeline* timeline, bool fresh, struct waveform_packet_info* info);
+
+/// @brief Refines the estimate of the radio's clock with a packet that has just arrived
+/// @details The caller serializes access to the clock.
+/// @param clock The clock estimate
+/// @param offset_ns How far the monotonic clock was ahead of the radio time of the end of the packet on arrival
+void vita_clock_sample(struct vita_clock* clock, int64_t offset_ns);
+
+#endif//WAVEFORM_SDK_VITA_TIMELINE_H
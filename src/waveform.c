@@ -21,7 +21,10 @@
 // ****************************************
 // System Includes
 // ****************************************
+#include <pthread.h>
+#include <stdalign.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
@@ -35,7 +38,11 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "alloc.h"
+#include "module.h"
+#include "plugin.h"
 #include "radio.h"
+#include "rcu.h"
 #include "utils.h"
 #include "waveform.h"
 
@@ -45,11 +52,29 @@
 // XXX I should probably be defined somewhere common.
 #define MAX_STRING_SIZE 255
 
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+//  A command sent with waveform_schedule_command(), alive until its report is delivered.  Its responses are
+//  handled on the radio's event loop, which owns it until the report is handed to the work queue.
+struct schedule_entry {
+   struct waveform_t*              waveform;
+   waveform_schedule_cb_t          cb;
+   void*                           arg;
+   struct waveform_schedule_report report;
+};
+
 // ****************************************
 // Global Variables
 // ****************************************
 struct waveform_t* wf_list;
 
+// ****************************************
+// Static Variables
+// ****************************************
+//  Serializes writers of the callback lists.  Readers never take this.
+static pthread_mutex_t cb_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // ****************************************
 // Public API Functions
 // ****************************************
@@ -57,30 +82,31 @@ struct waveform_t* waveform_create(struct radio_t* radio, const char* name,
                                    const char* short_name, const char* underlying_mode,
                                    const char* version)
 {
-   struct waveform_t* wave = calloc(1, sizeof(*wave));
+   struct waveform_t* wave = alloc_aligned(WF_ALLOC_OTHER, alignof(struct waveform_t), sizeof(*wave));
    if (!wave)
    {
       return NULL;
    }
+   memset(wave, 0, sizeof(*wave));
 
-   wave->name = strndup(name, MAX_STRING_SIZE);
+   wave->name = alloc_adopt(WF_ALLOC_OTHER, strndup(name, MAX_STRING_SIZE));
    if (!wave->name)
    {
       goto abort_name;
    }
 
-   wave->short_name = strndup(short_name, MAX_STRING_SIZE);
+   wave->short_name = alloc_adopt(WF_ALLOC_OTHER, strndup(short_name, MAX_STRING_SIZE));
    if (!wave->short_name)
    {
       goto abort_short_name;
    }
 
-   wave->underlying_mode = strndup(underlying_mode, MAX_STRING_SIZE);
+   wave->underlying_mode = alloc_adopt(WF_ALLOC_OTHER, strndup(underlying_mode, MAX_STRING_SIZE));
    if (!wave->underlying_mode)
    {
       goto abort_mode;
    }
-   wave->version = strndup(version, MAX_STRING_SIZE);
+   wave->version = alloc_adopt(WF_ALLOC_OTHER, strndup(version, MAX_STRING_SIZE));
    if (!wave->version)
    {
       goto abort_version;
@@ -93,6 +119,8 @@ struct waveform_t* waveform_create(struct radio_t* radio, const char* name,
 
    wave->active_slice = -1;
 
+   vita_setup(&wave->vita);
+
    if (!wf_list)
    {
       wf_list = wave;
@@ -108,47 +136,74 @@ struct waveform_t* waveform_create(struct radio_t* radio, const char* name,
    return wave;
 
 abort_version:
-   free(wave->underlying_mode);
+   alloc_free(WF_ALLOC_OTHER, wave->underlying_mode);
 abort_mode:
-   free(wave->short_name);
+   alloc_free(WF_ALLOC_OTHER, wave->short_name);
 abort_short_name:
-   free(wave->name);
+   alloc_free(WF_ALLOC_OTHER, wave->name);
 abort_name:
-   free(wave);
+   alloc_free(WF_ALLOC_OTHER, wave);
    return NULL;
 }
 
-static inline void free_cb_list(struct waveform_cb_list* list)
+/// @brief Frees a callback list and the names of all of its callbacks
+/// @details Only for use when no other thread can be reading the list.
+/// @param list The list to free
+static void free_cb_list(struct waveform_cb_list* list)
 {
+   if (list == NULL)
+   {
+      return;
+   }
 
-   struct waveform_cb_list* cur;
-   struct waveform_cb_list* tmp;
-   LL_FOREACH_SAFE(list, cur, tmp)
+   for (size_t i = 0; i < list->count; ++i)
    {
-      LL_DELETE(list, cur);
-      if (cur->name != NULL)
+      if (list->cbs[i].name != NULL)
       {
-         sdsfree(cur->name);
+         alloc_sds_free(WF_ALLOC_OTHER, list->cbs[i].name);
       }
-      free(cur);
    }
+   alloc_free(WF_ALLOC_OTHER, list);
+}
+
+/// @brief Frees a callback name once it has been retired
+/// @param name The sds string to free
+static void free_cb_name(void* name)
+{
+   alloc_sds_free(WF_ALLOC_OTHER, name);
 }
 
 void waveform_destroy(struct waveform_t* waveform)
 {
    LL_DELETE(wf_list, waveform);
+   if (waveform->status_cbs)
+   {
+      radio_subscriptions_changed(waveform->radio);
+   }
+
+   //  Modules and plugins send packets and commands through the waveform, so stop them before anything
+   //  they use goes away, and free them only once no data callback can reach them.
+   module_halt_all(waveform);
+   plugin_halt_all(waveform);
+   vita_teardown(&waveform->vita);
 
    free_cb_list(waveform->status_cbs);
    free_cb_list(waveform->state_cbs);
    free_cb_list(waveform->cmd_cbs);
    free_cb_list(waveform->rx_data_cbs);
    free_cb_list(waveform->tx_data_cbs);
+   free_cb_list(waveform->byte_data_cbs);
    free_cb_list(waveform->unknown_data_cbs);
+   free_cb_list(waveform->expired_data_cbs);
+
+   module_destroy_all(waveform);
+   plugin_destroy_all(waveform);
 
-   free(waveform->name);
-   free(waveform->short_name);
-   free(waveform->underlying_mode);
-   free(waveform);
+   alloc_free(WF_ALLOC_OTHER, waveform->name);
+   alloc_free(WF_ALLOC_OTHER, waveform->short_name);
+   alloc_free(WF_ALLOC_OTHER, waveform->underlying_mode);
+   alloc_free(WF_ALLOC_OTHER, waveform->version);
+   alloc_free(WF_ALLOC_OTHER, waveform);
 }
 
 inline int32_t waveform_send_api_command_cb(struct waveform_t* waveform,
@@ -180,35 +235,287 @@ int32_t waveform_send_timed_api_command_cb(struct waveform_t* waveform, struct t
    return ret;
 }
 
-static int waveform_register_cb(struct waveform_cb_list** cb_list, const char* name,
-                                waveform_cmd_cb_t cb, void* arg)
+/// @brief Measures how far the radio's clock is past the target of a scheduled command
+/// @param waveform The waveform the command was sent for
+/// @param entry The scheduled command
+/// @param late Where to store the radio time now minus the target, in nanoseconds
+/// @returns true if the radio's clock is known
+static bool schedule_late_ns(struct waveform_t* waveform, struct schedule_entry* entry, int64_t* late)
+{
+   uint64_t now;
+
+   if (vita_radio_time_ns(&waveform->vita, &now) == -1)
+   {
+      entry->report.flags &= ~WF_SCHEDULE_HAS_CLOCK;
+      return false;
+   }
+
+   uint64_t target = (uint64_t) entry->report.target.tv_sec * 1000000000ULL + (uint64_t) entry->report.target.tv_nsec;
+   *late = (int64_t) (now - target);
+   return true;
+}
+
+/// @brief Work queue function to hand the report of a scheduled command to its callback and free it
+/// @param arg The scheduled command
+static void schedule_call_cb(void* arg)
+{
+   struct schedule_entry* entry = arg;
+
+   if (entry->cb)
+   {
+      entry->cb(entry->waveform, &entry->report, entry->arg);
+   }
+   alloc_sds_free(WF_ALLOC_COMMAND, entry->report.message);
+   alloc_free(WF_ALLOC_COMMAND, entry);
+}
+
+/// @brief Finishes the report of a scheduled command and queues it for its callback
+/// @details The callback runs on the work queue like other response callbacks, so it can't hold up the radio's
+///          event loop.  The entry belongs to the work item from here on.
+/// @param waveform The waveform the command was sent for
+/// @param entry The scheduled command
+/// @param code The response code that ended the command
+/// @param message The response message that ended the command, only valid during the call
+static void schedule_report(struct waveform_t* waveform, struct schedule_entry* entry, unsigned int code, char* message)
+{
+   pthread_workitem_handle_t handle;
+   unsigned int gencountp;
+
+   entry->report.code = code;
+   entry->report.message = alloc_sds_adopt(WF_ALLOC_COMMAND, sdsnew(message));
+   pthread_workqueue_additem_np(waveform->radio->cb_wq, schedule_call_cb, entry, &handle, &gencountp);
+}
+
+/// @brief The queued callback of a scheduled command
+/// @details Runs on the radio's event loop as the response arrives, so the lead is measured then.
+static void schedule_queued_cb(struct waveform_t* waveform, unsigned int code, char* message, void* arg)
+{
+   struct schedule_entry* entry = arg;
+   int64_t late;
+
+   entry->report.flags |= WF_SCHEDULE_QUEUED;
+   if (schedule_late_ns(waveform, entry, &late))
+   {
+      entry->report.queued_lead_ns = -late;
+   }
+
+   //  A command the radio refused to queue gets no other response
+   if (code != 0)
+   {
+      schedule_report(waveform, entry, code, message);
+   }
+}
+
+/// @brief The completion callback of a scheduled command
+/// @details Runs on the radio's event loop as the response arrives, after the queued response if there was one.
+static void schedule_complete_cb(struct waveform_t* waveform, unsigned int code, char* message, void* arg)
+{
+   struct schedule_entry* entry = arg;
+   int64_t late;
+
+   entry->report.flags |= WF_SCHEDULE_EXECUTED;
+   if (schedule_late_ns(waveform, entry, &late))
+   {
+      entry->report.executed_late_ns = late;
+   }
+
+   schedule_report(waveform, entry, code, message);
+}
+
+/// @brief Sends a scheduled command once its target is known
+/// @param waveform The waveform sending the command
+/// @param entry The scheduled command with its target filled in, freed when the command is over
+/// @param command The format string for the command
+/// @param ap A va_list to complete the format string
+/// @returns The sequence number on success or -1 on failure
+static int32_t schedule_command_va(struct waveform_t* waveform, struct schedule_entry* entry, char* command, va_list ap)
+{
+   int64_t late;
+
+   entry->report.flags |= WF_SCHEDULE_HAS_CLOCK;
+   if (schedule_late_ns(waveform, entry, &late))
+   {
+      entry->report.send_lead_ns = -late;
+   }
+
+   //  The entry may be gone as soon as the command is sent, so the target is passed by a copy
+   struct timespec at = entry->report.target;
+   int32_t ret = radio_send_api_command_on_loop_va(waveform, &at, schedule_complete_cb, schedule_queued_cb, entry,
+                                                   command, ap);
+   if (ret == -1)
+   {
+      alloc_free(WF_ALLOC_COMMAND, entry);
+   }
+
+   return ret;
+}
+
+int32_t waveform_schedule_command(struct waveform_t* waveform, const struct timespec* at, waveform_schedule_cb_t cb,
+                                  void* arg, char* command, ...)
+{
+   va_list ap;
+   int32_t ret;
+
+   struct schedule_entry* entry = alloc_calloc(WF_ALLOC_COMMAND, 1, sizeof(*entry));
+   if (!entry)
+   {
+      return -1;
+   }
+   entry->waveform = waveform;
+   entry->cb = cb;
+   entry->arg = arg;
+   entry->report.target = *at;
+
+   va_start(ap, command);
+   ret = schedule_command_va(waveform, entry, command, ap);
+   va_end(ap);
+
+   return ret;
+}
+
+int32_t waveform_schedule_command_at_sample(struct waveform_t* waveform, uint32_t stream_id, uint64_t sample_index,
+                                            waveform_schedule_cb_t cb, void* arg, char* command, ...)
 {
-   // Freed in waveform_destroy()
-   struct waveform_cb_list* new_cb = calloc(1, sizeof(*new_cb));
-   if (!new_cb)
+   va_list ap;
+   int32_t ret;
+
+   struct schedule_entry* entry = alloc_calloc(WF_ALLOC_COMMAND, 1, sizeof(*entry));
+   if (!entry)
+   {
+      return -1;
+   }
+   entry->waveform = waveform;
+   entry->cb = cb;
+   entry->arg = arg;
+   entry->report.stream_id = stream_id;
+   entry->report.sample_index = sample_index;
+   entry->report.flags = WF_SCHEDULE_AT_SAMPLE;
+
+   if (waveform_sample_to_time(waveform, stream_id, sample_index, &entry->report.target) == -1)
    {
+      alloc_free(WF_ALLOC_COMMAND, entry);
       return -1;
    }
 
+   va_start(ap, command);
+   ret = schedule_command_va(waveform, entry, command, ap);
+   va_end(ap);
+
+   return ret;
+}
+
+/// @brief Adds a callback to a callback list
+/// @details Builds a copy of the list with the new callback appended and publishes it in place of the
+///          old one.  Threads traversing the old list continue to see it until they leave their read-side
+///          critical section, so this is safe to call while the radio is running.
+/// @param cb_list The list to add the callback to
+/// @param name The name to match the callback against, or NULL if the list doesn't use names
+/// @param cb The callback function
+/// @param arg The user argument for the callback
+/// @returns 0 on success or -1 on failure
+static int waveform_register_cb(_Atomic(struct waveform_cb_list*)* cb_list, const char* name,
+                                waveform_cmd_cb_t cb, void* arg)
+{
+   sds new_name = NULL;
+
    if (name != NULL)
    {
-      // Freed in waveform_destroy()
-      new_cb->name = sdsnew(name);
-      if (!new_cb->name)
+      // Freed in waveform_destroy() or when the callback is unregistered
+      new_name = alloc_sds_adopt(WF_ALLOC_OTHER, sdsnew(name));
+      if (!new_name)
       {
-         free(new_cb);
          return -1;
       }
    }
-   else
+
+   pthread_mutex_lock(&cb_lock);
+
+   struct waveform_cb_list* old_list = atomic_load(cb_list);
+   size_t count = old_list ? old_list->count : 0;
+
+   struct waveform_cb_list* new_list = alloc_malloc(WF_ALLOC_OTHER, sizeof(*new_list) + (count + 1) * sizeof(new_list->cbs[0]));
+   if (!new_list)
+   {
+      pthread_mutex_unlock(&cb_lock);
+      alloc_sds_free(WF_ALLOC_OTHER, new_name);
+      return -1;
+   }
+
+   if (old_list)
    {
-      new_cb->name = NULL;
+      memcpy(new_list->cbs, old_list->cbs, count * sizeof(new_list->cbs[0]));
    }
 
-   new_cb->cmd_cb = cb;
-   new_cb->arg = arg;
+   new_list->cbs[count].name = new_name;
+   new_list->cbs[count].cmd_cb = cb;
+   new_list->cbs[count].arg = arg;
+   new_list->count = count + 1;
 
-   LL_APPEND(*cb_list, new_cb);
+   rcu_exchange(*cb_list, new_list);
+
+   pthread_mutex_unlock(&cb_lock);
+
+   //  The names are now owned by the new list, so only the array itself goes away.
+   rcu_retire(old_list, alloc_free_other);
+
+   return 0;
+}
+
+/// @brief Removes a callback from a callback list
+/// @details Builds a copy of the list without the matching callback and publishes it in place of the
+///          old one.  The first callback matching all of name, cb and arg is removed.
+/// @param cb_list The list to remove the callback from
+/// @param name The name the callback was registered with, or NULL if the list doesn't use names
+/// @param cb The callback function
+/// @param arg The user argument the callback was registered with
+/// @returns 0 on success or -1 if the callback wasn't found
+static int waveform_unregister_cb(_Atomic(struct waveform_cb_list*)* cb_list, const char* name,
+                                  waveform_cmd_cb_t cb, void* arg)
+{
+   pthread_mutex_lock(&cb_lock);
+
+   struct waveform_cb_list* old_list = atomic_load(cb_list);
+   size_t count = old_list ? old_list->count : 0;
+   size_t found;
+
+   for (found = 0; found < count; ++found)
+   {
+      struct waveform_cb* cur = &old_list->cbs[found];
+      if (cur->cmd_cb == cb && cur->arg == arg &&
+          (name == NULL || (cur->name != NULL && strcmp(cur->name, name) == 0)))
+      {
+         break;
+      }
+   }
+
+   if (found == count)
+   {
+      pthread_mutex_unlock(&cb_lock);
+      return -1;
+   }
+
+   struct waveform_cb_list* new_list = NULL;
+   if (count > 1)
+   {
+      new_list = alloc_malloc(WF_ALLOC_OTHER, sizeof(*new_list) + (count - 1) * sizeof(new_list->cbs[0]));
+      if (!new_list)
+      {
+         pthread_mutex_unlock(&cb_lock);
+         return -1;
+      }
+
+      memcpy(new_list->cbs, old_list->cbs, found * sizeof(new_list->cbs[0]));
+      memcpy(new_list->cbs + found, old_list->cbs + found + 1, (count - found - 1) * sizeof(new_list->cbs[0]));
+      new_list->count = count - 1;
+   }
+
+   sds old_name = old_list->cbs[found].name;
+   rcu_exchange(*cb_list, new_list);
+
+   pthread_mutex_unlock(&cb_lock);
+
+   rcu_retire(old_name, free_cb_name);
+   rcu_retire(old_list, alloc_free_other);
 
    return 0;
 }
@@ -216,7 +523,12 @@ static int waveform_register_cb(struct waveform_cb_list** cb_list, const char* n
 inline int waveform_register_status_cb(struct waveform_t* waveform, const char* status_name,
                                        waveform_cmd_cb_t cb, void* arg)
 {
-   return waveform_register_cb(&waveform->status_cbs, status_name, cb, arg);
+   int ret = waveform_register_cb(&waveform->status_cbs, status_name, cb, arg);
+   if (ret == 0)
+   {
+      radio_subscriptions_changed(waveform->radio);
+   }
+   return ret;
 }
 
 inline int waveform_register_state_cb(struct waveform_t* waveform,
@@ -232,16 +544,45 @@ inline int waveform_register_command_cb(struct waveform_t* waveform,
    return waveform_register_cb(&waveform->cmd_cbs, command_name, cb, arg);
 }
 
-#define REGISTER_DATA_CB(name)                                                                           \
-   int waveform_register_##name##_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg) \
-   {                                                                                                     \
-      return waveform_register_cb(&waveform->name##_data_cbs, NULL, (waveform_cmd_cb_t) cb, arg);        \
+int waveform_unregister_status_cb(struct waveform_t* waveform, const char* status_name,
+                                  waveform_cmd_cb_t cb, void* arg)
+{
+   int ret = waveform_unregister_cb(&waveform->status_cbs, status_name, cb, arg);
+   if (ret == 0)
+   {
+      radio_subscriptions_changed(waveform->radio);
+   }
+   return ret;
+}
+
+int waveform_unregister_state_cb(struct waveform_t* waveform,
+                                 waveform_state_cb_t cb, void* arg)
+{
+   return waveform_unregister_cb(&waveform->state_cbs, NULL, (waveform_cmd_cb_t) cb, arg);
+}
+
+int waveform_unregister_command_cb(struct waveform_t* waveform,
+                                   const char* command_name, waveform_cmd_cb_t cb,
+                                   void* arg)
+{
+   return waveform_unregister_cb(&waveform->cmd_cbs, command_name, cb, arg);
+}
+
+#define REGISTER_DATA_CB(name)                                                                             \
+   int waveform_register_##name##_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg)   \
+   {                                                                                                       \
+      return waveform_register_cb(&waveform->name##_data_cbs, NULL, (waveform_cmd_cb_t) cb, arg);          \
+   }                                                                                                       \
+   int waveform_unregister_##name##_data_cb(struct waveform_t* waveform, waveform_data_cb_t cb, void* arg) \
+   {                                                                                                       \
+      return waveform_unregister_cb(&waveform->name##_data_cbs, NULL, (waveform_cmd_cb_t) cb, arg);        \
    }
 
 REGISTER_DATA_CB(rx)
 REGISTER_DATA_CB(tx)
 REGISTER_DATA_CB(byte)
 REGISTER_DATA_CB(unknown)
+REGISTER_DATA_CB(expired)
 
 inline ssize_t waveform_send_data_packet(struct waveform_t* waveform,
                                          float* samples, size_t num_samples,
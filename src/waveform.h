@@ -29,6 +29,7 @@
 // ****************************************
 // Project Includes
 // ****************************************
+#include "rcu.h"
 #include "vita.h"
 #include "waveform_api.h"
 
@@ -40,14 +41,18 @@
         (pos) = (pos)->next)                                \
       if ((pos)->radio == (radio))
 
-#define waveform_cb_for_each(wf, cb_list, pos)                          \
-   for (struct waveform_cb_list * (pos) = (wf)->cb_list; (pos) != NULL; \
-        (pos) = (pos)->next)
+//  Must be used inside of an RCU read-side critical section.  The list is an immutable
+//  snapshot so it is safe to traverse while other threads register callbacks.
+#define waveform_cb_for_each(wf, cb_list, pos)                                                 \
+   for (struct waveform_cb_list* _list_##pos = rcu_dereference((wf)->cb_list); _list_##pos; \
+        _list_##pos = NULL)                                                                   \
+      for (struct waveform_cb * (pos) = _list_##pos->cbs;                                     \
+           (pos) < _list_##pos->cbs + _list_##pos->count; ++(pos))
 
 // ****************************************
 // Structs, Enums, typedefs
 // ****************************************
-struct waveform_cb_list {
+struct waveform_cb {
    sds name;
    union
    {
@@ -56,7 +61,14 @@ struct waveform_cb_list {
       waveform_data_cb_t data_cb;
    };
    void* arg;
-   struct waveform_cb_list* next;
+};
+
+//  Callback lists are never modified once they are published.  Registering or
+//  unregistering a callback builds a new list, swaps it into the waveform and
+//  retires the old one with rcu_retire().
+struct waveform_cb_list {
+   size_t count;
+   struct waveform_cb cbs[];
 };
 
 struct waveform_meter {
@@ -71,33 +83,41 @@ struct waveform_meter {
    struct waveform_meter* next;
 };
 
+//  The callback lists are read for every packet, so they share lines only with fields
+//  that don't change while the waveform runs.  Must be allocated with aligned_alloc().
 struct waveform_t {
+   _Atomic(struct waveform_cb_list*) status_cbs;
+   _Atomic(struct waveform_cb_list*) state_cbs;
+   _Atomic(struct waveform_cb_list*) rx_data_cbs;
+   _Atomic(struct waveform_cb_list*) tx_data_cbs;
+   _Atomic(struct waveform_cb_list*) byte_data_cbs;
+   _Atomic(struct waveform_cb_list*) unknown_data_cbs;
+   _Atomic(struct waveform_cb_list*) expired_data_cbs;
+   _Atomic(struct waveform_cb_list*) cmd_cbs;
+
    char* name;
    char* short_name;
    char* underlying_mode;
    char* version;
-   int active_slice;
-
-   int rx_depth;
-   int tx_depth;
 
    struct radio_t* radio;
 
-   struct vita vita;
-
-   struct waveform_cb_list* status_cbs;
-   struct waveform_cb_list* state_cbs;
-   struct waveform_cb_list* rx_data_cbs;
-   struct waveform_cb_list* tx_data_cbs;
-   struct waveform_cb_list* byte_data_cbs;
-   struct waveform_cb_list* unknown_data_cbs;
-   struct waveform_cb_list* cmd_cbs;
-
    struct waveform_meter* meter_head;
 
+   struct waveform_module* modules;
+   struct waveform_plugin* plugins;
+
    void* ctx;
 
    struct waveform_t* next;
+
+   //  Changed by the radio thread when the mode changes
+   CACHE_ALIGNED int active_slice;
+
+   int rx_depth;
+   int tx_depth;
+
+   struct vita vita;
 };
 
 // ****************************************
@@ -0,0 +1,79 @@
+/// \file ConcurrencyTests.cpp
+/// \brief *Stress tests for the lock-free queues and RCU*
+///
+/// \copyright Unpublished software of FlexRadio Systems (c) 2020 FlexRadio Systems
+///
+/// Unauthorized use, duplication or distribution of this software is
+/// strictly prohibited by law.
+///
+/// The scenarios live in concurrency_stress.c; see there for what each
+/// one drives the structures through.
+///
+///
+// ****************************************
+// System Includes
+// ****************************************
+#include "gtest/gtest.h"
+
+// ****************************************
+// Project Includes
+// ****************************************
+extern "C" {
+#include "concurrency_stress.h"
+}
+
+// ****************************************
+// Static Functions
+// ****************************************
+static void expect_pass(const char* failure)
+{
+   EXPECT_EQ(failure, nullptr) << failure;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+TEST(ConcurrencyTestSuite, MpscHalfLinkedProducer)
+{
+   expect_pass(stress_mpsc_half_linked());
+}
+
+TEST(ConcurrencyTestSuite, MpscProducers)
+{
+   expect_pass(stress_mpsc_producers(4, 200000));
+}
+
+TEST(ConcurrencyTestSuite, MpmcWraparound)
+{
+   expect_pass(stress_mpmc_wraparound());
+}
+
+TEST(ConcurrencyTestSuite, MpmcTruncatedPop)
+{
+   expect_pass(stress_mpmc_truncation());
+}
+
+TEST(ConcurrencyTestSuite, MpmcThreads)
+{
+   expect_pass(stress_mpmc_threads(3, 3, 100000));
+}
+
+TEST(ConcurrencyTestSuite, SpscWraparound)
+{
+   expect_pass(stress_spsc_wraparound());
+}
+
+TEST(ConcurrencyTestSuite, SpscThreads)
+{
+   expect_pass(stress_spsc_threads(500000));
+}
+
+TEST(ConcurrencyTestSuite, RcuRetireAfterReader)
+{
+   expect_pass(stress_rcu_retire_after_reader());
+}
+
+TEST(ConcurrencyTestSuite, RcuThreads)
+{
+   expect_pass(stress_rcu_threads(4, 100000));
+}
@@ -0,0 +1,159 @@
+/// \file DataLaneTests.cpp
+/// \brief *Tests of the data callback lanes*
+///
+/// \copyright Unpublished software of FlexRadio Systems (c) 2020 FlexRadio Systems
+///
+/// Unauthorized use, duplication or distribution of this software is
+/// strictly prohibited by law.
+///
+/// Play the radio over the in-process transport and check what happens
+/// to packets whose callbacks are held up past their deadline.
+///
+///
+// ****************************************
+// System Includes
+// ****************************************
+#include <arpa/inet.h>
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "waveform_api.h"
+#include "waveform_format.h"
+#include "waveform_transport.h"
+
+// ****************************************
+// Static Variables
+// ****************************************
+static const uint32_t HEADER_WORDS = 7;
+static const uint32_t PAYLOAD_WORDS = 16;
+
+//  Packets on the unknown data lane get a fixed 20 ms budget, which this overruns several times over
+static const auto SLOW_CALLBACK = std::chrono::milliseconds(100);
+
+static std::atomic<unsigned int> slow_calls(0);
+static std::atomic<unsigned int> fast_calls(0);
+static std::mutex expired_lock;
+static std::vector<uint8_t> expired_sequences;
+
+// ****************************************
+// Static Functions
+// ****************************************
+static void slow_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   ++slow_calls;
+   std::this_thread::sleep_for(SLOW_CALLBACK);
+}
+
+static void fast_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   ++fast_calls;
+}
+
+static void expired_cb(struct waveform_t* waveform, struct waveform_vita_packet* packet, size_t packet_size, void* arg)
+{
+   std::lock_guard<std::mutex> guard(expired_lock);
+   expired_sequences.push_back(get_packet_info(packet)->sequence);
+}
+
+/// \brief Builds a packet in network byte order whose class makes it unknown data
+static void build_packet(uint32_t* words, uint8_t sequence)
+{
+   words[0] = htonl(WF_FORMAT_HEADER_WORD0(WF_FORMAT_FLOAT_STEREO, sequence, HEADER_WORDS + PAYLOAD_WORDS));
+   words[1] = htonl(0x04000000U);
+   words[2] = htonl(WF_VITA_OUI);
+   words[3] = htonl(WF_VITA_CLASS_WORD(0));
+   for (uint32_t i = 4; i < HEADER_WORDS + PAYLOAD_WORDS; ++i)
+   {
+      words[i] = 0;
+   }
+}
+
+/// \brief Polls until a condition holds or five seconds have passed
+/// \returns Whether the condition held
+static bool wait_for(const std::function<bool()>& condition)
+{
+   auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+
+   while (!condition())
+   {
+      if (std::chrono::steady_clock::now() > until)
+      {
+         return false;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+   }
+   return true;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+TEST(DataLaneTestSuite, ExpiredPacketPassedOnOnce)
+{
+   struct waveform_memory_transport* transport = waveform_memory_transport_create(64);
+   ASSERT_NE(transport, nullptr);
+
+   struct sockaddr_in addr = {};
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   struct radio_t* radio = waveform_radio_create(&addr);
+   ASSERT_NE(radio, nullptr);
+   ASSERT_EQ(waveform_radio_set_memory_transport(radio, transport), 0);
+
+   struct waveform_t* wf = waveform_create(radio, "Lane Test", "LTST", "DIGU", "1.0.0");
+   ASSERT_NE(wf, nullptr);
+
+   //  A single worker, so the slow callback holds up everything queued behind it
+   ASSERT_EQ(waveform_set_data_workers(wf, 1), 0);
+   ASSERT_EQ(waveform_set_data_lane_policy(wf, WF_LANE_EARLIEST_DEADLINE), 0);
+   ASSERT_EQ(waveform_register_unknown_data_cb(wf, slow_cb, nullptr), 0);
+   ASSERT_EQ(waveform_register_unknown_data_cb(wf, fast_cb, nullptr), 0);
+   ASSERT_EQ(waveform_register_expired_data_cb(wf, expired_cb, nullptr), 0);
+
+   waveform_radio_start(radio);
+   while (waveform_memory_transport_send_line(transport, "S0|slice 0 mode=LTST") == -1)
+   {
+      sched_yield();
+   }
+
+   //  The slow callback of the first packet starts on time, so only the fast callback of that packet expires,
+   //  followed by both callbacks of the second packet.
+   uint32_t packet[HEADER_WORDS + PAYLOAD_WORDS];
+   for (uint8_t sequence = 1; sequence <= 2; ++sequence)
+   {
+      build_packet(packet, sequence);
+      while (waveform_memory_transport_inject_vita(transport, packet, sizeof(packet)) == -1)
+      {
+         sched_yield();
+      }
+   }
+
+   struct waveform_lane_stats stats = {};
+   EXPECT_TRUE(wait_for([&] {
+      return waveform_get_data_lane_stats(wf, WF_DATA_LANE_UNKNOWN, &stats) == 0 && stats.expired == 3 &&
+             stats.depth == 0;
+   }));
+   //  Give a second delivery of either packet the chance to show up
+   std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+   EXPECT_EQ(stats.dispatched, 1u);
+   EXPECT_EQ(slow_calls.load(), 1u);
+   EXPECT_EQ(fast_calls.load(), 0u);
+
+   std::lock_guard<std::mutex> guard(expired_lock);
+   EXPECT_EQ(expired_sequences, std::vector<uint8_t>({1, 2}));
+
+   //  A started radio can't be stopped, so it is left to run until the test program exits.
+}
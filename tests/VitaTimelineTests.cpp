@@ -0,0 +1,305 @@
+/// \file VitaTimelineTests.cpp
+/// \brief *Unit tests for the sample timelines and radio clock estimate*
+///
+/// \copyright Unpublished software of FlexRadio Systems (c) 2020 FlexRadio Systems
+///
+/// Unauthorized use, duplication or distribution of this software is
+/// strictly prohibited by law.
+///
+/// Feed the timeline packets the way the VITA loop does and check the
+/// indices and discontinuity flags it assigns when packets go missing,
+/// the radio's clock jumps, or the sample rate changes.
+///
+///
+// ****************************************
+// System Includes
+// ****************************************
+#include "gtest/gtest.h"
+
+// ****************************************
+// Project Includes
+// ****************************************
+extern "C" {
+#include "vita_timeline.h"
+}
+
+// ****************************************
+// Static Variables
+// ****************************************
+//  Two channel packets of 128 frames, as the radio sends at 24 ksps
+static const uint32_t FRAMES = 128;
+static const uint32_t RATE = 24000;
+static const uint64_t START_NS = 1600000000ULL * 1000000000ULL;
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// \brief Builds the decoded header of a packet without a timestamp
+static struct waveform_packet_info untimed_packet(uint8_t sequence, uint32_t rate = RATE)
+{
+   struct waveform_packet_info info = {};
+
+   info.num_samples = FRAMES * 2;
+   info.channels = 2;
+   info.sample_rate = rate;
+   info.sequence = sequence & 0xfU;
+   return info;
+}
+
+/// \brief Builds the decoded header of a packet stamped with a radio time
+static struct waveform_packet_info timed_packet(uint8_t sequence, uint64_t time_ns, uint32_t rate = RATE)
+{
+   struct waveform_packet_info info = untimed_packet(sequence, rate);
+
+   info.flags = WF_PACKET_HAS_TIMESTAMP;
+   info.timestamp_int = (uint32_t) (time_ns / 1000000000ULL);
+   info.timestamp_frac = (time_ns % 1000000000ULL) * 1000;
+   return info;
+}
+
+/// \brief The radio time of a frame on a timeline that started at START_NS
+static uint64_t frame_time(uint64_t index, uint32_t rate = RATE)
+{
+   return START_NS + (uint64_t) vita_frames_to_ns((int64_t) index, rate);
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+
+///
+/// \brief *Round trips between frames and nanoseconds on both sides of the anchor*
+///
+///
+TEST(VitaTimelineTestSuite, FrameRounding)
+{
+   const uint32_t rates[] = {24000, 48000, 96000, 192000, 44100};
+
+   //  A frame at 24 ksps is 41666.67 ns; half of one rounds away from zero, less rounds towards it.
+   EXPECT_EQ(vita_frames_to_ns(1, 24000), 41666);
+   EXPECT_EQ(vita_frames_to_ns(-1, 24000), -41666);
+   EXPECT_EQ(vita_ns_to_frames(20833, 24000), 0);
+   EXPECT_EQ(vita_ns_to_frames(20834, 24000), 1);
+   EXPECT_EQ(vita_ns_to_frames(-20833, 24000), 0);
+   EXPECT_EQ(vita_ns_to_frames(-20834, 24000), -1);
+   EXPECT_EQ(vita_ns_to_frames(-1500000000LL, 24000), -36000);
+   EXPECT_EQ(vita_ns_to_frames(-1499979167LL, 24000), -36000);
+   EXPECT_EQ(vita_ns_to_frames(-1500020833LL, 24000), -36000);
+   EXPECT_EQ(vita_ns_to_frames(-1500020834LL, 24000), -36001);
+
+   for (uint32_t rate : rates)
+   {
+      for (int64_t frames = -3 * (int64_t) rate; frames <= 3 * (int64_t) rate; frames += 7)
+      {
+         ASSERT_EQ(vita_ns_to_frames(vita_frames_to_ns(frames, rate), rate), frames) << "rate " << rate;
+         ASSERT_EQ(vita_ns_to_frames(-vita_frames_to_ns(frames, rate), rate), -frames) << "rate " << rate;
+      }
+   }
+
+   //  A week of nanoseconds at the highest rate doesn't overflow
+   int64_t week_ns = 7LL * 86400 * 1000000000LL;
+   EXPECT_EQ(vita_ns_to_frames(week_ns, 192000), 7LL * 86400 * 192000);
+   EXPECT_EQ(vita_ns_to_frames(-week_ns, 192000), -7LL * 86400 * 192000);
+   EXPECT_EQ(vita_frames_to_ns(-7LL * 86400 * 192000, 192000), -week_ns);
+}
+
+///
+/// \brief *Packets lost without timestamps are skipped by their sequence numbers*
+///
+///
+TEST(VitaTimelineTestSuite, SequenceGapWithoutTimestamps)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info;
+
+   info = untimed_packet(14);
+   vita_timeline_place(&timeline, true, &info);
+   EXPECT_EQ(info.sample_index, 0U);
+   EXPECT_TRUE(info.flags & WF_PACKET_HAS_SAMPLE_INDEX);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+
+   //  The 4-bit count wraps from 15 to 0 without counting as a gap
+   info = untimed_packet(15);
+   vita_timeline_place(&timeline, false, &info);
+   info = untimed_packet(0);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 2U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+
+   //  1 and 2 went missing
+   info = untimed_packet(3);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 5U * FRAMES);
+   EXPECT_TRUE(info.flags & WF_PACKET_DISCONTINUITY);
+
+   info = untimed_packet(4);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 6U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+   EXPECT_FALSE(timeline.anchored);
+}
+
+///
+/// \brief *Timestamps within half a packet of the expected time don't move the timeline*
+///
+///
+TEST(VitaTimelineTestSuite, TimestampJitter)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info;
+
+   info = timed_packet(0, frame_time(0));
+   vita_timeline_place(&timeline, true, &info);
+   EXPECT_TRUE(timeline.anchored);
+   EXPECT_EQ(info.sample_index, 0U);
+
+   info = timed_packet(1, frame_time(FRAMES) + vita_frames_to_ns(FRAMES / 2 - 1, RATE));
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+
+   info = timed_packet(2, frame_time(2 * FRAMES) - vita_frames_to_ns(FRAMES / 2 - 1, RATE));
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 2U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+}
+
+///
+/// \brief *A timestamp that jumps ahead skips the missing frames and anchors there*
+///
+///
+TEST(VitaTimelineTestSuite, TimestampJumpForward)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info;
+
+   info = timed_packet(0, frame_time(0));
+   vita_timeline_place(&timeline, true, &info);
+
+   //  The sequence number says nothing was lost, but ten packets' worth of time has passed
+   info = timed_packet(1, frame_time(11 * FRAMES));
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 11U * FRAMES);
+   EXPECT_TRUE(info.flags & WF_PACKET_DISCONTINUITY);
+   EXPECT_EQ(timeline.anchor_index, 11U * FRAMES);
+   EXPECT_EQ(timeline.anchor_ns, frame_time(11 * FRAMES));
+
+   info = timed_packet(2, frame_time(12 * FRAMES));
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 12U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+}
+
+///
+/// \brief *A timestamp that jumps back keeps counting and anchors again*
+///
+///
+TEST(VitaTimelineTestSuite, TimestampJumpBackward)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info;
+   uint64_t earlier = frame_time(0) - 1000000000ULL;
+
+   info = timed_packet(0, frame_time(0));
+   vita_timeline_place(&timeline, true, &info);
+   info = timed_packet(1, frame_time(FRAMES));
+   vita_timeline_place(&timeline, false, &info);
+
+   //  Indices are never reused, so the packet follows on and the time is anchored to it
+   info = timed_packet(2, earlier);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 2U * FRAMES);
+   EXPECT_TRUE(info.flags & WF_PACKET_DISCONTINUITY);
+   EXPECT_EQ(timeline.anchor_index, 2U * FRAMES);
+   EXPECT_EQ(timeline.anchor_ns, earlier);
+
+   info = timed_packet(3, earlier + (uint64_t) vita_frames_to_ns(FRAMES, RATE));
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 3U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+}
+
+///
+/// \brief *A change of sample rate anchors the timeline again without a discontinuity*
+///
+///
+TEST(VitaTimelineTestSuite, RateChange)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info;
+
+   info = timed_packet(0, frame_time(0));
+   vita_timeline_place(&timeline, true, &info);
+   info = timed_packet(1, frame_time(FRAMES));
+   vita_timeline_place(&timeline, false, &info);
+
+   //  At 48 ksps the next packet starts at the same time but frames are half as long
+   uint64_t switch_ns = frame_time(2 * FRAMES);
+   info = timed_packet(2, switch_ns, 48000);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 2U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+   EXPECT_EQ(timeline.sample_rate, 48000U);
+   EXPECT_EQ(timeline.anchor_index, 2U * FRAMES);
+   EXPECT_EQ(timeline.anchor_ns, switch_ns);
+
+   info = timed_packet(3, switch_ns + (uint64_t) vita_frames_to_ns(FRAMES, 48000), 48000);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 3U * FRAMES);
+   EXPECT_FALSE(info.flags & WF_PACKET_DISCONTINUITY);
+
+   //  Without timestamps the rate change still starts over rather than trusting the old anchor
+   info = untimed_packet(4, 96000);
+   vita_timeline_place(&timeline, false, &info);
+   EXPECT_EQ(info.sample_index, 4U * FRAMES);
+   EXPECT_FALSE(timeline.anchored);
+}
+
+///
+/// \brief *The end of a timestamped packet is returned for the clock estimate*
+///
+///
+TEST(VitaTimelineTestSuite, PacketEndTime)
+{
+   struct vita_timeline timeline = {};
+   struct waveform_packet_info info = timed_packet(0, frame_time(0));
+
+   EXPECT_EQ(vita_timeline_place(&timeline, true, &info), frame_time(FRAMES));
+}
+
+///
+/// \brief *The clock offset is the smallest seen, and follows drift a window at a time*
+///
+///
+TEST(VitaTimelineTestSuite, ClockWindow)
+{
+   struct vita_clock clock = {};
+
+   vita_clock_sample(&clock, 5000);
+   EXPECT_TRUE(clock.valid);
+   EXPECT_EQ(clock.offset_ns, 5000);
+
+   //  Packets delayed in transit look further ahead and are ignored, quicker ones lower the estimate
+   vita_clock_sample(&clock, 9000);
+   EXPECT_EQ(clock.offset_ns, 5000);
+   vita_clock_sample(&clock, 3000);
+   EXPECT_EQ(clock.offset_ns, 3000);
+
+   //  Finishing the window takes its minimum, even one higher than before, so drift is followed
+   for (uint32_t i = 3; i < VITA_CLOCK_WINDOW; ++i)
+   {
+      vita_clock_sample(&clock, 3000);
+   }
+   EXPECT_EQ(clock.window_packets, 0U);
+   for (uint32_t i = 0; i < VITA_CLOCK_WINDOW - 1; ++i)
+   {
+      vita_clock_sample(&clock, 4000 + i);
+   }
+   EXPECT_EQ(clock.offset_ns, 3000);
+   vita_clock_sample(&clock, 7000);
+   EXPECT_EQ(clock.offset_ns, 4000);
+
+   //  A negative offset, a radio clock ahead of the local one, is as valid as any
+   vita_clock_sample(&clock, -250);
+   EXPECT_EQ(clock.offset_ns, -250);
+}
@@ -0,0 +1,860 @@
+/// \file concurrency_stress.c
+/// \brief *Stress tests for the lock-free queues and RCU*
+///
+/// \copyright Unpublished software of FlexRadio Systems (c) 2020 FlexRadio Systems
+///
+/// Unauthorized use, duplication or distribution of this software is
+/// strictly prohibited by law.
+///
+/// The scenarios behind ConcurrencyTests.cpp.  The single threaded ones
+/// drive the structures into states that are hard to hit by chance, such
+/// as a producer caught between swinging the tail and linking its node.
+/// The threaded ones run long enough to wrap the queues many times.
+///
+///
+// ****************************************
+// System Includes
+// ****************************************
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ****************************************
+// Project Includes
+// ****************************************
+#include "concurrency_stress.h"
+#include "mpmc.h"
+#include "mpsc.h"
+#include "rcu.h"
+#include "spsc.h"
+#include "utils.h"
+
+// ****************************************
+// Macros
+// ****************************************
+//  How long a consumer may go without progress before the scenario is declared hung
+#define STRESS_TIMEOUT_NS (10ULL * 1000000000ULL)
+
+#define RCU_LIVE 0x5243554c49564531ULL
+#define RCU_DEAD 0xdeaddeaddeaddeadULL
+
+// ****************************************
+// Structs, Enums, typedefs
+// ****************************************
+struct mpsc_item {
+   struct mpsc_node node;
+   unsigned int producer;
+   unsigned int sequence;
+};
+
+struct mpsc_producer {
+   pthread_t thread;
+   struct mpsc_queue* queue;
+   struct mpsc_item* items;
+   unsigned int count;
+};
+
+struct mpmc_record {
+   uint32_t producer;
+   uint32_t sequence;
+};
+
+struct mpmc_worker {
+   pthread_t thread;
+   struct mpmc_queue* queue;
+   unsigned int id;
+   unsigned int producers;
+   unsigned int per_producer;
+   _Atomic unsigned char* seen;
+   _Atomic unsigned int* consumed;
+};
+
+struct spsc_producer {
+   struct spsc_ring ring;
+   unsigned int count;
+};
+
+struct rcu_object {
+   uint64_t magic;
+   uint64_t version;
+};
+
+struct rcu_stepper {
+   struct rcu_object* _Atomic* shared;
+   sem_t inside;
+   sem_t go;
+   sem_t done;
+};
+
+struct rcu_reader_thread {
+   pthread_t thread;
+   struct rcu_object* _Atomic* shared;
+   _Atomic bool* stop;
+};
+
+// ****************************************
+// Static Variables
+// ****************************************
+static _Atomic(const char*) stress_failure;
+static _Atomic unsigned int rcu_freed;
+
+// ****************************************
+// Static Functions
+// ****************************************
+/// \brief Records the first failure of a scenario, from any thread
+static void stress_fail(const char* what)
+{
+   const char* expected = NULL;
+   atomic_compare_exchange_strong(&stress_failure, &expected, what);
+}
+
+static bool stress_failed(void)
+{
+   return atomic_load(&stress_failure) != NULL;
+}
+
+static void* mpsc_produce(void* arg)
+{
+   struct mpsc_producer* producer = (struct mpsc_producer*) arg;
+
+   for (unsigned int i = 0; i < producer->count; ++i)
+   {
+      mpsc_push(producer->queue, &producer->items[i].node);
+      //  Let the consumer catch up now and then so the stub is put back often
+      if (i % 64 == 0)
+      {
+         sched_yield();
+      }
+   }
+
+   return NULL;
+}
+
+static void* mpmc_produce(void* arg)
+{
+   struct mpmc_worker* worker = (struct mpmc_worker*) arg;
+   uint64_t progress = monotonic_now_ns();
+
+   for (unsigned int i = 0; i < worker->per_producer && !stress_failed();)
+   {
+      struct mpmc_record record = {.producer = worker->id, .sequence = i};
+
+      if (mpmc_push(worker->queue, &record, sizeof(record)))
+      {
+         ++i;
+         progress = monotonic_now_ns();
+      }
+      else if (monotonic_now_ns() - progress > STRESS_TIMEOUT_NS)
+      {
+         stress_fail("An MPMC producer found the queue full for too long");
+      }
+      else
+      {
+         sched_yield();
+      }
+   }
+
+   return NULL;
+}
+
+static void* mpmc_consume(void* arg)
+{
+   struct mpmc_worker* worker = (struct mpmc_worker*) arg;
+   unsigned int total = worker->producers * worker->per_producer;
+   int64_t* last = malloc(worker->producers * sizeof(*last));
+   uint64_t progress = monotonic_now_ns();
+   struct mpmc_record record;
+
+   for (unsigned int i = 0; i < worker->producers; ++i)
+   {
+      last[i] = -1;
+   }
+
+   while (atomic_load(worker->consumed) < total && !stress_failed())
+   {
+      ssize_t length = mpmc_pop(worker->queue, &record, sizeof(record));
+
+      if (length == -1)
+      {
+         if (monotonic_now_ns() - progress > STRESS_TIMEOUT_NS)
+         {
+            stress_fail("An MPMC consumer found the queue empty for too long");
+         }
+         sched_yield();
+         continue;
+      }
+      progress = monotonic_now_ns();
+
+      if (length != sizeof(record) || record.producer >= worker->producers || record.sequence >= worker->per_producer)
+      {
+         stress_fail("Popped an MPMC record that was never pushed");
+         break;
+      }
+
+      //  Pops are ordered, so one consumer sees each producer's records in the order they were pushed
+      if ((int64_t) record.sequence <= last[record.producer])
+      {
+         stress_fail("An MPMC consumer saw a producer's records out of order");
+      }
+      last[record.producer] = record.sequence;
+
+      if (atomic_fetch_add(&worker->seen[record.producer * worker->per_producer + record.sequence], 1) != 0)
+      {
+         stress_fail("Popped an MPMC record twice");
+      }
+      atomic_fetch_add(worker->consumed, 1);
+   }
+
+   free(last);
+   return NULL;
+}
+
+static void* spsc_produce(void* arg)
+{
+   struct spsc_producer* producer = (struct spsc_producer*) arg;
+   uint64_t progress = monotonic_now_ns();
+
+   for (unsigned int i = 0; i < producer->count && !stress_failed();)
+   {
+      uint64_t* slot = spsc_ring_reserve(&producer->ring);
+
+      if (!slot)
+      {
+         if (monotonic_now_ns() - progress > STRESS_TIMEOUT_NS)
+         {
+            stress_fail("The SPSC producer found the ring full for too long");
+         }
+         sched_yield();
+         continue;
+      }
+
+      slot[0] = i;
+      slot[1] = ~(uint64_t) i;
+      spsc_ring_commit(&producer->ring);
+      progress = monotonic_now_ns();
+      ++i;
+   }
+
+   return NULL;
+}
+
+/// \brief Marks a retired object freed without giving its memory back, so the test can still look at it
+static void rcu_mark_freed(void* ptr)
+{
+   ((struct rcu_object*) ptr)->magic = RCU_DEAD;
+   atomic_fetch_add(&rcu_freed, 1);
+}
+
+/// \brief Poisons and frees a retired object
+static void rcu_free_object(void* ptr)
+{
+   ((struct rcu_object*) ptr)->magic = RCU_DEAD;
+   free(ptr);
+   atomic_fetch_add(&rcu_freed, 1);
+}
+
+/// \brief A reader that holds two critical sections open until told to leave each
+static void* rcu_step_reader(void* arg)
+{
+   struct rcu_stepper* stepper = (struct rcu_stepper*) arg;
+
+   rcu_register_thread();
+
+   for (int i = 0; i < 2; ++i)
+   {
+      rcu_read_lock();
+      struct rcu_object* object = rcu_dereference(*stepper->shared);
+      sem_post(&stepper->inside);
+      sem_wait(&stepper->go);
+      if (object->magic != RCU_LIVE)
+      {
+         stress_fail("An RCU object was freed while a reader that saw it was inside its critical section");
+      }
+      rcu_read_unlock();
+   }
+
+   rcu_unregister_thread();
+   sem_post(&stepper->done);
+   return NULL;
+}
+
+static void* rcu_read_loop(void* arg)
+{
+   struct rcu_reader_thread* reader = (struct rcu_reader_thread*) arg;
+   uint64_t last = 0;
+
+   rcu_register_thread();
+
+   while (!atomic_load(reader->stop))
+   {
+      rcu_read_lock();
+      struct rcu_object* object = rcu_dereference(*reader->shared);
+      if (object)
+      {
+         if (object->magic != RCU_LIVE)
+         {
+            stress_fail("A reader saw a freed RCU object");
+         }
+         if (object->version < last)
+         {
+            stress_fail("A reader saw an older RCU version after a newer one");
+         }
+         last = object->version;
+      }
+      rcu_read_unlock();
+   }
+
+   rcu_unregister_thread();
+   return NULL;
+}
+
+// ****************************************
+// Global Functions
+// ****************************************
+const char* stress_mpsc_half_linked(void)
+{
+   struct mpsc_queue* queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue));
+   struct mpsc_node a, b, c, d, e;
+   struct mpsc_node* prev;
+
+   atomic_store(&stress_failure, NULL);
+   mpsc_init(queue);
+
+   //  b's producer has swung the tail but not yet linked a to it
+   mpsc_push(queue, &a);
+   atomic_store(&b.next, NULL);
+   prev = atomic_exchange(&queue->tail, &b);
+   if (prev != &a || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Popped a node whose successor was only half linked");
+      goto cleanup;
+   }
+   atomic_store(&prev->next, &b);
+   if (mpsc_pop(queue) != &a || mpsc_pop(queue) != &b || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Didn't pop both nodes once the producer finished linking");
+      goto cleanup;
+   }
+
+   //  Popping b put the stub back, and a producer half linked behind the stub must stay invisible
+   atomic_store(&c.next, NULL);
+   prev = atomic_exchange(&queue->tail, &c);
+   if (prev != &queue->stub || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Popped from behind a half linked producer following the stub");
+      goto cleanup;
+   }
+   atomic_store(&prev->next, &c);
+   if (mpsc_pop(queue) != &c || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Didn't pop the node behind the stub once it was linked");
+      goto cleanup;
+   }
+
+   //  The consumer sees d as the last node and re-inserts the stub just after a producer swings the
+   //  tail to e.  The stub lands behind e, which isn't linked to d yet.
+   mpsc_push(queue, &a);
+   mpsc_push(queue, &d);
+   if (mpsc_pop(queue) != &a)
+   {
+      stress_fail("Didn't pop the first of two nodes");
+      goto cleanup;
+   }
+   atomic_store(&e.next, NULL);
+   prev = atomic_exchange(&queue->tail, &e);
+   mpsc_push(queue, &queue->stub);
+   if (mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Popped the last node while the stub was queued behind a half linked producer");
+      goto cleanup;
+   }
+   atomic_store(&prev->next, &e);
+   if (mpsc_pop(queue) != &d || mpsc_pop(queue) != &e || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Lost a node around the re-inserted stub");
+      goto cleanup;
+   }
+   mpsc_push(queue, &a);
+   if (mpsc_pop(queue) != &a || mpsc_pop(queue) != NULL)
+   {
+      stress_fail("The queue didn't recover after the stub was re-inserted");
+   }
+
+cleanup:
+   free(queue);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_mpsc_producers(unsigned int producers, unsigned int per_producer)
+{
+   struct mpsc_queue* queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue));
+   struct mpsc_producer* threads = calloc(producers, sizeof(*threads));
+   unsigned int* next = calloc(producers, sizeof(*next));
+   unsigned int total = producers * per_producer;
+   unsigned int received = 0;
+   uint64_t progress;
+
+   atomic_store(&stress_failure, NULL);
+   mpsc_init(queue);
+
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      threads[p].queue = queue;
+      threads[p].count = per_producer;
+      threads[p].items = calloc(per_producer, sizeof(*threads[p].items));
+      for (unsigned int i = 0; i < per_producer; ++i)
+      {
+         threads[p].items[i].producer = p;
+         threads[p].items[i].sequence = i;
+      }
+   }
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      pthread_create(&threads[p].thread, NULL, mpsc_produce, &threads[p]);
+   }
+
+   progress = monotonic_now_ns();
+   while (received < total && !stress_failed())
+   {
+      struct mpsc_node* node = mpsc_pop(queue);
+
+      if (!node)
+      {
+         if (monotonic_now_ns() - progress > STRESS_TIMEOUT_NS)
+         {
+            stress_fail("The MPSC consumer stopped seeing nodes before all were popped");
+         }
+         sched_yield();
+         continue;
+      }
+      progress = monotonic_now_ns();
+
+      struct mpsc_item* item = container_of(node, struct mpsc_item, node);
+      if (node == &queue->stub)
+      {
+         stress_fail("Popped the stub node");
+      }
+      else if (item->sequence != next[item->producer]++)
+      {
+         stress_fail("Popped a producer's nodes out of order");
+      }
+      ++received;
+   }
+
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      pthread_join(threads[p].thread, NULL);
+   }
+   if (!stress_failed() && mpsc_pop(queue) != NULL)
+   {
+      stress_fail("Popped more nodes than were pushed");
+   }
+
+   for (unsigned int p = 0; p < producers; ++p)
+   {
+      free(threads[p].items);
+   }
+   free(next);
+   free(threads);
+   free(queue);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_mpmc_wraparound(void)
+{
+   struct mpmc_queue* queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue));
+   unsigned char record[16];
+   unsigned char popped[16];
+   uint64_t pushed = 0;
+   uint64_t taken = 0;
+
+   atomic_store(&stress_failure, NULL);
+   if (mpmc_init(queue, 4, sizeof(record), WF_ALLOC_OTHER, "test queue") == -1)
+   {
+      free(queue);
+      return "Couldn't allocate the MPMC queue";
+   }
+
+   for (unsigned int lap = 0; lap < 10000 && !stress_failed(); ++lap)
+   {
+      //  Vary how far each lap fills the queue so the positions wrap at every offset
+      unsigned int fill = lap % 5 == 4 ? 8 : lap % 5 + 1;
+      unsigned int accepted = 0;
+
+      for (unsigned int i = 0; i < fill; ++i)
+      {
+         size_t length = 1 + pushed % sizeof(record);
+
+         memset(record, (int) (pushed & 0xff), length);
+         if (!mpmc_push(queue, record, length))
+         {
+            break;
+         }
+         ++pushed;
+         ++accepted;
+      }
+      if (accepted != (fill < 4 ? fill : 4))
+      {
+         stress_fail("The MPMC queue held other than its capacity");
+      }
+
+      while (taken < pushed)
+      {
+         size_t length = 1 + taken % sizeof(record);
+
+         if (mpmc_pop(queue, popped, sizeof(popped)) != (ssize_t) length)
+         {
+            stress_fail("Popped an MPMC record of the wrong length");
+            break;
+         }
+         memset(record, (int) (taken & 0xff), length);
+         if (memcmp(record, popped, length) != 0)
+         {
+            stress_fail("Popped an MPMC record out of order");
+         }
+         ++taken;
+      }
+      if (mpmc_pop(queue, popped, sizeof(popped)) != -1)
+      {
+         stress_fail("Popped from an empty MPMC queue");
+      }
+   }
+
+   mpmc_destroy(queue);
+   free(queue);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_mpmc_truncation(void)
+{
+   struct mpmc_queue* queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue));
+   unsigned char record[65];
+   unsigned char popped[64];
+
+   atomic_store(&stress_failure, NULL);
+   if (mpmc_init(queue, 8, 64, WF_ALLOC_OTHER, "test queue") == -1)
+   {
+      free(queue);
+      return "Couldn't allocate the MPMC queue";
+   }
+
+   for (size_t i = 0; i < sizeof(record); ++i)
+   {
+      record[i] = (unsigned char) i;
+   }
+
+   if (mpmc_push(queue, record, sizeof(record)))
+   {
+      stress_fail("Pushed an MPMC record larger than the queue holds");
+      goto cleanup;
+   }
+
+   //  A short buffer gets the start of the record, nothing past its end, and the full length
+   if (!mpmc_push(queue, record, 64) || !mpmc_push(queue, record, 5))
+   {
+      stress_fail("Couldn't push an MPMC record");
+      goto cleanup;
+   }
+   memset(popped, 0xa5, sizeof(popped));
+   if (mpmc_pop(queue, popped, 10) != 64)
+   {
+      stress_fail("A truncated MPMC pop didn't return the full length");
+      goto cleanup;
+   }
+   if (memcmp(popped, record, 10) != 0)
+   {
+      stress_fail("A truncated MPMC pop didn't copy the start of the record");
+   }
+   for (size_t i = 10; i < sizeof(popped); ++i)
+   {
+      if (popped[i] != 0xa5)
+      {
+         stress_fail("A truncated MPMC pop wrote past the buffer");
+         break;
+      }
+   }
+
+   //  The rest of the truncated record is gone and the next one is intact
+   memset(popped, 0, sizeof(popped));
+   if (mpmc_pop(queue, popped, sizeof(popped)) != 5 || memcmp(popped, record, 5) != 0)
+   {
+      stress_fail("The MPMC record after a truncated one was damaged");
+   }
+
+   if (!mpmc_push(queue, record, 0) || mpmc_pop(queue, popped, 0) != 0 || mpmc_pop(queue, popped, 0) != -1)
+   {
+      stress_fail("An empty MPMC record wasn't passed through");
+   }
+
+cleanup:
+   mpmc_destroy(queue);
+   free(queue);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_mpmc_threads(unsigned int producers, unsigned int consumers, unsigned int per_producer)
+{
+   struct mpmc_queue* queue = aligned_alloc(CACHE_LINE_SIZE, sizeof(*queue));
+   struct mpmc_worker* workers = calloc(producers + consumers, sizeof(*workers));
+   _Atomic unsigned char* seen = calloc(producers * per_producer, sizeof(*seen));
+   _Atomic unsigned int consumed = 0;
+
+   atomic_store(&stress_failure, NULL);
+   //  A small queue so the positions wrap many times over
+   if (mpmc_init(queue, 8, sizeof(struct mpmc_record), WF_ALLOC_OTHER, "test queue") == -1)
+   {
+      stress_fail("Couldn't allocate the MPMC queue");
+      goto cleanup;
+   }
+
+   for (unsigned int i = 0; i < producers + consumers; ++i)
+   {
+      workers[i].queue = queue;
+      workers[i].id = i;
+      workers[i].producers = producers;
+      workers[i].per_producer = per_producer;
+      workers[i].seen = seen;
+      workers[i].consumed = &consumed;
+      pthread_create(&workers[i].thread, NULL, i < producers ? mpmc_produce : mpmc_consume, &workers[i]);
+   }
+   for (unsigned int i = 0; i < producers + consumers; ++i)
+   {
+      pthread_join(workers[i].thread, NULL);
+   }
+
+   for (unsigned int i = 0; i < producers * per_producer && !stress_failed(); ++i)
+   {
+      if (atomic_load(&seen[i]) != 1)
+      {
+         stress_fail("An MPMC record was lost");
+      }
+   }
+
+   mpmc_destroy(queue);
+cleanup:
+   free(seen);
+   free(workers);
+   free(queue);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_spsc_wraparound(void)
+{
+   void* memory = aligned_alloc(CACHE_LINE_SIZE, spsc_ring_size(4, sizeof(uint64_t)));
+   struct spsc_ring producer;
+   struct spsc_ring consumer;
+   uint64_t pushed = 0;
+   uint64_t taken = 0;
+
+   atomic_store(&stress_failure, NULL);
+   spsc_ring_init(&producer, memory, 4, sizeof(uint64_t));
+   spsc_ring_attach(&consumer, memory, 4, sizeof(uint64_t));
+
+   for (unsigned int lap = 0; lap < 10000 && !stress_failed(); ++lap)
+   {
+      unsigned int fill = lap % 5 == 4 ? 8 : lap % 5 + 1;
+      unsigned int accepted = 0;
+
+      for (unsigned int i = 0; i < fill; ++i)
+      {
+         uint64_t* slot = spsc_ring_reserve(&producer);
+
+         if (!slot)
+         {
+            break;
+         }
+         *slot = pushed++;
+         //  Only the commit into an empty ring needs to wake the consumer
+         if (spsc_ring_commit(&producer) != (i == 0))
+         {
+            stress_fail("An SPSC commit misreported whether the consumer needed waking");
+         }
+         ++accepted;
+      }
+      if (accepted != (fill < 4 ? fill : 4))
+      {
+         stress_fail("The SPSC ring held other than its slot count");
+      }
+
+      //  Leave one behind every other lap so the producer commits into a ring that isn't empty
+      uint64_t keep = lap % 2 && taken + 1 < pushed ? 1 : 0;
+      while (taken + keep < pushed)
+      {
+         uint64_t* slot = spsc_ring_peek(&consumer);
+
+         if (!slot || *slot != taken)
+         {
+            stress_fail("Peeked the wrong SPSC slot");
+            break;
+         }
+         spsc_ring_release(&consumer);
+         ++taken;
+      }
+      if (keep)
+      {
+         spsc_ring_skip(&consumer);
+         taken = pushed;
+      }
+      if (!spsc_ring_empty(&consumer) || spsc_ring_peek(&consumer) != NULL)
+      {
+         stress_fail("The SPSC ring wasn't empty after draining it");
+      }
+   }
+
+   free(memory);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_spsc_threads(unsigned int count)
+{
+   void* memory = aligned_alloc(CACHE_LINE_SIZE, spsc_ring_size(8, 2 * sizeof(uint64_t)));
+   struct spsc_producer producer = {.count = count};
+   struct spsc_ring consumer;
+   pthread_t thread;
+   uint64_t progress;
+
+   atomic_store(&stress_failure, NULL);
+   spsc_ring_init(&producer.ring, memory, 8, 2 * sizeof(uint64_t));
+   spsc_ring_attach(&consumer, memory, 8, 2 * sizeof(uint64_t));
+   pthread_create(&thread, NULL, spsc_produce, &producer);
+
+   progress = monotonic_now_ns();
+   for (unsigned int i = 0; i < count && !stress_failed();)
+   {
+      uint64_t* slot = spsc_ring_peek(&consumer);
+
+      if (!slot)
+      {
+         if (monotonic_now_ns() - progress > STRESS_TIMEOUT_NS)
+         {
+            stress_fail("The SPSC consumer stopped seeing slots before all were passed");
+         }
+         sched_yield();
+         continue;
+      }
+
+      if (slot[0] != i || slot[1] != ~(uint64_t) i)
+      {
+         stress_fail("The SPSC consumer saw a slot out of order or half written");
+      }
+      spsc_ring_release(&consumer);
+      progress = monotonic_now_ns();
+      ++i;
+   }
+
+   pthread_join(thread, NULL);
+   if (!stress_failed() && !spsc_ring_empty(&consumer))
+   {
+      stress_fail("The SPSC ring held more slots than were committed");
+   }
+
+   free(memory);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_rcu_retire_after_reader(void)
+{
+   struct rcu_object objects[3] = {{RCU_LIVE, 1}, {RCU_LIVE, 2}, {RCU_LIVE, 3}};
+   struct rcu_object* _Atomic shared = &objects[0];
+   struct rcu_stepper stepper = {.shared = &shared};
+   pthread_t thread;
+
+   atomic_store(&stress_failure, NULL);
+   atomic_store(&rcu_freed, 0);
+   sem_init(&stepper.inside, 0, 0);
+   sem_init(&stepper.go, 0, 0);
+   sem_init(&stepper.done, 0, 0);
+   pthread_create(&thread, NULL, rcu_step_reader, &stepper);
+
+   //  The reader is inside with the first version, so retiring it must wait for the reader
+   sem_wait(&stepper.inside);
+   rcu_retire(rcu_exchange(shared, &objects[1]), rcu_mark_freed);
+   rcu_reclaim();
+   if (atomic_load(&rcu_freed) != 0)
+   {
+      stress_fail("An RCU object was freed while a reader that could see it was inside");
+   }
+
+   //  Once the reader has left, a critical section it enters afterwards doesn't hold the old version up
+   sem_post(&stepper.go);
+   sem_wait(&stepper.inside);
+   rcu_reclaim();
+   if (atomic_load(&rcu_freed) != 1 || objects[0].magic != RCU_DEAD)
+   {
+      stress_fail("A reader that entered after the retire kept an RCU object from being freed");
+   }
+
+   //  That critical section saw the second version, which has to outlive it in turn
+   rcu_retire(rcu_exchange(shared, &objects[2]), rcu_mark_freed);
+   if (atomic_load(&rcu_freed) != 1)
+   {
+      stress_fail("An RCU object was freed while a reader that could see it was inside");
+   }
+   sem_post(&stepper.go);
+   sem_wait(&stepper.done);
+   pthread_join(thread, NULL);
+   rcu_reclaim();
+   if (atomic_load(&rcu_freed) != 2 || objects[1].magic != RCU_DEAD)
+   {
+      stress_fail("An RCU object wasn't freed once its last reader left");
+   }
+
+   //  With no readers at all the retire frees at once
+   rcu_retire(rcu_exchange(shared, NULL), rcu_mark_freed);
+   if (atomic_load(&rcu_freed) != 3 || objects[2].magic != RCU_DEAD)
+   {
+      stress_fail("An RCU object with no readers wasn't freed when it was retired");
+   }
+
+   sem_destroy(&stepper.inside);
+   sem_destroy(&stepper.go);
+   sem_destroy(&stepper.done);
+   return atomic_load(&stress_failure);
+}
+
+const char* stress_rcu_threads(unsigned int readers, unsigned int versions)
+{
+   struct rcu_reader_thread* threads = calloc(readers, sizeof(*threads));
+   struct rcu_object* _Atomic shared = NULL;
+   _Atomic bool stop = false;
+
+   atomic_store(&stress_failure, NULL);
+   atomic_store(&rcu_freed, 0);
+
+   for (unsigned int i = 0; i < readers; ++i)
+   {
+      threads[i].shared = &shared;
+      threads[i].stop = &stop;
+      pthread_create(&threads[i].thread, NULL, rcu_read_loop, &threads[i]);
+   }
+
+   for (unsigned int v = 1; v <= versions && !stress_failed(); ++v)
+   {
+      struct rcu_object* object = malloc(sizeof(*object));
+
+      object->magic = RCU_LIVE;
+      object->version = v;
+      rcu_retire(rcu_exchange(shared, object), rcu_free_object);
+   }
+
+   atomic_store(&stop, true);
+   for (unsigned int i = 0; i < readers; ++i)
+   {
+      pthread_join(threads[i].thread, NULL);
+   }
+
+   rcu_retire(rcu_exchange(shared, NULL), rcu_free_object);
+   rcu_reclaim();
+   if (!stress_failed() && atomic_load(&rcu_freed) != versions)
+   {
+      stress_fail("Not every retired RCU object was freed once the readers were gone");
+   }
+
+   free(threads);
+   return atomic_load(&stress_failure);
+}
@@ -0,0 +1,56 @@
+/// \file concurrency_stress.h
+/// \brief *Stress tests for the lock-free queues and RCU*
+///
+/// \copyright Unpublished software of FlexRadio Systems (c) 2020 FlexRadio Systems
+///
+/// Unauthorized use, duplication or distribution of this software is
+/// strictly prohibited by law.
+///
+/// The queue and RCU headers use C11 atomics that C++ can't include, so
+/// the scenarios are written in C and the GoogleTest cases call them
+/// through this header.  Each returns NULL if the scenario passed or a
+/// description of the first thing that went wrong.
+///
+///
+#ifndef WAVEFORM_SDK_CONCURRENCY_STRESS_H
+#define WAVEFORM_SDK_CONCURRENCY_STRESS_H
+
+// ****************************************
+// Global Functions
+// ****************************************
+/// \brief Pops around a producer that has swung the tail but not yet linked its node
+const char* stress_mpsc_half_linked(void);
+
+/// \brief Pops everything several threads push, checking each producer's order
+/// \param producers The number of producing threads
+/// \param per_producer The number of nodes each pushes
+const char* stress_mpsc_producers(unsigned int producers, unsigned int per_producer);
+
+/// \brief Fills and drains a small queue over many laps from one thread
+const char* stress_mpmc_wraparound(void);
+
+/// \brief Pops records into buffers too small for them
+const char* stress_mpmc_truncation(void);
+
+/// \brief Passes records from several producers to several consumers through a small queue
+/// \param producers The number of producing threads
+/// \param consumers The number of consuming threads
+/// \param per_producer The number of records each producer pushes
+const char* stress_mpmc_threads(unsigned int producers, unsigned int consumers, unsigned int per_producer);
+
+/// \brief Fills and drains a ring over many laps from one thread, checking when the consumer needs waking
+const char* stress_spsc_wraparound(void);
+
+/// \brief Passes a sequence from a producer thread to a consumer thread through a small ring
+/// \param count The number of slots to pass
+const char* stress_spsc_threads(unsigned int count);
+
+/// \brief Retires an object while a reader is inside a critical section that may see it
+const char* stress_rcu_retire_after_reader(void);
+
+/// \brief Publishes and retires versions of an object while threads read it
+/// \param readers The number of reading threads
+/// \param versions The number of versions to publish
+const char* stress_rcu_threads(unsigned int readers, unsigned int versions);
+
+#endif//WAVEFORM_SDK_CONCURRENCY_STRESS_H